@@ -0,0 +1,199 @@
+/*
+  bench.c: Common benchmark helpers
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "bench.h"
+
+static struct option bench_options[] = {
+  {"fs",          required_argument, NULL, 'f'},
+  {"samples",     required_argument, NULL, 'n'},
+  {"reps",        required_argument, NULL, 'r'},
+  {"min-bins",    required_argument, NULL, 'b'},
+  {"max-bins",    required_argument, NULL, 'B'},
+  {"max-threads", required_argument, NULL, 't'},
+  {"help",        no_argument,       NULL, 'h'},
+  {NULL,          0,                 NULL, 0}
+};
+
+static void
+bench_usage(const char *argv0, const char *what)
+{
+  fprintf(
+      stderr,
+      "Usage: %s [options]\n\n"
+      "Benchmarks %s.\n\n"
+      "Options:\n"
+      "  -f, --fs=RATE           sample rate for the real time factor\n"
+      "                          (default: %d)\n"
+      "  -n, --samples=N         samples per case and repetition\n"
+      "                          (default: %d)\n"
+      "  -r, --reps=N            repetitions, the median is reported\n"
+      "                          (default: %d)\n"
+      "  -b, --min-bins=N        smallest FFT size (default: %d)\n"
+      "  -B, --max-bins=N        largest FFT size (default: %d)\n"
+      "  -t, --max-threads=N     thread counts from 1 to N, doubling\n"
+      "                          (default: %d)\n"
+      "  -h, --help              show this help\n",
+      argv0,
+      what,
+      BENCH_DEFAULT_FS,
+      BENCH_DEFAULT_SAMPLES,
+      BENCH_DEFAULT_REPS,
+      BENCH_DEFAULT_MIN_BINS,
+      BENCH_DEFAULT_MAX_BINS,
+      BENCH_DEFAULT_THREADS);
+}
+
+void
+bench_parse_options(
+    struct bench_options *opts,
+    int argc,
+    char *argv[],
+    const char *what)
+{
+  unsigned long long samples;
+  int c;
+
+  opts->fs          = BENCH_DEFAULT_FS;
+  opts->samples     = BENCH_DEFAULT_SAMPLES;
+  opts->reps        = BENCH_DEFAULT_REPS;
+  opts->min_bins    = BENCH_DEFAULT_MIN_BINS;
+  opts->max_bins    = BENCH_DEFAULT_MAX_BINS;
+  opts->max_threads = BENCH_DEFAULT_THREADS;
+
+  while ((c = getopt_long(argc, argv, "f:n:r:b:B:t:h", bench_options, NULL))
+         != -1) {
+    switch (c) {
+      case 'f':
+        if (sscanf(optarg, "%lf", &opts->fs) == 1 && opts->fs > 0)
+          continue;
+        break;
+
+      case 'n':
+        if (sscanf(optarg, "%llu", &samples) == 1 && samples > 0) {
+          opts->samples = samples;
+          continue;
+        }
+        break;
+
+      case 'r':
+        if (sscanf(optarg, "%u", &opts->reps) == 1 && opts->reps > 0)
+          continue;
+        break;
+
+      case 'b':
+        if (sscanf(optarg, "%u", &opts->min_bins) == 1 && opts->min_bins > 1)
+          continue;
+        break;
+
+      case 'B':
+        if (sscanf(optarg, "%u", &opts->max_bins) == 1 && opts->max_bins > 1)
+          continue;
+        break;
+
+      case 't':
+        if (sscanf(optarg, "%u", &opts->max_threads) == 1
+            && opts->max_threads > 0)
+          continue;
+        break;
+
+      case 'h':
+        bench_usage(argv[0], what);
+        exit(EXIT_SUCCESS);
+    }
+
+    bench_usage(argv[0], what);
+    exit(EXIT_FAILURE);
+  }
+}
+
+void
+bench_print_header(const char *name, const struct bench_options *opts)
+{
+  printf(
+      "# radiotel-bench %s v%d fs=%.0lf samples=%llu reps=%u seed=%#x\n",
+      name,
+      BENCH_VERSION,
+      opts->fs,
+      (unsigned long long) opts->samples,
+      opts->reps,
+      BENCH_SEED);
+  fflush(stdout);
+}
+
+uint64_t
+bench_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+bench_compare(const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+double
+bench_median(double *samples, unsigned int count)
+{
+  qsort(samples, count, sizeof (double), bench_compare);
+
+  if (count & 1)
+    return samples[count / 2];
+
+  return .5 * (samples[count / 2 - 1] + samples[count / 2]);
+}
+
+uint32_t
+bench_random(uint32_t *state)
+{
+  /* xorshift32 */
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+
+  return *state;
+}
+
+RTSFLOAT
+bench_noise(uint32_t *state)
+{
+  RTSFLOAT sum = 0;
+  unsigned int i;
+
+  /* Irwin-Hall: 12 uniforms have variance 1 */
+  for (i = 0; i < 12; ++i)
+    sum += bench_random(state) / 4294967296.;
+
+  return sum - 6;
+}
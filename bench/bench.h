@@ -0,0 +1,74 @@
+/*
+  bench.h: Common benchmark helpers
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _BENCH_BENCH_H
+#define _BENCH_BENCH_H
+
+#include <stdint.h>
+
+#include <rtsutil/common.h>
+
+/*
+ * Results are printed one case per line, as space-separated key=value
+ * pairs, after a `#' header with the workload. The workload does not
+ * depend on how fast the machine is, so lines with the same keys can
+ * be compared across commits.
+ */
+#define BENCH_VERSION 1
+
+#define BENCH_DEFAULT_FS       10000000 /* Samples per second */
+#define BENCH_DEFAULT_SAMPLES  (1 << 21) /* Per case and repetition */
+#define BENCH_DEFAULT_REPS     5
+#define BENCH_DEFAULT_MIN_BINS 256
+#define BENCH_DEFAULT_MAX_BINS (1 << 20)
+#define BENCH_DEFAULT_THREADS  4
+#define BENCH_SEED             0x5eed
+
+struct bench_options {
+  RTSFLOAT fs;
+  uint64_t samples;
+  unsigned int reps;
+  RTSCOUNT min_bins;
+  RTSCOUNT max_bins;
+  unsigned int max_threads;
+};
+
+/* Exits on error or --help */
+void bench_parse_options(
+    struct bench_options *opts,
+    int argc,
+    char *argv[],
+    const char *what);
+
+void bench_print_header(const char *name, const struct bench_options *opts);
+
+uint64_t bench_now_ns(void);
+
+/* Sorts the samples */
+double bench_median(double *samples, unsigned int count);
+
+/* Fixed sequence, same data on every run */
+uint32_t bench_random(uint32_t *state);
+
+/* Gaussian-ish noise, zero mean and unit variance */
+RTSFLOAT bench_noise(uint32_t *state);
+
+#endif /* _BENCH_BENCH_H */
@@ -0,0 +1,388 @@
+/*
+  dsp.c: Benchmark of the acquisition chain, source to spectrum
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <rtsutil/source.h>
+#include <rtsutil/spectrogram.h>
+
+#include "bench.h"
+
+#define BENCH_SOURCE_SAMPLES 65536 /* Played in a loop, fits in cache */
+#define BENCH_TONE_FREQ      0.1   /* Fraction of fs */
+
+/* Sample formats of the supported hardware and capture files */
+enum bench_format {
+  BENCH_FORMAT_CF32, /* IQ files */
+  BENCH_FORMAT_CI16, /* bladeRF, 12 bit samples */
+  BENCH_FORMAT_CI8,  /* 8 bit SDRs */
+  BENCH_FORMAT_COUNT
+};
+
+static const char *bench_format_name[] = {"cf32", "ci16", "ci8"};
+
+static const struct {
+  const char *name;
+  enum rts_window_type type;
+} bench_window[] = {
+  {"blackmann-harris", RTS_WINDOW_BLACKMANN_HARRIS},
+  {"rectangular",      RTS_WINDOW_RECTANGULAR}
+};
+
+/* In-memory source: raw samples converted on every read */
+struct bench_source {
+  enum bench_format format;
+  void *data;
+  RTSCOUNT ptr;
+};
+
+static void
+bench_source_close(void *hnd)
+{
+  struct bench_source *src = (struct bench_source *) hnd;
+
+  free(src->data);
+  free(src);
+}
+
+static void *
+bench_source_open(
+    const rts_params_t *params,
+    struct rts_signal_source_info *info)
+{
+  struct bench_source *new = NULL;
+  const char *format;
+  uint32_t seed = BENCH_SEED;
+  RTSFLOAT i_val, q_val;
+  unsigned int fs;
+  unsigned int i;
+
+  if ((format = rts_params_get(params, "format")) == NULL
+      || rts_params_get(params, "fs") == NULL
+      || sscanf(rts_params_get(params, "fs"), "%u", &fs) < 1)
+    return NULL;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (struct bench_source)), goto fail);
+
+  for (new->format = 0; new->format < BENCH_FORMAT_COUNT; ++new->format)
+    if (strcmp(format, bench_format_name[new->format]) == 0)
+      break;
+
+  RTS_TRYCATCH(new->format < BENCH_FORMAT_COUNT, goto fail);
+
+  RTS_TRYCATCH(
+      new->data = malloc(BENCH_SOURCE_SAMPLES * 2 * sizeof (float)),
+      goto fail);
+
+  /* A tone over noise, at half the full scale */
+  for (i = 0; i < BENCH_SOURCE_SAMPLES; ++i) {
+    i_val = .4 * cos(2 * M_PI * BENCH_TONE_FREQ * i) + .05 * bench_noise(&seed);
+    q_val = .4 * sin(2 * M_PI * BENCH_TONE_FREQ * i) + .05 * bench_noise(&seed);
+
+    switch (new->format) {
+      case BENCH_FORMAT_CF32:
+        ((float *) new->data)[2 * i]     = i_val;
+        ((float *) new->data)[2 * i + 1] = q_val;
+        break;
+
+      case BENCH_FORMAT_CI16:
+        ((int16_t *) new->data)[2 * i]     = i_val * 2048;
+        ((int16_t *) new->data)[2 * i + 1] = q_val * 2048;
+        break;
+
+      case BENCH_FORMAT_CI8:
+        ((int8_t *) new->data)[2 * i]     = i_val * 128;
+        ((int8_t *) new->data)[2 * i + 1] = q_val * 128;
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  info->samp_rate = fs;
+  info->freq = 0;
+
+  return new;
+
+fail:
+  if (new != NULL)
+    bench_source_close(new);
+
+  return NULL;
+}
+
+/* Same conversions as the real sources */
+static RTSCOUNT
+bench_source_acquire(void *hnd, RTSCOMPLEX *buffer, RTSCOUNT count)
+{
+  struct bench_source *src = (struct bench_source *) hnd;
+  const float *f32 = (const float *) src->data + 2 * src->ptr;
+  const int16_t *i16 = (const int16_t *) src->data + 2 * src->ptr;
+  const int8_t *i8 = (const int8_t *) src->data + 2 * src->ptr;
+  RTSCOUNT i;
+
+  if (count > BENCH_SOURCE_SAMPLES - src->ptr)
+    count = BENCH_SOURCE_SAMPLES - src->ptr;
+
+  switch (src->format) {
+    case BENCH_FORMAT_CF32:
+      for (i = 0; i < count; ++i)
+        buffer[i] = f32[2 * i] + I * f32[2 * i + 1];
+      break;
+
+    case BENCH_FORMAT_CI16:
+      for (i = 0; i < count; ++i)
+        buffer[i] = i16[2 * i] / 2048.0 + I * i16[2 * i + 1] / 2048.0;
+      break;
+
+    case BENCH_FORMAT_CI8:
+      for (i = 0; i < count; ++i)
+        buffer[i] = i8[2 * i] / 128.0 + I * i8[2 * i + 1] / 128.0;
+      break;
+
+    default:
+      return RTS_SOURCE_ACQUIRE_RESULT_ERROR;
+  }
+
+  if ((src->ptr += count) == BENCH_SOURCE_SAMPLES)
+    src->ptr = 0;
+
+  return count;
+}
+
+static const struct rts_signal_source bench_source =
+{
+    .name = "bench",
+    .open = bench_source_open,
+    .acquire = bench_source_acquire,
+    .close = bench_source_close
+};
+
+/* One independent chain per thread */
+struct bench_chain {
+  rts_srchnd_t *handle;
+  rts_spectrogram_t *spect;
+  RTSBOOL ok;
+  pthread_t thread;
+};
+
+static void *
+bench_chain_run(void *data)
+{
+  struct bench_chain *chain = (struct bench_chain *) data;
+
+  chain->ok = RTS_FALSE;
+
+  while (!rts_spectrogram_complete(chain->spect))
+    if (!rts_spectrogram_acquire(chain->spect))
+      return NULL;
+
+  rts_spectrogram_release(chain->spect, rts_spectrogram_swap(chain->spect));
+
+  chain->ok = RTS_TRUE;
+
+  return NULL;
+}
+
+static void
+bench_chain_finalize(struct bench_chain *chain)
+{
+  if (chain->spect != NULL)
+    rts_spectrogram_destroy(chain->spect);
+
+  if (chain->handle != NULL)
+    rts_source_close(chain->handle);
+}
+
+/* Opens the source and plans the FFT, nothing of which is timed */
+static RTSBOOL
+bench_chain_init(
+    struct bench_chain *chain,
+    const struct bench_options *opts,
+    enum bench_format format,
+    enum rts_window_type window,
+    RTSCOUNT bins,
+    RTSCOUNT frames)
+{
+  struct rts_spectrogram_params params;
+  rts_params_t *src_params = NULL;
+  char fs[32];
+  RTSBOOL ok = RTS_FALSE;
+
+  memset(chain, 0, sizeof (struct bench_chain));
+
+  snprintf(fs, sizeof (fs), "%.0lf", opts->fs);
+
+  RTS_TRYCATCH(src_params = rts_params_new(), goto done);
+  RTS_TRYCATCH(
+      rts_params_set(src_params, "format", bench_format_name[format]),
+      goto done);
+  RTS_TRYCATCH(rts_params_set(src_params, "fs", fs), goto done);
+
+  RTS_TRYCATCH(
+      chain->handle = rts_source_open(&bench_source, src_params),
+      goto done);
+
+  params.bins     = bins;
+  params.window   = window;
+  params.avg_time = (frames - .5) * bins / opts->fs;
+
+  RTS_TRYCATCH(
+      chain->spect = rts_spectrogram_new(chain->handle, &params),
+      goto done);
+
+  ok = RTS_TRUE;
+
+done:
+  if (src_params != NULL)
+    rts_params_destroy(src_params);
+
+  return ok;
+}
+
+/* Median seconds for `threads' chains to integrate `frames' each */
+static RTSBOOL
+bench_run_case(
+    const struct bench_options *opts,
+    enum bench_format format,
+    enum rts_window_type window,
+    RTSCOUNT bins,
+    RTSCOUNT frames,
+    unsigned int threads,
+    double *seconds)
+{
+  struct bench_chain *chain = NULL;
+  double *rep_time = NULL;
+  uint64_t start;
+  unsigned int i, rep;
+  RTSBOOL ok = RTS_FALSE;
+
+  RTS_TRYCATCH(chain = calloc(threads, sizeof (struct bench_chain)), goto done);
+  RTS_TRYCATCH(rep_time = calloc(opts->reps, sizeof (double)), goto done);
+
+  for (i = 0; i < threads; ++i)
+    RTS_TRYCATCH(
+        bench_chain_init(&chain[i], opts, format, window, bins, frames),
+        goto done);
+
+  /* First run warms caches and page tables up, not reported */
+  for (rep = 0; rep <= opts->reps; ++rep) {
+    start = bench_now_ns();
+
+    for (i = 1; i < threads; ++i)
+      RTS_TRYCATCH(
+          pthread_create(&chain[i].thread, NULL, bench_chain_run, &chain[i])
+          == 0,
+          goto done);
+
+    bench_chain_run(&chain[0]);
+
+    for (i = 1; i < threads; ++i)
+      pthread_join(chain[i].thread, NULL);
+
+    if (rep > 0)
+      rep_time[rep - 1] = (bench_now_ns() - start) * 1e-9;
+
+    for (i = 0; i < threads; ++i)
+      RTS_TRYCATCH(chain[i].ok, goto done);
+  }
+
+  *seconds = bench_median(rep_time, opts->reps);
+
+  ok = RTS_TRUE;
+
+done:
+  if (chain != NULL) {
+    for (i = 0; i < threads; ++i)
+      bench_chain_finalize(&chain[i]);
+    free(chain);
+  }
+
+  if (rep_time != NULL)
+    free(rep_time);
+
+  return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bench_options opts;
+  enum bench_format format;
+  unsigned int window;
+  unsigned int threads;
+  RTSCOUNT bins, frames;
+  uint64_t samples;
+  double seconds = 0;
+
+  bench_parse_options(
+      &opts,
+      argc,
+      argv,
+      "source conversion, window, FFT and accumulation");
+
+  bench_print_header("dsp", &opts);
+
+  for (bins = opts.min_bins; bins <= opts.max_bins; bins <<= 2)
+    for (format = 0; format < BENCH_FORMAT_COUNT; ++format)
+      for (window = 0; window < sizeof (bench_window) / sizeof (bench_window[0]); ++window)
+        for (threads = 1; threads <= opts.max_threads; threads <<= 1) {
+          /* Whole frames, at least one */
+          if ((frames = opts.samples / bins) == 0)
+            frames = 1;
+
+          if (!bench_run_case(
+              &opts,
+              format,
+              bench_window[window].type,
+              bins,
+              frames,
+              threads,
+              &seconds)) {
+            fprintf(stderr, "%s: case failed\n", argv[0]);
+            return EXIT_FAILURE;
+          }
+
+          samples = (uint64_t) threads * frames * bins;
+
+          printf(
+              "bench=dsp format=%s window=%s bins=%u threads=%u "
+              "samples=%llu seconds=%.6lf samples_per_s=%.4le rtf=%.3lf "
+              "ns_per_bin=%.3lf\n",
+              bench_format_name[format],
+              bench_window[window].name,
+              bins,
+              threads,
+              (unsigned long long) samples,
+              seconds,
+              samples / seconds,
+              samples / seconds / opts.fs,
+              seconds * 1e9 / samples);
+          fflush(stdout);
+        }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,311 @@
+/*
+  render.c: Benchmark of the spectrum redraw and snapshot export
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <png.h>
+
+#include "screen.h"
+#include "bench.h"
+
+#define BENCH_RENDER_FRAMES    32      /* Redraws per repetition */
+#define BENCH_RENDER_MAX_BINS  65536   /* Largest spectrum the application shows */
+#define BENCH_RENDER_SAMP_RATE 2000000 /* Only shown in the labels */
+#define BENCH_RENDER_FREQ      1420405752
+
+static const struct {
+  const char *name;
+  enum png_mode mode;
+} bench_png_mode[] = {
+  {"store",   PNG_MODE_STORE},
+  {"rle",     PNG_MODE_RLE},
+  {"deflate", PNG_MODE_DEFLATE}
+};
+
+/* The application's screen, fed with made-up snapshots */
+struct bench_render {
+  struct radtel_render screen;
+  rts_spectrum_snapshot_t snap;
+  struct timeval row_tv;
+  RTSFLOAT *spectrum; /* Cumulative, FFT order */
+  RTSCOUNT bins;
+  RTSCOUNT frames;
+  uint32_t seed;
+};
+
+/* One frame more of noise and a few carriers over a sloped baseline */
+static void
+bench_render_integrate(struct bench_render *render)
+{
+  rts_spectrum_snapshot_t *snap = &render->snap;
+  RTSFLOAT power;
+  RTSCOUNT i;
+
+  for (i = 0; i < render->bins; ++i) {
+    power = 1e-3 * (1 + .5 * i / render->bins)
+        * (1 + .1 * bench_noise(&render->seed));
+    if (i % (render->bins / 8 + 1) == 0)
+      power += 1e-1;
+    render->spectrum[i] += power > 0 ? power : 0;
+
+    if (i == 0 || render->spectrum[i] < snap->min)
+      snap->min = render->spectrum[i];
+    if (i == 0 || render->spectrum[i] > snap->max)
+      snap->max = render->spectrum[i];
+  }
+
+  ++render->frames;
+
+  snap->frame_count = render->frames;
+  snap->got_samples = render->frames * render->bins;
+}
+
+/* What the render thread does for every snapshot it draws */
+static void
+bench_render_frame(struct bench_render *render)
+{
+  radtel_render_snapshot(&render->screen, &render->snap, &render->row_tv);
+}
+
+static void
+bench_render_finalize(struct bench_render *render)
+{
+  if (render->screen.disp != NULL)
+    display_end(render->screen.disp);
+
+  radtel_render_finalize(&render->screen);
+
+  if (render->spectrum != NULL)
+    free(render->spectrum);
+
+  memset(render, 0, sizeof (struct bench_render));
+}
+
+/* A full waterfall, so every redraw has WATERFALL_HEIGHT rows */
+static RTSBOOL
+bench_render_init(
+    struct bench_render *render,
+    RTSCOUNT bins,
+    unsigned int threads)
+{
+  rts_spectrum_snapshot_t *snap = &render->snap;
+  unsigned int i;
+
+  memset(render, 0, sizeof (struct bench_render));
+
+  render->bins = bins;
+  render->seed = BENCH_SEED;
+
+  render->screen.view.zoom   = 1;
+  render->screen.view.center = .5;
+
+  RTS_TRYCATCH(
+      render->screen.disp = display_new_headless(WINDOW_WIDTH, WINDOW_HEIGHT),
+      goto fail);
+
+  if (threads > 1)
+    RTS_TRYCATCH(
+        display_enable_bands(render->screen.disp, threads - 1) == 0,
+        goto fail);
+
+  RTS_TRYCATCH(radtel_render_resize(&render->screen, bins), goto fail);
+  RTS_TRYCATCH(render->spectrum = calloc(bins, sizeof (RTSFLOAT)), goto fail);
+
+  snap->bins      = bins;
+  snap->capacity  = bins;
+  snap->spectrum  = render->spectrum;
+  snap->samp_rate = BENCH_RENDER_SAMP_RATE;
+  snap->progress  = .5;
+  snap->f_lo      = BENCH_RENDER_FREQ - .5 * BENCH_RENDER_SAMP_RATE;
+  snap->f_hi      = BENCH_RENDER_FREQ + .5 * BENCH_RENDER_SAMP_RATE;
+
+  for (i = 0; i < WATERFALL_HEIGHT; ++i) {
+    bench_render_integrate(render);
+    rts_waterfall_feed(render->screen.wf, render->spectrum, render->frames);
+    RTS_TRYCATCH(rts_waterfall_commit(render->screen.wf), goto fail);
+  }
+
+  gettimeofday(&render->row_tv, NULL);
+
+  return RTS_TRUE;
+
+fail:
+  bench_render_finalize(render);
+
+  return RTS_FALSE;
+}
+
+static RTSBOOL
+bench_run_redraw(
+    const struct bench_options *opts,
+    RTSCOUNT bins,
+    unsigned int threads,
+    double *seconds)
+{
+  struct bench_render render;
+  double *rep_time = NULL;
+  uint64_t start;
+  unsigned int i, rep;
+  RTSBOOL ok = RTS_FALSE;
+
+  RTS_TRYCATCH(rep_time = calloc(opts->reps, sizeof (double)), return ok);
+  RTS_TRYCATCH(bench_render_init(&render, bins, threads), goto done);
+
+  /* First run warms caches and page tables up, not reported */
+  for (rep = 0; rep <= opts->reps; ++rep) {
+    start = bench_now_ns();
+
+    for (i = 0; i < BENCH_RENDER_FRAMES; ++i) {
+      bench_render_integrate(&render);
+      bench_render_frame(&render);
+    }
+
+    if (rep > 0)
+      rep_time[rep - 1] = (bench_now_ns() - start) * 1e-9;
+  }
+
+  *seconds = bench_median(rep_time, opts->reps) / BENCH_RENDER_FRAMES;
+
+  bench_render_finalize(&render);
+
+  ok = RTS_TRUE;
+
+done:
+  free(rep_time);
+
+  return ok;
+}
+
+/* What the writer thread does with a copy of the screen */
+static RTSBOOL
+bench_run_snapshot(
+    const struct bench_options *opts,
+    enum png_mode mode,
+    double *seconds)
+{
+  struct bench_render render;
+  struct display_snapshot *snapshot;
+  double *rep_time = NULL;
+  uint64_t start;
+  unsigned int rep;
+  RTSBOOL ok = RTS_FALSE;
+
+  RTS_TRYCATCH(rep_time = calloc(opts->reps, sizeof (double)), return ok);
+  RTS_TRYCATCH(bench_render_init(&render, opts->min_bins, 1), goto done);
+
+  bench_render_integrate(&render);
+  bench_render_frame(&render);
+
+  for (rep = 0; rep <= opts->reps; ++rep) {
+    start = bench_now_ns();
+
+    RTS_TRYCATCH(snapshot = display_snapshot_new(render.screen.disp), goto done);
+
+    if (display_snapshot_to_png("/dev/null", snapshot, mode) == -1) {
+      display_snapshot_free(snapshot);
+      goto done;
+    }
+
+    display_snapshot_free(snapshot);
+
+    if (rep > 0)
+      rep_time[rep - 1] = (bench_now_ns() - start) * 1e-9;
+  }
+
+  *seconds = bench_median(rep_time, opts->reps);
+
+  ok = RTS_TRUE;
+
+done:
+  if (render.screen.disp != NULL)
+    bench_render_finalize(&render);
+
+  free(rep_time);
+
+  return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bench_options opts;
+  unsigned int threads;
+  unsigned int mode;
+  RTSCOUNT bins;
+  double seconds = 0;
+
+  bench_parse_options(
+      &opts,
+      argc,
+      argv,
+      "spectrum and waterfall redraw, snapshot export");
+
+  /* Larger spectra are never drawn */
+  if (opts.max_bins > BENCH_RENDER_MAX_BINS)
+    opts.max_bins = BENCH_RENDER_MAX_BINS;
+
+  bench_print_header("render", &opts);
+
+  radtel_init_waterfall_palette();
+
+  for (bins = opts.min_bins; bins <= opts.max_bins; bins <<= 2)
+    for (threads = 1; threads <= opts.max_threads; threads <<= 1) {
+      if (!bench_run_redraw(&opts, bins, threads, &seconds)) {
+        fprintf(stderr, "%s: case failed\n", argv[0]);
+        return EXIT_FAILURE;
+      }
+
+      printf(
+          "bench=redraw bins=%u threads=%u width=%d height=%d "
+          "ns_per_frame=%.0lf fps=%.1lf ns_per_bin=%.3lf\n",
+          bins,
+          threads,
+          WINDOW_WIDTH,
+          WINDOW_HEIGHT,
+          seconds * 1e9,
+          1 / seconds,
+          seconds * 1e9 / bins);
+      fflush(stdout);
+    }
+
+  for (mode = 0; mode < sizeof (bench_png_mode) / sizeof (bench_png_mode[0]); ++mode) {
+    if (!bench_run_snapshot(&opts, bench_png_mode[mode].mode, &seconds)) {
+      fprintf(stderr, "%s: case failed\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+    printf(
+        "bench=snapshot mode=%s width=%d height=%d "
+        "ns_per_frame=%.0lf fps=%.1lf ns_per_pixel=%.3lf\n",
+        bench_png_mode[mode].name,
+        WINDOW_WIDTH,
+        WINDOW_HEIGHT,
+        seconds * 1e9,
+        1 / seconds,
+        seconds * 1e9 / (WINDOW_WIDTH * WINDOW_HEIGHT));
+    fflush(stdout);
+  }
+
+  return EXIT_SUCCESS;
+}
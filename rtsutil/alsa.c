@@ -19,8 +19,10 @@
 
 */
 
+#include <errno.h>
 
 #include "alsa.h"
+#include "perf.h"
 
 void
 alsa_state_destroy(struct alsa_state *state)
@@ -44,7 +46,6 @@ alsa_state_new(const struct alsa_params *params)
   RTS_TRYCATCH(new = calloc(1, sizeof(struct alsa_state)), goto done);
 
   new->fc = params->fc;
-  new->dc_remove = params->dc_remove;
 
   RTS_TRYCATCH(
       (err = snd_pcm_open(
@@ -100,6 +101,12 @@ alsa_state_new(const struct alsa_params *params)
       (err = snd_pcm_hw_params(new->handle, hw_params)) >= 0,
       goto done);
 
+  RTS_TRYCATCH(
+      (err = snd_pcm_hw_params_get_buffer_size(
+          hw_params,
+          &new->buffer_size)) >= 0,
+      goto done);
+
   RTS_TRYCATCH(
       (err = snd_pcm_prepare(new->handle)) >= 0,
       goto done);
@@ -164,6 +171,8 @@ rts_alsa_open(const rts_params_t *params, struct rts_signal_source_info *info)
     goto fail;
   }
 
+  info->buffer_size = state->buffer_size;
+
   return state;
 
 fail:
@@ -178,33 +187,49 @@ rts_alsa_acquire(void *handle, RTSCOMPLEX *buffer, RTSCOUNT count)
 {
   int status;
   int i;
-  RTSCOMPLEX samp;
+  uint64_t start;
+  snd_pcm_sframes_t got;
   struct alsa_state *state = (struct alsa_state *) handle;
 
   count = MIN(count, ALSA_INTEGER_BUFFER_SIZE);
 
-  count = snd_pcm_readi(state->handle, state->buffer, count);
+  /* Overrun: what was captured meanwhile is lost, start over */
+  while ((got = snd_pcm_readi(state->handle, state->buffer, count))
+      == -EPIPE) {
+    ++state->xruns;
+
+    if (snd_pcm_prepare(state->handle) < 0)
+      return RTS_SOURCE_ACQUIRE_RESULT_ERROR;
+  }
+
+  if (got < 0) {
+    fprintf(stderr, "ALSA error: capture failed: %s\n", snd_strerror(got));
+    return RTS_SOURCE_ACQUIRE_RESULT_ERROR;
+  }
+
+  count = got;
   if (count > 0) {
     /*
      * ALSA does not seem to allow to read FLOAT64_LE directly. We have
      * to transform the integer samples manually
      */
+    start = rts_perf_begin();
 
-    if (state->dc_remove) {
-      for (i = 0; i < count; ++i) {
-        samp = state->buffer[i] / 32768.0;
-        buffer[i] = samp - state->last;
-        state->last = samp;
-      }
-    } else {
-      for (i = 0; i < count; ++i)
-        buffer[i] = state->buffer[i] / 32768.0;
-    }
+    for (i = 0; i < count; ++i)
+      buffer[i] = state->buffer[i] / 32768.0;
+
+    rts_perf_end(RTS_PERF_CONVERT, start);
   }
 
   return count;
 }
 
+RTS_PRIVATE uint64_t
+rts_alsa_get_xruns(void *handle)
+{
+  return ((const struct alsa_state *) handle)->xruns;
+}
+
 RTS_PRIVATE void
 rts_alsa_close(void *handle)
 {
@@ -219,7 +244,8 @@ rts_alsa_source_register(void)
       .name = "alsa",
       .open = rts_alsa_open,
       .acquire = rts_alsa_acquire,
-      .close = rts_alsa_close
+      .close = rts_alsa_close,
+      .get_xruns = rts_alsa_get_xruns
   };
 
   RTS_TRYCATCH(rts_signal_source_register(&src), return RTS_FALSE);
@@ -28,7 +28,6 @@ struct alsa_params {
   const char *device;
   unsigned int samp_rate;
   RTSCOUNT fc;
-  RTSBOOL dc_remove;
 };
 
 #define ALSA_INTEGER_BUFFER_SIZE 2048
@@ -39,9 +38,9 @@ struct alsa_state {
   snd_pcm_t *handle;
   uint64_t samp_rate;
   uint64_t fc;
+  snd_pcm_uframes_t buffer_size; /* Of the device, in frames */
   int16_t buffer[ALSA_INTEGER_BUFFER_SIZE];
-  RTSCOMPLEX last;
-  RTSBOOL dc_remove;
+  uint64_t xruns;
 };
 
 RTSBOOL rts_alsa_source_init(void);
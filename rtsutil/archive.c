@@ -0,0 +1,856 @@
+/*
+  archive.c: Binary spectrum archive
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "huffman.h"
+#include "perf.h"
+
+#define RTS_ARCHIVE_ALIGNED(x) \
+  ((((x) + RTS_ARCHIVE_ALIGN - 1) / RTS_ARCHIVE_ALIGN) * RTS_ARCHIVE_ALIGN)
+
+#define RTS_ARCHIVE_FLOOR 1e-30 /* Avoid log10(0) */
+
+/* Largest possible payload: every plane stored raw */
+#define RTS_ARCHIVE_PAYLOAD_BOUND(bins, word_size) \
+  ((word_size) * (1 + sizeof (uint32_t) + (size_t) (bins)))
+
+RTS_PRIVATE size_t
+rts_archive_sample_size(uint32_t type)
+{
+  switch (type) {
+    case RTS_ARCHIVE_FLOAT32:
+      return sizeof (float);
+
+    case RTS_ARCHIVE_FLOAT64:
+      return sizeof (double);
+  }
+
+  return 0;
+}
+
+RTS_PRIVATE RTSBOOL
+rts_archive_write_all(int fd, const void *data, size_t size)
+{
+  uint64_t start = rts_perf_begin();
+  ssize_t ret;
+
+  while (size > 0) {
+    if ((ret = write(fd, data, size)) < 0) {
+      if (errno == EINTR)
+        continue;
+
+      return RTS_FALSE;
+    }
+
+    data += ret;
+    size -= ret;
+  }
+
+  rts_perf_end(RTS_PERF_WRITE, start);
+
+  return RTS_TRUE;
+}
+
+RTS_PRIVATE size_t
+rts_archive_word_size(const struct rts_archive_header *header)
+{
+  if (header->compression == RTS_ARCHIVE_QUANTIZED)
+    return sizeof (uint32_t);
+
+  return rts_archive_sample_size(header->sample_type);
+}
+
+RTS_PRIVATE inline void
+rts_archive_put_le32(uint8_t *p, uint32_t value)
+{
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+}
+
+RTS_PRIVATE inline uint32_t
+rts_archive_get_le32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/*
+ * Byte planes of an array of words. `plane' is scratch space of
+ * `count' bytes, and `out' must have RTS_HUFFMAN_BOUND(count) bytes of
+ * scratch space after the first `huffman_room' ones. Returns the
+ * number of bytes written to `out'.
+ */
+RTS_PRIVATE size_t
+rts_archive_encode_planes(
+    const uint64_t *words,
+    RTSCOUNT count,
+    size_t word_size,
+    uint8_t *plane,
+    uint8_t *out,
+    size_t huffman_room)
+{
+  uint8_t *p = out;
+  uint8_t *huff = out + huffman_room;
+  RTSBOOL zero;
+  size_t size;
+  unsigned int b;
+  RTSCOUNT i;
+
+  for (b = 0; b < word_size; ++b) {
+    zero = RTS_TRUE;
+    for (i = 0; i < count; ++i)
+      if ((plane[i] = words[i] >> (8 * b)) != 0)
+        zero = RTS_FALSE;
+
+    if (zero) {
+      *p++ = RTS_ARCHIVE_PLANE_ZERO;
+      continue;
+    }
+
+    /* Encoded past the end of the payload, then moved if smaller */
+    size = rts_huffman_encode(plane, count, huff);
+
+    if (size < count) {
+      *p++ = RTS_ARCHIVE_PLANE_HUFFMAN;
+      rts_archive_put_le32(p, size);
+      memmove(p + 4, huff, size);
+    } else {
+      *p++ = RTS_ARCHIVE_PLANE_RAW;
+      rts_archive_put_le32(p, size = count);
+      memcpy(p + 4, plane, size);
+    }
+
+    p += 4 + size;
+  }
+
+  return p - out;
+}
+
+RTS_PRIVATE RTSBOOL
+rts_archive_decode_planes(
+    const uint8_t *in,
+    size_t in_size,
+    uint64_t *words,
+    RTSCOUNT count,
+    size_t word_size,
+    uint8_t *plane)
+{
+  const uint8_t *end = in + in_size;
+  uint32_t size;
+  unsigned int b;
+  RTSCOUNT i;
+
+  memset(words, 0, count * sizeof (uint64_t));
+
+  for (b = 0; b < word_size; ++b) {
+    if (in >= end)
+      return RTS_FALSE;
+
+    if (*in == RTS_ARCHIVE_PLANE_ZERO) {
+      ++in;
+      continue;
+    }
+
+    if (end - in < 5)
+      return RTS_FALSE;
+
+    size = rts_archive_get_le32(in + 1);
+    if (size > end - in - 5)
+      return RTS_FALSE;
+
+    switch (*in) {
+      case RTS_ARCHIVE_PLANE_RAW:
+        if (size != count)
+          return RTS_FALSE;
+        memcpy(plane, in + 5, count);
+        break;
+
+      case RTS_ARCHIVE_PLANE_HUFFMAN:
+        if (!rts_huffman_decode(in + 5, size, plane, count))
+          return RTS_FALSE;
+        break;
+
+      default:
+        return RTS_FALSE;
+    }
+
+    for (i = 0; i < count; ++i)
+      words[i] |= (uint64_t) plane[i] << (8 * b);
+
+    in += 5 + size;
+  }
+
+  return RTS_TRUE;
+}
+
+RTS_PRIVATE inline uint32_t
+rts_archive_zigzag(int32_t x)
+{
+  return ((uint32_t) x << 1) ^ (uint32_t) (x >> 31);
+}
+
+RTS_PRIVATE inline int32_t
+rts_archive_unzigzag(uint32_t x)
+{
+  return (int32_t) (x >> 1) ^ -(int32_t) (x & 1);
+}
+
+/******************************* Writer *************************************/
+void
+rts_archive_close(rts_archive_t *archive)
+{
+  if (archive->fd != -1)
+    close(archive->fd);
+
+  if (archive->record != NULL)
+    free(archive->record);
+
+  if (archive->prev != NULL)
+    free(archive->prev);
+
+  if (archive->next != NULL)
+    free(archive->next);
+
+  if (archive->words != NULL)
+    free(archive->words);
+
+  if (archive->plane != NULL)
+    free(archive->plane);
+
+  free(archive);
+}
+
+rts_archive_t *
+rts_archive_create(const char *path, const struct rts_archive_params *params)
+{
+  rts_archive_t *new = NULL;
+  size_t sample_size;
+
+  RTS_TRYCATCH(
+      (sample_size = rts_archive_sample_size(params->sample_type)) > 0,
+      goto fail);
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_archive_t)), goto fail);
+
+  new->fd = -1;
+
+  memcpy(new->header.magic, RTS_ARCHIVE_MAGIC, sizeof (new->header.magic));
+  new->header.version     = RTS_ARCHIVE_VERSION;
+  new->header.header_size = RTS_ARCHIVE_ALIGNED(
+      sizeof (struct rts_archive_header));
+  new->header.record_size = RTS_ARCHIVE_ALIGNED(
+      sizeof (struct rts_archive_record) + params->bins * sample_size);
+  new->header.bins        = params->bins;
+  new->header.sample_type = params->sample_type;
+  new->header.window      = params->window;
+  new->header.samp_rate   = params->samp_rate;
+  new->header.frames      = params->frames;
+  new->header.fc          = params->fc;
+  new->header.avg_time    = params->avg_time;
+  new->header.source_buffer = params->source_buffer;
+  new->header.created     = time(NULL);
+  new->header.compression = params->compression;
+
+  new->record_alloc = new->header.record_size;
+
+  if (params->compression != RTS_ARCHIVE_UNCOMPRESSED) {
+    RTS_TRYCATCH(
+        params->compression != RTS_ARCHIVE_QUANTIZED
+        || params->quant_step > 0,
+        goto fail);
+
+    new->header.record_size       = 0;
+    new->header.keyframe_interval = params->keyframe_interval;
+    new->header.quant_step        = params->quant_step;
+
+    new->word_size = rts_archive_word_size(&new->header);
+
+    /* Worst case payload plus room to try the Huffman encoding */
+    new->record_alloc = RTS_ARCHIVE_ALIGNED(
+        sizeof (struct rts_archive_record)
+        + RTS_ARCHIVE_PAYLOAD_BOUND(params->bins, new->word_size)
+        + RTS_HUFFMAN_BOUND(params->bins));
+
+    RTS_TRYCATCH(
+        new->prev = calloc(params->bins, sizeof (uint64_t)),
+        goto fail);
+    RTS_TRYCATCH(
+        new->next = calloc(params->bins, sizeof (uint64_t)),
+        goto fail);
+    RTS_TRYCATCH(
+        new->words = malloc(params->bins * sizeof (uint64_t)),
+        goto fail);
+    RTS_TRYCATCH(new->plane = malloc(params->bins), goto fail);
+  }
+
+  RTS_TRYCATCH(
+      posix_memalign(
+          &new->record,
+          RTS_ARCHIVE_ALIGN,
+          new->record_alloc) == 0,
+      new->record = NULL; goto fail);
+
+  memset(new->record, 0, new->record_alloc);
+
+  if ((new->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644))
+      == -1) {
+    fprintf(
+        stderr,
+        "archive: cannot create %s: %s\n",
+        path,
+        strerror(errno));
+    goto fail;
+  }
+
+  RTS_TRYCATCH(
+      rts_archive_write_all(
+          new->fd,
+          &new->header,
+          sizeof (struct rts_archive_header)),
+      goto fail);
+
+  new->offset = sizeof (struct rts_archive_header);
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_archive_close(new);
+
+  return NULL;
+}
+
+/*
+ * Delta words against the previous record, in place of the samples. The
+ * reference for the record after this one goes to archive->next, and only
+ * becomes archive->prev once the record is on disk.
+ */
+RTS_PRIVATE size_t
+rts_archive_compress(
+    rts_archive_t *archive,
+    const RTSFLOAT *spectrum,
+    RTSFLOAT scale,
+    RTSBOOL keyframe,
+    uint8_t *out)
+{
+  const struct rts_archive_header *header = &archive->header;
+  uint64_t *words = archive->words;
+  uint64_t *next = archive->next;
+  uint64_t word;
+  union {
+    float f;
+    uint32_t u;
+  } f32;
+  union {
+    double f;
+    uint64_t u;
+  } f64;
+  RTSFLOAT v;
+  int32_t q;
+  unsigned int i;
+
+  for (i = 0; i < header->bins; ++i) {
+    v = spectrum[i] * scale;
+
+    if (header->compression == RTS_ARCHIVE_QUANTIZED) {
+      q = lrint(
+          10 * log10(v > RTS_ARCHIVE_FLOOR ? v : RTS_ARCHIVE_FLOOR)
+          / header->quant_step);
+      next[i] = (uint32_t) q;
+      words[i] = rts_archive_zigzag(
+          q - (keyframe ? 0 : (int32_t) archive->prev[i]));
+    } else {
+      if (header->sample_type == RTS_ARCHIVE_FLOAT32) {
+        f32.f = v;
+        word = f32.u;
+      } else {
+        f64.f = v;
+        word = f64.u;
+      }
+
+      next[i] = word;
+      words[i] = word ^ (keyframe ? 0 : archive->prev[i]);
+    }
+  }
+
+  return rts_archive_encode_planes(
+      words,
+      header->bins,
+      archive->word_size,
+      archive->plane,
+      out,
+      RTS_ARCHIVE_PAYLOAD_BOUND(header->bins, archive->word_size));
+}
+
+/*
+ * Write the staged record. A failed or short write is cut back off the
+ * file so that it still ends on a whole record, and the next record is
+ * made a keyframe: its predecessor never made it to disk, so a delta
+ * against it could not be decoded.
+ */
+RTS_PRIVATE RTSBOOL
+rts_archive_store(rts_archive_t *archive, size_t size)
+{
+  uint64_t *tmp;
+
+  if (!rts_archive_write_all(archive->fd, archive->record, size)) {
+    fprintf(
+        stderr,
+        "archive: record %lu not written: %s\n",
+        (unsigned long) archive->count,
+        strerror(errno));
+
+    if (ftruncate(archive->fd, archive->offset) == -1)
+      fprintf(
+          stderr,
+          "archive: cannot drop partial record: %s\n",
+          strerror(errno));
+
+    archive->resync = RTS_TRUE;
+
+    return RTS_FALSE;
+  }
+
+  archive->offset += size;
+
+  if (archive->next != NULL) {
+    tmp = archive->prev;
+    archive->prev = archive->next;
+    archive->next = tmp;
+    archive->resync = RTS_FALSE;
+  }
+
+  ++archive->count;
+
+  return RTS_TRUE;
+}
+
+RTSBOOL
+rts_archive_append(
+    rts_archive_t *archive,
+    const struct rts_archive_record *record,
+    const RTSFLOAT *spectrum,
+    RTSFLOAT scale)
+{
+  struct rts_archive_record *header;
+  RTSBOOL keyframe;
+  size_t size;
+  void *samples;
+  float *as_float;
+  double *as_double;
+  unsigned int i;
+
+  memcpy(archive->record, record, sizeof (struct rts_archive_record));
+
+  samples = archive->record + sizeof (struct rts_archive_record);
+
+  if (archive->header.compression != RTS_ARCHIVE_UNCOMPRESSED) {
+    header = archive->record;
+
+    keyframe = archive->count == 0
+        || archive->resync
+        || (archive->header.keyframe_interval > 0
+            && archive->count % archive->header.keyframe_interval == 0);
+
+    header->payload_size = rts_archive_compress(
+        archive,
+        spectrum,
+        scale,
+        keyframe,
+        samples);
+
+    size = RTS_ARCHIVE_ALIGNED(
+        sizeof (struct rts_archive_record) + header->payload_size);
+
+    /* Keep padding deterministic */
+    memset(
+        samples + header->payload_size,
+        0,
+        size - sizeof (struct rts_archive_record) - header->payload_size);
+
+    header->size  = size;
+    header->flags = record->flags | (keyframe ? RTS_ARCHIVE_RECORD_KEYFRAME : 0);
+
+    return rts_archive_store(archive, size);
+  }
+
+  if (archive->header.sample_type == RTS_ARCHIVE_FLOAT32) {
+    as_float = (float *) samples;
+    for (i = 0; i < archive->header.bins; ++i)
+      as_float[i] = spectrum[i] * scale;
+  } else {
+    as_double = (double *) samples;
+    for (i = 0; i < archive->header.bins; ++i)
+      as_double[i] = spectrum[i] * scale;
+  }
+
+  return rts_archive_store(archive, archive->header.record_size);
+}
+
+/******************************* Reader *************************************/
+void
+rts_archive_reader_close(rts_archive_reader_t *reader)
+{
+  if (reader->map != NULL)
+    munmap(reader->map, reader->size);
+
+  free(reader);
+}
+
+rts_archive_reader_t *
+rts_archive_open(const char *path)
+{
+  rts_archive_reader_t *new = NULL;
+  const struct rts_archive_header *header;
+  struct stat sbuf;
+  void *map;
+  int fd = -1;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_archive_reader_t)), goto fail);
+
+  if ((fd = open(path, O_RDONLY)) == -1) {
+    fprintf(stderr, "archive: cannot open %s: %s\n", path, strerror(errno));
+    goto fail;
+  }
+
+  RTS_TRYCATCH(fstat(fd, &sbuf) != -1, goto fail);
+
+  if (sbuf.st_size < sizeof (struct rts_archive_header)) {
+    fprintf(stderr, "archive: %s: truncated header\n", path);
+    goto fail;
+  }
+
+  RTS_TRYCATCH(
+      (map = mmap(NULL, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0))
+      != MAP_FAILED,
+      goto fail);
+
+  new->map = map;
+  new->size = sbuf.st_size;
+  new->header = header = map;
+
+  if (memcmp(header->magic, RTS_ARCHIVE_MAGIC, sizeof (header->magic)) != 0) {
+    fprintf(stderr, "archive: %s: not a spectrum archive\n", path);
+    goto fail;
+  }
+
+  if (header->version < 1 || header->version > RTS_ARCHIVE_VERSION) {
+    fprintf(
+        stderr,
+        "archive: %s: unsupported version %u\n",
+        path,
+        header->version);
+    goto fail;
+  }
+
+  if (header->version > 1
+      && header->compression != RTS_ARCHIVE_UNCOMPRESSED) {
+    fprintf(
+        stderr,
+        "archive: %s: compressed archives can only be streamed\n",
+        path);
+    goto fail;
+  }
+
+  if (header->header_size > new->size
+      || rts_archive_sample_size(header->sample_type) == 0
+      || header->record_size < sizeof (struct rts_archive_record)
+         + header->bins * rts_archive_sample_size(header->sample_type)) {
+    fprintf(stderr, "archive: %s: inconsistent header\n", path);
+    goto fail;
+  }
+
+  /* Trailing partial records (e.g. after a crash) are ignored */
+  new->count = (new->size - header->header_size) / header->record_size;
+
+  close(fd);
+
+  return new;
+
+fail:
+  if (fd != -1)
+    close(fd);
+
+  if (new != NULL)
+    rts_archive_reader_close(new);
+
+  return NULL;
+}
+
+const struct rts_archive_record *
+rts_archive_get_record(const rts_archive_reader_t *reader, RTSCOUNT index)
+{
+  if (index >= reader->count)
+    return NULL;
+
+  return reader->map
+      + reader->header->header_size
+      + (size_t) index * reader->header->record_size;
+}
+
+const void *
+rts_archive_get_samples(const rts_archive_reader_t *reader, RTSCOUNT index)
+{
+  const struct rts_archive_record *record;
+
+  if ((record = rts_archive_get_record(reader, index)) == NULL)
+    return NULL;
+
+  return record + 1;
+}
+
+RTSBOOL
+rts_archive_read_spectrum(
+    const rts_archive_reader_t *reader,
+    RTSCOUNT index,
+    RTSFLOAT *spectrum)
+{
+  const void *samples;
+  const float *as_float;
+  const double *as_double;
+  unsigned int i;
+
+  if ((samples = rts_archive_get_samples(reader, index)) == NULL)
+    return RTS_FALSE;
+
+  if (reader->header->sample_type == RTS_ARCHIVE_FLOAT32) {
+    as_float = samples;
+    for (i = 0; i < reader->header->bins; ++i)
+      spectrum[i] = as_float[i];
+  } else {
+    as_double = samples;
+    for (i = 0; i < reader->header->bins; ++i)
+      spectrum[i] = as_double[i];
+  }
+
+  return RTS_TRUE;
+}
+
+/******************************* Stream *************************************/
+void
+rts_archive_stream_close(rts_archive_stream_t *stream)
+{
+  if (stream->fp != NULL)
+    fclose(stream->fp);
+
+  if (stream->prev != NULL)
+    free(stream->prev);
+
+  if (stream->plane != NULL)
+    free(stream->plane);
+
+  if (stream->payload != NULL)
+    free(stream->payload);
+
+  free(stream);
+}
+
+rts_archive_stream_t *
+rts_archive_stream_open(const char *path)
+{
+  rts_archive_stream_t *new = NULL;
+  struct rts_archive_header *header;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_archive_stream_t)), goto fail);
+
+  header = &new->header;
+
+  if ((new->fp = fopen(path, "rb")) == NULL) {
+    fprintf(stderr, "archive: cannot open %s: %s\n", path, strerror(errno));
+    goto fail;
+  }
+
+  if (fread(header, sizeof (struct rts_archive_header), 1, new->fp) < 1) {
+    fprintf(stderr, "archive: %s: truncated header\n", path);
+    goto fail;
+  }
+
+  if (memcmp(header->magic, RTS_ARCHIVE_MAGIC, sizeof (header->magic)) != 0
+      || header->version < 1
+      || header->version > RTS_ARCHIVE_VERSION) {
+    fprintf(stderr, "archive: %s: not a supported spectrum archive\n", path);
+    goto fail;
+  }
+
+  /* Version 1 had no compression fields */
+  if (header->version == 1)
+    header->compression = RTS_ARCHIVE_UNCOMPRESSED;
+
+  if (rts_archive_sample_size(header->sample_type) == 0
+      || header->compression > RTS_ARCHIVE_QUANTIZED
+      || (header->compression == RTS_ARCHIVE_UNCOMPRESSED
+          && header->record_size < sizeof (struct rts_archive_record)
+             + header->bins * rts_archive_sample_size(header->sample_type))) {
+    fprintf(stderr, "archive: %s: inconsistent header\n", path);
+    goto fail;
+  }
+
+  RTS_TRYCATCH(
+      fseek(new->fp, header->header_size, SEEK_SET) == 0,
+      goto fail);
+
+  new->word_size = rts_archive_word_size(header);
+
+  if (header->compression == RTS_ARCHIVE_UNCOMPRESSED) {
+    new->payload_alloc =
+        header->record_size - sizeof (struct rts_archive_record);
+  } else {
+    new->payload_alloc = RTS_ARCHIVE_ALIGNED(
+        RTS_ARCHIVE_PAYLOAD_BOUND(header->bins, new->word_size));
+
+    RTS_TRYCATCH(
+        new->prev = calloc(header->bins, sizeof (uint64_t)),
+        goto fail);
+    RTS_TRYCATCH(new->plane = malloc(header->bins), goto fail);
+  }
+
+  /* Decoded words go after the payload */
+  RTS_TRYCATCH(
+      new->payload = malloc(
+          new->payload_alloc + header->bins * sizeof (uint64_t)),
+      goto fail);
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_archive_stream_close(new);
+
+  return NULL;
+}
+
+RTS_PRIVATE RTSBOOL
+rts_archive_stream_decompress(
+    rts_archive_stream_t *stream,
+    const struct rts_archive_record *record,
+    RTSFLOAT *spectrum)
+{
+  const struct rts_archive_header *header = &stream->header;
+  uint64_t *words = (uint64_t *) (stream->payload + stream->payload_alloc);
+  union {
+    float f;
+    uint32_t u;
+  } f32;
+  union {
+    double f;
+    uint64_t u;
+  } f64;
+  int32_t q;
+  unsigned int i;
+
+  if (record->flags & RTS_ARCHIVE_RECORD_KEYFRAME)
+    memset(stream->prev, 0, header->bins * sizeof (uint64_t));
+  else if (stream->count == 0)
+    return RTS_FALSE; /* Deltas against nothing */
+
+  RTS_TRYCATCH(
+      rts_archive_decode_planes(
+          stream->payload,
+          record->payload_size,
+          words,
+          header->bins,
+          stream->word_size,
+          stream->plane),
+      return RTS_FALSE);
+
+  for (i = 0; i < header->bins; ++i) {
+    if (header->compression == RTS_ARCHIVE_QUANTIZED) {
+      q = (int32_t) stream->prev[i] + rts_archive_unzigzag(words[i]);
+      stream->prev[i] = (uint32_t) q;
+      spectrum[i] = pow(10, q * header->quant_step / 10);
+    } else {
+      stream->prev[i] ^= words[i];
+
+      if (header->sample_type == RTS_ARCHIVE_FLOAT32) {
+        f32.u = stream->prev[i];
+        spectrum[i] = f32.f;
+      } else {
+        f64.u = stream->prev[i];
+        spectrum[i] = f64.f;
+      }
+    }
+  }
+
+  return RTS_TRUE;
+}
+
+RTSBOOL
+rts_archive_stream_read(
+    rts_archive_stream_t *stream,
+    struct rts_archive_record *record,
+    RTSFLOAT *spectrum)
+{
+  const struct rts_archive_header *header = &stream->header;
+  const float *as_float;
+  const double *as_double;
+  size_t size;
+  unsigned int i;
+
+  if (fread(record, sizeof (struct rts_archive_record), 1, stream->fp) < 1)
+    return RTS_FALSE;
+
+  if (header->compression == RTS_ARCHIVE_UNCOMPRESSED) {
+    size = header->record_size - sizeof (struct rts_archive_record);
+  } else {
+    if (record->size < sizeof (struct rts_archive_record)
+        || record->size - sizeof (struct rts_archive_record)
+           > stream->payload_alloc
+        || record->payload_size
+           > record->size - sizeof (struct rts_archive_record)) {
+      fprintf(stderr, "archive: corrupt record %u\n", stream->count);
+      return RTS_FALSE;
+    }
+
+    size = record->size - sizeof (struct rts_archive_record);
+  }
+
+  /* Trailing partial records (e.g. after a crash) are ignored */
+  if (fread(stream->payload, 1, size, stream->fp) < size)
+    return RTS_FALSE;
+
+  if (header->compression != RTS_ARCHIVE_UNCOMPRESSED) {
+    if (!rts_archive_stream_decompress(stream, record, spectrum)) {
+      fprintf(stderr, "archive: cannot decode record %u\n", stream->count);
+      return RTS_FALSE;
+    }
+  } else if (header->sample_type == RTS_ARCHIVE_FLOAT32) {
+    as_float = (const float *) stream->payload;
+    for (i = 0; i < header->bins; ++i)
+      spectrum[i] = as_float[i];
+  } else {
+    as_double = (const double *) stream->payload;
+    for (i = 0; i < header->bins; ++i)
+      spectrum[i] = as_double[i];
+  }
+
+  ++stream->count;
+
+  return RTS_TRUE;
+}
@@ -0,0 +1,239 @@
+/*
+  archive.h: Binary spectrum archive
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_ARCHIVE_H
+#define _RTSUTIL_ARCHIVE_H
+
+#include <sys/types.h>
+
+#include "common.h"
+
+/*
+ * Archive layout (all fields in host byte order, little endian in
+ * practice):
+ *
+ *   struct rts_archive_header       (header_size bytes)
+ *   record 0                        (record_size bytes)
+ *   record 1
+ *   ...
+ *
+ * Each record is a struct rts_archive_record followed by `bins' samples
+ * of the spectrum (already divided by the frame count) and padded to
+ * RTS_ARCHIVE_ALIGN bytes, so every record and every spectrum can be
+ * used in place from a mmap'ed file.
+ *
+ * Compressed archives (compression != RTS_ARCHIVE_UNCOMPRESSED) have
+ * variable-size records (record_size is 0 in the header, each record
+ * carries its own size, still a multiple of RTS_ARCHIVE_ALIGN). The
+ * payload encodes every bin as a word relative to the same bin of the
+ * previous record, unless the record is a keyframe:
+ *
+ *   RTS_ARCHIVE_LOSSLESS:  sample bits XOR previous sample bits
+ *   RTS_ARCHIVE_QUANTIZED: round(dB / quant_step) minus previous, zigzag
+ *                          encoded in 32 bit words
+ *
+ * Words are then split in byte planes (all least significant bytes
+ * first), and each plane is stored as:
+ *
+ *   uint8_t  mode (RTS_ARCHIVE_PLANE_*)
+ *   uint32_t size (absent for zero planes)
+ *   size bytes    (raw bytes or a canonical Huffman block)
+ *
+ * These archives can only be read sequentially, through
+ * rts_archive_stream_open().
+ */
+
+#define RTS_ARCHIVE_MAGIC   "RTSARCHV"
+#define RTS_ARCHIVE_VERSION 2
+#define RTS_ARCHIVE_ALIGN   64
+
+enum rts_archive_sample_type {
+  RTS_ARCHIVE_FLOAT32 = 0,
+  RTS_ARCHIVE_FLOAT64
+};
+
+enum rts_archive_compression {
+  RTS_ARCHIVE_UNCOMPRESSED = 0,
+  RTS_ARCHIVE_LOSSLESS,
+  RTS_ARCHIVE_QUANTIZED
+};
+
+#define RTS_ARCHIVE_PLANE_ZERO    0
+#define RTS_ARCHIVE_PLANE_RAW     1
+#define RTS_ARCHIVE_PLANE_HUFFMAN 2
+
+#define RTS_ARCHIVE_RECORD_KEYFRAME 1
+
+struct rts_archive_header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t record_size;
+  uint32_t bins;
+  uint32_t sample_type; /* enum rts_archive_sample_type */
+  uint32_t window;      /* enum rts_window_type */
+  uint32_t samp_rate;
+  uint32_t frames;      /* FFT frames per complete integration */
+  int64_t  fc;
+  double   avg_time;    /* Integration time, in seconds */
+  int64_t  created;     /* UNIX time */
+  uint32_t compression; /* enum rts_archive_compression */
+  uint32_t keyframe_interval;
+  double   quant_step;  /* dB, RTS_ARCHIVE_QUANTIZED only */
+  uint32_t source_buffer; /* Samples, 0 if unknown */
+  uint8_t  reserved[44];
+};
+
+struct rts_archive_record {
+  int64_t  tv_sec;      /* UTC time of the end of the integration */
+  uint32_t tv_nsec;
+  uint32_t frame_count;
+  uint32_t drop_count;   /* Source overruns during the integration */
+  uint32_t flags;
+  uint32_t size;         /* Whole record, compressed archives only */
+  uint32_t payload_size;
+
+  /* Real-time margin over the integration (struct rts_margin_stats) */
+  float    rtf_min;     /* 0 if unknown */
+  float    fill_max;    /* Of source_buffer, 0 if unknown */
+  uint32_t lag_max;     /* Samples */
+  uint32_t queue_max;   /* Writer jobs */
+  uint8_t  reserved[16];
+};
+
+struct rts_archive_params {
+  RTSCOUNT bins;
+  enum rts_archive_sample_type sample_type;
+  enum rts_window_type window;
+  unsigned int samp_rate;
+  RTSCOUNT frames;
+  int64_t fc;
+  RTSFLOAT avg_time;
+  RTSCOUNT source_buffer;
+
+  enum rts_archive_compression compression;
+  RTSCOUNT keyframe_interval; /* 0: first record only */
+  RTSFLOAT quant_step;
+};
+
+/* Append-only writer */
+struct rts_archive {
+  int fd;
+  struct rts_archive_header header;
+  void *record; /* One full record, written with a single write() */
+  size_t record_alloc;
+
+  /* Compression state */
+  size_t word_size;
+  uint64_t *prev;
+  uint64_t *next; /* prev after the pending record, kept once it is stored */
+  uint64_t *words;
+  uint8_t *plane;
+  RTSCOUNT count;
+  RTSBOOL resync; /* A write failed: the next record must be a keyframe */
+  off_t offset;   /* End of the last record fully written */
+};
+
+typedef struct rts_archive rts_archive_t;
+
+rts_archive_t *rts_archive_create(
+    const char *path,
+    const struct rts_archive_params *params);
+
+RTSBOOL rts_archive_append(
+    rts_archive_t *archive,
+    const struct rts_archive_record *record,
+    const RTSFLOAT *spectrum,
+    RTSFLOAT scale);
+
+void rts_archive_close(rts_archive_t *archive);
+
+/* Read-only access through mmap */
+struct rts_archive_reader {
+  void *map;
+  size_t size;
+  const struct rts_archive_header *header;
+  RTSCOUNT count;
+};
+
+typedef struct rts_archive_reader rts_archive_reader_t;
+
+rts_archive_reader_t *rts_archive_open(const char *path);
+
+RTS_PRIVATE inline const struct rts_archive_header *
+rts_archive_get_header(const rts_archive_reader_t *reader)
+{
+  return reader->header;
+}
+
+RTS_PRIVATE inline RTSCOUNT
+rts_archive_get_record_count(const rts_archive_reader_t *reader)
+{
+  return reader->count;
+}
+
+const struct rts_archive_record *rts_archive_get_record(
+    const rts_archive_reader_t *reader,
+    RTSCOUNT index);
+
+/* Raw samples of a record, of the type given in the header */
+const void *rts_archive_get_samples(
+    const rts_archive_reader_t *reader,
+    RTSCOUNT index);
+
+RTSBOOL rts_archive_read_spectrum(
+    const rts_archive_reader_t *reader,
+    RTSCOUNT index,
+    RTSFLOAT *spectrum);
+
+void rts_archive_reader_close(rts_archive_reader_t *reader);
+
+/* Sequential access, for any kind of archive */
+struct rts_archive_stream {
+  FILE *fp;
+  struct rts_archive_header header;
+  size_t word_size;
+  uint64_t *prev;
+  uint8_t *plane;
+  uint8_t *payload;
+  size_t payload_alloc;
+  RTSCOUNT count;
+};
+
+typedef struct rts_archive_stream rts_archive_stream_t;
+
+rts_archive_stream_t *rts_archive_stream_open(const char *path);
+
+RTS_PRIVATE inline const struct rts_archive_header *
+rts_archive_stream_get_header(const rts_archive_stream_t *stream)
+{
+  return &stream->header;
+}
+
+/* RTS_FALSE at the end of the archive (or on error) */
+RTSBOOL rts_archive_stream_read(
+    rts_archive_stream_t *stream,
+    struct rts_archive_record *record,
+    RTSFLOAT *spectrum);
+
+void rts_archive_stream_close(rts_archive_stream_t *stream);
+
+#endif /* _RTSUTIL_ARCHIVE_H */
@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include "bladerf.h"
+#include "perf.h"
 
 RTS_PRIVATE void
 bladeRF_state_destroy(struct bladeRF_state *state)
@@ -43,8 +44,8 @@ bladeRF_state_init_sync(struct bladeRF_state *state)
   status = bladerf_sync_config(
       state->dev,
       BLADERF_MODULE_RX,
-      BLADERF_FORMAT_SC16_Q11,
-      16,
+      BLADERF_FORMAT_SC16_Q11_META,
+      BLADERF_SYNC_BUFFERS,
       state->params.bufsiz,
       8,
       3500);
@@ -344,6 +345,8 @@ rts_bladeRF_open(const rts_params_t *params, struct rts_signal_source_info *info
     goto fail;
   }
 
+  info->buffer_size = BLADERF_SYNC_BUFFERS * bladerf_params.bufsiz;
+
   return state;
 
 fail:
@@ -356,17 +359,22 @@ fail:
 RTS_PRIVATE RTSCOUNT
 rts_bladeRF_acquire(void *handle, RTSCOMPLEX *buffer, RTSCOUNT count)
 {
+  struct bladerf_metadata meta;
   int status;
   int i;
+  uint64_t start;
   struct bladeRF_state *state = (struct bladeRF_state *) handle;
 
   count = MIN(count, state->params.bufsiz);
 
+  memset(&meta, 0, sizeof (struct bladerf_metadata));
+  meta.flags = BLADERF_META_FLAG_RX_NOW;
+
   status = bladerf_sync_rx(
       state->dev,
       state->buffer,
       count,
-      NULL,
+      &meta,
       5000);
 
   if (status != 0) {
@@ -375,21 +383,112 @@ rts_bladeRF_acquire(void *handle, RTSCOMPLEX *buffer, RTSCOUNT count)
         "BladeRF error: sync read error: %s\n", bladerf_strerror(status));
     return -1;
   }
+
+  /* Overrun: only what came before the discontinuity is returned */
+  if (meta.status & BLADERF_META_STATUS_OVERRUN) {
+    ++state->xruns;
+    count = MIN(count, meta.actual_count);
+  }
     /* Read OK. Transform samples */
+  start = rts_perf_begin();
+
   for (i = 0; i < count; ++i)
     buffer[i] =
         state->buffer[i << 1] / 2048.0
         + I * state->buffer[(i << 1) + 1] / 2048.0;
 
+  rts_perf_end(RTS_PERF_CONVERT, start);
+
   return count;
 }
 
+RTS_PRIVATE uint64_t
+rts_bladeRF_get_xruns(void *handle)
+{
+  return ((const struct bladeRF_state *) handle)->xruns;
+}
+
 RTS_PRIVATE void
 rts_bladeRF_close(void *handle)
 {
   bladeRF_state_destroy((struct bladeRF_state *) handle);
 }
 
+/* Tuning and gains can be changed without restarting the stream */
+RTS_PRIVATE RTSBOOL
+rts_bladeRF_set(
+    void *handle,
+    const char *key,
+    const char *value,
+    struct rts_signal_source_info *info)
+{
+  struct bladeRF_state *state = (struct bladeRF_state *) handle;
+  unsigned int actual_fc;
+  long long fc;
+  int gain;
+  int status;
+
+  if (strcmp(key, "fc") == 0) {
+    if (sscanf(value, "%lli", &fc) < 1 || fc <= 0) {
+      fprintf(stderr, "BladeRF error: wrong central frequency\n");
+      return RTS_FALSE;
+    }
+
+    status = bladerf_set_frequency(state->dev, BLADERF_MODULE_RX, fc);
+    if (status == 0)
+      status = bladerf_get_frequency(
+          state->dev,
+          BLADERF_MODULE_RX,
+          &actual_fc);
+
+    if (status != 0) {
+      fprintf(
+          stderr,
+          "BladeRF error: Cannot set frequency: %s\n",
+          bladerf_strerror(status));
+      return RTS_FALSE;
+    }
+
+    state->params.fc = fc;
+    state->fc = actual_fc;
+    info->freq = actual_fc;
+
+    return RTS_TRUE;
+  }
+
+  if (sscanf(value, "%i", &gain) < 1) {
+    fprintf(stderr, "BladeRF error: wrong value for `%s'\n", key);
+    return RTS_FALSE;
+  }
+
+  if (strcmp(key, "vga1") == 0) {
+    if ((status = bladerf_set_rxvga1(state->dev, gain)) != 0)
+      goto fail;
+    state->params.vga1 = gain;
+  } else if (strcmp(key, "vga2") == 0) {
+    if ((status = bladerf_set_rxvga2(state->dev, gain)) != 0)
+      goto fail;
+    state->params.vga2 = gain;
+  } else if (strcmp(key, "lna_gain") == 0) {
+    if ((status = bladerf_set_lna_gain(state->dev, gain)) != 0)
+      goto fail;
+    state->params.lnagain = gain;
+  } else {
+    return RTS_FALSE;
+  }
+
+  return RTS_TRUE;
+
+fail:
+  fprintf(
+      stderr,
+      "BladeRF error: Failed to set `%s': %s\n",
+      key,
+      bladerf_strerror(status));
+
+  return RTS_FALSE;
+}
+
 RTSBOOL
 rts_bladeRF_source_register(void)
 {
@@ -398,7 +497,9 @@ rts_bladeRF_source_register(void)
       .name = "bladerf",
       .open = rts_bladeRF_open,
       .acquire = rts_bladeRF_acquire,
-      .close = rts_bladeRF_close
+      .close = rts_bladeRF_close,
+      .set = rts_bladeRF_set,
+      .get_xruns = rts_bladeRF_get_xruns
   };
 
   RTS_TRYCATCH(rts_signal_source_register(&src), return RTS_FALSE);
@@ -26,6 +26,9 @@
 
 #include <libbladeRF.h>
 
+/* Buffers of the sync interface, each of bufsiz samples */
+#define BLADERF_SYNC_BUFFERS 16
+
 struct bladeRF_params {
   const char *serial;
   RTSCOUNT samp_rate;
@@ -55,6 +58,7 @@ struct bladeRF_state {
   uint64_t samp_rate; /* Actual sample rate */
   uint64_t fc; /* Actual frequency */
   int16_t *buffer; /* Must be SIGNED! */
+  uint64_t xruns; /* Reported in the metadata of the reads */
 };
 
 RTSBOOL rts_bladeRF_source_register(void);
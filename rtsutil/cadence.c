@@ -0,0 +1,207 @@
+/*
+  cadence.c: Several integration times from one stream of frames
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+
+#include "cadence.h"
+
+RTS_PRIVATE void
+rts_cadence_destroy(struct rts_cadence *cadence)
+{
+  if (cadence->sum != NULL)
+    free(cadence->sum);
+
+  free(cadence);
+}
+
+void
+rts_cadence_bank_destroy(rts_cadence_bank_t *bank)
+{
+  unsigned int i;
+
+  for (i = 0; i < bank->cadence_count; ++i)
+    if (bank->cadence_list[i] != NULL)
+      rts_cadence_destroy(bank->cadence_list[i]);
+
+  if (bank->cadence_list != NULL)
+    free(bank->cadence_list);
+
+  if (bank->snapshot != NULL)
+    free(bank->snapshot);
+
+  free(bank);
+}
+
+rts_cadence_bank_t *
+rts_cadence_bank_new(
+    RTSCOUNT bins,
+    RTSFLOAT frame_time,
+    rts_cadence_func_t func,
+    void *priv)
+{
+  rts_cadence_bank_t *new = NULL;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_cadence_bank_t)), goto fail);
+
+  new->bins       = bins;
+  new->frame_time = frame_time;
+  new->func       = func;
+  new->priv       = priv;
+
+  RTS_TRYCATCH(new->snapshot = calloc(bins, sizeof (RTSFLOAT)), goto fail);
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_cadence_bank_destroy(new);
+
+  return NULL;
+}
+
+int
+rts_cadence_bank_add(rts_cadence_bank_t *bank, RTSFLOAT avg_time)
+{
+  struct rts_cadence *new = NULL;
+  const struct rts_cadence *last = NULL;
+  RTSCOUNT unit = 1;
+  int index = -1;
+
+  if (bank->cadence_count > 0) {
+    last = bank->cadence_list[bank->cadence_count - 1];
+    unit = last->frames;
+  }
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (struct rts_cadence)), goto done);
+
+  /* Round to a whole number of periods of the previous cadence */
+  new->ratio = (RTSCOUNT) round(avg_time / (unit * bank->frame_time));
+
+  if (new->ratio < 1 || (last != NULL && new->ratio < 2)) {
+    fprintf(
+        stderr,
+        "cadence: %lg s is not longer than the previous cadence\n",
+        avg_time);
+    goto done;
+  }
+
+  new->frames   = new->ratio * unit;
+  new->avg_time = new->frames * bank->frame_time;
+
+  RTS_TRYCATCH(new->sum = calloc(bank->bins, sizeof (RTSFLOAT)), goto done);
+
+  RTS_TRYCATCH(
+      (index = PTR_LIST_APPEND_CHECK(bank->cadence, new)) != -1,
+      goto done);
+
+  new = NULL;
+
+done:
+  if (new != NULL)
+    rts_cadence_destroy(new);
+
+  return index;
+}
+
+/* Hand over a complete period and fold it into the next cadence */
+RTS_PRIVATE void
+rts_cadence_bank_complete(rts_cadence_bank_t *bank, unsigned int index)
+{
+  struct rts_cadence *cadence = bank->cadence_list[index];
+  struct rts_cadence *next;
+  struct timespec now;
+  RTSCOUNT i;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  ++cadence->completed;
+
+  if (bank->func != NULL)
+    (bank->func) (bank->priv, index, cadence, cadence->sum, &now);
+
+  if (index + 1 < bank->cadence_count) {
+    next = bank->cadence_list[index + 1];
+
+    for (i = 0; i < bank->bins; ++i)
+      next->sum[i] += cadence->sum[i];
+
+    next->xrun_count += cadence->xrun_count;
+
+    if (++next->count == next->ratio)
+      rts_cadence_bank_complete(bank, index + 1);
+  }
+
+  memset(cadence->sum, 0, bank->bins * sizeof (RTSFLOAT));
+  cadence->count = 0;
+  cadence->xrun_count = 0;
+}
+
+void
+rts_cadence_bank_frame(
+    rts_cadence_bank_t *bank,
+    const RTSFLOAT *cumulative,
+    RTSCOUNT xruns)
+{
+  struct rts_cadence *first;
+  RTSCOUNT i;
+
+  if (bank->cadence_count == 0)
+    return;
+
+  first = bank->cadence_list[0];
+
+  bank->xrun_count += xruns;
+
+  if (++bank->frame_count < first->frames)
+    return;
+
+  for (i = 0; i < bank->bins; ++i) {
+    first->sum[i] += cumulative[i] - bank->snapshot[i];
+    bank->snapshot[i] = cumulative[i];
+  }
+
+  first->xrun_count += bank->xrun_count;
+
+  bank->frame_count = 0;
+  bank->xrun_count = 0;
+
+  rts_cadence_bank_complete(bank, 0);
+}
+
+void
+rts_cadence_bank_restart(
+    rts_cadence_bank_t *bank,
+    const RTSFLOAT *cumulative)
+{
+  struct rts_cadence *first;
+  RTSCOUNT i;
+
+  if (bank->cadence_count == 0)
+    return;
+
+  first = bank->cadence_list[0];
+
+  /* Keep what was integrated since the last boundary */
+  for (i = 0; i < bank->bins; ++i)
+    first->sum[i] += cumulative[i] - bank->snapshot[i];
+
+  memset(bank->snapshot, 0, bank->bins * sizeof (RTSFLOAT));
+}
@@ -0,0 +1,106 @@
+/*
+  cadence.h: Several integration times from one stream of frames
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_CADENCE_H
+#define _RTSUTIL_CADENCE_H
+
+#include <time.h>
+
+#include "common.h"
+
+/*
+ * Cadences are kept in increasing order of integration time, and every
+ * period is a whole number of periods of the previous cadence. The
+ * shortest cadence is obtained as a difference of the cumulative
+ * spectrum of the main integrator (no extra work per frame) and every
+ * completed period is added to the next cadence only, so a cadence
+ * costs one vector add per period of the previous one.
+ */
+
+struct rts_cadence {
+  RTSFLOAT avg_time; /* Actual integration time, after rounding */
+  RTSCOUNT frames;   /* FFT frames per period */
+  RTSCOUNT ratio;    /* Periods of the previous cadence per period */
+  RTSCOUNT count;    /* Periods of the previous cadence folded so far */
+  RTSCOUNT completed;
+  RTSCOUNT xrun_count; /* Source overruns during the period */
+  RTSFLOAT *sum;
+};
+
+/* Called from the acquisition thread, spectrum is not normalized */
+typedef void (*rts_cadence_func_t) (
+    void *priv,
+    unsigned int index,
+    const struct rts_cadence *cadence,
+    const RTSFLOAT *spectrum,
+    const struct timespec *end);
+
+struct rts_cadence_bank {
+  RTSCOUNT bins;
+  RTSFLOAT frame_time;
+
+  RTSCOUNT frame_count; /* Frames since the last shortest period */
+  RTSCOUNT xrun_count;  /* Source overruns since then */
+  RTSFLOAT *snapshot;   /* Cumulative spectrum at that moment */
+
+  rts_cadence_func_t func;
+  void *priv;
+
+  PTR_LIST(struct rts_cadence, cadence);
+};
+
+typedef struct rts_cadence_bank rts_cadence_bank_t;
+
+rts_cadence_bank_t *rts_cadence_bank_new(
+    RTSCOUNT bins,
+    RTSFLOAT frame_time,
+    rts_cadence_func_t func,
+    void *priv);
+
+/* Returns the index of the new cadence, or -1 */
+int rts_cadence_bank_add(rts_cadence_bank_t *bank, RTSFLOAT avg_time);
+
+RTS_PRIVATE inline unsigned int
+rts_cadence_bank_get_count(const rts_cadence_bank_t *bank)
+{
+  return bank->cadence_count;
+}
+
+RTS_PRIVATE inline const struct rts_cadence *
+rts_cadence_bank_get(const rts_cadence_bank_t *bank, unsigned int index)
+{
+  return bank->cadence_list[index];
+}
+
+/* A frame was just added to `cumulative', xruns overruns ago */
+void rts_cadence_bank_frame(
+    rts_cadence_bank_t *bank,
+    const RTSFLOAT *cumulative,
+    RTSCOUNT xruns);
+
+/* `cumulative' is about to be reset to zero */
+void rts_cadence_bank_restart(
+    rts_cadence_bank_t *bank,
+    const RTSFLOAT *cumulative);
+
+void rts_cadence_bank_destroy(rts_cadence_bank_t *bank);
+
+#endif /* _RTSUTIL_CADENCE_H */
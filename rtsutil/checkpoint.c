@@ -0,0 +1,374 @@
+/*
+  checkpoint.c: Crash-safe snapshots of a partial integration
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "checkpoint.h"
+#include "perf.h"
+
+#define RTS_CHECKPOINT_DATA_OFFSET 128 /* Spectra, from the slot start */
+
+RTS_PRIVATE size_t
+rts_checkpoint_page_align(size_t size)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+
+  return ((size + page - 1) / page) * page;
+}
+
+/* FNV-1a, 64 bit words at a time */
+RTS_PRIVATE uint64_t
+rts_checkpoint_checksum(const struct rts_checkpoint_slot *slot, size_t size)
+{
+  const uint64_t *data = (const uint64_t *) &slot->frame_count;
+  size_t i, count = (size - offsetof(struct rts_checkpoint_slot, frame_count))
+      / sizeof (uint64_t);
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  for (i = 0; i < count; ++i)
+    hash = (hash ^ data[i]) * 0x100000001b3ull;
+
+  return hash;
+}
+
+RTS_PRIVATE double *
+rts_checkpoint_slot_data(const struct rts_checkpoint_slot *slot)
+{
+  return (double *) ((uint8_t *) slot + RTS_CHECKPOINT_DATA_OFFSET);
+}
+
+RTSBOOL
+rts_checkpoint_get_config(
+    const rts_spectrogram_t *spect,
+    struct rts_checkpoint_config *config)
+{
+  const rts_cadence_bank_t *bank = rts_spectrogram_get_cadences(spect);
+  unsigned int i;
+
+  memset(config, 0, sizeof (struct rts_checkpoint_config));
+
+  config->bins      = spect->params.bins;
+  config->frames    = spect->frames;
+  config->samp_rate = spect->handle->info.samp_rate;
+  config->window    = spect->params.window;
+  config->fc        = spect->handle->info.freq;
+  config->avg_time  = spect->params.avg_time;
+
+  if (bank != NULL) {
+    config->cadences = rts_cadence_bank_get_count(bank);
+    if (config->cadences > RTS_CHECKPOINT_MAX_CADENCES) {
+      fprintf(stderr, "checkpoint: too many cadences\n");
+      return RTS_FALSE;
+    }
+
+    for (i = 0; i < config->cadences; ++i)
+      config->cadence_frames[i] = rts_cadence_bank_get(bank, i)->frames;
+  }
+
+  return RTS_TRUE;
+}
+
+/* Valid bytes of a slot, cadence snapshot and sums included */
+RTS_PRIVATE size_t
+rts_checkpoint_data_size(const struct rts_checkpoint_config *config)
+{
+  size_t vectors = 1;
+
+  if (config->cadences > 0)
+    vectors += 1 + config->cadences;
+
+  return RTS_CHECKPOINT_DATA_OFFSET + vectors * config->bins * sizeof (double);
+}
+
+rts_checkpoint_t *
+rts_checkpoint_create(
+    const char *path,
+    const struct rts_checkpoint_config *config)
+{
+  rts_checkpoint_t *new = NULL;
+  struct rts_checkpoint_header *header;
+  struct stat sbuf;
+  size_t header_size, slot_size;
+  RTSBOOL keep;
+  void *map;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_checkpoint_t)), goto fail);
+
+  new->fd = -1;
+  new->data_size = rts_checkpoint_data_size(config);
+  header_size = rts_checkpoint_page_align(
+      sizeof (struct rts_checkpoint_header));
+  slot_size = rts_checkpoint_page_align(new->data_size);
+  new->size = header_size + 2 * slot_size;
+
+  if ((new->fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+    fprintf(stderr, "checkpoint: cannot open %s: %s\n", path, strerror(errno));
+    goto fail;
+  }
+
+  RTS_TRYCATCH(fstat(new->fd, &sbuf) != -1, goto fail);
+
+  keep = sbuf.st_size == new->size;
+
+  if (!keep)
+    RTS_TRYCATCH(ftruncate(new->fd, new->size) != -1, goto fail);
+
+  RTS_TRYCATCH(
+      (map = mmap(
+          NULL,
+          new->size,
+          PROT_READ | PROT_WRITE,
+          MAP_SHARED,
+          new->fd,
+          0)) != MAP_FAILED,
+      goto fail);
+
+  new->map = map;
+  new->header = header = map;
+  new->slot[0] = map + header_size;
+  new->slot[1] = map + header_size + slot_size;
+
+  if (keep)
+    keep = memcmp(header->magic, RTS_CHECKPOINT_MAGIC, sizeof (header->magic))
+           == 0
+        && header->version == RTS_CHECKPOINT_VERSION
+        && header->slot_size == slot_size
+        && memcmp(&header->config, config, sizeof (*config)) == 0;
+
+  if (!keep) {
+    if (sbuf.st_size > 0)
+      fprintf(stderr, "checkpoint: %s: configuration changed, discarded\n", path);
+
+    memset(map, 0, new->size);
+    memcpy(header->magic, RTS_CHECKPOINT_MAGIC, sizeof (header->magic));
+    header->version   = RTS_CHECKPOINT_VERSION;
+    header->slot_size = slot_size;
+    header->config    = *config;
+
+    RTS_TRYCATCH(msync(map, new->size, MS_SYNC) != -1, goto fail);
+  }
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_checkpoint_close(new);
+
+  return NULL;
+}
+
+rts_checkpoint_t *
+rts_checkpoint_open(const char *path, const rts_spectrogram_t *spect)
+{
+  struct rts_checkpoint_config config;
+
+  RTS_TRYCATCH(rts_checkpoint_get_config(spect, &config), return NULL);
+
+  return rts_checkpoint_create(path, &config);
+}
+
+RTS_PRIVATE RTSBOOL
+rts_checkpoint_slot_is_valid(
+    const rts_checkpoint_t *ckpt,
+    const struct rts_checkpoint_slot *slot)
+{
+  return slot->seq != 0
+      && slot->checksum == rts_checkpoint_checksum(slot, ckpt->data_size);
+}
+
+RTSBOOL
+rts_checkpoint_restore(rts_checkpoint_t *ckpt, rts_spectrogram_t *spect)
+{
+  const struct rts_checkpoint_slot *slot = NULL;
+  rts_spectrum_acc_t *acc = spect->acc;
+  rts_cadence_bank_t *bank = spect->cadences;
+  struct rts_cadence *cadence;
+  const double *data;
+  RTSCOUNT bins = spect->params.bins;
+  unsigned int i, j;
+
+  for (i = 0; i < 2; ++i)
+    if (rts_checkpoint_slot_is_valid(ckpt, ckpt->slot[i])
+        && (slot == NULL || ckpt->slot[i]->seq > slot->seq)) {
+      slot = ckpt->slot[i];
+      ckpt->last = i;
+    }
+
+  if (slot == NULL || slot->frame_count >= spect->frames)
+    return RTS_FALSE;
+
+  ckpt->seq = slot->seq;
+  data = rts_checkpoint_slot_data(slot);
+
+  for (j = 0; j < bins; ++j)
+    acc->spectrum[j] = data[j];
+  data += bins;
+
+  acc->frame_count   = slot->frame_count;
+  acc->got_samples   = slot->got_samples;
+  acc->reset_count   = slot->acc_reset_count;
+  acc->start.tv_sec  = slot->start_sec;
+  acc->start.tv_nsec = slot->start_nsec;
+  acc->min           = slot->min;
+  acc->max           = slot->max;
+  spect->reset_count = slot->reset_count;
+
+  if (bank != NULL) {
+    bank->frame_count = slot->cadence_frame_count;
+
+    for (j = 0; j < bins; ++j)
+      bank->snapshot[j] = data[j];
+    data += bins;
+
+    for (i = 0; i < rts_cadence_bank_get_count(bank); ++i) {
+      cadence = bank->cadence_list[i];
+      cadence->count     = slot->cadence_count[i];
+      cadence->completed = slot->cadence_completed[i];
+
+      for (j = 0; j < bins; ++j)
+        cadence->sum[j] = data[j];
+      data += bins;
+    }
+  }
+
+  return RTS_TRUE;
+}
+
+int
+rts_checkpoint_save(rts_checkpoint_t *ckpt, const rts_spectrogram_t *spect)
+{
+  struct rts_checkpoint_slot *slot;
+  const rts_spectrum_acc_t *acc = spect->acc;
+  const rts_cadence_bank_t *bank = spect->cadences;
+  const struct rts_cadence *cadence;
+  double *data;
+  RTSCOUNT bins = spect->params.bins;
+  unsigned int index = !ckpt->last;
+  unsigned int i, j;
+
+  /* Still being flushed: skip this one rather than wait */
+  if (__atomic_load_n(&ckpt->busy[index], __ATOMIC_ACQUIRE))
+    return -1;
+
+  slot = ckpt->slot[index];
+
+  /* Invalidate first, in case we crash halfway */
+  slot->seq = 0;
+
+  data = rts_checkpoint_slot_data(slot);
+  for (j = 0; j < bins; ++j)
+    data[j] = acc->spectrum[j];
+  data += bins;
+
+  slot->frame_count     = acc->frame_count;
+  slot->got_samples     = acc->got_samples;
+  slot->acc_reset_count = acc->reset_count;
+  slot->reset_count     = spect->reset_count;
+  slot->start_sec       = acc->start.tv_sec;
+  slot->start_nsec      = acc->start.tv_nsec;
+  slot->min             = acc->min;
+  slot->max             = acc->max;
+
+  if (bank != NULL) {
+    slot->cadence_frame_count = bank->frame_count;
+
+    for (j = 0; j < bins; ++j)
+      data[j] = bank->snapshot[j];
+    data += bins;
+
+    for (i = 0; i < rts_cadence_bank_get_count(bank); ++i) {
+      cadence = rts_cadence_bank_get(bank, i);
+      slot->cadence_count[i]     = cadence->count;
+      slot->cadence_completed[i] = cadence->completed;
+
+      for (j = 0; j < bins; ++j)
+        data[j] = cadence->sum[j];
+      data += bins;
+    }
+  }
+
+  slot->checksum = rts_checkpoint_checksum(slot, ckpt->data_size);
+  __atomic_store_n(&slot->seq, ++ckpt->seq, __ATOMIC_RELEASE);
+
+  ckpt->last = index;
+  __atomic_store_n(&ckpt->busy[index], 1, __ATOMIC_RELEASE);
+
+  return index;
+}
+
+void
+rts_checkpoint_invalidate(rts_checkpoint_t *ckpt)
+{
+  unsigned int i;
+
+  /* Flushes in progress may or may not take this along */
+  for (i = 0; i < 2; ++i)
+    __atomic_store_n(&ckpt->slot[i]->seq, 0, __ATOMIC_RELEASE);
+}
+
+void
+rts_checkpoint_wait(const rts_checkpoint_t *ckpt)
+{
+  while (__atomic_load_n(&ckpt->busy[0], __ATOMIC_ACQUIRE)
+      || __atomic_load_n(&ckpt->busy[1], __ATOMIC_ACQUIRE))
+    usleep(RTS_CHECKPOINT_WAIT_US);
+}
+
+RTSBOOL
+rts_checkpoint_sync(rts_checkpoint_t *ckpt, unsigned int slot)
+{
+  uint64_t start = rts_perf_begin();
+  RTSBOOL ok;
+
+  ok = msync(
+      ckpt->slot[slot],
+      rts_checkpoint_page_align(ckpt->data_size),
+      MS_SYNC) != -1;
+
+  rts_perf_end(RTS_PERF_WRITE, start);
+
+  if (!ok)
+    fprintf(stderr, "checkpoint: msync failed: %s\n", strerror(errno));
+
+  __atomic_store_n(&ckpt->busy[slot], 0, __ATOMIC_RELEASE);
+
+  return ok;
+}
+
+void
+rts_checkpoint_close(rts_checkpoint_t *ckpt)
+{
+  if (ckpt->map != NULL) {
+    (void) msync(ckpt->map, ckpt->size, MS_SYNC);
+    munmap(ckpt->map, ckpt->size);
+  }
+
+  if (ckpt->fd != -1)
+    close(ckpt->fd);
+
+  free(ckpt);
+}
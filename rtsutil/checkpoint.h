@@ -0,0 +1,138 @@
+/*
+  checkpoint.h: Crash-safe snapshots of a partial integration
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_CHECKPOINT_H
+#define _RTSUTIL_CHECKPOINT_H
+
+#include "spectrogram.h"
+
+/*
+ * The checkpoint file is mmap'ed and holds a header describing the
+ * acquisition configuration and two page-aligned slots. A save copies
+ * the integrator state into the slot that is not being flushed, stamps
+ * it with a checksum and an increasing sequence number, and leaves the
+ * msync() to whoever calls rts_checkpoint_sync() (i.e. a background
+ * thread). Restoring picks the newest slot with a valid checksum, so a
+ * crash in the middle of a save or a flush falls back to the previous
+ * one.
+ */
+
+#define RTS_CHECKPOINT_MAGIC         "RTSCKPT"
+#define RTS_CHECKPOINT_VERSION       1
+#define RTS_CHECKPOINT_MAX_CADENCES  8
+#define RTS_CHECKPOINT_WAIT_US       1000
+
+struct rts_checkpoint_config {
+  uint32_t bins;
+  uint32_t frames;
+  uint32_t samp_rate;
+  uint32_t window;
+  int64_t  fc;
+  double   avg_time;
+  uint32_t cadences;
+  uint32_t cadence_frames[RTS_CHECKPOINT_MAX_CADENCES];
+};
+
+struct rts_checkpoint_header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t slot_size;
+  struct rts_checkpoint_config config;
+};
+
+/* Followed by spectrum, cadence snapshot and cadence sums (doubles) */
+struct rts_checkpoint_slot {
+  uint64_t seq;      /* 0: never written */
+  uint64_t checksum; /* Of everything after this field */
+
+  uint32_t frame_count;
+  uint32_t got_samples;
+  uint32_t acc_reset_count;
+  uint32_t reset_count;
+  int64_t  start_sec;
+  uint32_t start_nsec;
+  uint32_t cadence_frame_count;
+  double   min;
+  double   max;
+
+  uint32_t cadence_count[RTS_CHECKPOINT_MAX_CADENCES];
+  uint32_t cadence_completed[RTS_CHECKPOINT_MAX_CADENCES];
+};
+
+struct rts_checkpoint {
+  int fd;
+  void *map;
+  size_t size;
+  size_t data_size; /* Valid bytes of a slot */
+  struct rts_checkpoint_header *header;
+  struct rts_checkpoint_slot *slot[2];
+  int busy[2];      /* Being flushed, accessed atomically */
+  unsigned int last;
+  uint64_t seq;
+};
+
+typedef struct rts_checkpoint rts_checkpoint_t;
+
+RTSBOOL rts_checkpoint_get_config(
+    const rts_spectrogram_t *spect,
+    struct rts_checkpoint_config *config);
+
+/*
+ * Same as rts_checkpoint_open(), from a configuration taken earlier:
+ * the spectrogram may be in use by another thread meanwhile.
+ */
+rts_checkpoint_t *rts_checkpoint_create(
+    const char *path,
+    const struct rts_checkpoint_config *config);
+
+/*
+ * Opens (or creates) the checkpoint file for this spectrogram. Extra
+ * cadences, if any, must be added before. A file with a different
+ * configuration is discarded.
+ */
+rts_checkpoint_t *rts_checkpoint_open(
+    const char *path,
+    const rts_spectrogram_t *spect);
+
+/* RTS_TRUE if a saved state was loaded into spect */
+RTSBOOL rts_checkpoint_restore(
+    rts_checkpoint_t *ckpt,
+    rts_spectrogram_t *spect);
+
+/* Slot that needs a flush, or -1 if both slots are busy */
+int rts_checkpoint_save(rts_checkpoint_t *ckpt, const rts_spectrogram_t *spect);
+
+/*
+ * Nothing is restored from this file any more, until the next save.
+ * For when the saved state cannot be replaced but must not come back
+ * (e.g. it was archived already).
+ */
+void rts_checkpoint_invalidate(rts_checkpoint_t *ckpt);
+
+/* Blocks until every slot saved so far has been flushed */
+void rts_checkpoint_wait(const rts_checkpoint_t *ckpt);
+
+/* Blocking flush of a slot. Thread safe. */
+RTSBOOL rts_checkpoint_sync(rts_checkpoint_t *ckpt, unsigned int slot);
+
+void rts_checkpoint_close(rts_checkpoint_t *ckpt);
+
+#endif /* _RTSUTIL_CHECKPOINT_H */
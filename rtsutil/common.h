@@ -80,4 +80,9 @@ typedef complex double RTSCOMPLEX;
 
 typedef uint32_t RTSCOUNT;
 
+enum rts_window_type {
+  RTS_WINDOW_RECTANGULAR = 0,
+  RTS_WINDOW_BLACKMANN_HARRIS
+};
+
 #endif /* _RTSUTIL_COMMON_H */
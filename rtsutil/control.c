@@ -0,0 +1,137 @@
+/*
+  control.c: Line-based control socket
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "control.h"
+#include "listener.h"
+
+RTS_PRIVATE void
+rts_control_serve(rts_control_t *ctl, int fd)
+{
+  char line[RTS_CONTROL_LINE_MAX];
+  char reply[RTS_CONTROL_REPLY_MAX];
+  size_t len = 0;
+  ssize_t got;
+  char *nl;
+
+  while (rts_listener_wait(&ctl->halt, fd, 0)) {
+    if ((got = read(fd, line + len, sizeof (line) - 1 - len)) <= 0)
+      break;
+
+    len += got;
+    line[len] = '\0';
+
+    while ((nl = strchr(line, '\n')) != NULL) {
+      *nl = '\0';
+      if (nl > line && nl[-1] == '\r')
+        nl[-1] = '\0';
+
+      reply[0] = '\0';
+      (ctl->func) (ctl->priv, line, reply, sizeof (reply) - 1);
+      strcat(reply, "\n");
+
+      if (write(fd, reply, strlen(reply)) == -1)
+        return;
+
+      len -= nl + 1 - line;
+      memmove(line, nl + 1, len + 1);
+    }
+
+    /* No room left for the newline */
+    if (len == sizeof (line) - 1) {
+      (void) write(fd, "error: line too long\n", 21);
+      return;
+    }
+  }
+}
+
+RTS_PRIVATE void *
+rts_control_thread(void *data)
+{
+  rts_control_t *ctl = (rts_control_t *) data;
+  int fd;
+
+  while (rts_listener_wait(&ctl->halt, ctl->fd, 0)) {
+    if ((fd = accept(ctl->fd, NULL, NULL)) == -1)
+      continue;
+
+    rts_control_serve(ctl, fd);
+
+    close(fd);
+  }
+
+  return NULL;
+}
+
+void
+rts_control_destroy(rts_control_t *ctl)
+{
+  if (ctl->thread_running) {
+    __atomic_store_n(&ctl->halt, 1, __ATOMIC_RELEASE);
+    pthread_join(ctl->thread, NULL);
+  }
+
+  if (ctl->fd != -1)
+    close(ctl->fd);
+
+  if (ctl->path != NULL) {
+    rts_listener_unlink(ctl->path);
+    free(ctl->path);
+  }
+
+  free(ctl);
+}
+
+rts_control_t *
+rts_control_new(const char *path, rts_control_func_t func, void *priv)
+{
+  rts_control_t *new = NULL;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_control_t)), goto fail);
+
+  new->fd   = -1;
+  new->func = func;
+  new->priv = priv;
+
+  if ((new->fd = rts_listener_bind_unix(path, "control")) == -1)
+    goto fail;
+
+  RTS_TRYCATCH(new->path = strdup(path), goto fail);
+
+  RTS_TRYCATCH(listen(new->fd, 1) != -1, goto fail);
+
+  RTS_TRYCATCH(
+      pthread_create(&new->thread, NULL, rts_control_thread, new) == 0,
+      goto fail);
+  new->thread_running = RTS_TRUE;
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_control_destroy(new);
+
+  return NULL;
+}
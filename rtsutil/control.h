@@ -0,0 +1,68 @@
+/*
+  control.h: Line-based control socket
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_CONTROL_H
+#define _RTSUTIL_CONTROL_H
+
+#include <pthread.h>
+
+#include "common.h"
+
+#define RTS_CONTROL_LINE_MAX  256
+#define RTS_CONTROL_REPLY_MAX 256
+
+/*
+ * Handles a command line (without the newline) and leaves a one-line
+ * answer in reply. Called from the control thread, one line at a time.
+ */
+typedef void (*rts_control_func_t) (
+    void *priv,
+    const char *line,
+    char *reply,
+    size_t size);
+
+/*
+ * Unix domain stream socket served by a thread of its own. Clients are
+ * served one at a time: send a line, read a line back.
+ */
+struct rts_control {
+  char *path;
+  int fd;
+
+  rts_control_func_t func;
+  void *priv;
+
+  pthread_t thread;
+  RTSBOOL thread_running;
+  int halt; /* Accessed atomically */
+};
+
+typedef struct rts_control rts_control_t;
+
+rts_control_t *rts_control_new(
+    const char *path,
+    rts_control_func_t func,
+    void *priv);
+
+/* Waits for the command being handled, if any */
+void rts_control_destroy(rts_control_t *ctl);
+
+#endif /* _RTSUTIL_CONTROL_H */
@@ -0,0 +1,236 @@
+/*
+  envelope.c: Per-column envelope of a spectrum
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+
+#include "envelope.h"
+
+#define RTS_ENVELOPE_FLOOR 1e-30 /* Avoid log10(0) */
+
+void
+rts_envelope_db(
+    const RTSFLOAT *spectrum,
+    RTSCOUNT bins,
+    RTSFLOAT scale,
+    float *lo,
+    float *hi,
+    unsigned int columns)
+{
+  RTSCOUNT half = bins / 2;
+  RTSCOUNT first, last;
+  RTSCOUNT i, p;
+  RTSFLOAT v, min, max;
+  unsigned int x;
+
+  for (x = 0; x < columns; ++x) {
+    first = (uint64_t) x * bins / columns;
+    last  = (uint64_t) (x + 1) * bins / columns;
+    if (last <= first)
+      last = first + 1;
+
+    /* Frequency order: bin i of the output is bin i + bins / 2 */
+    p = first + half;
+    if (p >= bins)
+      p -= bins;
+
+    min = max = spectrum[p];
+
+    for (i = first + 1; i < last; ++i) {
+      if (++p == bins)
+        p = 0;
+
+      v = spectrum[p];
+      if (v < min)
+        min = v;
+      if (v > max)
+        max = v;
+    }
+
+    lo[x] = 10 * log10(min * scale + RTS_ENVELOPE_FLOOR);
+    hi[x] = 10 * log10(max * scale + RTS_ENVELOPE_FLOOR);
+  }
+}
+
+void
+rts_envelope_pyramid_destroy(rts_envelope_pyramid_t *pyramid)
+{
+  if (pyramid->level != NULL)
+    free(pyramid->level);
+
+  if (pyramid->data != NULL)
+    free(pyramid->data);
+
+  free(pyramid);
+}
+
+rts_envelope_pyramid_t *
+rts_envelope_pyramid_new(RTSCOUNT bins)
+{
+  rts_envelope_pyramid_t *new = NULL;
+  size_t size;
+  RTSCOUNT n;
+  unsigned int i;
+
+  RTS_TRYCATCH(bins > 0, goto fail);
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_envelope_pyramid_t)), goto fail);
+
+  new->bins = bins;
+
+  for (n = bins; n > 0; n >>= 1)
+    ++new->levels;
+
+  RTS_TRYCATCH(
+      new->level = calloc(new->levels, sizeof (struct rts_envelope_level)),
+      goto fail);
+
+  /* Level 0 is stored once, coarser levels have three arrays */
+  size = bins;
+  for (n = bins >> 1; n > 0; n >>= 1)
+    size += 3 * n;
+
+  RTS_TRYCATCH(new->data = calloc(size, sizeof (RTSFLOAT)), goto fail);
+
+  new->level[0].bins = bins;
+  new->level[0].min  = new->data;
+  new->level[0].max  = new->data;
+  new->level[0].mean = new->data;
+
+  size = bins;
+  for (i = 1; i < new->levels; ++i) {
+    new->level[i].bins = new->level[i - 1].bins >> 1;
+    new->level[i].min  = new->data + size;
+    new->level[i].max  = new->level[i].min + new->level[i].bins;
+    new->level[i].mean = new->level[i].max + new->level[i].bins;
+    size += 3 * new->level[i].bins;
+  }
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_envelope_pyramid_destroy(new);
+
+  return NULL;
+}
+
+void
+rts_envelope_pyramid_update(
+    rts_envelope_pyramid_t *pyramid,
+    const RTSFLOAT *spectrum)
+{
+  const struct rts_envelope_level *prev;
+  struct rts_envelope_level *this;
+  RTSCOUNT half = pyramid->bins / 2;
+  RTSCOUNT i;
+  unsigned int k;
+
+  /* Frequency order: bin i of level 0 is bin i + bins / 2 */
+  memcpy(
+      pyramid->level[0].mean,
+      spectrum + half,
+      (pyramid->bins - half) * sizeof (RTSFLOAT));
+  memcpy(
+      pyramid->level[0].mean + pyramid->bins - half,
+      spectrum,
+      half * sizeof (RTSFLOAT));
+
+  for (k = 1; k < pyramid->levels; ++k) {
+    prev = &pyramid->level[k - 1];
+    this = &pyramid->level[k];
+
+    for (i = 0; i < this->bins; ++i) {
+      this->min[i] = prev->min[2 * i] < prev->min[2 * i + 1]
+          ? prev->min[2 * i]
+          : prev->min[2 * i + 1];
+      this->max[i] = prev->max[2 * i] > prev->max[2 * i + 1]
+          ? prev->max[2 * i]
+          : prev->max[2 * i + 1];
+      this->mean[i] = .5 * (prev->mean[2 * i] + prev->mean[2 * i + 1]);
+    }
+  }
+}
+
+void
+rts_envelope_pyramid_db(
+    const rts_envelope_pyramid_t *pyramid,
+    RTSFLOAT scale,
+    RTSFLOAT first,
+    RTSFLOAT last,
+    float *lo,
+    float *hi,
+    float *mean,
+    unsigned int columns)
+{
+  const struct rts_envelope_level *level;
+  RTSFLOAT width;
+  RTSFLOAT step;
+  RTSCOUNT a, b, i;
+  RTSFLOAT min, max, sum;
+  unsigned int k = 0;
+  unsigned int x;
+
+  if (first < 0)
+    first = 0;
+  if (last > pyramid->bins)
+    last = pyramid->bins;
+  if (last <= first)
+    last = first + 1;
+
+  width = (last - first) / columns;
+
+  /* Coarsest level with entries no wider than a column */
+  while (k + 1 < pyramid->levels && (RTSFLOAT) (2 << k) <= width)
+    ++k;
+
+  level = &pyramid->level[k];
+  step  = (RTSFLOAT) (1 << k);
+
+  for (x = 0; x < columns; ++x) {
+    a = (first + x * width) / step;
+    b = (first + (x + 1) * width) / step;
+
+    if (a >= level->bins)
+      a = level->bins - 1;
+    if (b > level->bins)
+      b = level->bins;
+    if (b <= a)
+      b = a + 1;
+
+    min = level->min[a];
+    max = level->max[a];
+    sum = level->mean[a];
+
+    for (i = a + 1; i < b; ++i) {
+      if (level->min[i] < min)
+        min = level->min[i];
+      if (level->max[i] > max)
+        max = level->max[i];
+      sum += level->mean[i];
+    }
+
+    lo[x] = 10 * log10(min * scale + RTS_ENVELOPE_FLOOR);
+    hi[x] = 10 * log10(max * scale + RTS_ENVELOPE_FLOOR);
+
+    if (mean != NULL)
+      mean[x] = 10 * log10(sum / (b - a) * scale + RTS_ENVELOPE_FLOOR);
+  }
+}
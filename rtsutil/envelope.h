@@ -0,0 +1,95 @@
+/*
+  envelope.h: Per-column envelope of a spectrum
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_ENVELOPE_H
+#define _RTSUTIL_ENVELOPE_H
+
+#include "common.h"
+
+/*
+ * Reduces an FFT-ordered spectrum (DC first) to `columns' pairs of
+ * minimum and maximum power, in dB, in frequency order (lowest
+ * frequency first). Every bin is multiplied by `scale' (i.e. 1 / frame
+ * count). The reduction is done on linear power, as min and max commute
+ * with the logarithm, so only two logarithms per column are computed
+ * whatever the number of bins.
+ *
+ * When there are fewer bins than columns, neighboring columns share
+ * bins.
+ */
+void rts_envelope_db(
+    const RTSFLOAT *spectrum,
+    RTSCOUNT bins,
+    RTSFLOAT scale,
+    float *lo,
+    float *hi,
+    unsigned int columns);
+
+/*
+ * Decimation pyramid of a spectrum, for views of part of the band.
+ * Level 0 is the spectrum in frequency order; level k has bins >> k
+ * entries, each one the minimum, maximum and mean of 2^k bins of
+ * level 0, still in linear power. An envelope of any window of the
+ * band is then read from the level whose entries are just narrower
+ * than a column, i.e. a handful of entries per column however many
+ * bins the window spans.
+ */
+struct rts_envelope_level {
+  RTSCOUNT bins;
+  RTSFLOAT *min;
+  RTSFLOAT *max;
+  RTSFLOAT *mean;
+};
+
+struct rts_envelope_pyramid {
+  RTSCOUNT bins;
+  unsigned int levels;
+  struct rts_envelope_level *level;
+  RTSFLOAT *data;
+};
+
+typedef struct rts_envelope_pyramid rts_envelope_pyramid_t;
+
+rts_envelope_pyramid_t *rts_envelope_pyramid_new(RTSCOUNT bins);
+
+void rts_envelope_pyramid_destroy(rts_envelope_pyramid_t *pyramid);
+
+/* Rebuilds every level from an FFT-ordered spectrum */
+void rts_envelope_pyramid_update(
+    rts_envelope_pyramid_t *pyramid,
+    const RTSFLOAT *spectrum);
+
+/*
+ * Same as rts_envelope_db, for the window from bin `first' to bin
+ * `last' (frequency order, fractional, last excluded). mean may be
+ * NULL.
+ */
+void rts_envelope_pyramid_db(
+    const rts_envelope_pyramid_t *pyramid,
+    RTSFLOAT scale,
+    RTSFLOAT first,
+    RTSFLOAT last,
+    float *lo,
+    float *hi,
+    float *mean,
+    unsigned int columns);
+
+#endif /* _RTSUTIL_ENVELOPE_H */
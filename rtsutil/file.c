@@ -25,6 +25,7 @@
 
 #include "param.h"
 #include "source.h"
+#include "perf.h"
 
 #define READ_BUF_MAX 1024
 
@@ -80,6 +81,7 @@ rts_file_acquire(void *handle, RTSCOMPLEX *buffer, RTSCOUNT count)
 {
   complex float samples[READ_BUF_MAX];
   RTSCOUNT got;
+  uint64_t start;
   unsigned int i;
 
   if (count > READ_BUF_MAX)
@@ -87,10 +89,15 @@ rts_file_acquire(void *handle, RTSCOMPLEX *buffer, RTSCOUNT count)
 
   got = fread(samples, sizeof (complex float), count, (FILE *) handle);
 
-  if (got > 0)
+  if (got > 0) {
+    start = rts_perf_begin();
+
     for (i = 0; i < got; ++i)
       buffer[i] = samples[i];
 
+    rts_perf_end(RTS_PERF_CONVERT, start);
+  }
+
   if (got >= 0 && got < count)
     fseek((FILE *) handle, 0, SEEK_SET);
 
@@ -103,6 +110,29 @@ rts_file_close(void *handle)
   fclose((FILE *) handle);
 }
 
+/* Recorded captures can only be relabeled */
+RTS_PRIVATE RTSBOOL
+rts_file_set(
+    void *handle,
+    const char *key,
+    const char *value,
+    struct rts_signal_source_info *info)
+{
+  long long fc;
+
+  if (strcmp(key, "fc") != 0)
+    return RTS_FALSE;
+
+  if (sscanf(value, "%lli", &fc) < 1) {
+    fprintf(stderr, "IQ file source: wrong central frequency\n");
+    return RTS_FALSE;
+  }
+
+  info->freq = fc;
+
+  return RTS_TRUE;
+}
+
 RTSBOOL
 rts_file_source_register(void)
 {
@@ -111,7 +141,8 @@ rts_file_source_register(void)
       .name = "file",
       .open = rts_file_open,
       .acquire = rts_file_acquire,
-      .close = rts_file_close
+      .close = rts_file_close,
+      .set = rts_file_set
   };
 
   RTS_TRYCATCH(rts_signal_source_register(&src), return RTS_FALSE);
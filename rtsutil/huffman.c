@@ -0,0 +1,228 @@
+/*
+  huffman.c: Canonical Huffman coding of byte buffers
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+
+#include "huffman.h"
+
+#define RTS_HUFFMAN_SYMBOLS 256
+
+struct rts_huffman_node {
+  uint32_t freq;
+  int parent;
+};
+
+/* Two-queue Huffman construction over the used symbols */
+RTS_PRIVATE unsigned int
+rts_huffman_build_lengths(const uint32_t *freq, uint8_t *lengths)
+{
+  struct rts_huffman_node node[2 * RTS_HUFFMAN_SYMBOLS];
+  int leaf[RTS_HUFFMAN_SYMBOLS];
+  int n = 0, next, q1 = 0, q2, pick[2];
+  int i, j, tmp, depth;
+  unsigned int max = 0;
+
+  memset(lengths, 0, RTS_HUFFMAN_SYMBOLS);
+
+  for (i = 0; i < RTS_HUFFMAN_SYMBOLS; ++i)
+    if (freq[i] > 0)
+      leaf[n++] = i;
+
+  if (n == 1) {
+    lengths[leaf[0]] = 1;
+    return 1;
+  }
+
+  /* Insertion sort of the leaves by frequency (n <= 256) */
+  for (i = 1; i < n; ++i)
+    for (j = i; j > 0 && freq[leaf[j - 1]] > freq[leaf[j]]; --j) {
+      tmp = leaf[j];
+      leaf[j] = leaf[j - 1];
+      leaf[j - 1] = tmp;
+    }
+
+  for (i = 0; i < n; ++i) {
+    node[i].freq = freq[leaf[i]];
+    node[i].parent = -1;
+  }
+
+  /* Internal nodes are created in non-decreasing frequency order */
+  next = q2 = n;
+  while (next < 2 * n - 1) {
+    for (j = 0; j < 2; ++j)
+      if (q1 < n && (q2 == next || node[q1].freq <= node[q2].freq))
+        pick[j] = q1++;
+      else
+        pick[j] = q2++;
+
+    node[next].freq = node[pick[0]].freq + node[pick[1]].freq;
+    node[next].parent = -1;
+    node[pick[0]].parent = node[pick[1]].parent = next;
+    ++next;
+  }
+
+  for (i = 0; i < n; ++i) {
+    for (depth = 0, j = i; node[j].parent != -1; j = node[j].parent)
+      ++depth;
+
+    lengths[leaf[i]] = depth;
+    if (depth > max)
+      max = depth;
+  }
+
+  return max;
+}
+
+/* Codes are assigned in (length, symbol) order */
+RTS_PRIVATE void
+rts_huffman_assign_codes(const uint8_t *lengths, uint16_t *codes)
+{
+  unsigned int count[RTS_HUFFMAN_MAX_BITS + 1];
+  unsigned int next[RTS_HUFFMAN_MAX_BITS + 1];
+  unsigned int code = 0;
+  int i;
+
+  memset(count, 0, sizeof (count));
+
+  for (i = 0; i < RTS_HUFFMAN_SYMBOLS; ++i)
+    ++count[lengths[i]];
+
+  count[0] = 0;
+  for (i = 1; i <= RTS_HUFFMAN_MAX_BITS; ++i) {
+    code = (code + count[i - 1]) << 1;
+    next[i] = code;
+  }
+
+  for (i = 0; i < RTS_HUFFMAN_SYMBOLS; ++i)
+    if (lengths[i] != 0)
+      codes[i] = next[lengths[i]]++;
+}
+
+size_t
+rts_huffman_encode(const uint8_t *in, size_t n, uint8_t *out)
+{
+  uint32_t freq[RTS_HUFFMAN_SYMBOLS];
+  uint8_t lengths[RTS_HUFFMAN_SYMBOLS];
+  uint16_t codes[RTS_HUFFMAN_SYMBOLS];
+  uint8_t *p = out + RTS_HUFFMAN_TABLE_SIZE;
+  uint32_t acc = 0;
+  int bits = 0;
+  size_t i;
+
+  memset(freq, 0, sizeof (freq));
+
+  for (i = 0; i < n; ++i)
+    ++freq[in[i]];
+
+  /* Flatten the distribution until the code fits */
+  while (rts_huffman_build_lengths(freq, lengths) > RTS_HUFFMAN_MAX_BITS)
+    for (i = 0; i < RTS_HUFFMAN_SYMBOLS; ++i)
+      if (freq[i] > 0)
+        freq[i] = (freq[i] + 1) >> 1;
+
+  rts_huffman_assign_codes(lengths, codes);
+
+  for (i = 0; i < RTS_HUFFMAN_TABLE_SIZE; ++i)
+    out[i] = lengths[2 * i] | (lengths[2 * i + 1] << 4);
+
+  for (i = 0; i < n; ++i) {
+    acc = (acc << lengths[in[i]]) | codes[in[i]];
+    bits += lengths[in[i]];
+
+    while (bits >= 8) {
+      bits -= 8;
+      *p++ = acc >> bits;
+    }
+  }
+
+  if (bits > 0)
+    *p++ = acc << (8 - bits);
+
+  return p - out;
+}
+
+RTSBOOL
+rts_huffman_decode(const uint8_t *in, size_t size, uint8_t *out, size_t n)
+{
+  uint8_t lengths[RTS_HUFFMAN_SYMBOLS];
+  uint16_t count[RTS_HUFFMAN_MAX_BITS + 1];
+  uint8_t sorted[RTS_HUFFMAN_SYMBOLS];
+  uint16_t offset[RTS_HUFFMAN_MAX_BITS + 1];
+  const uint8_t *end = in + size;
+  const uint8_t *p;
+  int code, first, index, len;
+  int bitpos = 0;
+  size_t i;
+
+  if (size < RTS_HUFFMAN_TABLE_SIZE)
+    return RTS_FALSE;
+
+  for (i = 0; i < RTS_HUFFMAN_TABLE_SIZE; ++i) {
+    lengths[2 * i]     = in[i] & 0xf;
+    lengths[2 * i + 1] = in[i] >> 4;
+  }
+
+  memset(count, 0, sizeof (count));
+  for (i = 0; i < RTS_HUFFMAN_SYMBOLS; ++i)
+    ++count[lengths[i]];
+  count[0] = 0;
+
+  offset[1] = 0;
+  for (len = 1; len < RTS_HUFFMAN_MAX_BITS; ++len)
+    offset[len + 1] = offset[len] + count[len];
+
+  for (i = 0; i < RTS_HUFFMAN_SYMBOLS; ++i)
+    if (lengths[i] != 0)
+      sorted[offset[lengths[i]]++] = i;
+
+  p = in + RTS_HUFFMAN_TABLE_SIZE;
+
+  /* Canonical decoding, one bit at a time */
+  for (i = 0; i < n; ++i) {
+    code = first = index = 0;
+
+    for (len = 1; len <= RTS_HUFFMAN_MAX_BITS; ++len) {
+      if (p >= end)
+        return RTS_FALSE;
+
+      code |= (*p >> (7 - bitpos)) & 1;
+      if (++bitpos == 8) {
+        bitpos = 0;
+        ++p;
+      }
+
+      if (code - count[len] < first)
+        break;
+
+      index += count[len];
+      first += count[len];
+      first <<= 1;
+      code  <<= 1;
+    }
+
+    if (len > RTS_HUFFMAN_MAX_BITS)
+      return RTS_FALSE;
+
+    out[i] = sorted[index + (code - first)];
+  }
+
+  return RTS_TRUE;
+}
@@ -0,0 +1,48 @@
+/*
+  huffman.h: Canonical Huffman coding of byte buffers
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_HUFFMAN_H
+#define _RTSUTIL_HUFFMAN_H
+
+#include "common.h"
+
+/*
+ * Encoded block: 128 bytes with the code length of each byte value
+ * (4 bits each, 0 = unused, low nibble first), followed by the codes
+ * MSB first. The number of symbols is not stored.
+ */
+
+#define RTS_HUFFMAN_MAX_BITS   15
+#define RTS_HUFFMAN_TABLE_SIZE 128
+
+#define RTS_HUFFMAN_BOUND(n) \
+  (RTS_HUFFMAN_TABLE_SIZE + ((size_t) (n) * RTS_HUFFMAN_MAX_BITS + 7) / 8)
+
+/* Returns the encoded size. `out' must hold RTS_HUFFMAN_BOUND(n) bytes. */
+size_t rts_huffman_encode(const uint8_t *in, size_t n, uint8_t *out);
+
+RTSBOOL rts_huffman_decode(
+    const uint8_t *in,
+    size_t size,
+    uint8_t *out,
+    size_t n);
+
+#endif /* _RTSUTIL_HUFFMAN_H */
@@ -0,0 +1,106 @@
+/*
+  listener.c: Unix domain sockets for the servers of rtsutil
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "listener.h"
+
+int
+rts_listener_bind_unix(const char *path, const char *who)
+{
+  struct sockaddr_un addr;
+  struct stat sbuf;
+  int fd = -1;
+
+  if (strlen(path) >= sizeof (addr.sun_path)) {
+    fprintf(stderr, "%s: socket path too long: %s\n", who, path);
+    goto fail;
+  }
+
+  if (lstat(path, &sbuf) == 0) {
+    if (!S_ISSOCK(sbuf.st_mode)) {
+      fprintf(stderr, "%s: %s exists and is not a socket\n", who, path);
+      goto fail;
+    }
+
+    /* Left behind by a previous run */
+    (void) unlink(path);
+  }
+
+  RTS_TRYCATCH((fd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1, goto fail);
+
+  memset(&addr, 0, sizeof (struct sockaddr_un));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if (bind(fd, (struct sockaddr *) &addr, sizeof (addr)) == -1) {
+    fprintf(stderr, "%s: cannot bind to %s: %s\n", who, path, strerror(errno));
+    goto fail;
+  }
+
+  return fd;
+
+fail:
+  if (fd != -1)
+    close(fd);
+
+  return -1;
+}
+
+void
+rts_listener_unlink(const char *path)
+{
+  struct stat sbuf;
+
+  if (lstat(path, &sbuf) == 0 && S_ISSOCK(sbuf.st_mode))
+    (void) unlink(path);
+}
+
+RTSBOOL
+rts_listener_wait(const int *halt, int fd, int timeout_ms)
+{
+  struct pollfd pfd;
+  int waited = 0;
+  int ret;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+
+  while (!__atomic_load_n(halt, __ATOMIC_ACQUIRE)) {
+    if ((ret = poll(&pfd, 1, RTS_LISTENER_POLL_MS)) > 0)
+      return RTS_TRUE;
+
+    if (ret == -1 && errno != EINTR)
+      return RTS_FALSE;
+
+    if (timeout_ms > 0 && (waited += RTS_LISTENER_POLL_MS) >= timeout_ms)
+      return RTS_FALSE;
+  }
+
+  return RTS_FALSE;
+}
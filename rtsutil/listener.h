@@ -0,0 +1,46 @@
+/*
+  listener.h: Unix domain sockets for the servers of rtsutil
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_LISTENER_H
+#define _RTSUTIL_LISTENER_H
+
+#include "common.h"
+
+#define RTS_LISTENER_POLL_MS 200 /* Halt latency */
+
+/*
+ * Stream socket bound to the Unix domain path, not listening yet, or -1.
+ * A socket already at path is taken to be left behind by a previous run
+ * and replaced. Anything else at path is left alone and fails the bind.
+ * Errors are reported on stderr, prefixed by who.
+ */
+int rts_listener_bind_unix(const char *path, const char *who);
+
+/* Removes path, as long as it is still a socket */
+void rts_listener_unlink(const char *path);
+
+/*
+ * RTS_TRUE when fd is readable. RTS_FALSE once *halt is set (it is read
+ * atomically), on error, or after timeout_ms unless that is 0.
+ */
+RTSBOOL rts_listener_wait(const int *halt, int fd, int timeout_ms);
+
+#endif /* _RTSUTIL_LISTENER_H */
@@ -0,0 +1,131 @@
+/*
+  margin.c: Real-time margin of the acquisition loop
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+#include <time.h>
+
+#include "margin.h"
+
+#define RTS_MARGIN_NS 1000000000ull
+
+RTS_PRIVATE uint64_t
+rts_margin_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * RTS_MARGIN_NS + ts.tv_nsec;
+}
+
+void
+rts_margin_init(rts_margin_t *margin)
+{
+  memset(margin, 0, sizeof (rts_margin_t));
+}
+
+RTS_PRIVATE void
+rts_margin_start(
+    rts_margin_t *margin,
+    const struct rts_signal_source_info *info,
+    uint64_t now)
+{
+  rts_margin_init(margin);
+
+  margin->samp_rate      = info->samp_rate;
+  margin->buffer_size    = info->buffer_size;
+  margin->origin         = now;
+  margin->window_start   = now;
+  margin->baseline_start = now;
+}
+
+void
+rts_margin_update(
+    rts_margin_t *margin,
+    const struct rts_signal_source_info *info,
+    RTSCOUNT got)
+{
+  uint64_t now = rts_margin_now();
+  int64_t expected;
+  int64_t raw;
+  int64_t base;
+
+  /* Samples of the first frame were produced before the origin */
+  if (margin->origin == 0 || margin->samp_rate != info->samp_rate) {
+    rts_margin_start(margin, info, now);
+    return;
+  }
+
+  margin->buffer_size     = info->buffer_size;
+  margin->processed      += got;
+  margin->window_samples += got;
+
+  expected = (int64_t)
+      ((RTSFLOAT) (now - margin->origin) * margin->samp_rate / RTS_MARGIN_NS);
+  raw = expected - (int64_t) margin->processed;
+
+  if (now - margin->baseline_start
+      >= (uint64_t) (RTS_MARGIN_BASELINE * RTS_MARGIN_NS)) {
+    margin->baseline[0]    = margin->baseline[1];
+    margin->baseline[1]    = raw;
+    margin->baseline_start = now;
+  } else if (raw < margin->baseline[1]) {
+    margin->baseline[1] = raw;
+  }
+
+  base = MIN(margin->baseline[0], margin->baseline[1]);
+
+  margin->lag  = raw > base ? raw - base : 0;
+  margin->fill = margin->buffer_size > 0
+      ? (RTSFLOAT) margin->lag / margin->buffer_size
+      : 0;
+
+  if (now - margin->window_start
+      >= (uint64_t) (RTS_MARGIN_WINDOW * RTS_MARGIN_NS)) {
+    margin->rtf = margin->window_samples
+        / ((RTSFLOAT) (now - margin->window_start)
+            * margin->samp_rate / RTS_MARGIN_NS);
+
+    margin->window_start   = now;
+    margin->window_samples = 0;
+  }
+}
+
+void
+rts_margin_stats_reset(struct rts_margin_stats *stats)
+{
+  memset(stats, 0, sizeof (struct rts_margin_stats));
+}
+
+void
+rts_margin_stats_update(
+    struct rts_margin_stats *stats,
+    const rts_margin_t *margin)
+{
+  if (margin->rtf > 0 && (stats->rtf_min == 0 || margin->rtf < stats->rtf_min))
+    stats->rtf_min = margin->rtf;
+
+  if (margin->lag > stats->lag_max)
+    stats->lag_max = margin->lag;
+
+  if (margin->fill > stats->fill_max)
+    stats->fill_max = margin->fill;
+}
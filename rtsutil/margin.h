@@ -0,0 +1,96 @@
+/*
+  margin.h: Real-time margin of the acquisition loop
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_MARGIN_H
+#define _RTSUTIL_MARGIN_H
+
+#include "source.h"
+
+/*
+ * Samples processed are compared once per FFT frame against the
+ * samples a source running at samp_rate must have produced since the
+ * first frame, by the monotonic clock:
+ *
+ *   rtf:  processed over produced in the last RTS_MARGIN_WINDOW
+ *         seconds. About 1 while a live source is kept up with, higher
+ *         for sources that run ahead of real time (files).
+ *   lag:  samples produced but not processed yet, which must be
+ *         waiting in the source buffers. Measured against the lowest
+ *         lag of the last two RTS_MARGIN_BASELINE periods, so that the
+ *         drift between the clock of the source and ours and whatever
+ *         the source buffered before the first frame do not count.
+ *   fill: lag over the buffer size of the source, if known. An overrun
+ *         is near as it approaches 1.
+ */
+
+#define RTS_MARGIN_WINDOW   1.    /* Seconds */
+#define RTS_MARGIN_BASELINE 60.   /* Seconds */
+#define RTS_MARGIN_WARN     .5    /* Fill */
+
+struct rts_margin {
+  unsigned int samp_rate;
+  RTSCOUNT buffer_size;
+
+  uint64_t origin;    /* Monotonic ns of the first frame, 0 before it */
+  uint64_t processed; /* Samples since origin */
+
+  uint64_t window_start;
+  uint64_t window_samples;
+
+  uint64_t baseline_start;
+  int64_t  baseline[2]; /* Lowest raw lag, previous and current period */
+
+  RTSFLOAT rtf; /* 0 until the first window completes */
+  RTSCOUNT lag;
+  RTSFLOAT fill;
+};
+
+typedef struct rts_margin rts_margin_t;
+
+/* Worst values over an integration */
+struct rts_margin_stats {
+  RTSFLOAT rtf_min;   /* 0 if no window completed */
+  RTSCOUNT lag_max;
+  RTSFLOAT fill_max;
+  RTSCOUNT queue_max; /* Of the writer thread, filled by the application */
+};
+
+void rts_margin_init(rts_margin_t *margin);
+
+/* got: samples of the frame just completed */
+void rts_margin_update(
+    rts_margin_t *margin,
+    const struct rts_signal_source_info *info,
+    RTSCOUNT got);
+
+void rts_margin_stats_reset(struct rts_margin_stats *stats);
+
+void rts_margin_stats_update(
+    struct rts_margin_stats *stats,
+    const rts_margin_t *margin);
+
+RTS_PRIVATE inline RTSBOOL
+rts_margin_is_critical(const rts_margin_t *margin)
+{
+  return margin->fill >= RTS_MARGIN_WARN;
+}
+
+#endif /* _RTSUTIL_MARGIN_H */
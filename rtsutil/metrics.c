@@ -0,0 +1,302 @@
+/*
+  metrics.c: Engine counters and gauges, exported in Prometheus format
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE /* SCHED_IDLE */
+#endif /* _GNU_SOURCE */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+#include "listener.h"
+#include "perf.h"
+
+#define RTS_METRICS_REQUEST_MAX 1024
+
+uint64_t rts_metrics[RTS_METRIC_COUNT];
+
+struct rts_metric_desc {
+  const char *name;
+  RTSBOOL counter;
+  const char *help;
+};
+
+static const struct rts_metric_desc rts_metric_descs[RTS_METRIC_COUNT] = {
+  {"samples_total", RTS_TRUE, "Samples processed"},
+  {"frames_total", RTS_TRUE, "FFT frames processed"},
+  {"integrations_total", RTS_TRUE, "Integrations completed"},
+  {"drops_total", RTS_TRUE, "Integrations lost before reaching the archive"},
+  {"xruns_total", RTS_TRUE, "Overruns reported by the source"},
+  {"real_time_factor", RTS_FALSE, "Samples processed over samples produced"},
+  {"lag_seconds", RTS_FALSE, "Samples waiting in the source, in seconds"},
+  {"source_buffer_fill", RTS_FALSE, "Fraction of the source buffers in use"},
+  {"writer_queue_jobs", RTS_FALSE, "Peak of pending writer jobs"},
+  {"integration_progress", RTS_FALSE, "Fraction of the current integration"},
+  {"noise_floor_db", RTS_FALSE, "Median power of the last integration"},
+  {"sample_rate_hertz", RTS_FALSE, "Sample rate of the source"}
+};
+
+const char *
+rts_metric_name(enum rts_metric metric)
+{
+  return rts_metric_descs[metric].name;
+}
+
+RTS_PRIVATE void
+rts_metrics_write_hist(FILE *fp, const char *ns)
+{
+  rts_perf_hist_t hist;
+  uint64_t cumulative;
+  unsigned int i, j;
+
+  fprintf(fp, "# HELP %s_stage_seconds Latency of the hot path stages\n", ns);
+  fprintf(fp, "# TYPE %s_stage_seconds histogram\n", ns);
+
+  for (i = 0; i < RTS_PERF_STAGE_COUNT; ++i) {
+    rts_perf_get(i, &hist);
+
+    /* Bucket j ends at 2^j ns, the last one is open */
+    cumulative = 0;
+    for (j = 0; j < RTS_PERF_BUCKETS - 1; ++j) {
+      cumulative += hist.bucket[j];
+      fprintf(
+          fp,
+          "%s_stage_seconds_bucket{stage=\"%s\",le=\"%.9g\"} %llu\n",
+          ns,
+          rts_perf_stage_name(i),
+          (double) (1ull << j) * 1e-9,
+          (unsigned long long) cumulative);
+    }
+
+    fprintf(
+        fp,
+        "%s_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n"
+        "%s_stage_seconds_sum{stage=\"%s\"} %.9g\n"
+        "%s_stage_seconds_count{stage=\"%s\"} %llu\n",
+        ns,
+        rts_perf_stage_name(i),
+        (unsigned long long) hist.count,
+        ns,
+        rts_perf_stage_name(i),
+        hist.ns_total * 1e-9,
+        ns,
+        rts_perf_stage_name(i),
+        (unsigned long long) hist.count);
+  }
+}
+
+void
+rts_metrics_write(FILE *fp, const char *ns)
+{
+  const struct rts_metric_desc *desc;
+  uint64_t bits;
+  double value;
+  unsigned int i;
+
+  for (i = 0; i < RTS_METRIC_COUNT; ++i) {
+    desc = &rts_metric_descs[i];
+    bits = __atomic_load_n(&rts_metrics[i], __ATOMIC_RELAXED);
+
+    fprintf(fp, "# HELP %s_%s %s\n", ns, desc->name, desc->help);
+    fprintf(
+        fp,
+        "# TYPE %s_%s %s\n",
+        ns,
+        desc->name,
+        desc->counter ? "counter" : "gauge");
+
+    if (desc->counter) {
+      fprintf(fp, "%s_%s %llu\n", ns, desc->name, (unsigned long long) bits);
+    } else {
+      memcpy(&value, &bits, sizeof (value));
+      fprintf(fp, "%s_%s %.9g\n", ns, desc->name, value);
+    }
+  }
+
+  if (rts_perf_enabled())
+    rts_metrics_write_hist(fp, ns);
+}
+
+RTS_PRIVATE void
+rts_metrics_serve(rts_metrics_server_t *server, int fd)
+{
+  static const char header[] =
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Connection: close\r\n"
+      "\r\n";
+  char request[RTS_METRICS_REQUEST_MAX];
+  char *body = NULL;
+  size_t body_size = 0;
+  size_t len = 0;
+  ssize_t got;
+  FILE *fp;
+
+  /* Whatever was asked for, once the headers are in */
+  do {
+    if (!rts_listener_wait(&server->halt, fd, RTS_METRICS_REQUEST_MS))
+      return;
+
+    if ((got = read(fd, request + len, sizeof (request) - 1 - len)) <= 0)
+      return;
+
+    len += got;
+    request[len] = '\0';
+  } while (strstr(request, "\r\n\r\n") == NULL
+      && strstr(request, "\n\n") == NULL
+      && len < sizeof (request) - 1);
+
+  if ((fp = open_memstream(&body, &body_size)) == NULL)
+    return;
+
+  rts_metrics_write(fp, server->ns);
+
+  if (fclose(fp) == 0
+      && send(fd, header, sizeof (header) - 1, MSG_NOSIGNAL) != -1)
+    (void) send(fd, body, body_size, MSG_NOSIGNAL);
+
+  free(body);
+}
+
+RTS_PRIVATE void *
+rts_metrics_thread(void *data)
+{
+  rts_metrics_server_t *server = (rts_metrics_server_t *) data;
+#ifdef SCHED_IDLE
+  struct sched_param param;
+#endif /* SCHED_IDLE */
+  int fd;
+
+#ifdef SCHED_IDLE
+  /* Scrapes only get the CPU time nobody else wants */
+  memset(&param, 0, sizeof (struct sched_param));
+  (void) pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif /* SCHED_IDLE */
+
+  while (rts_listener_wait(&server->halt, server->fd, 0)) {
+    if ((fd = accept(server->fd, NULL, NULL)) == -1)
+      continue;
+
+    rts_metrics_serve(server, fd);
+
+    close(fd);
+  }
+
+  return NULL;
+}
+
+void
+rts_metrics_server_destroy(rts_metrics_server_t *server)
+{
+  if (server->thread_running) {
+    __atomic_store_n(&server->halt, 1, __ATOMIC_RELEASE);
+    pthread_join(server->thread, NULL);
+  }
+
+  if (server->fd != -1)
+    close(server->fd);
+
+  if (server->path != NULL) {
+    rts_listener_unlink(server->path);
+    free(server->path);
+  }
+
+  if (server->ns != NULL)
+    free(server->ns);
+
+  free(server);
+}
+
+RTS_PRIVATE RTSBOOL
+rts_metrics_server_bind_tcp(rts_metrics_server_t *server, unsigned int port)
+{
+  struct sockaddr_in addr;
+  int one = 1;
+
+  RTS_TRYCATCH(port > 0 && port < 65536, return RTS_FALSE);
+
+  RTS_TRYCATCH(
+      (server->fd = socket(AF_INET, SOCK_STREAM, 0)) != -1,
+      return RTS_FALSE);
+
+  (void) setsockopt(server->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+
+  memset(&addr, 0, sizeof (struct sockaddr_in));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (bind(server->fd, (struct sockaddr *) &addr, sizeof (addr)) == -1) {
+    fprintf(
+        stderr,
+        "metrics: cannot bind to port %u: %s\n",
+        port,
+        strerror(errno));
+    return RTS_FALSE;
+  }
+
+  return RTS_TRUE;
+}
+
+rts_metrics_server_t *
+rts_metrics_server_new(const char *addr, const char *ns)
+{
+  rts_metrics_server_t *new = NULL;
+  unsigned int port;
+  char extra;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_metrics_server_t)), goto fail);
+
+  new->fd = -1;
+
+  RTS_TRYCATCH(new->ns = strdup(ns), goto fail);
+
+  if (sscanf(addr, "%u%c", &port, &extra) == 1) {
+    RTS_TRYCATCH(rts_metrics_server_bind_tcp(new, port), goto fail);
+  } else {
+    if ((new->fd = rts_listener_bind_unix(addr, "metrics")) == -1)
+      goto fail;
+
+    RTS_TRYCATCH(new->path = strdup(addr), goto fail);
+  }
+
+  RTS_TRYCATCH(listen(new->fd, 4) != -1, goto fail);
+
+  RTS_TRYCATCH(
+      pthread_create(&new->thread, NULL, rts_metrics_thread, new) == 0,
+      goto fail);
+  new->thread_running = RTS_TRUE;
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_metrics_server_destroy(new);
+
+  return NULL;
+}
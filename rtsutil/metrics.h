@@ -0,0 +1,98 @@
+/*
+  metrics.h: Engine counters and gauges, exported in Prometheus format
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_METRICS_H
+#define _RTSUTIL_METRICS_H
+
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+
+#define RTS_METRICS_REQUEST_MS 1000 /* Slow clients are dropped */
+
+/*
+ * Written from any thread with relaxed atomic stores, never a lock:
+ * a scrape may see a counter one update behind another. Gauges hold
+ * the bits of a double.
+ */
+enum rts_metric {
+  RTS_METRIC_SAMPLES,      /* Counters */
+  RTS_METRIC_FRAMES,
+  RTS_METRIC_INTEGRATIONS,
+  RTS_METRIC_DROPS,        /* Integrations lost on the way to disk */
+  RTS_METRIC_XRUNS,        /* Overruns reported by the source */
+  RTS_METRIC_RTF,          /* Gauges */
+  RTS_METRIC_LAG,          /* Seconds */
+  RTS_METRIC_FILL,
+  RTS_METRIC_QUEUE,
+  RTS_METRIC_PROGRESS,
+  RTS_METRIC_NOISE_FLOOR,  /* dB, of the last complete integration */
+  RTS_METRIC_SAMP_RATE,
+  RTS_METRIC_COUNT
+};
+
+extern uint64_t rts_metrics[RTS_METRIC_COUNT];
+
+RTS_PRIVATE inline void
+rts_metrics_add(enum rts_metric metric, uint64_t n)
+{
+  __atomic_fetch_add(&rts_metrics[metric], n, __ATOMIC_RELAXED);
+}
+
+RTS_PRIVATE inline void
+rts_metrics_set(enum rts_metric metric, double value)
+{
+  uint64_t bits;
+
+  memcpy(&bits, &value, sizeof (bits));
+
+  __atomic_store_n(&rts_metrics[metric], bits, __ATOMIC_RELAXED);
+}
+
+const char *rts_metric_name(enum rts_metric metric);
+
+/*
+ * HTTP served by a low priority thread of its own, one client at a
+ * time: every request gets the text exposition format, whatever the
+ * path. addr is either the path of a Unix domain socket or a TCP port,
+ * bound to the loopback interface only. Names get the `ns' prefix.
+ */
+struct rts_metrics_server {
+  char *path; /* Unix domain sockets only */
+  char *ns;
+  int fd;
+
+  pthread_t thread;
+  RTSBOOL thread_running;
+  int halt; /* Accessed atomically */
+};
+
+typedef struct rts_metrics_server rts_metrics_server_t;
+
+rts_metrics_server_t *rts_metrics_server_new(const char *addr, const char *ns);
+
+void rts_metrics_server_destroy(rts_metrics_server_t *server);
+
+/* Full exposition, histograms of the perf stages included */
+void rts_metrics_write(FILE *fp, const char *ns);
+
+#endif /* _RTSUTIL_METRICS_H */
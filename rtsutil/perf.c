@@ -0,0 +1,181 @@
+/*
+  perf.c: Hot path latency histograms
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "perf.h"
+
+rts_perf_hist_t rts_perf_hist[RTS_PERF_STAGE_COUNT];
+
+static const char *rts_perf_stage_names[RTS_PERF_STAGE_COUNT] = {
+  "src", "cvt", "win", "fft", "acc", "pub", "ckpt", "draw", "dump", "io",
+  "png"
+};
+
+const char *
+rts_perf_stage_name(enum rts_perf_stage stage)
+{
+  return rts_perf_stage_names[stage];
+}
+
+void
+rts_perf_get(enum rts_perf_stage stage, rts_perf_hist_t *hist)
+{
+  const rts_perf_hist_t *src = &rts_perf_hist[stage];
+  unsigned int i;
+
+  hist->count    = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+  hist->ns_total = __atomic_load_n(&src->ns_total, __ATOMIC_RELAXED);
+  hist->ns_max   = __atomic_load_n(&src->ns_max, __ATOMIC_RELAXED);
+
+  for (i = 0; i < RTS_PERF_BUCKETS; ++i)
+    hist->bucket[i] = __atomic_load_n(&src->bucket[i], __ATOMIC_RELAXED);
+}
+
+uint64_t
+rts_perf_hist_percentile(const rts_perf_hist_t *hist, RTSFLOAT p)
+{
+  uint64_t target = ceil(p * hist->count);
+  uint64_t acc = 0;
+  uint64_t bound;
+  unsigned int i;
+
+  for (i = 0; i < RTS_PERF_BUCKETS - 1; ++i) {
+    if ((acc += hist->bucket[i]) >= target && acc > 0)
+      break;
+  }
+
+  /* Never beyond what was actually seen */
+  bound = i == 0 ? 0 : 1ull << i;
+
+  return bound < hist->ns_max ? bound : hist->ns_max;
+}
+
+/* Three significant digits and a one-letter unit: 850n, 12.3u, 1.2m */
+RTS_PRIVATE void
+rts_perf_format_ns(char *buf, size_t size, uint64_t ns)
+{
+  if (ns < 1000)
+    snprintf(buf, size, "%un", (unsigned int) ns);
+  else if (ns < 1000000)
+    snprintf(buf, size, "%.3gu", ns * 1e-3);
+  else if (ns < 1000000000)
+    snprintf(buf, size, "%.3gm", ns * 1e-6);
+  else
+    snprintf(buf, size, "%.3gs", ns * 1e-9);
+}
+
+void
+rts_perf_format_line(char *buf, size_t size)
+{
+  rts_perf_hist_t hist;
+  char p99[16], max[16];
+  size_t len;
+  unsigned int i;
+
+  len = snprintf(buf, size, "p99/max:");
+
+  for (i = 0; i < RTS_PERF_STAGE_COUNT && len < size; ++i) {
+    rts_perf_get(i, &hist);
+
+    /* Stages that do not run in this setup */
+    if (hist.count == 0)
+      continue;
+
+    rts_perf_format_ns(p99, sizeof (p99), rts_perf_hist_percentile(&hist, .99));
+    rts_perf_format_ns(max, sizeof (max), hist.ns_max);
+
+    len += snprintf(
+        buf + len,
+        size - len,
+        " %s %s/%s",
+        rts_perf_stage_names[i],
+        p99,
+        max);
+  }
+}
+
+/*
+ * One line per stage, as space-separated key=value pairs, counting
+ * from program start. The file is written aside and renamed, so
+ * readers never see it half written.
+ */
+RTSBOOL
+rts_perf_dump(const char *path)
+{
+  rts_perf_hist_t hist;
+  char *tmp = NULL;
+  FILE *fp = NULL;
+  unsigned int i, j;
+  RTSBOOL ok = RTS_FALSE;
+
+  RTS_TRYCATCH(tmp = strbuild("%s.tmp", path), goto done);
+  RTS_TRYCATCH(fp = fopen(tmp, "w"), goto done);
+
+  fprintf(
+      fp,
+      "# Latency histograms since start: bucket k counts calls of\n"
+      "# 2^(k-1) to 2^k ns, bucket 0 calls under 1 ns\n"
+      "time=%lld buckets=%u\n",
+      (long long) time(NULL),
+      RTS_PERF_BUCKETS);
+
+  for (i = 0; i < RTS_PERF_STAGE_COUNT; ++i) {
+    rts_perf_get(i, &hist);
+
+    fprintf(
+        fp,
+        "stage=%s count=%llu total_ns=%llu max_ns=%llu p50_ns=%llu "
+        "p99_ns=%llu hist=",
+        rts_perf_stage_names[i],
+        (unsigned long long) hist.count,
+        (unsigned long long) hist.ns_total,
+        (unsigned long long) hist.ns_max,
+        (unsigned long long) rts_perf_hist_percentile(&hist, .5),
+        (unsigned long long) rts_perf_hist_percentile(&hist, .99));
+
+    for (j = 0; j < RTS_PERF_BUCKETS; ++j)
+      fprintf(
+          fp,
+          "%s%llu",
+          j > 0 ? "," : "",
+          (unsigned long long) hist.bucket[j]);
+
+    fputc('\n', fp);
+  }
+
+  RTS_TRYCATCH(fclose(fp) == 0, fp = NULL; goto done);
+  fp = NULL;
+
+  RTS_TRYCATCH(rename(tmp, path) == 0, goto done);
+
+  ok = RTS_TRUE;
+
+done:
+  if (fp != NULL)
+    fclose(fp);
+
+  if (tmp != NULL)
+    free(tmp);
+
+  return ok;
+}
@@ -0,0 +1,151 @@
+/*
+  perf.h: Hot path latency histograms
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_PERF_H
+#define _RTSUTIL_PERF_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "common.h"
+#include "trace.h"
+
+/*
+ * Timing of the hot path. Build with -DRTS_PERF=0 (configure
+ * --disable-perf) to compile every measurement out.
+ */
+#ifndef RTS_PERF
+#  define RTS_PERF 1
+#endif
+
+/* Bucket k >= 1 counts durations of 2^(k-1) to 2^k ns, the last one more */
+#define RTS_PERF_BUCKETS  32
+#define RTS_PERF_LINE_MAX 256
+
+enum rts_perf_stage {
+  RTS_PERF_SOURCE,     /* rts_source_acquire, conversion included */
+  RTS_PERF_CONVERT,    /* Sample format conversion, within the source */
+  RTS_PERF_WINDOW,
+  RTS_PERF_FFT,
+  RTS_PERF_ACCUMULATE, /* Power spectrum, accumulation and cadences */
+  RTS_PERF_PUBLISH,    /* Spectrum copy for the render thread */
+  RTS_PERF_CHECKPOINT, /* Integrator state copy */
+  RTS_PERF_REDRAW,
+  RTS_PERF_DUMP,       /* Archive, cadence and checkpoint writes */
+  RTS_PERF_WRITE,      /* write() and msync() within them */
+  RTS_PERF_PNG,        /* Snapshot encoding */
+  RTS_PERF_STAGE_COUNT
+};
+
+/*
+ * Updated with relaxed atomics, from any thread. A copy taken while
+ * a stage is being recorded may be off by that one call, no more.
+ */
+struct rts_perf_hist {
+  uint64_t count;
+  uint64_t ns_total;
+  uint64_t ns_max;
+  uint64_t bucket[RTS_PERF_BUCKETS];
+} __attribute__ ((aligned (64))); /* Stages of different threads */
+
+typedef struct rts_perf_hist rts_perf_hist_t;
+
+extern rts_perf_hist_t rts_perf_hist[RTS_PERF_STAGE_COUNT];
+
+RTS_PRIVATE inline uint64_t
+rts_perf_now(void)
+{
+#if RTS_PERF || RTS_TRACE
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#else
+  return 0;
+#endif /* RTS_PERF || RTS_TRACE */
+}
+
+RTS_PRIVATE inline void
+rts_perf_record(enum rts_perf_stage stage, uint64_t ns)
+{
+#if RTS_PERF
+  rts_perf_hist_t *hist = &rts_perf_hist[stage];
+  unsigned int bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+  uint64_t max;
+
+  if (bucket >= RTS_PERF_BUCKETS)
+    bucket = RTS_PERF_BUCKETS - 1;
+
+  __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->ns_total, ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->bucket[bucket], 1, __ATOMIC_RELAXED);
+
+  max = __atomic_load_n(&hist->ns_max, __ATOMIC_RELAXED);
+  while (ns > max
+      && !__atomic_compare_exchange_n(
+          &hist->ns_max,
+          &max,
+          ns,
+          RTS_TRUE,
+          __ATOMIC_RELAXED,
+          __ATOMIC_RELAXED));
+#endif /* RTS_PERF */
+}
+
+RTS_PRIVATE inline uint64_t
+rts_perf_begin(void)
+{
+  return rts_perf_now();
+}
+
+/* Returns the end time, so consecutive stages can share timestamps */
+RTS_PRIVATE inline uint64_t
+rts_perf_end(enum rts_perf_stage stage, uint64_t start)
+{
+  uint64_t now = rts_perf_now();
+
+  rts_perf_record(stage, now - start);
+  rts_trace_record(stage, start, now);
+
+  return now;
+}
+
+RTS_PRIVATE inline RTSBOOL
+rts_perf_enabled(void)
+{
+  return RTS_PERF ? RTS_TRUE : RTS_FALSE;
+}
+
+const char *rts_perf_stage_name(enum rts_perf_stage stage);
+
+void rts_perf_get(enum rts_perf_stage stage, rts_perf_hist_t *hist);
+
+/* Upper bound of the bucket holding the given fraction of the calls */
+uint64_t rts_perf_hist_percentile(const rts_perf_hist_t *hist, RTSFLOAT p);
+
+/* Compact one-line summary for on-screen display: p99/max per stage */
+void rts_perf_format_line(char *buf, size_t size);
+
+/* Replaces path with the histograms of every stage, see perf.c */
+RTSBOOL rts_perf_dump(const char *path);
+
+#endif /* _RTSUTIL_PERF_H */
@@ -0,0 +1,482 @@
+/*
+  pipeline.c: Chain of processing stages between source and spectrogram
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+#include <time.h>
+
+#include "pipeline.h"
+
+PTR_LIST_CONST_PRIVATE(struct rts_stage_class, stage_class);
+
+/***************************** Block pool ***********************************/
+rts_block_t *
+rts_block_pool_get(struct rts_block_pool *pool)
+{
+  rts_block_t *block = NULL;
+
+  if (pool->free_list != NULL) {
+    block = pool->free_list;
+    pool->free_list = block->next;
+  } else {
+    RTS_TRYCATCH(
+        block = malloc(
+            sizeof (rts_block_t) + pool->block_size * sizeof (RTSCOMPLEX)),
+        return NULL);
+
+    block->pool = pool;
+    block->size = pool->block_size;
+    block->data = (RTSCOMPLEX *) (block + 1);
+    ++pool->allocated;
+  }
+
+  block->next = NULL;
+  block->refcnt = 1;
+  block->length = 0;
+  ++pool->in_use;
+
+  return block;
+}
+
+void
+rts_block_ref(rts_block_t *block)
+{
+  ++block->refcnt;
+}
+
+void
+rts_block_unref(rts_block_t *block)
+{
+  RTS_ASSERT(block->refcnt > 0);
+
+  if (--block->refcnt == 0) {
+    block->next = block->pool->free_list;
+    block->pool->free_list = block;
+    --block->pool->in_use;
+  }
+}
+
+RTS_PRIVATE void
+rts_block_pool_finalize(struct rts_block_pool *pool)
+{
+  rts_block_t *next;
+
+  RTS_ASSERT(pool->in_use == 0);
+
+  while (pool->free_list != NULL) {
+    next = pool->free_list->next;
+    free(pool->free_list);
+    pool->free_list = next;
+  }
+}
+
+/***************************** Stage registry *******************************/
+const struct rts_stage_class *
+rts_stage_class_lookup(const char *name)
+{
+  unsigned int i;
+
+  for (i = 0; i < stage_class_count; ++i)
+    if (strcmp(stage_class_list[i]->name, name) == 0)
+      return stage_class_list[i];
+
+  return NULL;
+}
+
+RTSBOOL
+rts_stage_class_register(const struct rts_stage_class *class)
+{
+  RTS_ASSERT(class->name != NULL);
+  RTS_ASSERT(class->open != NULL);
+  RTS_ASSERT(class->process != NULL);
+  RTS_ASSERT(class->close != NULL);
+
+  RTS_ASSERT(rts_stage_class_lookup(class->name) == NULL);
+
+  RTS_TRYCATCH(
+      PTR_LIST_APPEND_CHECK(stage_class, (void *) class) != -1,
+      return RTS_FALSE);
+
+  return RTS_TRUE;
+}
+
+RTSBOOL
+rts_register_builtin_stages(void)
+{
+  RTSBOOL ok = RTS_FALSE;
+
+  RTS_TRYCATCH(rts_dcblock_stage_register(), goto done);
+  RTS_TRYCATCH(rts_iqcorr_stage_register(), goto done);
+  RTS_TRYCATCH(rts_blanker_stage_register(), goto done);
+  RTS_TRYCATCH(rts_ddc_stage_register(), goto done);
+  RTS_TRYCATCH(rts_tee_stage_register(), goto done);
+
+  ok = RTS_TRUE;
+
+done:
+  return ok;
+}
+
+/******************************* Timing *************************************/
+RTS_PRIVATE inline uint64_t
+rts_pipeline_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+RTS_PRIVATE inline void
+rts_stage_stats_update(
+    struct rts_stage_stats *stats,
+    uint64_t start,
+    RTSCOUNT samples)
+{
+  uint64_t elapsed = rts_pipeline_now_ns() - start;
+
+  ++stats->calls;
+  stats->samples  += samples;
+  stats->ns_total += elapsed;
+
+  if (elapsed > stats->ns_max)
+    stats->ns_max = elapsed;
+}
+
+/***************************** Pipeline *************************************/
+RTS_PRIVATE void
+rts_stage_destroy(struct rts_stage *stage)
+{
+  if (stage->priv != NULL)
+    (stage->class->close) (stage->priv);
+
+  free(stage);
+}
+
+/*
+ * Pull one block from the source and push it through every stage.
+ * Returns the resulting block, or NULL on end of stream / error (in
+ * which case *result holds the source's return code).
+ */
+RTS_PRIVATE rts_block_t *
+rts_pipeline_run(rts_pipeline_t *pipe, RTSCOUNT *result)
+{
+  rts_block_t *block = NULL;
+  uint64_t start;
+  RTSCOUNT got;
+  unsigned int i;
+
+  if ((block = rts_block_pool_get(&pipe->pool)) == NULL) {
+    *result = RTS_SOURCE_ACQUIRE_RESULT_ERROR;
+    return NULL;
+  }
+
+  start = rts_pipeline_now_ns();
+  got = rts_source_acquire(pipe->source, block->data, block->size);
+
+  if (got == RTS_SOURCE_ACQUIRE_RESULT_EOS
+      || got == (RTSCOUNT) RTS_SOURCE_ACQUIRE_RESULT_ERROR) {
+    rts_block_unref(block);
+    *result = got;
+    return NULL;
+  }
+
+  block->length = got;
+  rts_stage_stats_update(&pipe->source_stats, start, got);
+
+  for (i = 0; i < pipe->stage_count; ++i) {
+    got = block->length;
+    start = rts_pipeline_now_ns();
+
+    if ((block = (pipe->stage_list[i]->class->process) (
+        pipe->stage_list[i]->priv,
+        block)) == NULL) {
+      fprintf(
+          stderr,
+          "pipeline: stage `%s' failed\n",
+          pipe->stage_list[i]->class->name);
+      *result = RTS_SOURCE_ACQUIRE_RESULT_ERROR;
+      return NULL;
+    }
+
+    rts_stage_stats_update(&pipe->stage_list[i]->stats, start, got);
+  }
+
+  return block;
+}
+
+/* Acquire callback of the signal source exposed by the pipeline */
+RTS_PRIVATE RTSCOUNT
+rts_pipeline_acquire(void *hnd, RTSCOMPLEX *buffer, RTSCOUNT count)
+{
+  rts_pipeline_t *pipe = (rts_pipeline_t *) hnd;
+  RTSCOUNT avail;
+  RTSCOUNT result;
+
+  while (pipe->pending == NULL) {
+    if ((pipe->pending = rts_pipeline_run(pipe, &result)) == NULL)
+      return result;
+
+    pipe->pending_ptr = 0;
+
+    /* Stages may consume whole blocks (e.g. decimators) */
+    if (pipe->pending->length == 0) {
+      rts_block_unref(pipe->pending);
+      pipe->pending = NULL;
+    }
+  }
+
+  avail = pipe->pending->length - pipe->pending_ptr;
+  if (count > avail)
+    count = avail;
+
+  /*
+   * The only copy in the chain: stages pass blocks by reference, but
+   * the spectrogram assembles its frames in the aligned buffer its FFT
+   * was planned on, and frames straddle blocks of unrelated size. It
+   * is one sequential pass per sample, cheap next to the FFT.
+   */
+  memcpy(
+      buffer,
+      pipe->pending->data + pipe->pending_ptr,
+      count * sizeof (RTSCOMPLEX));
+
+  pipe->pending_ptr += count;
+
+  if (pipe->pending_ptr == pipe->pending->length) {
+    rts_block_unref(pipe->pending);
+    pipe->pending = NULL;
+  }
+
+  return count;
+}
+
+RTS_PRIVATE void *
+rts_pipeline_open(const rts_params_t *params, struct rts_signal_source_info *info)
+{
+  /* Pipelines are not opened through rts_source_open */
+  return NULL;
+}
+
+RTS_PRIVATE void
+rts_pipeline_close(void *hnd)
+{
+  /* Pipeline handles are released by rts_pipeline_destroy */
+}
+
+/*
+ * Settings go to the source. Stages may have shifted the frequency the
+ * consumer sees, but only by a fixed offset: apply the same change.
+ */
+RTS_PRIVATE RTSBOOL
+rts_pipeline_set(
+    void *hnd,
+    const char *key,
+    const char *value,
+    struct rts_signal_source_info *info)
+{
+  rts_pipeline_t *pipe = (rts_pipeline_t *) hnd;
+  int64_t old_freq = pipe->source->info.freq;
+
+  if (!rts_source_set(pipe->source, key, value))
+    return RTS_FALSE;
+
+  info->freq += pipe->source->info.freq - old_freq;
+
+  return RTS_TRUE;
+}
+
+/* Those of the source, updated when the pipeline pulls from it */
+RTS_PRIVATE uint64_t
+rts_pipeline_get_xruns(void *hnd)
+{
+  return ((const rts_pipeline_t *) hnd)->source->info.xruns;
+}
+
+RTS_PRIVATE const struct rts_signal_source rts_pipeline_source =
+{
+    .name = "pipeline",
+    .open = rts_pipeline_open,
+    .acquire = rts_pipeline_acquire,
+    .close = rts_pipeline_close,
+    .set = rts_pipeline_set,
+    .get_xruns = rts_pipeline_get_xruns
+};
+
+rts_pipeline_t *
+rts_pipeline_new(rts_srchnd_t *source, RTSCOUNT block_size)
+{
+  rts_pipeline_t *new = NULL;
+
+  RTS_TRYCATCH(block_size > 0, goto fail);
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_pipeline_t)), goto fail);
+
+  new->source = source;
+  new->pool.block_size = block_size;
+
+  new->handle.src = &rts_pipeline_source;
+  new->handle.info = source->info;
+  new->handle.handle = new;
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_pipeline_destroy(new);
+
+  return NULL;
+}
+
+RTSBOOL
+rts_pipeline_append(
+    rts_pipeline_t *pipe,
+    const struct rts_stage_class *class,
+    const rts_params_t *params)
+{
+  struct rts_stage *stage = NULL;
+  struct rts_signal_source_info info = pipe->handle.info;
+  RTSBOOL ok = RTS_FALSE;
+
+  RTS_TRYCATCH(stage = calloc(1, sizeof (struct rts_stage)), goto done);
+
+  stage->class = class;
+
+  RTS_TRYCATCH(stage->priv = (class->open) (params, &info), goto done);
+
+  /* Source buffers, counted in samples at the output rate */
+  if (info.samp_rate != pipe->handle.info.samp_rate
+      && info.buffer_size == pipe->handle.info.buffer_size
+      && pipe->handle.info.samp_rate > 0)
+    info.buffer_size = (uint64_t) info.buffer_size
+        * info.samp_rate
+        / pipe->handle.info.samp_rate;
+
+  RTS_TRYCATCH(PTR_LIST_APPEND_CHECK(pipe->stage, stage) != -1, goto done);
+
+  pipe->handle.info = info;
+  stage = NULL;
+
+  ok = RTS_TRUE;
+
+done:
+  if (stage != NULL)
+    rts_stage_destroy(stage);
+
+  return ok;
+}
+
+/* Stage specs have the form name[:param=value[,param=value...]] */
+RTSBOOL
+rts_pipeline_append_spec(rts_pipeline_t *pipe, const char *spec)
+{
+  const struct rts_stage_class *class;
+  rts_params_t *params = NULL;
+  char *name = NULL;
+  char *args;
+  RTSBOOL ok = RTS_FALSE;
+
+  RTS_TRYCATCH(name = strdup(spec), goto done);
+
+  if ((args = strchr(name, ':')) != NULL)
+    *args++ = '\0';
+
+  if ((class = rts_stage_class_lookup(name)) == NULL) {
+    fprintf(stderr, "pipeline: unknown stage `%s'\n", name);
+    goto done;
+  }
+
+  RTS_TRYCATCH(params = rts_params_new(), goto done);
+
+  if (args != NULL)
+    RTS_TRYCATCH(rts_params_parse(params, args), goto done);
+
+  RTS_TRYCATCH(rts_pipeline_append(pipe, class, params), goto done);
+
+  ok = RTS_TRUE;
+
+done:
+  if (params != NULL)
+    rts_params_destroy(params);
+
+  if (name != NULL)
+    free(name);
+
+  return ok;
+}
+
+RTS_PRIVATE void
+rts_stage_stats_print(
+    FILE *fp,
+    const char *name,
+    const struct rts_stage_stats *stats)
+{
+  fprintf(
+      fp,
+      "  %-12s %10llu calls %14llu samples %9.2lf ns/samp %10.3lf ms max\n",
+      name,
+      (unsigned long long) stats->calls,
+      (unsigned long long) stats->samples,
+      stats->samples > 0
+      ? (RTSFLOAT) stats->ns_total / (RTSFLOAT) stats->samples
+      : 0.,
+      stats->ns_max * 1e-6);
+}
+
+void
+rts_pipeline_print_stats(const rts_pipeline_t *pipe, FILE *fp)
+{
+  unsigned int i;
+
+  fprintf(
+      fp,
+      "pipeline: %u blocks of %u samples allocated\n",
+      pipe->pool.allocated,
+      pipe->pool.block_size);
+
+  rts_stage_stats_print(fp, pipe->source->src->name, &pipe->source_stats);
+
+  for (i = 0; i < pipe->stage_count; ++i)
+    rts_stage_stats_print(
+        fp,
+        pipe->stage_list[i]->class->name,
+        &pipe->stage_list[i]->stats);
+}
+
+void
+rts_pipeline_destroy(rts_pipeline_t *pipe)
+{
+  unsigned int i;
+
+  if (pipe->pending != NULL)
+    rts_block_unref(pipe->pending);
+
+  for (i = 0; i < pipe->stage_count; ++i)
+    if (pipe->stage_list[i] != NULL)
+      rts_stage_destroy(pipe->stage_list[i]);
+
+  if (pipe->stage_list != NULL)
+    free(pipe->stage_list);
+
+  rts_block_pool_finalize(&pipe->pool);
+
+  free(pipe);
+}
@@ -0,0 +1,150 @@
+/*
+  pipeline.h: Chain of processing stages between source and spectrogram
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_PIPELINE_H
+#define _RTSUTIL_PIPELINE_H
+
+#include "source.h"
+
+#define RTS_PIPELINE_DEFAULT_BLOCK_SIZE 4096
+
+/*
+ * Sample blocks are taken from a pool owned by the pipeline and passed
+ * by reference from stage to stage. A stage that needs to keep a block
+ * after returning must take its own reference with rts_block_ref().
+ * Samples are only copied once, out of the last block into the buffer
+ * the consumer passes to acquire.
+ */
+struct rts_block_pool;
+
+struct rts_block {
+  struct rts_block_pool *pool;
+  struct rts_block *next; /* Free list link */
+  unsigned int refcnt;
+
+  RTSCOUNT size;   /* Capacity, in samples */
+  RTSCOUNT length; /* Valid samples */
+  RTSCOMPLEX *data;
+};
+
+typedef struct rts_block rts_block_t;
+
+struct rts_block_pool {
+  RTSCOUNT block_size;
+  struct rts_block *free_list;
+  RTSCOUNT allocated;
+  RTSCOUNT in_use;
+};
+
+rts_block_t *rts_block_pool_get(struct rts_block_pool *pool);
+
+void rts_block_ref(rts_block_t *block);
+
+void rts_block_unref(rts_block_t *block);
+
+/* Per-stage timing counters */
+struct rts_stage_stats {
+  uint64_t calls;
+  uint64_t samples;
+  uint64_t ns_total;
+  uint64_t ns_max;
+};
+
+/*
+ * A stage receives one reference to a block and returns the block to
+ * pass downstream (either the same one, processed in place, or a new
+ * one taken from block->pool after releasing the input). Returning NULL
+ * signals an error. Stages may shrink block->length (e.g. decimators),
+ * even down to zero.
+ *
+ * open() receives the stream properties as seen by this stage and must
+ * update them if the stage changes the sample rate or the frequency.
+ */
+struct rts_stage_class {
+  const char *name;
+
+  void *(*open) (
+      const rts_params_t *params,
+      struct rts_signal_source_info *info);
+
+  rts_block_t *(*process) (void *priv, rts_block_t *block);
+
+  void (*close) (void *priv);
+};
+
+struct rts_stage {
+  const struct rts_stage_class *class;
+  void *priv;
+  struct rts_stage_stats stats;
+};
+
+struct rts_pipeline {
+  rts_srchnd_t *source;
+  rts_srchnd_t handle; /* Source handle seen by the consumer */
+
+  struct rts_block_pool pool;
+  PTR_LIST(struct rts_stage, stage);
+  struct rts_stage_stats source_stats;
+
+  /* Output block being consumed */
+  rts_block_t *pending;
+  RTSCOUNT pending_ptr;
+};
+
+typedef struct rts_pipeline rts_pipeline_t;
+
+RTSBOOL rts_stage_class_register(const struct rts_stage_class *class);
+
+const struct rts_stage_class *rts_stage_class_lookup(const char *name);
+
+RTSBOOL rts_dcblock_stage_register(void);
+
+RTSBOOL rts_iqcorr_stage_register(void);
+
+RTSBOOL rts_blanker_stage_register(void);
+
+RTSBOOL rts_ddc_stage_register(void);
+
+RTSBOOL rts_tee_stage_register(void);
+
+RTSBOOL rts_register_builtin_stages(void);
+
+rts_pipeline_t *rts_pipeline_new(rts_srchnd_t *source, RTSCOUNT block_size);
+
+RTSBOOL rts_pipeline_append(
+    rts_pipeline_t *pipe,
+    const struct rts_stage_class *class,
+    const rts_params_t *params);
+
+RTSBOOL rts_pipeline_append_spec(rts_pipeline_t *pipe, const char *spec);
+
+/* The returned handle is owned by the pipeline: do not rts_source_close() it */
+RTS_PRIVATE inline rts_srchnd_t *
+rts_pipeline_get_handle(rts_pipeline_t *pipe)
+{
+  return &pipe->handle;
+}
+
+void rts_pipeline_print_stats(const rts_pipeline_t *pipe, FILE *fp);
+
+void rts_pipeline_destroy(rts_pipeline_t *pipe);
+
+#endif /* _RTSUTIL_PIPELINE_H */
@@ -0,0 +1,138 @@
+/*
+  snapshot.c: Spectrum snapshots published to other threads
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+
+#include "snapshot.h"
+
+rts_snapshot_buffer_t *
+rts_snapshot_buffer_new(RTSCOUNT bins)
+{
+  rts_snapshot_buffer_t *new = NULL;
+  unsigned int i;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_snapshot_buffer_t)), goto fail);
+
+  for (i = 0; i < 3; ++i) {
+    new->snapshot[i].bins = bins;
+    new->snapshot[i].capacity = bins;
+    RTS_TRYCATCH(
+        new->snapshot[i].spectrum = calloc(bins, sizeof (RTSFLOAT)),
+        goto fail);
+  }
+
+  new->back   = 0;
+  new->middle = 1;
+  new->front  = 2;
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_snapshot_buffer_destroy(new);
+
+  return NULL;
+}
+
+rts_spectrum_snapshot_t *
+rts_snapshot_buffer_begin(rts_snapshot_buffer_t *buf, RTSBOOL complete)
+{
+  unsigned int middle;
+
+  if (!complete) {
+    middle = __atomic_load_n(&buf->middle, __ATOMIC_ACQUIRE);
+    if ((middle & RTS_SNAPSHOT_FRESH) && (middle & RTS_SNAPSHOT_COMPLETE))
+      return NULL;
+  }
+
+  buf->snapshot[buf->back].complete = complete;
+
+  return &buf->snapshot[buf->back];
+}
+
+void
+rts_snapshot_buffer_commit(rts_snapshot_buffer_t *buf)
+{
+  unsigned int state = buf->back | RTS_SNAPSHOT_FRESH;
+
+  if (buf->snapshot[buf->back].complete)
+    state |= RTS_SNAPSHOT_COMPLETE;
+
+  buf->back = __atomic_exchange_n(&buf->middle, state, __ATOMIC_ACQ_REL)
+      & RTS_SNAPSHOT_INDEX;
+}
+
+const rts_spectrum_snapshot_t *
+rts_snapshot_buffer_update(rts_snapshot_buffer_t *buf)
+{
+  if (!(__atomic_load_n(&buf->middle, __ATOMIC_ACQUIRE) & RTS_SNAPSHOT_FRESH))
+    return NULL;
+
+  buf->front = __atomic_exchange_n(&buf->middle, buf->front, __ATOMIC_ACQ_REL)
+      & RTS_SNAPSHOT_INDEX;
+
+  return &buf->snapshot[buf->front];
+}
+
+void
+rts_snapshot_buffer_destroy(rts_snapshot_buffer_t *buf)
+{
+  unsigned int i;
+
+  for (i = 0; i < 3; ++i)
+    if (buf->snapshot[i].spectrum != NULL)
+      free(buf->snapshot[i].spectrum);
+
+  free(buf);
+}
+
+void
+rts_spectrum_snapshot_fill(
+    rts_spectrum_snapshot_t *snapshot,
+    const rts_spectrogram_t *spect,
+    const rts_spectrum_acc_t *acc)
+{
+  RTS_ASSERT(acc->bins <= snapshot->capacity);
+
+  snapshot->bins = acc->bins;
+
+  memcpy(
+      snapshot->spectrum,
+      rts_spectrum_acc_get_cumulative(acc),
+      snapshot->bins * sizeof (RTSFLOAT));
+
+  snapshot->frame_count = rts_spectrum_acc_get_frame_count(acc);
+  snapshot->got_samples = rts_spectrum_acc_get_got_samples(acc);
+  snapshot->reset_count = rts_spectrum_acc_get_reset_count(acc);
+  snapshot->samp_rate   = rts_spectrogram_get_samp_rate(spect);
+  snapshot->progress    = rts_spectrogram_get_acc_progress(spect, acc);
+  snapshot->start       = acc->start;
+  snapshot->margin      = *rts_spectrogram_get_margin(spect);
+  snapshot->worst       = acc->margin;
+
+  rts_spectrogram_get_acc_range(
+      spect,
+      acc,
+      &snapshot->min,
+      &snapshot->max,
+      &snapshot->f_lo,
+      &snapshot->f_hi);
+}
@@ -0,0 +1,97 @@
+/*
+  snapshot.h: Spectrum snapshots published to other threads
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_SNAPSHOT_H
+#define _RTSUTIL_SNAPSHOT_H
+
+#include "spectrogram.h"
+
+/*
+ * Triple buffer: the writer fills the back buffer and swaps it with
+ * the middle one, the reader swaps the middle one with its front
+ * buffer when there is something new. Neither side ever waits for the
+ * other; the reader just sees the newest snapshot.
+ *
+ * Snapshots of complete integrations are not overwritten by ordinary
+ * ones until the reader picks them up: rts_snapshot_buffer_begin()
+ * refuses to start an ordinary snapshot meanwhile.
+ */
+
+#define RTS_SNAPSHOT_INDEX    3
+#define RTS_SNAPSHOT_FRESH    4
+#define RTS_SNAPSHOT_COMPLETE 8
+
+/* Everything needed to draw an accumulator, copied */
+struct rts_spectrum_snapshot {
+  RTSCOUNT bins;
+  RTSCOUNT capacity; /* Largest spectrum that fits */
+  RTSFLOAT *spectrum; /* Cumulative */
+
+  RTSCOUNT frame_count;
+  RTSCOUNT got_samples;
+  RTSCOUNT reset_count;
+  RTSCOUNT samp_rate;
+  RTSFLOAT progress;
+  RTSBOOL  complete;
+
+  RTSFLOAT min, max;
+  RTSFLOAT f_lo, f_hi;
+
+  struct timespec start;
+
+  /* Real-time margin, now and worst of the integration */
+  rts_margin_t margin;
+  struct rts_margin_stats worst;
+};
+
+typedef struct rts_spectrum_snapshot rts_spectrum_snapshot_t;
+
+struct rts_snapshot_buffer {
+  rts_spectrum_snapshot_t snapshot[3];
+  unsigned int back;   /* Writer only */
+  unsigned int front;  /* Reader only */
+  unsigned int middle; /* Index and flags, accessed atomically */
+};
+
+typedef struct rts_snapshot_buffer rts_snapshot_buffer_t;
+
+/* bins: largest spectrum to be published */
+rts_snapshot_buffer_t *rts_snapshot_buffer_new(RTSCOUNT bins);
+
+/* Writer side. NULL if the snapshot must be skipped. */
+rts_spectrum_snapshot_t *rts_snapshot_buffer_begin(
+    rts_snapshot_buffer_t *buf,
+    RTSBOOL complete);
+
+void rts_snapshot_buffer_commit(rts_snapshot_buffer_t *buf);
+
+/* Reader side. Newest snapshot, or NULL if nothing new was published. */
+const rts_spectrum_snapshot_t *rts_snapshot_buffer_update(
+    rts_snapshot_buffer_t *buf);
+
+void rts_snapshot_buffer_destroy(rts_snapshot_buffer_t *buf);
+
+void rts_spectrum_snapshot_fill(
+    rts_spectrum_snapshot_t *snapshot,
+    const rts_spectrogram_t *spect,
+    const rts_spectrum_acc_t *acc);
+
+#endif /* _RTSUTIL_SNAPSHOT_H */
@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include "source.h"
+#include "perf.h"
 #include "bladerf.h"
 #include "alsa.h"
 
@@ -64,6 +65,7 @@ rts_source_open(const struct rts_signal_source *src, const rts_params_t *params)
   RTS_TRYCATCH(hnd = malloc(sizeof (rts_srchnd_t)), goto fail);
 
   hnd->src = src;
+  memset(&hnd->info, 0, sizeof (struct rts_signal_source_info));
 
   RTS_TRYCATCH(hnd->handle = (src->open) (params, &hnd->info), goto fail);
 
@@ -76,10 +78,54 @@ fail:
   return NULL;
 }
 
+#if RTS_PERF
+/* Reads of the source behind a pipeline are part of the pipeline's */
+static __thread unsigned int rts_source_depth;
+#endif /* RTS_PERF */
+
 RTSCOUNT
 rts_source_acquire(rts_srchnd_t *hnd, RTSCOMPLEX *buffer, RTSCOUNT count)
 {
-  return (hnd->src->acquire) (hnd->handle, buffer, count);
+  RTSCOUNT got;
+#if RTS_PERF
+  uint64_t start;
+
+  if (rts_source_depth > 0) {
+    got = (hnd->src->acquire) (hnd->handle, buffer, count);
+  } else {
+    ++rts_source_depth;
+
+    start = rts_perf_begin();
+    got = (hnd->src->acquire) (hnd->handle, buffer, count);
+    rts_perf_end(RTS_PERF_SOURCE, start);
+
+    --rts_source_depth;
+  }
+#else
+  got = (hnd->src->acquire) (hnd->handle, buffer, count);
+#endif /* RTS_PERF */
+
+  if (hnd->src->get_xruns != NULL)
+    hnd->info.xruns = (hnd->src->get_xruns) (hnd->handle);
+
+  return got;
+}
+
+/* Fails if the source does not support changing key at run time */
+RTSBOOL
+rts_source_set(rts_srchnd_t *hnd, const char *key, const char *value)
+{
+  struct rts_signal_source_info info = hnd->info;
+
+  if (hnd->src->set == NULL)
+    return RTS_FALSE;
+
+  if (!(hnd->src->set) (hnd->handle, key, value, &info))
+    return RTS_FALSE;
+
+  hnd->info = info;
+
+  return RTS_TRUE;
 }
 
 void
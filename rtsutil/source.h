@@ -31,6 +31,8 @@
 struct rts_signal_source_info {
   unsigned int samp_rate;
   int64_t freq;
+  RTSCOUNT buffer_size; /* Samples held before an overrun, 0 if unknown */
+  uint64_t xruns; /* Overruns so far, kept up to date by rts_source_acquire */
 };
 
 struct rts_signal_source {
@@ -42,6 +44,20 @@ struct rts_signal_source {
   RTSCOUNT (*acquire) (void *hnd, RTSCOMPLEX *buffer, RTSCOUNT count);
 
   void (*close) (void *hnd);
+
+  /* Optional. Overruns since the source was opened. */
+  uint64_t (*get_xruns) (void *hnd);
+
+  /*
+   * Optional. Changes a parameter of an open source, with the same
+   * syntax as in open, and updates info accordingly. Called from the
+   * acquisition thread between two calls to acquire.
+   */
+  RTSBOOL (*set) (
+      void *hnd,
+      const char *key,
+      const char *value,
+      struct rts_signal_source_info *info);
 };
 
 struct rts_signal_source_handle {
@@ -65,6 +81,11 @@ RTSCOUNT rts_source_acquire(
     RTSCOMPLEX *buffer,
     RTSCOUNT count);
 
+RTSBOOL rts_source_set(
+    rts_srchnd_t *hnd,
+    const char *key,
+    const char *value);
+
 void rts_source_close(rts_srchnd_t *hnd);
 
 RTSBOOL rts_file_source_register(void);
@@ -20,23 +20,94 @@
 */
 
 #include <math.h>
+#include <time.h>
+#include <string.h>
 
 #include "spectrogram.h"
+#include "perf.h"
+#include "metrics.h"
 
-#define RTS_SPECTROGRAM_APPLY_WINDOW
 #define RTS_SPECTROGRAM_DC_BINS 10
 
-rts_spectrogram_t *
-rts_spectrogram_new(rts_srchnd_t *hnd, struct rts_spectrogram_params *params)
+RTS_PRIVATE void
+rts_spectrum_acc_destroy(rts_spectrum_acc_t *acc)
 {
-  rts_spectrogram_t *new = NULL;
+  if (acc->spectrum != NULL)
+    free(acc->spectrum);
 
-  RTS_TRYCATCH(new = calloc(1, sizeof (rts_spectrogram_t)), goto fail);
+  free(acc);
+}
+
+RTS_PRIVATE rts_spectrum_acc_t *
+rts_spectrum_acc_new(RTSCOUNT bins)
+{
+  rts_spectrum_acc_t *new = NULL;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_spectrum_acc_t)), goto fail);
+
+  new->bins = bins;
+
+  RTS_TRYCATCH(new->spectrum = calloc(bins, sizeof (RTSFLOAT)), goto fail);
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_spectrum_acc_destroy(new);
+
+  return NULL;
+}
+
+RTS_PRIVATE void
+rts_spectrum_acc_start(rts_spectrum_acc_t *acc, RTSCOUNT reset_count)
+{
+  acc->frame_count = 0;
+  acc->got_samples = 0;
+  acc->reset_count = reset_count;
+  acc->xrun_count  = 0;
+  acc->min = acc->max = 0;
+
+  rts_margin_stats_reset(&acc->margin);
+
+  clock_gettime(CLOCK_REALTIME, &acc->start);
+  acc->end = acc->start;
+}
+
+void
+rts_spectrogram_plan_destroy(rts_spectrogram_plan_t *plan)
+{
+  if (plan->fft_plan != NULL)
+    RTS_FFTW(_destroy_plan)(plan->fft_plan);
+
+  if (plan->window != NULL)
+    fftw_free(plan->window);
+
+  if (plan->fft != NULL)
+    fftw_free(plan->fft);
+
+  if (plan->acc != NULL)
+    rts_spectrum_acc_destroy(plan->acc);
+
+  if (plan->spare != NULL)
+    rts_spectrum_acc_destroy(plan->spare);
+
+  if (plan->cadences != NULL)
+    rts_cadence_bank_destroy(plan->cadences);
+
+  free(plan);
+}
+
+RTS_PRIVATE rts_spectrogram_plan_t *
+rts_spectrogram_plan_new(
+    const rts_srchnd_t *hnd,
+    const struct rts_spectrogram_params *params)
+{
+  rts_spectrogram_plan_t *new = NULL;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_spectrogram_plan_t)), goto fail);
 
   new->params = *params;
-  new->handle = hnd;
   new->frames = ceil((params->avg_time * hnd->info.samp_rate) / params->bins);
-  new->total_samples = params->bins * new->frames;
 
   RTS_TRYCATCH(
       new->window = fftw_malloc(params->bins * sizeof(RTS_FFTW(_complex))),
@@ -55,13 +126,92 @@ rts_spectrogram_new(rts_srchnd_t *hnd, struct rts_spectrogram_params *params)
           FFTW_ESTIMATE),
       goto fail);
 
-  RTS_TRYCATCH(
-      new->spectrum = calloc(sizeof(RTSCOMPLEX), params->bins),
-      goto fail);
+  RTS_TRYCATCH(new->acc = rts_spectrum_acc_new(params->bins), goto fail);
+  RTS_TRYCATCH(new->spare = rts_spectrum_acc_new(params->bins), goto fail);
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_spectrogram_plan_destroy(new);
+
+  return NULL;
+}
+
+/*
+ * Exchanges everything that depends on the acquisition parameters
+ * between spect and plan. Cadences are exchanged only if the plan
+ * brings its own.
+ */
+RTS_PRIVATE void
+rts_spectrogram_exchange(
+    rts_spectrogram_t *spect,
+    rts_spectrogram_plan_t *plan)
+{
+  struct rts_spectrogram_params params = spect->params;
+  RTS_FFTW(_complex) *window = spect->window;
+  RTS_FFTW(_plan) fft_plan = spect->fft_plan;
+  RTS_FFTW(_complex) *fft = spect->fft;
+  rts_spectrum_acc_t *acc = spect->acc;
+  rts_cadence_bank_t *cadences = spect->cadences;
+  RTSCOUNT frames = spect->frames;
+
+  spect->params   = plan->params;
+  spect->frames   = plan->frames;
+  spect->window   = plan->window;
+  spect->fft_plan = plan->fft_plan;
+  spect->fft      = plan->fft;
+  spect->acc      = plan->acc;
+
+  spect->total_samples = spect->params.bins * spect->frames;
+
+  plan->params   = params;
+  plan->frames   = frames;
+  plan->window   = window;
+  plan->fft_plan = fft_plan;
+  plan->fft      = fft;
+  plan->acc      = acc;
+
+  /* The spare may be being released from another thread right now */
+  plan->spare = __atomic_exchange_n(
+      &spect->spare,
+      plan->spare,
+      __ATOMIC_ACQ_REL);
+
+  /* rts_spectrogram_prepare() reads it from the planning thread */
+  if (plan->cadences != NULL) {
+    __atomic_store_n(&spect->cadences, plan->cadences, __ATOMIC_RELEASE);
+    plan->cadences = cadences;
+  }
+}
+
+rts_spectrogram_t *
+rts_spectrogram_new(rts_srchnd_t *hnd, struct rts_spectrogram_params *params)
+{
+  rts_spectrogram_t *new = NULL;
+  rts_spectrogram_plan_t *plan = NULL;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_spectrogram_t)), goto fail);
+
+  new->handle = hnd;
+  new->xruns  = hnd->info.xruns;
+
+  RTS_TRYCATCH(plan = rts_spectrogram_plan_new(hnd, params), goto fail);
+
+  rts_spectrogram_exchange(new, plan);
+
+  rts_spectrum_acc_start(new->acc, 0);
+
+  rts_spectrogram_plan_destroy(plan);
+
+  rts_metrics_set(RTS_METRIC_SAMP_RATE, hnd->info.samp_rate);
 
   return new;
 
 fail:
+  if (plan != NULL)
+    rts_spectrogram_plan_destroy(plan);
+
   if (new != NULL)
     rts_spectrogram_destroy(new);
 
@@ -80,12 +230,89 @@ rts_spectrogram_destroy(rts_spectrogram_t *spect)
   if (spect->fft != NULL)
     fftw_free(spect->fft);
 
-  if (spect->spectrum != NULL)
-    free(spect->spectrum);
+  if (spect->acc != NULL)
+    rts_spectrum_acc_destroy(spect->acc);
+
+  if (spect->spare != NULL)
+    rts_spectrum_acc_destroy(spect->spare);
+
+  if (spect->cadences != NULL)
+    rts_cadence_bank_destroy(spect->cadences);
 
   free(spect);
 }
 
+/*
+ * Allocates and plans everything needed to integrate with new params
+ * (cadences included, with the same integration times) without
+ * touching spect. Meant to be called outside the acquisition thread.
+ * Note that FFTW planning is not thread safe: all calls must come
+ * from the same thread.
+ */
+rts_spectrogram_plan_t *
+rts_spectrogram_prepare(
+    const rts_spectrogram_t *spect,
+    const struct rts_spectrogram_params *params)
+{
+  rts_spectrogram_plan_t *plan = NULL;
+  const rts_cadence_bank_t *cadences;
+  unsigned int i;
+
+  RTS_TRYCATCH(params->bins > 0 && params->avg_time > 0, goto fail);
+
+  RTS_TRYCATCH(
+      plan = rts_spectrogram_plan_new(spect->handle, params),
+      goto fail);
+
+  cadences = __atomic_load_n(&spect->cadences, __ATOMIC_ACQUIRE);
+
+  if (cadences != NULL) {
+    RTS_TRYCATCH(
+        plan->cadences = rts_cadence_bank_new(
+            params->bins,
+            (RTSFLOAT) params->bins / spect->handle->info.samp_rate,
+            cadences->func,
+            cadences->priv),
+        goto fail);
+
+    for (i = 0; i < rts_cadence_bank_get_count(cadences); ++i)
+      if (rts_cadence_bank_add(
+          plan->cadences,
+          rts_cadence_bank_get(cadences, i)->avg_time) == -1) {
+        fprintf(
+            stderr,
+            "spectrogram: cadence of %g s does not fit new parameters\n",
+            rts_cadence_bank_get(cadences, i)->avg_time);
+        goto fail;
+      }
+  }
+
+  return plan;
+
+fail:
+  if (plan != NULL)
+    rts_spectrogram_plan_destroy(plan);
+
+  return NULL;
+}
+
+/*
+ * Switches to a prepared plan. Must be called from the acquisition
+ * thread right after rts_spectrogram_swap(), so that no integration
+ * mixes both configurations. The plan is left holding the previous
+ * resources, for the caller to destroy from the planning thread.
+ */
+void
+rts_spectrogram_apply(rts_spectrogram_t *spect, rts_spectrogram_plan_t *plan)
+{
+  RTSCOUNT reset_count = spect->acc->reset_count;
+
+  rts_spectrogram_exchange(spect, plan);
+
+  spect->window_ptr = 0;
+  rts_spectrum_acc_start(spect->acc, reset_count);
+}
+
 #define RTS_BLACKMANN_HARRIS_A0 0.35875
 #define RTS_BLACKMANN_HARRIS_A1 0.48829
 #define RTS_BLACKMANN_HARRIS_A2 0.14128
@@ -107,17 +334,25 @@ rts_apply_blackmann_harris_complex(RTSCOMPLEX *h, RTSCOUNT size)
 void
 rts_spectrogram_apply_window(rts_spectrogram_t *spect)
 {
-#ifdef RTS_SPECTROGRAM_APPLY_WINDOW
-  rts_apply_blackmann_harris_complex(spect->window, spect->params.bins);
-#endif
+  switch (spect->params.window) {
+    case RTS_WINDOW_BLACKMANN_HARRIS:
+      rts_apply_blackmann_harris_complex(spect->window, spect->params.bins);
+      break;
+
+    case RTS_WINDOW_RECTANGULAR:
+      break;
+  }
 }
 
 RTSBOOL
 rts_spectrogram_acquire(rts_spectrogram_t *spect)
 {
+  rts_spectrum_acc_t *acc = spect->acc;
   RTSCOUNT needed;
   RTSCOUNT got;
   RTSFLOAT psd;
+  uint64_t start;
+  uint64_t xruns;
   int i;
 
   if (rts_spectrogram_complete(spect))
@@ -141,41 +376,75 @@ rts_spectrogram_acquire(rts_spectrogram_t *spect)
       return RTS_FALSE;
   }
 
-  spect->window_ptr  += got;
-  spect->got_samples += got;
+  spect->window_ptr += got;
+  acc->got_samples  += got;
 
   if (spect->window_ptr == spect->params.bins) {
+    start = rts_perf_begin();
+
     /* Apply window function */
     rts_spectrogram_apply_window(spect);
 
+    start = rts_perf_end(RTS_PERF_WINDOW, start);
+
     /* Perform FFT in the current window */
     RTS_FFTW(_execute)(spect->fft_plan);
 
-    spect->min = INFINITY;
-    spect->max = -INFINITY;
+    start = rts_perf_end(RTS_PERF_FFT, start);
+
+    acc->min = INFINITY;
+    acc->max = -INFINITY;
 
     /* Save power spectrum */
     for (i = 0; i < spect->params.bins; ++i) {
       psd = creal(spect->fft[i] * conj(spect->fft[i])) / spect->params.bins;
 
-      if (spect->frame_count == 0)
-        spect->spectrum[i] = psd; /* If reading first frame, store directly */
+      if (acc->frame_count == 0)
+        acc->spectrum[i] = psd; /* If reading first frame, store directly */
       else
-        spect->spectrum[i] += psd; /* Otherwise, accumulate */
+        acc->spectrum[i] += psd; /* Otherwise, accumulate */
 
       /* In last iteration before reset, update limits */
       if (i >= (RTS_SPECTROGRAM_DC_BINS / 2)
           && i < (spect->params.bins - (RTS_SPECTROGRAM_DC_BINS / 2))) {
-        if (spect->spectrum[i] < spect->min)
-          spect->min = spect->spectrum[i];
-        if (spect->spectrum[i] > spect->max)
-          spect->max = spect->spectrum[i];
+        if (acc->spectrum[i] < acc->min)
+          acc->min = acc->spectrum[i];
+        if (acc->spectrum[i] > acc->max)
+          acc->max = acc->spectrum[i];
       }
     }
 
     /* Reset window pointer, increment frame counter */
     spect->window_ptr = 0;
-    ++spect->frame_count;
+    ++acc->frame_count;
+
+    /* Those of this source only, other spectrograms have their own */
+    xruns = spect->handle->info.xruns - spect->xruns;
+    spect->xruns += xruns;
+    acc->xrun_count += xruns;
+
+    if (spect->cadences != NULL)
+      rts_cadence_bank_frame(spect->cadences, acc->spectrum, xruns);
+
+    rts_perf_end(RTS_PERF_ACCUMULATE, start);
+
+    rts_margin_update(
+        &spect->margin,
+        &spect->handle->info,
+        spect->params.bins);
+    rts_margin_stats_update(&acc->margin, &spect->margin);
+
+    rts_metrics_add(RTS_METRIC_SAMPLES, spect->params.bins);
+    rts_metrics_add(RTS_METRIC_FRAMES, 1);
+    rts_metrics_add(RTS_METRIC_XRUNS, xruns);
+    rts_metrics_set(
+        RTS_METRIC_PROGRESS,
+        (RTSFLOAT) acc->frame_count / spect->frames);
+    rts_metrics_set(RTS_METRIC_RTF, spect->margin.rtf);
+    rts_metrics_set(
+        RTS_METRIC_LAG,
+        (RTSFLOAT) spect->margin.lag / spect->handle->info.samp_rate);
+    rts_metrics_set(RTS_METRIC_FILL, spect->margin.fill);
   }
 
   return RTS_TRUE;
@@ -184,51 +453,189 @@ rts_spectrogram_acquire(rts_spectrogram_t *spect)
 RTSBOOL
 rts_spectrogram_complete(const rts_spectrogram_t *spect)
 {
-  return spect->frame_count == spect->frames;
+  return spect->acc->frame_count == spect->frames;
 }
 
 void
 rts_spectrogram_reset(rts_spectrogram_t *spect)
 {
-  spect->got_samples = 0;
-  spect->frame_count = 0;
+  if (spect->cadences != NULL)
+    rts_cadence_bank_restart(spect->cadences, spect->acc->spectrum);
+
+  spect->window_ptr = 0;
+  rts_spectrum_acc_start(spect->acc, ++spect->reset_count);
+}
+
+/*
+ * Hand the current accumulator to the caller and continue integrating
+ * in the spare one. If the previous accumulator has not been released
+ * yet, a new one is allocated so that acquisition never waits.
+ */
+rts_spectrum_acc_t *
+rts_spectrogram_swap(rts_spectrogram_t *spect)
+{
+  rts_spectrum_acc_t *done = spect->acc;
+  rts_spectrum_acc_t *next;
+
+  next = __atomic_exchange_n(&spect->spare, NULL, __ATOMIC_ACQ_REL);
+
+  /* Released after a change of parameters */
+  if (next != NULL && next->bins != spect->params.bins) {
+    rts_spectrum_acc_destroy(next);
+    next = NULL;
+  }
+
+  if (next == NULL)
+    RTS_TRYCATCH(next = rts_spectrum_acc_new(spect->params.bins), return NULL);
+
+  clock_gettime(CLOCK_REALTIME, &done->end);
+
+  if (spect->cadences != NULL)
+    rts_cadence_bank_restart(spect->cadences, done->spectrum);
+
+  spect->acc = next;
   spect->window_ptr = 0;
-  ++spect->reset_count;
+  rts_spectrum_acc_start(next, ++spect->reset_count);
+
+  rts_metrics_add(RTS_METRIC_INTEGRATIONS, 1);
+
+  return done;
+}
+
+/* May be called from any thread */
+void
+rts_spectrogram_release(rts_spectrogram_t *spect, rts_spectrum_acc_t *acc)
+{
+  rts_spectrum_acc_t *old;
+
+  old = __atomic_exchange_n(&spect->spare, acc, __ATOMIC_ACQ_REL);
+
+  if (old != NULL)
+    rts_spectrum_acc_destroy(old);
 }
 
 const RTSFLOAT *
 rts_spectrogram_get_cumulative(const rts_spectrogram_t *spect)
 {
-  return spect->spectrum;
+  return spect->acc->spectrum;
 }
 
 RTSCOUNT
 rts_spectrogram_get_frame_count(const rts_spectrogram_t *spect)
 {
-  return spect->frame_count;
+  return spect->acc->frame_count;
+}
+
+RTSFLOAT
+rts_spectrogram_get_acc_progress(
+    const rts_spectrogram_t *spect,
+    const rts_spectrum_acc_t *acc)
+{
+  return (RTSFLOAT) acc->got_samples / (RTSFLOAT) spect->total_samples;
 }
 
 RTSFLOAT
 rts_spectrogram_get_progress(const rts_spectrogram_t *spect)
 {
-  return (RTSFLOAT) spect->got_samples / (RTSFLOAT) spect->total_samples;
+  return rts_spectrogram_get_acc_progress(spect, spect->acc);
 }
 
 void
-rts_spectrogram_get_range(
+rts_spectrogram_get_acc_range(
     const rts_spectrogram_t *spect,
+    const rts_spectrum_acc_t *acc,
     RTSFLOAT *min,
     RTSFLOAT *max,
     RTSFLOAT *f_lo,
     RTSFLOAT *f_hi)
 {
-  *min = spect->min;
-  *max = spect->max;
+  *min = acc->min;
+  *max = acc->max;
 
   *f_lo = spect->handle->info.freq - spect->handle->info.samp_rate / 2;
   *f_hi = spect->handle->info.freq + spect->handle->info.samp_rate / 2;
 }
 
+/* Hoare's selection, leaves the k-th smallest value at v[k] */
+RTS_PRIVATE RTSFLOAT
+rts_select(RTSFLOAT *v, long n, long k)
+{
+  long lo = 0, hi = n - 1;
+  long i, j;
+  RTSFLOAT pivot, tmp;
+
+  while (lo < hi) {
+    pivot = v[lo + (hi - lo) / 2];
+    i = lo;
+    j = hi;
+
+    while (i <= j) {
+      while (v[i] < pivot)
+        ++i;
+      while (v[j] > pivot)
+        --j;
+
+      if (i <= j) {
+        tmp = v[i];
+        v[i++] = v[j];
+        v[j--] = tmp;
+      }
+    }
+
+    if (k <= j)
+      hi = j;
+    else if (k >= i)
+      lo = i;
+    else
+      break;
+  }
+
+  return v[k];
+}
+
+/*
+ * Median power of the bins, per frame and in dB, DC excluded like in
+ * the spectrum range. Narrow RFI does not move it. NAN if there is
+ * nothing to measure.
+ */
+RTSFLOAT
+rts_spectrum_acc_get_noise_floor(const rts_spectrum_acc_t *acc)
+{
+  RTSFLOAT *copy;
+  RTSCOUNT count;
+  RTSFLOAT median;
+
+  if (acc->frame_count == 0 || acc->bins <= RTS_SPECTROGRAM_DC_BINS)
+    return NAN;
+
+  count = acc->bins - RTS_SPECTROGRAM_DC_BINS;
+
+  if ((copy = malloc(count * sizeof (RTSFLOAT))) == NULL)
+    return NAN;
+
+  memcpy(
+      copy,
+      acc->spectrum + RTS_SPECTROGRAM_DC_BINS / 2,
+      count * sizeof (RTSFLOAT));
+
+  median = rts_select(copy, count, count / 2) / acc->frame_count;
+
+  free(copy);
+
+  return 10 * log10(median);
+}
+
+void
+rts_spectrogram_get_range(
+    const rts_spectrogram_t *spect,
+    RTSFLOAT *min,
+    RTSFLOAT *max,
+    RTSFLOAT *f_lo,
+    RTSFLOAT *f_hi)
+{
+  rts_spectrogram_get_acc_range(spect, spect->acc, min, max, f_lo, f_hi);
+}
+
 RTSBOOL
 rts_spectrogram_dump_matlab(const rts_spectrogram_t *spect, const char *pfx)
 {
@@ -269,3 +676,134 @@ done:
 
   return ok;
 }
+
+void
+rts_spectrogram_get_archive_params(
+    const rts_spectrogram_t *spect,
+    struct rts_archive_params *params)
+{
+  params->bins      = spect->params.bins;
+  params->window    = spect->params.window;
+  params->samp_rate = spect->handle->info.samp_rate;
+  params->frames    = spect->frames;
+  params->fc        = spect->handle->info.freq;
+  params->avg_time  = spect->params.avg_time;
+
+  params->source_buffer = spect->handle->info.buffer_size;
+}
+
+rts_archive_t *
+rts_spectrogram_create_archive(
+    const rts_spectrogram_t *spect,
+    const char *path,
+    struct rts_archive_params *params)
+{
+  rts_spectrogram_get_archive_params(spect, params);
+
+  return rts_archive_create(path, params);
+}
+
+RTSBOOL
+rts_spectrogram_init_cadences(
+    rts_spectrogram_t *spect,
+    rts_cadence_func_t func,
+    void *priv)
+{
+  RTS_TRYCATCH(spect->cadences == NULL, return RTS_FALSE);
+
+  RTS_TRYCATCH(
+      spect->cadences = rts_cadence_bank_new(
+          spect->params.bins,
+          (RTSFLOAT) spect->params.bins / spect->handle->info.samp_rate,
+          func,
+          priv),
+      return RTS_FALSE);
+
+  return RTS_TRUE;
+}
+
+int
+rts_spectrogram_add_cadence(rts_spectrogram_t *spect, RTSFLOAT avg_time)
+{
+  RTS_TRYCATCH(spect->cadences != NULL, return -1);
+
+  return rts_cadence_bank_add(spect->cadences, avg_time);
+}
+
+RTSBOOL
+rts_spectrogram_get_cadence_archive_params(
+    const rts_spectrogram_t *spect,
+    unsigned int index,
+    struct rts_archive_params *params)
+{
+  const struct rts_cadence *cadence;
+
+  RTS_TRYCATCH(
+      spect->cadences != NULL
+      && index < rts_cadence_bank_get_count(spect->cadences),
+      return RTS_FALSE);
+
+  cadence = rts_cadence_bank_get(spect->cadences, index);
+
+  params->bins      = spect->params.bins;
+  params->window    = spect->params.window;
+  params->samp_rate = spect->handle->info.samp_rate;
+  params->frames    = cadence->frames;
+  params->fc        = spect->handle->info.freq;
+  params->avg_time  = cadence->avg_time;
+
+  params->source_buffer = spect->handle->info.buffer_size;
+
+  return RTS_TRUE;
+}
+
+rts_archive_t *
+rts_spectrogram_create_cadence_archive(
+    const rts_spectrogram_t *spect,
+    unsigned int index,
+    const char *path,
+    struct rts_archive_params *params)
+{
+  RTS_TRYCATCH(
+      rts_spectrogram_get_cadence_archive_params(spect, index, params),
+      return NULL);
+
+  return rts_archive_create(path, params);
+}
+
+RTSBOOL
+rts_spectrum_acc_dump_archive(
+    const rts_spectrum_acc_t *acc,
+    rts_archive_t *archive)
+{
+  struct rts_archive_record record;
+
+  RTS_TRYCATCH(acc->frame_count > 0, return RTS_FALSE);
+
+  memset(&record, 0, sizeof (struct rts_archive_record));
+
+  record.tv_sec      = acc->end.tv_sec;
+  record.tv_nsec     = acc->end.tv_nsec;
+  record.frame_count = acc->frame_count;
+  record.drop_count  = acc->xrun_count;
+  record.rtf_min     = acc->margin.rtf_min;
+  record.fill_max    = acc->margin.fill_max;
+  record.lag_max     = acc->margin.lag_max;
+  record.queue_max   = acc->margin.queue_max;
+
+  return rts_archive_append(
+      archive,
+      &record,
+      acc->spectrum,
+      1. / acc->frame_count);
+}
+
+RTSBOOL
+rts_spectrogram_dump_archive(
+    const rts_spectrogram_t *spect,
+    rts_archive_t *archive)
+{
+  clock_gettime(CLOCK_REALTIME, &spect->acc->end);
+
+  return rts_spectrum_acc_dump_archive(spect->acc, archive);
+}
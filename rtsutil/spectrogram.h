@@ -23,7 +23,11 @@
 #define _RTSUTIL_SPECTROGRAM_H
 
 #include "source.h"
+#include "archive.h"
+#include "cadence.h"
+#include "margin.h"
 
+#include <time.h>
 #include <complex.h>
 #include <fftw3.h>
 
@@ -33,8 +37,37 @@
 struct rts_spectrogram_params {
   RTSCOUNT bins;
   RTSFLOAT avg_time;
+  enum rts_window_type window;
 };
 
+/*
+ * Spectrum accumulator. The spectrogram integrates into one of these
+ * while the previous one (if any) is being processed somewhere else:
+ * rts_spectrogram_swap() hands the finished accumulator to the caller,
+ * who gives it back with rts_spectrogram_release() when done.
+ */
+struct rts_spectrum_acc {
+  RTSCOUNT bins;
+  RTSFLOAT *spectrum; /* Cumulative spectrum */
+
+  RTSCOUNT frame_count;
+  RTSCOUNT got_samples;
+  RTSCOUNT reset_count; /* Integration number */
+  RTSCOUNT xrun_count;  /* Source overruns during the integration */
+
+  /* Integration start and end (UTC) */
+  struct timespec start;
+  struct timespec end;
+
+  /* Spectrum range */
+  RTSFLOAT min;
+  RTSFLOAT max;
+
+  struct rts_margin_stats margin;
+};
+
+typedef struct rts_spectrum_acc rts_spectrum_acc_t;
+
 struct rts_spectrogram {
   struct rts_spectrogram_params params;
   rts_srchnd_t *handle;
@@ -44,23 +77,74 @@ struct rts_spectrogram {
   RTS_FFTW(_plan) fft_plan;
   RTS_FFTW(_complex) *fft;
 
-  RTSFLOAT *spectrum; /* Averaged spectrum */
-
-  RTSCOUNT frame_count;
   RTSCOUNT window_ptr;
 
+  rts_spectrum_acc_t *acc;   /* Current accumulator */
+  rts_spectrum_acc_t *spare; /* Released accumulator, swapped atomically */
+
+  rts_cadence_bank_t *cadences; /* Optional extra integration times */
+
   /* Statistical properties */
   RTSCOUNT total_samples;
-  RTSCOUNT got_samples;
   RTSCOUNT reset_count;
+  uint64_t xruns; /* Source overruns at the last frame */
 
-  /* Spectrum range */
-  RTSFLOAT min;
-  RTSFLOAT max;
+  rts_margin_t margin; /* Updated once per frame */
 };
 
 typedef struct rts_spectrogram rts_spectrogram_t;
 
+/*
+ * Everything that depends on the acquisition parameters, allocated and
+ * planned by rts_spectrogram_prepare() away from the acquisition thread
+ * and swapped in by rts_spectrogram_apply() between two integrations.
+ */
+struct rts_spectrogram_plan {
+  struct rts_spectrogram_params params;
+  RTSCOUNT frames;
+
+  RTS_FFTW(_complex) *window;
+  RTS_FFTW(_plan) fft_plan;
+  RTS_FFTW(_complex) *fft;
+
+  rts_spectrum_acc_t *acc;
+  rts_spectrum_acc_t *spare;
+
+  rts_cadence_bank_t *cadences;
+};
+
+typedef struct rts_spectrogram_plan rts_spectrogram_plan_t;
+
+RTS_PRIVATE inline const RTSFLOAT *
+rts_spectrum_acc_get_cumulative(const rts_spectrum_acc_t *acc)
+{
+  return acc->spectrum;
+}
+
+RTS_PRIVATE inline RTSCOUNT
+rts_spectrum_acc_get_frame_count(const rts_spectrum_acc_t *acc)
+{
+  return acc->frame_count;
+}
+
+RTS_PRIVATE inline RTSCOUNT
+rts_spectrum_acc_get_got_samples(const rts_spectrum_acc_t *acc)
+{
+  return acc->got_samples;
+}
+
+RTS_PRIVATE inline RTSCOUNT
+rts_spectrum_acc_get_reset_count(const rts_spectrum_acc_t *acc)
+{
+  return acc->reset_count;
+}
+
+RTS_PRIVATE inline const rts_spectrum_acc_t *
+rts_spectrogram_get_acc(const rts_spectrogram_t *spect)
+{
+  return spect->acc;
+}
+
 RTS_PRIVATE inline RTSCOUNT
 rts_spectrogram_get_reset_count(const rts_spectrogram_t *spect)
 {
@@ -76,7 +160,27 @@ rts_spectrogram_get_total_samples(const rts_spectrogram_t *spect)
 RTS_PRIVATE inline RTSCOUNT
 rts_spectrogram_get_got_samples(const rts_spectrogram_t *spect)
 {
-  return spect->got_samples;
+  return spect->acc->got_samples;
+}
+
+RTS_PRIVATE inline const rts_margin_t *
+rts_spectrogram_get_margin(const rts_spectrogram_t *spect)
+{
+  return &spect->margin;
+}
+
+/* Writer queue length, kept as a high water mark of the integration */
+RTS_PRIVATE inline void
+rts_spectrogram_note_queue(rts_spectrogram_t *spect, RTSCOUNT pending)
+{
+  if (pending > spect->acc->margin.queue_max)
+    spect->acc->margin.queue_max = pending;
+}
+
+RTS_PRIVATE inline const struct rts_spectrogram_params *
+rts_spectrogram_get_params(const rts_spectrogram_t *spect)
+{
+  return &spect->params;
 }
 
 RTS_PRIVATE inline RTSCOUNT
@@ -97,12 +201,32 @@ RTSBOOL rts_spectrogram_complete(const rts_spectrogram_t *spect);
 
 void rts_spectrogram_reset(rts_spectrogram_t *spect);
 
+rts_spectrum_acc_t *rts_spectrogram_swap(rts_spectrogram_t *spect);
+
+rts_spectrogram_plan_t *rts_spectrogram_prepare(
+    const rts_spectrogram_t *spect,
+    const struct rts_spectrogram_params *params);
+
+void rts_spectrogram_apply(
+    rts_spectrogram_t *spect,
+    rts_spectrogram_plan_t *plan);
+
+void rts_spectrogram_plan_destroy(rts_spectrogram_plan_t *plan);
+
+void rts_spectrogram_release(
+    rts_spectrogram_t *spect,
+    rts_spectrum_acc_t *acc);
+
 const RTSFLOAT *rts_spectrogram_get_cumulative(const rts_spectrogram_t *spect);
 
 RTSCOUNT rts_spectrogram_get_frame_count(const rts_spectrogram_t *spect);
 
 RTSFLOAT rts_spectrogram_get_progress(const rts_spectrogram_t *spect);
 
+RTSFLOAT rts_spectrogram_get_acc_progress(
+    const rts_spectrogram_t *spect,
+    const rts_spectrum_acc_t *acc);
+
 void rts_spectrogram_get_range(
     const rts_spectrogram_t *spect,
     RTSFLOAT *min,
@@ -110,8 +234,68 @@ void rts_spectrogram_get_range(
     RTSFLOAT *f_lo,
     RTSFLOAT *f_hi);
 
+void rts_spectrogram_get_acc_range(
+    const rts_spectrogram_t *spect,
+    const rts_spectrum_acc_t *acc,
+    RTSFLOAT *min,
+    RTSFLOAT *max,
+    RTSFLOAT *f_lo,
+    RTSFLOAT *f_hi);
+
+RTSFLOAT rts_spectrum_acc_get_noise_floor(const rts_spectrum_acc_t *acc);
+
 RTSBOOL rts_spectrogram_dump_matlab(
     const rts_spectrogram_t *spect,
     const char *pfx);
 
+/*
+ * Fills the acquisition fields of params (bins, window, rate...), the
+ * storage ones (sample type, compression) are up to the caller.
+ */
+void rts_spectrogram_get_archive_params(
+    const rts_spectrogram_t *spect,
+    struct rts_archive_params *params);
+
+rts_archive_t *rts_spectrogram_create_archive(
+    const rts_spectrogram_t *spect,
+    const char *path,
+    struct rts_archive_params *params);
+
+/*
+ * Extra cadences, in increasing order of integration time. Each one is
+ * delivered to func as soon as it completes, from the acquisition
+ * thread.
+ */
+RTSBOOL rts_spectrogram_init_cadences(
+    rts_spectrogram_t *spect,
+    rts_cadence_func_t func,
+    void *priv);
+
+int rts_spectrogram_add_cadence(rts_spectrogram_t *spect, RTSFLOAT avg_time);
+
+RTS_PRIVATE inline const rts_cadence_bank_t *
+rts_spectrogram_get_cadences(const rts_spectrogram_t *spect)
+{
+  return spect->cadences;
+}
+
+RTSBOOL rts_spectrogram_get_cadence_archive_params(
+    const rts_spectrogram_t *spect,
+    unsigned int index,
+    struct rts_archive_params *params);
+
+rts_archive_t *rts_spectrogram_create_cadence_archive(
+    const rts_spectrogram_t *spect,
+    unsigned int index,
+    const char *path,
+    struct rts_archive_params *params);
+
+RTSBOOL rts_spectrum_acc_dump_archive(
+    const rts_spectrum_acc_t *acc,
+    rts_archive_t *archive);
+
+RTSBOOL rts_spectrogram_dump_archive(
+    const rts_spectrogram_t *spect,
+    rts_archive_t *archive);
+
 #endif /* _RTSUTIL_SPECTROGRAM_H */
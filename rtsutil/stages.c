@@ -0,0 +1,662 @@
+/*
+  stages.c: Built-in pipeline stages
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pipeline.h"
+
+RTS_PRIVATE RTSBOOL
+rts_stage_get_float(
+    const rts_params_t *params,
+    const char *stage,
+    const char *name,
+    RTSFLOAT *value)
+{
+  const char *str;
+
+  if ((str = rts_params_get(params, name)) != NULL)
+    if (sscanf(str, "%lf", value) < 1) {
+      fprintf(stderr, "%s stage: wrong value for `%s'\n", stage, name);
+      return RTS_FALSE;
+    }
+
+  return RTS_TRUE;
+}
+
+/******************************** DC blocker ********************************/
+#define RTS_DCBLOCK_DEFAULT_ALPHA .999
+
+struct rts_dcblock_state {
+  RTSFLOAT alpha;
+  RTSCOMPLEX x1; /* Previous input */
+  RTSCOMPLEX y1; /* Previous output */
+};
+
+RTS_PRIVATE void *
+rts_dcblock_open(const rts_params_t *params, struct rts_signal_source_info *info)
+{
+  struct rts_dcblock_state *new = NULL;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (struct rts_dcblock_state)), goto fail);
+
+  new->alpha = RTS_DCBLOCK_DEFAULT_ALPHA;
+
+  if (!rts_stage_get_float(params, "dcblock", "alpha", &new->alpha))
+    goto fail;
+
+  return new;
+
+fail:
+  if (new != NULL)
+    free(new);
+
+  return NULL;
+}
+
+RTS_PRIVATE rts_block_t *
+rts_dcblock_process(void *priv, rts_block_t *block)
+{
+  struct rts_dcblock_state *state = (struct rts_dcblock_state *) priv;
+  RTSCOMPLEX x, y;
+  unsigned int i;
+
+  /* y[n] = x[n] - x[n - 1] + alpha * y[n - 1] */
+  for (i = 0; i < block->length; ++i) {
+    x = block->data[i];
+    y = x - state->x1 + state->alpha * state->y1;
+    state->x1 = x;
+    state->y1 = y;
+    block->data[i] = y;
+  }
+
+  return block;
+}
+
+RTS_PRIVATE void
+rts_dcblock_close(void *priv)
+{
+  free(priv);
+}
+
+RTSBOOL
+rts_dcblock_stage_register(void)
+{
+  static struct rts_stage_class class =
+  {
+      .name = "dcblock",
+      .open = rts_dcblock_open,
+      .process = rts_dcblock_process,
+      .close = rts_dcblock_close
+  };
+
+  RTS_TRYCATCH(rts_stage_class_register(&class), return RTS_FALSE);
+
+  return RTS_TRUE;
+}
+
+/***************************** IQ imbalance correction **********************/
+#define RTS_IQCORR_DEFAULT_MU 1e-2
+
+/*
+ * Received Q branch is modelled as g * (Q cos(phi) + I sin(phi)). Unless
+ * gain and phase are given, both are estimated blindly from the running
+ * second-order moments of I and Q, updated once per block.
+ */
+struct rts_iqcorr_state {
+  RTSBOOL adaptive;
+  RTSFLOAT mu;
+
+  RTSFLOAT p_ii;
+  RTSFLOAT p_qq;
+  RTSFLOAT p_iq;
+
+  RTSFLOAT inv_gain;
+  RTSFLOAT sin_phi;
+  RTSFLOAT inv_cos_phi;
+};
+
+RTS_PRIVATE void *
+rts_iqcorr_open(const rts_params_t *params, struct rts_signal_source_info *info)
+{
+  struct rts_iqcorr_state *new = NULL;
+  RTSFLOAT gain = 1;
+  RTSFLOAT phase = 0;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (struct rts_iqcorr_state)), goto fail);
+
+  new->mu = RTS_IQCORR_DEFAULT_MU;
+  new->adaptive = rts_params_get(params, "gain") == NULL
+      && rts_params_get(params, "phase") == NULL;
+
+  if (!rts_stage_get_float(params, "iqcorr", "mu", &new->mu))
+    goto fail;
+
+  if (!rts_stage_get_float(params, "iqcorr", "gain", &gain))
+    goto fail;
+
+  if (!rts_stage_get_float(params, "iqcorr", "phase", &phase))
+    goto fail;
+
+  if (gain <= 0) {
+    fprintf(stderr, "iqcorr stage: gain must be positive\n");
+    goto fail;
+  }
+
+  phase *= M_PI / 180;
+
+  new->inv_gain = 1. / gain;
+  new->sin_phi = sin(phase);
+  new->inv_cos_phi = 1. / cos(phase);
+
+  return new;
+
+fail:
+  if (new != NULL)
+    free(new);
+
+  return NULL;
+}
+
+RTS_PRIVATE void
+rts_iqcorr_update(struct rts_iqcorr_state *state, const rts_block_t *block)
+{
+  RTSFLOAT ii = 0, qq = 0, iq = 0;
+  RTSFLOAT re, im;
+  RTSFLOAT sin_phi;
+  unsigned int i;
+
+  for (i = 0; i < block->length; ++i) {
+    re = creal(block->data[i]);
+    im = cimag(block->data[i]);
+    ii += re * re;
+    qq += im * im;
+    iq += re * im;
+  }
+
+  ii /= block->length;
+  qq /= block->length;
+  iq /= block->length;
+
+  if (state->p_ii == 0) {
+    state->p_ii = ii;
+    state->p_qq = qq;
+    state->p_iq = iq;
+  } else {
+    state->p_ii += state->mu * (ii - state->p_ii);
+    state->p_qq += state->mu * (qq - state->p_qq);
+    state->p_iq += state->mu * (iq - state->p_iq);
+  }
+
+  if (state->p_ii > 0 && state->p_qq > 0) {
+    sin_phi = state->p_iq / sqrt(state->p_ii * state->p_qq);
+    if (fabs(sin_phi) < 1) {
+      state->inv_gain = sqrt(state->p_ii / state->p_qq);
+      state->sin_phi = sin_phi;
+      state->inv_cos_phi = 1. / sqrt(1 - sin_phi * sin_phi);
+    }
+  }
+}
+
+RTS_PRIVATE rts_block_t *
+rts_iqcorr_process(void *priv, rts_block_t *block)
+{
+  struct rts_iqcorr_state *state = (struct rts_iqcorr_state *) priv;
+  RTSFLOAT re, im;
+  unsigned int i;
+
+  if (block->length == 0)
+    return block;
+
+  if (state->adaptive)
+    rts_iqcorr_update(state, block);
+
+  for (i = 0; i < block->length; ++i) {
+    re = creal(block->data[i]);
+    im = cimag(block->data[i]);
+    im = (im * state->inv_gain - re * state->sin_phi) * state->inv_cos_phi;
+    block->data[i] = re + I * im;
+  }
+
+  return block;
+}
+
+RTS_PRIVATE void
+rts_iqcorr_close(void *priv)
+{
+  free(priv);
+}
+
+RTSBOOL
+rts_iqcorr_stage_register(void)
+{
+  static struct rts_stage_class class =
+  {
+      .name = "iqcorr",
+      .open = rts_iqcorr_open,
+      .process = rts_iqcorr_process,
+      .close = rts_iqcorr_close
+  };
+
+  RTS_TRYCATCH(rts_stage_class_register(&class), return RTS_FALSE);
+
+  return RTS_TRUE;
+}
+
+/****************************** Noise blanker *******************************/
+#define RTS_BLANKER_DEFAULT_THRESHOLD 20. /* Power ratio */
+#define RTS_BLANKER_DEFAULT_TAU       1024.
+#define RTS_BLANKER_DEFAULT_HOLD      8
+
+struct rts_blanker_state {
+  RTSFLOAT threshold;
+  RTSFLOAT alpha;
+  RTSCOUNT hold;
+
+  RTSFLOAT mean; /* Mean power of unblanked samples */
+  RTSCOUNT remaining;
+  uint64_t blanked;
+};
+
+RTS_PRIVATE void *
+rts_blanker_open(const rts_params_t *params, struct rts_signal_source_info *info)
+{
+  struct rts_blanker_state *new = NULL;
+  RTSFLOAT tau = RTS_BLANKER_DEFAULT_TAU;
+  RTSFLOAT hold = RTS_BLANKER_DEFAULT_HOLD;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (struct rts_blanker_state)), goto fail);
+
+  new->threshold = RTS_BLANKER_DEFAULT_THRESHOLD;
+
+  if (!rts_stage_get_float(params, "blanker", "threshold", &new->threshold))
+    goto fail;
+
+  if (!rts_stage_get_float(params, "blanker", "tau", &tau))
+    goto fail;
+
+  if (!rts_stage_get_float(params, "blanker", "hold", &hold))
+    goto fail;
+
+  if (tau < 1 || hold < 0) {
+    fprintf(stderr, "blanker stage: invalid tau or hold\n");
+    goto fail;
+  }
+
+  new->alpha = 1. / tau;
+  new->hold = hold;
+
+  return new;
+
+fail:
+  if (new != NULL)
+    free(new);
+
+  return NULL;
+}
+
+RTS_PRIVATE rts_block_t *
+rts_blanker_process(void *priv, rts_block_t *block)
+{
+  struct rts_blanker_state *state = (struct rts_blanker_state *) priv;
+  RTSFLOAT power;
+  unsigned int i;
+
+  for (i = 0; i < block->length; ++i) {
+    power = creal(block->data[i] * conj(block->data[i]));
+
+    if (state->mean > 0 && power > state->threshold * state->mean)
+      state->remaining = state->hold + 1;
+
+    if (state->remaining > 0) {
+      --state->remaining;
+      ++state->blanked;
+      block->data[i] = 0;
+    } else {
+      state->mean += state->alpha * (power - state->mean);
+    }
+  }
+
+  return block;
+}
+
+RTS_PRIVATE void
+rts_blanker_close(void *priv)
+{
+  struct rts_blanker_state *state = (struct rts_blanker_state *) priv;
+
+  if (state->blanked > 0)
+    fprintf(
+        stderr,
+        "blanker: %llu samples blanked\n",
+        (unsigned long long) state->blanked);
+
+  free(state);
+}
+
+RTSBOOL
+rts_blanker_stage_register(void)
+{
+  static struct rts_stage_class class =
+  {
+      .name = "blanker",
+      .open = rts_blanker_open,
+      .process = rts_blanker_process,
+      .close = rts_blanker_close
+  };
+
+  RTS_TRYCATCH(rts_stage_class_register(&class), return RTS_FALSE);
+
+  return RTS_TRUE;
+}
+
+/************************** Digital downconverter ***************************/
+#define RTS_DDC_NORMALIZE_BLOCKS 64
+#define RTS_DDC_DEFAULT_TAPS     32 /* Per output sample */
+
+/*
+ * Shifts the spectrum by -shift Hz and decimates by an integer factor.
+ * Integrate-and-dump would only reject out of band signals by ~13 dB,
+ * so a Blackman-Harris windowed sinc, cut at the output Nyquist
+ * frequency, runs before dropping samples: the band edges are within
+ * its transition, but anything beyond them is down by more than 90 dB.
+ * Decimated samples are written in place at the beginning of the block.
+ */
+struct rts_ddc_state {
+  RTSCOMPLEX phasor;
+  RTSCOMPLEX rot;
+  RTSCOUNT decim;
+  RTSCOUNT blocks;
+
+  RTSFLOAT *taps; /* Symmetric */
+  RTSCOUNT ntaps;
+  RTSCOMPLEX *history; /* Twice the taps, to read them contiguously */
+  RTSCOUNT pos;
+  RTSCOUNT phase; /* Inputs since the last output */
+};
+
+RTS_PRIVATE void
+rts_ddc_close(void *priv)
+{
+  struct rts_ddc_state *state = (struct rts_ddc_state *) priv;
+
+  if (state->taps != NULL)
+    free(state->taps);
+
+  if (state->history != NULL)
+    free(state->history);
+
+  free(state);
+}
+
+/* Unit gain at DC */
+RTS_PRIVATE void
+rts_ddc_design(RTSFLOAT *taps, RTSCOUNT ntaps, RTSCOUNT decim)
+{
+  RTSFLOAT m = (ntaps - 1) / 2.;
+  RTSFLOAT t, x, w;
+  RTSFLOAT sum = 0;
+  RTSCOUNT i;
+
+  for (i = 0; i < ntaps; ++i) {
+    t = 2 * M_PI * i / (ntaps - 1);
+    w = 0.35875
+        - 0.48829 * cos(t)
+        + 0.14128 * cos(2 * t)
+        - 0.01168 * cos(3 * t);
+
+    x = M_PI * (i - m) / decim;
+    taps[i] = w * (x == 0 ? 1 : sin(x) / x);
+    sum += taps[i];
+  }
+
+  for (i = 0; i < ntaps; ++i)
+    taps[i] /= sum;
+}
+
+RTS_PRIVATE void *
+rts_ddc_open(const rts_params_t *params, struct rts_signal_source_info *info)
+{
+  struct rts_ddc_state *new = NULL;
+  RTSFLOAT shift = 0;
+  RTSFLOAT decim = 1;
+  RTSFLOAT taps = RTS_DDC_DEFAULT_TAPS;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (struct rts_ddc_state)), goto fail);
+
+  if (!rts_stage_get_float(params, "ddc", "shift", &shift))
+    goto fail;
+
+  if (!rts_stage_get_float(params, "ddc", "decim", &decim))
+    goto fail;
+
+  if (!rts_stage_get_float(params, "ddc", "taps", &taps))
+    goto fail;
+
+  if (info->samp_rate == 0) {
+    fprintf(stderr, "ddc stage: unknown input sample rate\n");
+    goto fail;
+  }
+
+  /* Otherwise the output rate, and the frequency axis, would be wrong */
+  if (decim < 1
+      || decim != floor(decim)
+      || decim > info->samp_rate
+      || info->samp_rate % (unsigned int) decim != 0) {
+    fprintf(
+        stderr,
+        "ddc stage: decimation must be an integer dividing %u\n",
+        info->samp_rate);
+    goto fail;
+  }
+
+  if (taps < 1) {
+    fprintf(stderr, "ddc stage: invalid number of taps\n");
+    goto fail;
+  }
+
+  new->decim = decim;
+  new->phasor = 1;
+  new->rot = cexp(-2 * M_PI * I * shift / info->samp_rate);
+
+  if (new->decim > 1) {
+    new->ntaps = (RTSCOUNT) taps * new->decim + 1;
+
+    RTS_TRYCATCH(
+        new->taps = malloc(new->ntaps * sizeof (RTSFLOAT)),
+        goto fail);
+    RTS_TRYCATCH(
+        new->history = calloc(2 * new->ntaps, sizeof (RTSCOMPLEX)),
+        goto fail);
+
+    rts_ddc_design(new->taps, new->ntaps, new->decim);
+  }
+
+  info->freq += (int64_t) round(shift);
+  info->samp_rate /= new->decim;
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_ddc_close(new);
+
+  return NULL;
+}
+
+/* One output every decim inputs, from the last ntaps of them */
+RTS_PRIVATE RTSCOMPLEX
+rts_ddc_filter(const struct rts_ddc_state *state)
+{
+  const RTSCOMPLEX *x = state->history + state->pos;
+  RTSCOMPLEX y = 0;
+  RTSCOUNT i;
+
+  for (i = 0; i < state->ntaps; ++i)
+    y += state->taps[i] * x[i];
+
+  return y;
+}
+
+RTS_PRIVATE rts_block_t *
+rts_ddc_process(void *priv, rts_block_t *block)
+{
+  struct rts_ddc_state *state = (struct rts_ddc_state *) priv;
+  RTSCOMPLEX phasor = state->phasor;
+  RTSCOMPLEX x;
+  RTSCOUNT out = 0;
+  unsigned int i;
+
+  for (i = 0; i < block->length; ++i) {
+    x = block->data[i] * phasor;
+    phasor *= state->rot;
+
+    if (state->decim == 1) {
+      block->data[out++] = x;
+      continue;
+    }
+
+    state->history[state->pos] = state->history[state->pos + state->ntaps] = x;
+    if (++state->pos == state->ntaps)
+      state->pos = 0;
+
+    if (++state->phase == state->decim) {
+      block->data[out++] = rts_ddc_filter(state);
+      state->phase = 0;
+    }
+  }
+
+  /* Keep the oscillator on the unit circle */
+  if (++state->blocks % RTS_DDC_NORMALIZE_BLOCKS == 0)
+    phasor /= cabs(phasor);
+
+  state->phasor = phasor;
+  block->length = out;
+
+  return block;
+}
+
+RTSBOOL
+rts_ddc_stage_register(void)
+{
+  static struct rts_stage_class class =
+  {
+      .name = "ddc",
+      .open = rts_ddc_open,
+      .process = rts_ddc_process,
+      .close = rts_ddc_close
+  };
+
+  RTS_TRYCATCH(rts_stage_class_register(&class), return RTS_FALSE);
+
+  return RTS_TRUE;
+}
+
+/****************************** Recorder tee ********************************/
+#define RTS_TEE_BUF_MAX 1024
+
+/* Samples are saved as complex float, the format read by the file source */
+struct rts_tee_state {
+  FILE *fp;
+  complex float buffer[RTS_TEE_BUF_MAX];
+};
+
+RTS_PRIVATE void
+rts_tee_close(void *priv)
+{
+  struct rts_tee_state *state = (struct rts_tee_state *) priv;
+
+  if (state->fp != NULL)
+    fclose(state->fp);
+
+  free(state);
+}
+
+RTS_PRIVATE void *
+rts_tee_open(const rts_params_t *params, struct rts_signal_source_info *info)
+{
+  struct rts_tee_state *new = NULL;
+  const char *path;
+
+  if ((path = rts_params_get(params, "path")) == NULL) {
+    fprintf(stderr, "tee stage: `path' not set\n");
+    goto fail;
+  }
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (struct rts_tee_state)), goto fail);
+
+  if ((new->fp = fopen(path, "wb")) == NULL) {
+    fprintf(
+        stderr,
+        "tee stage: cannot open %s: %s\n",
+        path,
+        strerror(errno));
+    goto fail;
+  }
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_tee_close(new);
+
+  return NULL;
+}
+
+RTS_PRIVATE rts_block_t *
+rts_tee_process(void *priv, rts_block_t *block)
+{
+  struct rts_tee_state *state = (struct rts_tee_state *) priv;
+  unsigned int i, j, chunk;
+
+  for (i = 0; i < block->length; i += chunk) {
+    chunk = MIN(block->length - i, RTS_TEE_BUF_MAX);
+
+    for (j = 0; j < chunk; ++j)
+      state->buffer[j] = block->data[i + j];
+
+    if (fwrite(state->buffer, sizeof (complex float), chunk, state->fp)
+        < chunk) {
+      fprintf(stderr, "tee stage: write error: %s\n", strerror(errno));
+      rts_block_unref(block);
+      return NULL;
+    }
+  }
+
+  return block;
+}
+
+RTSBOOL
+rts_tee_stage_register(void)
+{
+  static struct rts_stage_class class =
+  {
+      .name = "tee",
+      .open = rts_tee_open,
+      .process = rts_tee_process,
+      .close = rts_tee_close
+  };
+
+  RTS_TRYCATCH(rts_stage_class_register(&class), return RTS_FALSE);
+
+  return RTS_TRUE;
+}
@@ -0,0 +1,205 @@
+/*
+  trace.c: Per-thread event rings, dumped in Chrome trace format
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+#include "perf.h"
+
+#if RTS_TRACE
+__thread struct rts_trace_ring *rts_trace_self;
+
+static struct rts_trace_ring *rts_trace_rings;
+
+struct rts_trace_ring *
+rts_trace_ring_new(void)
+{
+  struct rts_trace_ring *new = NULL;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (struct rts_trace_ring)), return NULL);
+
+  new->tid = syscall(SYS_gettid);
+  snprintf(new->name, sizeof (new->name), "thread %d", (int) new->tid);
+
+  new->next = __atomic_load_n(&rts_trace_rings, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(
+      &rts_trace_rings,
+      &new->next,
+      new,
+      RTS_TRUE,
+      __ATOMIC_RELEASE,
+      __ATOMIC_RELAXED));
+
+  rts_trace_self = new;
+
+  return new;
+}
+
+void
+rts_trace_set_thread_name(const char *name)
+{
+  struct rts_trace_ring *ring = rts_trace_self;
+
+  if (ring == NULL && (ring = rts_trace_ring_new()) == NULL)
+    return;
+
+  /* Read along with the spans, good enough for a label */
+  strncpy(ring->name, name, sizeof (ring->name) - 1);
+}
+
+/*
+ * Copies the ring and returns how many spans of the copy are still
+ * valid, from copy[*offset] on, oldest first.
+ */
+RTS_PRIVATE uint64_t
+rts_trace_ring_copy(
+    const struct rts_trace_ring *ring,
+    struct rts_trace_span *copy,
+    uint64_t *offset)
+{
+  uint64_t head, tail, after, valid;
+  uint64_t i;
+
+  head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  tail = head > RTS_TRACE_RING_SIZE ? head - RTS_TRACE_RING_SIZE : 0;
+
+  for (i = tail; i < head; ++i)
+    copy[i - tail] = ring->span[i & (RTS_TRACE_RING_SIZE - 1)];
+
+  /* The owner may have replaced the oldest ones, one more in flight */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  after = __atomic_load_n(&ring->head, __ATOMIC_RELAXED) + 1;
+  valid = after > RTS_TRACE_RING_SIZE ? after - RTS_TRACE_RING_SIZE : 0;
+
+  valid = MAX(valid, tail);
+  valid = MIN(valid, head);
+
+  *offset = valid - tail;
+
+  return head - valid;
+}
+
+/* Timestamps in microseconds, with the nanoseconds as decimals */
+RTS_PRIVATE void
+rts_trace_write_ring(
+    FILE *fp,
+    const struct rts_trace_ring *ring,
+    struct rts_trace_span *copy,
+    RTSBOOL *first_event)
+{
+  const struct rts_trace_span *span;
+  uint64_t count, offset;
+  uint64_t i;
+  int pid = getpid();
+
+  fprintf(
+      fp,
+      "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+      "\"args\":{\"name\":\"%s\"}}",
+      *first_event ? "" : ",",
+      pid,
+      (int) ring->tid,
+      ring->name);
+  *first_event = RTS_FALSE;
+
+  count = rts_trace_ring_copy(ring, copy, &offset);
+
+  for (i = 0; i < count; ++i) {
+    span = &copy[offset + i];
+
+    if (span->stage >= RTS_PERF_STAGE_COUNT || span->end < span->start)
+      continue;
+
+    fprintf(
+        fp,
+        ",\n{\"name\":\"%s\",\"cat\":\"rts\",\"ph\":\"X\",\"pid\":%d,"
+        "\"tid\":%d,\"ts\":%llu.%03u,\"dur\":%llu.%03u}",
+        rts_perf_stage_name(span->stage),
+        pid,
+        (int) ring->tid,
+        (unsigned long long) (span->start / 1000),
+        (unsigned int) (span->start % 1000),
+        (unsigned long long) ((span->end - span->start) / 1000),
+        (unsigned int) ((span->end - span->start) % 1000));
+  }
+}
+
+/* Written aside and renamed, like the perf stats */
+RTSBOOL
+rts_trace_dump(const char *path)
+{
+  const struct rts_trace_ring *ring;
+  struct rts_trace_span *copy = NULL;
+  RTSBOOL first_event = RTS_TRUE;
+  char *tmp = NULL;
+  FILE *fp = NULL;
+  RTSBOOL ok = RTS_FALSE;
+
+  RTS_TRYCATCH(
+      copy = malloc(RTS_TRACE_RING_SIZE * sizeof (struct rts_trace_span)),
+      goto done);
+
+  RTS_TRYCATCH(tmp = strbuild("%s.tmp", path), goto done);
+  RTS_TRYCATCH(fp = fopen(tmp, "w"), goto done);
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+  for (ring = __atomic_load_n(&rts_trace_rings, __ATOMIC_ACQUIRE);
+       ring != NULL;
+       ring = ring->next)
+    rts_trace_write_ring(fp, ring, copy, &first_event);
+
+  fprintf(fp, "\n]}\n");
+
+  RTS_TRYCATCH(fclose(fp) == 0, fp = NULL; goto done);
+  fp = NULL;
+
+  RTS_TRYCATCH(rename(tmp, path) == 0, goto done);
+
+  ok = RTS_TRUE;
+
+done:
+  if (fp != NULL)
+    fclose(fp);
+
+  if (tmp != NULL)
+    free(tmp);
+
+  if (copy != NULL)
+    free(copy);
+
+  return ok;
+}
+#else
+void
+rts_trace_set_thread_name(const char *name)
+{
+}
+
+RTSBOOL
+rts_trace_dump(const char *path)
+{
+  return RTS_FALSE;
+}
+#endif /* RTS_TRACE */
@@ -0,0 +1,104 @@
+/*
+  trace.h: Per-thread event rings, dumped in Chrome trace format
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_TRACE_H
+#define _RTSUTIL_TRACE_H
+
+#include <sys/types.h>
+
+#include "common.h"
+
+/*
+ * Every span timed by perf.h (source reads, FFT, redraws, dumps, I/O...)
+ * is also kept in a ring of the thread that ran it, to see when each
+ * one happened and not just how long it took. Off unless built with
+ * -DRTS_TRACE=1 (configure --enable-trace).
+ */
+#ifndef RTS_TRACE
+#  define RTS_TRACE 0
+#endif
+
+#define RTS_TRACE_RING_SIZE 65536 /* Spans per thread, a power of two */
+#define RTS_TRACE_NAME_MAX  16
+
+struct rts_trace_span {
+  uint64_t start; /* Monotonic ns */
+  uint64_t end;
+  uint32_t stage; /* enum rts_perf_stage */
+};
+
+/*
+ * Only the owner thread writes, and head is published last: readers
+ * copy the ring and then drop whatever the owner may have overwritten
+ * meanwhile. Rings outlive their threads, so that spans of threads
+ * already gone still make it to the file.
+ */
+struct rts_trace_ring {
+  struct rts_trace_ring *next; /* All rings, most recent first */
+  pid_t tid;
+  char name[RTS_TRACE_NAME_MAX];
+  uint64_t head; /* Spans ever recorded */
+  struct rts_trace_span span[RTS_TRACE_RING_SIZE];
+};
+
+#if RTS_TRACE
+extern __thread struct rts_trace_ring *rts_trace_self;
+
+struct rts_trace_ring *rts_trace_ring_new(void);
+#endif /* RTS_TRACE */
+
+RTS_PRIVATE inline void
+rts_trace_record(unsigned int stage, uint64_t start, uint64_t end)
+{
+#if RTS_TRACE
+  struct rts_trace_ring *ring = rts_trace_self;
+  struct rts_trace_span *span;
+
+  if (ring == NULL && (ring = rts_trace_ring_new()) == NULL)
+    return;
+
+  span = &ring->span[ring->head & (RTS_TRACE_RING_SIZE - 1)];
+  span->start = start;
+  span->end   = end;
+  span->stage = stage;
+
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+#endif /* RTS_TRACE */
+}
+
+RTS_PRIVATE inline RTSBOOL
+rts_trace_enabled(void)
+{
+  return RTS_TRACE ? RTS_TRUE : RTS_FALSE;
+}
+
+/* Names the calling thread in the trace */
+void rts_trace_set_thread_name(const char *name);
+
+/*
+ * Writes the spans held by every ring as Chrome trace JSON (load it in
+ * chrome://tracing or Perfetto). Rings are not drained: every dump has
+ * the last RTS_TRACE_RING_SIZE spans of each thread. May be called from
+ * any thread.
+ */
+RTSBOOL rts_trace_dump(const char *path);
+
+#endif /* _RTSUTIL_TRACE_H */
@@ -0,0 +1,292 @@
+/*
+  waterfall.c: History of sub-integration spectra
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+
+#include "waterfall.h"
+
+#define RTS_WATERFALL_FLOOR 1e-30 /* Avoid log10(0) */
+
+void
+rts_waterfall_destroy(rts_waterfall_t *wf)
+{
+  if (wf->level != NULL)
+    free(wf->level);
+
+  if (wf->data != NULL)
+    free(wf->data);
+
+  if (wf->info != NULL)
+    free(wf->info);
+
+  if (wf->prev != NULL)
+    free(wf->prev);
+
+  if (wf->pending != NULL)
+    free(wf->pending);
+
+  if (wf->linear != NULL)
+    free(wf->linear);
+
+  free(wf);
+}
+
+rts_waterfall_t *
+rts_waterfall_new(RTSCOUNT bins, RTSCOUNT depth, RTSCOUNT width)
+{
+  rts_waterfall_t *new = NULL;
+  RTSCOUNT n;
+  unsigned int i;
+
+  RTS_TRYCATCH(bins > 0 && depth > 0, goto fail);
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_waterfall_t)), goto fail);
+
+  new->bins  = bins;
+  new->depth = depth;
+
+  for (n = bins; n > 0; n >>= 1)
+    ++new->levels;
+
+  RTS_TRYCATCH(
+      new->level = calloc(new->levels, sizeof (struct rts_waterfall_level)),
+      goto fail);
+
+  /* Level 0 is stored once, coarser levels have three arrays */
+  new->level[0].bins = bins;
+  new->pyramid_size = bins;
+
+  for (i = 1; i < new->levels; ++i) {
+    new->level[i].bins = new->level[i - 1].bins >> 1;
+    new->level[i].offset[RTS_WATERFALL_MEAN] = new->pyramid_size;
+    new->level[i].offset[RTS_WATERFALL_MIN]  =
+        new->pyramid_size + new->level[i].bins;
+    new->level[i].offset[RTS_WATERFALL_MAX]  =
+        new->pyramid_size + 2 * new->level[i].bins;
+    new->pyramid_size += 3 * new->level[i].bins;
+  }
+
+  /* Levels are laid out finest first: rows keep the tail only */
+  new->first = rts_waterfall_select_level(new, width);
+  new->base = new->level[new->first].offset[RTS_WATERFALL_MEAN];
+  new->row_size = new->pyramid_size - new->base;
+
+  RTS_TRYCATCH(
+      new->data = malloc(depth * new->row_size * sizeof (float)),
+      goto fail);
+
+  RTS_TRYCATCH(
+      new->info = calloc(depth, sizeof (struct rts_waterfall_row_info)),
+      goto fail);
+
+  RTS_TRYCATCH(new->prev = calloc(bins, sizeof (RTSFLOAT)), goto fail);
+  RTS_TRYCATCH(new->pending = calloc(bins, sizeof (RTSFLOAT)), goto fail);
+  RTS_TRYCATCH(
+      new->linear = malloc(new->pyramid_size * sizeof (RTSFLOAT)),
+      goto fail);
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_waterfall_destroy(new);
+
+  return NULL;
+}
+
+void
+rts_waterfall_feed(
+    rts_waterfall_t *wf,
+    const RTSFLOAT *cumulative,
+    RTSCOUNT frames)
+{
+  RTSCOUNT i;
+
+  if (frames <= wf->prev_frames)
+    return;
+
+  for (i = 0; i < wf->bins; ++i) {
+    wf->pending[i] += cumulative[i] - wf->prev[i];
+    wf->prev[i] = cumulative[i];
+  }
+
+  wf->pending_frames += frames - wf->prev_frames;
+  wf->prev_frames = frames;
+}
+
+void
+rts_waterfall_restart(rts_waterfall_t *wf)
+{
+  memset(wf->prev, 0, wf->bins * sizeof (RTSFLOAT));
+  wf->prev_frames = 0;
+}
+
+RTSBOOL
+rts_waterfall_commit(rts_waterfall_t *wf)
+{
+  struct rts_waterfall_row_info *info;
+  const struct rts_waterfall_level *lo, *hi;
+  const struct rts_waterfall_level *first = wf->level + wf->first;
+  RTSFLOAT *linear = wf->linear;
+  RTSFLOAT a, b;
+  float *row;
+  const float *min, *max;
+  RTSCOUNT half = wf->bins / 2;
+  RTSCOUNT i;
+  unsigned int k;
+
+  if (wf->pending_frames == 0)
+    return RTS_FALSE;
+
+  /* Level 0: mean power, FFT order to frequency order */
+  for (i = 0; i < wf->bins; ++i)
+    linear[i] = wf->pending[(i + wf->bins - half) % wf->bins]
+        / wf->pending_frames;
+
+  /* Coarser levels, each one from the previous */
+  for (k = 1; k < wf->levels; ++k) {
+    lo = wf->level + k - 1;
+    hi = wf->level + k;
+
+    for (i = 0; i < hi->bins; ++i) {
+      a = linear[lo->offset[RTS_WATERFALL_MEAN] + 2 * i];
+      b = linear[lo->offset[RTS_WATERFALL_MEAN] + 2 * i + 1];
+      linear[hi->offset[RTS_WATERFALL_MEAN] + i] = .5 * (a + b);
+
+      a = linear[lo->offset[RTS_WATERFALL_MIN] + 2 * i];
+      b = linear[lo->offset[RTS_WATERFALL_MIN] + 2 * i + 1];
+      linear[hi->offset[RTS_WATERFALL_MIN] + i] = a < b ? a : b;
+
+      a = linear[lo->offset[RTS_WATERFALL_MAX] + 2 * i];
+      b = linear[lo->offset[RTS_WATERFALL_MAX] + 2 * i + 1];
+      linear[hi->offset[RTS_WATERFALL_MAX] + i] = a > b ? a : b;
+    }
+  }
+
+  /* Everything to dB at once. Min and max commute with the log. */
+  row  = wf->data + wf->head * wf->row_size;
+  info = wf->info + wf->head;
+
+  linear += wf->base;
+  for (i = 0; i < wf->row_size; ++i)
+    row[i] = 10 * log10(
+        linear[i] > RTS_WATERFALL_FLOOR ? linear[i] : RTS_WATERFALL_FLOOR);
+
+  /* Same range as level 0, whatever the first level stored is */
+  info->min = INFINITY;
+  info->max = -INFINITY;
+  min = row + first->offset[RTS_WATERFALL_MIN] - wf->base;
+  max = row + first->offset[RTS_WATERFALL_MAX] - wf->base;
+  for (i = 0; i < first->bins; ++i) {
+    if (min[i] < info->min)
+      info->min = min[i];
+    if (max[i] > info->max)
+      info->max = max[i];
+  }
+
+  clock_gettime(CLOCK_REALTIME, &info->ts);
+  info->frames = wf->pending_frames;
+
+  memset(wf->pending, 0, wf->bins * sizeof (RTSFLOAT));
+  wf->pending_frames = 0;
+
+  wf->head = (wf->head + 1) % wf->depth;
+  if (wf->count < wf->depth)
+    ++wf->count;
+
+  return RTS_TRUE;
+}
+
+unsigned int
+rts_waterfall_select_level(const rts_waterfall_t *wf, RTSCOUNT width)
+{
+  unsigned int k = wf->first;
+
+  while (k + 1 < wf->levels && wf->level[k + 1].bins >= width)
+    ++k;
+
+  return k;
+}
+
+RTS_PRIVATE RTSCOUNT
+rts_waterfall_get_index(const rts_waterfall_t *wf, RTSCOUNT age)
+{
+  return (wf->head + wf->depth - 1 - age) % wf->depth;
+}
+
+const float *
+rts_waterfall_get_row(
+    const rts_waterfall_t *wf,
+    RTSCOUNT age,
+    unsigned int level,
+    enum rts_waterfall_stat stat)
+{
+  if (age >= wf->count || level < wf->first || level >= wf->levels)
+    return NULL;
+
+  /* Level 0 has one array for all statistics */
+  if (level == 0)
+    stat = RTS_WATERFALL_MEAN;
+
+  return wf->data
+      + rts_waterfall_get_index(wf, age) * wf->row_size
+      + wf->level[level].offset[stat]
+      - wf->base;
+}
+
+const struct rts_waterfall_row_info *
+rts_waterfall_get_row_info(const rts_waterfall_t *wf, RTSCOUNT age)
+{
+  if (age >= wf->count)
+    return NULL;
+
+  return wf->info + rts_waterfall_get_index(wf, age);
+}
+
+RTSBOOL
+rts_waterfall_get_range(
+    const rts_waterfall_t *wf,
+    RTSCOUNT rows,
+    float *min,
+    float *max)
+{
+  const struct rts_waterfall_row_info *info;
+  RTSCOUNT i;
+
+  if (rows > wf->count)
+    rows = wf->count;
+
+  if (rows == 0)
+    return RTS_FALSE;
+
+  *min = INFINITY;
+  *max = -INFINITY;
+
+  for (i = 0; i < rows; ++i) {
+    info = rts_waterfall_get_row_info(wf, i);
+    if (info->min < *min)
+      *min = info->min;
+    if (info->max > *max)
+      *max = info->max;
+  }
+
+  return RTS_TRUE;
+}
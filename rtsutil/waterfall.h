@@ -0,0 +1,151 @@
+/*
+  waterfall.h: History of sub-integration spectra
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_WATERFALL_H
+#define _RTSUTIL_WATERFALL_H
+
+#include <time.h>
+
+#include "common.h"
+
+/*
+ * Fixed-size ring of spectra. Each row is the mean power spectrum of
+ * the frames integrated since the previous row, obtained as the
+ * difference of two cumulative spectra, so the integrator itself is
+ * left untouched.
+ *
+ * Rows are stored in frequency order (lowest frequency first) and in
+ * dB, together with a decimation pyramid: level k has bins >> k
+ * entries, each one summarizing 2^k bins of level 0 by their minimum,
+ * maximum and mean. Level 0 has a single array (min = max = mean).
+ * Drawing a row of a given width only needs the level closest to that
+ * width, whatever the FFT size is, so levels finer than the widest
+ * row ever drawn are computed but not stored: history takes the same
+ * memory for any number of bins above that width.
+ */
+
+enum rts_waterfall_stat {
+  RTS_WATERFALL_MEAN,
+  RTS_WATERFALL_MIN,
+  RTS_WATERFALL_MAX
+};
+
+struct rts_waterfall_level {
+  RTSCOUNT bins;
+  size_t offset[3]; /* Per enum rts_waterfall_stat, in floats */
+};
+
+struct rts_waterfall_row_info {
+  struct timespec ts; /* UTC time of the last frame of the row */
+  RTSCOUNT frames;
+  float min;          /* Level 0 range, in dB */
+  float max;
+};
+
+struct rts_waterfall {
+  RTSCOUNT bins;
+  RTSCOUNT depth;
+
+  unsigned int levels;
+  struct rts_waterfall_level *level;
+  unsigned int first; /* Finest level stored */
+
+  size_t pyramid_size; /* All levels, in floats */
+  size_t base;         /* Where the first level stored starts */
+  size_t row_size;     /* Levels stored */
+  float *data;
+  struct rts_waterfall_row_info *info;
+
+  RTSCOUNT head;   /* Next row to be written */
+  RTSCOUNT count;  /* Rows available */
+
+  /* Sub-integration state */
+  RTSFLOAT *prev;
+  RTSCOUNT prev_frames;
+  RTSFLOAT *pending;
+  RTSCOUNT pending_frames;
+  RTSFLOAT *linear; /* Pyramid scratch */
+};
+
+typedef struct rts_waterfall rts_waterfall_t;
+
+/* Rows are never drawn more than `width' pixels wide */
+rts_waterfall_t *rts_waterfall_new(
+    RTSCOUNT bins,
+    RTSCOUNT depth,
+    RTSCOUNT width);
+
+void rts_waterfall_destroy(rts_waterfall_t *wf);
+
+/* Takes whatever was integrated since the last call */
+void rts_waterfall_feed(
+    rts_waterfall_t *wf,
+    const RTSFLOAT *cumulative,
+    RTSCOUNT frames);
+
+/* The next cumulative spectrum starts from zero (accumulator swapped) */
+void rts_waterfall_restart(rts_waterfall_t *wf);
+
+/* Push everything fed so far as a new row */
+RTSBOOL rts_waterfall_commit(rts_waterfall_t *wf);
+
+RTS_PRIVATE inline RTSCOUNT
+rts_waterfall_get_count(const rts_waterfall_t *wf)
+{
+  return wf->count;
+}
+
+RTS_PRIVATE inline unsigned int
+rts_waterfall_get_levels(const rts_waterfall_t *wf)
+{
+  return wf->levels;
+}
+
+RTS_PRIVATE inline RTSCOUNT
+rts_waterfall_get_level_bins(const rts_waterfall_t *wf, unsigned int level)
+{
+  return wf->level[level].bins;
+}
+
+/* Coarsest level with at least `width' bins, or the finest stored */
+unsigned int rts_waterfall_select_level(
+    const rts_waterfall_t *wf,
+    RTSCOUNT width);
+
+/* Age 0 is the newest row. NULL for levels not stored. */
+const float *rts_waterfall_get_row(
+    const rts_waterfall_t *wf,
+    RTSCOUNT age,
+    unsigned int level,
+    enum rts_waterfall_stat stat);
+
+const struct rts_waterfall_row_info *rts_waterfall_get_row_info(
+    const rts_waterfall_t *wf,
+    RTSCOUNT age);
+
+/* dB range of the `rows' newest rows */
+RTSBOOL rts_waterfall_get_range(
+    const rts_waterfall_t *wf,
+    RTSCOUNT rows,
+    float *min,
+    float *max);
+
+#endif /* _RTSUTIL_WATERFALL_H */
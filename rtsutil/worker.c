@@ -0,0 +1,169 @@
+/*
+  worker.c: Background job queue
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <string.h>
+
+#include "worker.h"
+#include "trace.h"
+
+RTS_PRIVATE void *
+rts_worker_thread(void *data)
+{
+  rts_worker_t *worker = (rts_worker_t *) data;
+  struct rts_job *job;
+
+  rts_trace_set_thread_name("worker");
+
+  pthread_mutex_lock(&worker->mutex);
+
+  for (;;) {
+    while (worker->head == NULL && !worker->halt)
+      pthread_cond_wait(&worker->cond, &worker->mutex);
+
+    /* Halt only when the queue has been drained */
+    if ((job = worker->head) == NULL)
+      break;
+
+    if ((worker->head = job->next) == NULL)
+      worker->tail = NULL;
+
+    pthread_mutex_unlock(&worker->mutex);
+
+    (job->func) (job->ctx);
+    free(job);
+
+    pthread_mutex_lock(&worker->mutex);
+    --worker->pending;
+  }
+
+  pthread_mutex_unlock(&worker->mutex);
+
+  return NULL;
+}
+
+void
+rts_worker_destroy(rts_worker_t *worker)
+{
+  struct rts_job *job;
+
+  if (worker->thread_running) {
+    pthread_mutex_lock(&worker->mutex);
+    worker->halt = RTS_TRUE;
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+
+    pthread_join(worker->thread, NULL);
+  }
+
+  /* Only reachable if the thread could not be started */
+  while ((job = worker->head) != NULL) {
+    worker->head = job->next;
+    free(job);
+  }
+
+  if (worker->cond_init)
+    pthread_cond_destroy(&worker->cond);
+
+  if (worker->mutex_init)
+    pthread_mutex_destroy(&worker->mutex);
+
+  free(worker);
+}
+
+rts_worker_t *
+rts_worker_new(void)
+{
+  rts_worker_t *new = NULL;
+
+  RTS_TRYCATCH(new = calloc(1, sizeof (rts_worker_t)), goto fail);
+
+  RTS_TRYCATCH(pthread_mutex_init(&new->mutex, NULL) == 0, goto fail);
+  new->mutex_init = RTS_TRUE;
+
+  RTS_TRYCATCH(pthread_cond_init(&new->cond, NULL) == 0, goto fail);
+  new->cond_init = RTS_TRUE;
+
+  RTS_TRYCATCH(
+      pthread_create(&new->thread, NULL, rts_worker_thread, new) == 0,
+      goto fail);
+  new->thread_running = RTS_TRUE;
+
+  return new;
+
+fail:
+  if (new != NULL)
+    rts_worker_destroy(new);
+
+  return NULL;
+}
+
+RTSBOOL
+rts_worker_push(rts_worker_t *worker, rts_job_func_t func, void *ctx)
+{
+  struct rts_job *job;
+
+  RTS_TRYCATCH(job = malloc(sizeof (struct rts_job)), return RTS_FALSE);
+
+  job->func = func;
+  job->ctx  = ctx;
+  job->next = NULL;
+
+  pthread_mutex_lock(&worker->mutex);
+
+  if (worker->tail != NULL)
+    worker->tail->next = job;
+  else
+    worker->head = job;
+
+  worker->tail = job;
+  if (++worker->pending > worker->high_water)
+    worker->high_water = worker->pending;
+
+  pthread_cond_signal(&worker->cond);
+  pthread_mutex_unlock(&worker->mutex);
+
+  return RTS_TRUE;
+}
+
+RTSCOUNT
+rts_worker_get_pending(rts_worker_t *worker)
+{
+  RTSCOUNT pending;
+
+  pthread_mutex_lock(&worker->mutex);
+  pending = worker->pending;
+  pthread_mutex_unlock(&worker->mutex);
+
+  return pending;
+}
+
+RTSCOUNT
+rts_worker_take_high_water(rts_worker_t *worker)
+{
+  RTSCOUNT high_water;
+
+  pthread_mutex_lock(&worker->mutex);
+  high_water = worker->high_water;
+  worker->high_water = worker->pending;
+  pthread_mutex_unlock(&worker->mutex);
+
+  return high_water;
+}
@@ -0,0 +1,71 @@
+/*
+  worker.h: Background job queue
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _RTSUTIL_WORKER_H
+#define _RTSUTIL_WORKER_H
+
+#include <pthread.h>
+
+#include "common.h"
+
+/*
+ * Jobs are run in order by a single thread. The job function owns
+ * `ctx' and is responsible for releasing it.
+ */
+typedef void (*rts_job_func_t) (void *ctx);
+
+struct rts_job {
+  rts_job_func_t func;
+  void *ctx;
+  struct rts_job *next;
+};
+
+struct rts_worker {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  struct rts_job *head;
+  struct rts_job *tail;
+  RTSCOUNT pending;
+  RTSCOUNT high_water; /* Most jobs pending at once since last taken */
+
+  RTSBOOL halt;
+  RTSBOOL thread_running;
+  RTSBOOL mutex_init;
+  RTSBOOL cond_init;
+};
+
+typedef struct rts_worker rts_worker_t;
+
+rts_worker_t *rts_worker_new(void);
+
+RTSBOOL rts_worker_push(rts_worker_t *worker, rts_job_func_t func, void *ctx);
+
+RTSCOUNT rts_worker_get_pending(rts_worker_t *worker);
+
+/* Returns the high water mark of pending jobs and restarts it */
+RTSCOUNT rts_worker_take_high_water(rts_worker_t *worker);
+
+/* Runs all pending jobs before returning */
+void rts_worker_destroy(rts_worker_t *worker);
+
+#endif /* _RTSUTIL_WORKER_H */
@@ -0,0 +1,292 @@
+/*
+ *    <one line to give the program's name and a brief idea of what it does.>
+ *    Copyright (C) <year>  <name of author>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "draw.h"
+
+#include <util.h>
+
+/*
+ * Tiled render mode: a row range of the screen is split in horizontal
+ * bands of consecutive rows, and the same draw function is run for
+ * every band by a pool of threads (the calling thread included).
+ *
+ * Each band draws through a private copy of the display, so dirty
+ * rectangles go to a list of its own. Once all bands are done, these
+ * lists are merged into the display in band order: the result does
+ * not depend on which thread ran which band, or when.
+ */
+struct display_band_pool
+{
+  int threads;
+  pthread_t *thread;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t  start_cond;
+  pthread_cond_t  done_cond;
+
+  unsigned int generation; /* One per display_run_bands */
+  int halt;
+
+  struct display_band *bands;
+  int count;
+  int next;    /* Next band to be taken */
+  int pending; /* Bands taken or not, still running */
+
+  display_band_func_t func;
+  void *priv;
+};
+
+/* Called with the mutex held, returns with the mutex held */
+static void
+display_band_pool_work (struct display_band_pool *pool)
+{
+  int i;
+
+  while (pool->next < pool->count)
+  {
+    i = pool->next++;
+
+    pthread_mutex_unlock (&pool->mutex);
+
+    (pool->func) (&pool->bands[i], pool->priv);
+
+    pthread_mutex_lock (&pool->mutex);
+
+    if (--pool->pending == 0)
+      pthread_cond_signal (&pool->done_cond);
+  }
+}
+
+static void *
+display_band_thread (void *data)
+{
+  struct display_band_pool *pool = (struct display_band_pool *) data;
+  unsigned int generation = 0;
+
+  pthread_mutex_lock (&pool->mutex);
+
+  for (;;)
+  {
+    while (!pool->halt && pool->generation == generation)
+      pthread_cond_wait (&pool->start_cond, &pool->mutex);
+
+    if (pool->halt)
+      break;
+
+    generation = pool->generation;
+
+    display_band_pool_work (pool);
+  }
+
+  pthread_mutex_unlock (&pool->mutex);
+
+  return NULL;
+}
+
+static void
+display_band_pool_destroy (struct display_band_pool *pool)
+{
+  int i;
+
+  pthread_mutex_lock (&pool->mutex);
+  pool->halt = 1;
+  pthread_cond_broadcast (&pool->start_cond);
+  pthread_mutex_unlock (&pool->mutex);
+
+  for (i = 0; i < pool->threads; i++)
+    pthread_join (pool->thread[i], NULL);
+
+  pthread_cond_destroy (&pool->done_cond);
+  pthread_cond_destroy (&pool->start_cond);
+  pthread_mutex_destroy (&pool->mutex);
+
+  free (pool->bands);
+  free (pool->thread);
+  free (pool);
+}
+
+/*
+ * Draw work passed to display_run_bands is split among `threads' extra
+ * threads and the caller. Returns -1 if the threads could not be
+ * started, in which case bands keep running on the calling thread.
+ */
+int
+display_enable_bands (display_t *display, int threads)
+{
+  struct display_band_pool *pool;
+  int i;
+
+  display_disable_bands (display);
+
+  if (threads <= 0)
+    return 0;
+
+  pool = xmalloc (sizeof (struct display_band_pool));
+
+  memset (pool, 0, sizeof (struct display_band_pool));
+
+  pool->thread = xmalloc (threads * sizeof (pthread_t));
+  pool->bands  = xmalloc ((threads + 1) * sizeof (struct display_band));
+
+  pthread_mutex_init (&pool->mutex, NULL);
+  pthread_cond_init (&pool->start_cond, NULL);
+  pthread_cond_init (&pool->done_cond, NULL);
+
+  for (i = 0; i < threads; i++)
+  {
+    if ((errno = pthread_create (&pool->thread[i],
+                                 NULL,
+                                 display_band_thread,
+                                 pool)) != 0)
+    {
+      ERROR ("Unable to start band thread: %s\n", strerror (errno));
+
+      pool->threads = i;
+      display_band_pool_destroy (pool);
+
+      return -1;
+    }
+
+    pool->threads = i + 1;
+  }
+
+  display->band_pool = pool;
+
+  return 0;
+}
+
+void
+display_disable_bands (display_t *display)
+{
+  if (display->band_pool != NULL)
+  {
+    display_band_pool_destroy (display->band_pool);
+    display->band_pool = NULL;
+  }
+}
+
+static void
+display_band_init (struct display_band *band,
+                   display_t *display,
+                   int index,
+                   int y1,
+                   int y2)
+{
+  memcpy (&band->view, display, sizeof (display_t));
+
+  band->view.dirty = 0;
+  band->view.band_pool = NULL;
+
+  band->index = index;
+  band->y1 = y1;
+  band->y2 = y2;
+}
+
+static void
+display_band_merge (display_t *display, const struct display_band *band)
+{
+  const struct dirty_rect *r;
+  int i;
+
+  for (i = 0; i < band->view.dirty; i++)
+  {
+    r = &band->view.dirty_list[i];
+    __make_dirty_rect (display, r->x1, r->y1, r->x2, r->y2);
+  }
+}
+
+/*
+ * Runs func once per band of rows y1 to y2 (both included), and waits
+ * for all of them. func must only touch the rows of its band, through
+ * band->view. Without a pool, there is a single band drawn by the
+ * calling thread.
+ */
+void
+display_run_bands (display_t *display,
+                   int y1,
+                   int y2,
+                   display_band_func_t func,
+                   void *priv)
+{
+  struct display_band_pool *pool = display->band_pool;
+  struct display_band single;
+  int rows, count;
+  int i;
+
+  if (y1 < 0)
+    y1 = 0;
+
+  if (y2 >= display->height)
+    y2 = display->height - 1;
+
+  if (y1 > y2)
+    return;
+
+  rows = y2 - y1 + 1;
+
+  if (pool == NULL || rows < 2 * DISPLAY_BAND_MIN_ROWS)
+  {
+    display_band_init (&single, display, 0, y1, y2);
+
+    (func) (&single, priv);
+
+    display_band_merge (display, &single);
+
+    return;
+  }
+
+  count = rows / DISPLAY_BAND_MIN_ROWS;
+
+  if (count > pool->threads + 1)
+    count = pool->threads + 1;
+
+  /* Same split for the same range, whatever the load */
+  for (i = 0; i < count; i++)
+    display_band_init (&pool->bands[i],
+                       display,
+                       i,
+                       y1 + (int) ((long) rows * i / count),
+                       y1 + (int) ((long) rows * (i + 1) / count) - 1);
+
+  pthread_mutex_lock (&pool->mutex);
+
+  pool->func    = func;
+  pool->priv    = priv;
+  pool->count   = count;
+  pool->next    = 0;
+  pool->pending = count;
+
+  ++pool->generation;
+  pthread_cond_broadcast (&pool->start_cond);
+
+  display_band_pool_work (pool);
+
+  while (pool->pending > 0)
+    pthread_cond_wait (&pool->done_cond, &pool->mutex);
+
+  pthread_mutex_unlock (&pool->mutex);
+
+  for (i = 0; i < count; i++)
+    display_band_merge (display, &pool->bands[i]);
+}
@@ -0,0 +1,281 @@
+/*
+ *    <one line to give the program's name and a brief idea of what it does.>
+ *    Copyright (C) <year>  <name of author>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "blend.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#  define BLEND_HAVE_X86
+#  include <immintrin.h>
+#endif
+
+/*
+ * alphacolor () computes, for every channel:
+ *
+ *   a * c - (a - 3) * b + (b << 8) = a * c + (259 - a) * b
+ *
+ * shifted right 8 bits and saturated to 255. Both factors fit in 16
+ * bits, so the vector versions interleave base and color channels as
+ * 16 bit words and let pmaddwd do both products and the sum at once.
+ * Saturating packs take care of the clamp.
+ */
+
+static inline DWORD
+blend_channel (DWORD base, DWORD color, int alpha, int shift)
+{
+  int x;
+
+  x = (alpha * ((color >> shift) & 0xff)
+    + (259 - alpha) * ((base >> shift) & 0xff)) >> 8;
+
+  return x > 255 ? 255 : x;
+}
+
+static inline DWORD
+blend_pixel (DWORD base, DWORD color, int alpha)
+{
+  return (blend_channel (base, color, alpha, 16) << 16)
+       | (blend_channel (base, color, alpha, 8) << 8)
+       |  blend_channel (base, color, alpha, 0);
+}
+
+static void
+blend_row_generic (DWORD *dest, int count, DWORD color)
+{
+  int alpha = (color >> 24) & 0xff;
+  int i;
+
+  for (i = 0; i < count; ++i)
+    dest[i] = blend_pixel (dest[i], color, alpha);
+}
+
+static void
+blend_row_src_generic (DWORD *dest, const DWORD *src, int count, int alpha)
+{
+  int i;
+
+  for (i = 0; i < count; ++i)
+    dest[i] = blend_pixel (dest[i], src[i], alpha);
+}
+
+#ifdef BLEND_HAVE_X86
+/* Four pixels: base and color as 32 bit BGRX words */
+__attribute__ ((target ("sse2"))) static inline __m128i
+blend_4_sse2 (__m128i base, __m128i color, __m128i factors)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i b, c, lo, hi;
+
+  b = _mm_unpacklo_epi8 (base, zero);
+  c = _mm_unpacklo_epi8 (color, zero);
+
+  lo = _mm_packs_epi32 (
+    _mm_srai_epi32 (_mm_madd_epi16 (_mm_unpacklo_epi16 (b, c), factors), 8),
+    _mm_srai_epi32 (_mm_madd_epi16 (_mm_unpackhi_epi16 (b, c), factors), 8));
+
+  b = _mm_unpackhi_epi8 (base, zero);
+  c = _mm_unpackhi_epi8 (color, zero);
+
+  hi = _mm_packs_epi32 (
+    _mm_srai_epi32 (_mm_madd_epi16 (_mm_unpacklo_epi16 (b, c), factors), 8),
+    _mm_srai_epi32 (_mm_madd_epi16 (_mm_unpackhi_epi16 (b, c), factors), 8));
+
+  return _mm_and_si128 (
+    _mm_packus_epi16 (lo, hi),
+    _mm_set1_epi32 (0xffffff));
+}
+
+__attribute__ ((target ("sse2"))) static void
+blend_row_sse2 (DWORD *dest, int count, DWORD color)
+{
+  int alpha = (color >> 24) & 0xff;
+  __m128i factors = _mm_set1_epi32 ((alpha << 16) | (259 - alpha));
+  __m128i c = _mm_set1_epi32 (color & 0xffffff);
+  int i = 0;
+
+  for (; i + 4 <= count; i += 4)
+    _mm_storeu_si128 (
+      (__m128i *) (dest + i),
+      blend_4_sse2 (
+        _mm_loadu_si128 ((const __m128i *) (dest + i)), c, factors));
+
+  blend_row_generic (dest + i, count - i, color);
+}
+
+__attribute__ ((target ("sse2"))) static void
+blend_row_src_sse2 (DWORD *dest, const DWORD *src, int count, int alpha)
+{
+  __m128i factors = _mm_set1_epi32 ((alpha << 16) | (259 - alpha));
+  int i = 0;
+
+  for (; i + 4 <= count; i += 4)
+    _mm_storeu_si128 (
+      (__m128i *) (dest + i),
+      blend_4_sse2 (
+        _mm_loadu_si128 ((const __m128i *) (dest + i)),
+        _mm_loadu_si128 ((const __m128i *) (src + i)),
+        factors));
+
+  blend_row_src_generic (dest + i, src + i, count - i, alpha);
+}
+
+/* Same as above, eight pixels. Unpacks and packs stay within lanes. */
+__attribute__ ((target ("avx2"))) static inline __m256i
+blend_8_avx2 (__m256i base, __m256i color, __m256i factors)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  __m256i b, c, lo, hi;
+
+  b = _mm256_unpacklo_epi8 (base, zero);
+  c = _mm256_unpacklo_epi8 (color, zero);
+
+  lo = _mm256_packs_epi32 (
+    _mm256_srai_epi32 (
+      _mm256_madd_epi16 (_mm256_unpacklo_epi16 (b, c), factors), 8),
+    _mm256_srai_epi32 (
+      _mm256_madd_epi16 (_mm256_unpackhi_epi16 (b, c), factors), 8));
+
+  b = _mm256_unpackhi_epi8 (base, zero);
+  c = _mm256_unpackhi_epi8 (color, zero);
+
+  hi = _mm256_packs_epi32 (
+    _mm256_srai_epi32 (
+      _mm256_madd_epi16 (_mm256_unpacklo_epi16 (b, c), factors), 8),
+    _mm256_srai_epi32 (
+      _mm256_madd_epi16 (_mm256_unpackhi_epi16 (b, c), factors), 8));
+
+  return _mm256_and_si256 (
+    _mm256_packus_epi16 (lo, hi),
+    _mm256_set1_epi32 (0xffffff));
+}
+
+/* Sixteen pixels per iteration, two independent chains */
+__attribute__ ((target ("avx2"))) static void
+blend_row_avx2 (DWORD *dest, int count, DWORD color)
+{
+  int alpha = (color >> 24) & 0xff;
+  __m256i factors = _mm256_set1_epi32 ((alpha << 16) | (259 - alpha));
+  __m256i c = _mm256_set1_epi32 (color & 0xffffff);
+  __m256i *p;
+  int i = 0;
+
+  for (; i + 16 <= count; i += 16)
+  {
+    p = (__m256i *) (dest + i);
+
+    _mm256_storeu_si256 (
+      p,
+      blend_8_avx2 (_mm256_loadu_si256 (p), c, factors));
+    _mm256_storeu_si256 (
+      p + 1,
+      blend_8_avx2 (_mm256_loadu_si256 (p + 1), c, factors));
+  }
+
+  for (; i + 8 <= count; i += 8)
+  {
+    p = (__m256i *) (dest + i);
+
+    _mm256_storeu_si256 (
+      p,
+      blend_8_avx2 (_mm256_loadu_si256 (p), c, factors));
+  }
+
+  blend_row_generic (dest + i, count - i, color);
+}
+
+__attribute__ ((target ("avx2"))) static void
+blend_row_src_avx2 (DWORD *dest, const DWORD *src, int count, int alpha)
+{
+  __m256i factors = _mm256_set1_epi32 ((alpha << 16) | (259 - alpha));
+  __m256i *p;
+  int i = 0;
+
+  for (; i + 8 <= count; i += 8)
+  {
+    p = (__m256i *) (dest + i);
+
+    _mm256_storeu_si256 (
+      p,
+      blend_8_avx2 (
+        _mm256_loadu_si256 (p),
+        _mm256_loadu_si256 ((const __m256i *) (src + i)),
+        factors));
+  }
+
+  blend_row_src_generic (dest + i, src + i, count - i, alpha);
+}
+#endif /* BLEND_HAVE_X86 */
+
+static void (*blend_row_impl) (DWORD *, int, DWORD) =
+  blend_row_generic;
+
+static void (*blend_row_src_impl) (DWORD *, const DWORD *, int, int) =
+  blend_row_src_generic;
+
+static void blend_select_impl (void) __attribute__ ((constructor));
+
+static void
+blend_select_impl (void)
+{
+#ifdef BLEND_HAVE_X86
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("avx2"))
+  {
+    blend_row_impl     = blend_row_avx2;
+    blend_row_src_impl = blend_row_src_avx2;
+  }
+  else if (__builtin_cpu_supports ("sse2"))
+  {
+    blend_row_impl     = blend_row_sse2;
+    blend_row_src_impl = blend_row_src_sse2;
+  }
+#endif /* BLEND_HAVE_X86 */
+}
+
+void
+blend_row (DWORD *dest, int count, DWORD color)
+{
+  (blend_row_impl) (dest, count, color);
+}
+
+void
+blend_row_src (DWORD *dest, const DWORD *src, int count, int alpha)
+{
+  (blend_row_src_impl) (dest, src, count, alpha);
+}
+
+/* pitch in pixels. Contiguous rectangles are blended as a single row. */
+void
+blend_rect (DWORD *dest, int pitch, int width, int height, DWORD color)
+{
+  int j;
+
+  if (pitch == width)
+  {
+    (blend_row_impl) (dest, width * height, color);
+    return;
+  }
+
+  for (j = 0; j < height; ++j, dest += pitch)
+    (blend_row_impl) (dest, width, color);
+}
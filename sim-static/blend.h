@@ -0,0 +1,33 @@
+/*
+ *    <one line to give the program's name and a brief idea of what it does.>
+ *    Copyright (C) <year>  <name of author>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef _BLEND_H
+#define _BLEND_H
+
+#include "layout.h"
+
+/*
+ * Translucent spans, same result as alphacolor () pixel by pixel. Alpha
+ * must be in 1..254: opaque and fully transparent spans are the
+ * caller's business. The alpha byte of the result is cleared.
+ */
+void blend_row (DWORD *, int, DWORD);
+void blend_row_src (DWORD *, const DWORD *, int, int);
+void blend_rect (DWORD *, int, int, int, DWORD);
+
+#endif /* _BLEND_H */
@@ -110,6 +110,9 @@ cpi_get_page (cpi_handle_t *handle, short cp)
     return NULL;
   }
   
+  if (handle->cached_page != NULL && handle->cached_cp == cp)
+    return handle->cached_page;
+  
   entry_count = 0;
   
   for (entry = (struct cpi_entry *) (handle->cpi_file + 
@@ -126,9 +129,12 @@ cpi_get_page (cpi_handle_t *handle, short cp)
     }
     
     if (entry->device_type == 1 && entry->codepage == cp)
+    {
+      handle->cached_cp   = cp;
+      handle->cached_page = entry;
+      
       return entry;
-    
-    printf ("%d omissible\n", entry->codepage);
+    }
     
     entry_count++;
     
@@ -157,7 +163,6 @@ cpi_get_page (cpi_handle_t *handle, short cp)
     }
     else
     {
-      printf ("Next entry is at 0x%08x\n", entry->next_entry);
       entry = (struct cpi_entry *) (handle->cpi_file + entry->next_entry);
     }
   }
@@ -275,6 +280,95 @@ void cpi_puts  (struct cpi_disp_font *font,
   }
 }
 
+struct cpi_atlas *
+cpi_atlas_new (const struct cpi_disp_font *font)
+{
+  struct cpi_atlas *new;
+  const struct glyph *glyph;
+  unsigned int *mask;
+  int c, i, j;
+  
+  if (font->cols != 8)
+  {
+    ERROR ("cpi_atlas_new: weird font type (cols != 8)\n");
+    return NULL;
+  }
+  
+  new = xmalloc (sizeof (struct cpi_atlas));
+  
+  new->rows  = font->rows;
+  new->chars = font->chars;
+  new->mask  = xmalloc (new->chars * new->rows * 8 * sizeof (unsigned int));
+  
+  mask = new->mask;
+  
+  for (c = 0; c < new->chars; c++)
+  {
+    glyph = cpi_get_glyph ((struct cpi_disp_font *) font, c);
+    
+    for (j = 0; j < new->rows; j++)
+      for (i = 0; i < 8; i++)
+        *mask++ = glyph->bits[j] & (1 << (7 - i)) ? 0xffffffff : 0;
+  }
+  
+  return new;
+}
+
+/* Same as cpi_puts with wordsize 4 */
+void
+cpi_atlas_puts (const struct cpi_atlas *atlas,
+                int width, int height,
+                int x, int y,
+                unsigned int *buf,
+                int transpbg,
+                unsigned int fc,
+                unsigned int bc,
+                const char *text)
+{
+  const unsigned int *mask;
+  unsigned int *dst;
+  int i, j;
+  int n;
+  int len;
+  int charlength;
+  int c;
+  
+  len = strlen (text);
+  
+  if (8 * len + x > width)
+    len = (width - x) / 8;
+  
+  charlength = atlas->rows;
+  
+  if (charlength + y > height)
+    charlength = height - y;
+  
+  for (n = 0; n < len; n++)
+  {
+    if ((c = (unsigned char) text[n]) >= atlas->chars)
+      continue;
+    
+    mask = atlas->mask + c * atlas->rows * 8;
+    dst  = buf + y * width + x + n * 8;
+    
+    if (transpbg)
+      for (j = 0; j < charlength; j++, mask += 8, dst += width)
+        for (i = 0; i < 8; i++)
+          dst[i] = (fc & mask[i]) | (dst[i] & ~mask[i]);
+    else
+      for (j = 0; j < charlength; j++, mask += 8, dst += width)
+        for (i = 0; i < 8; i++)
+          dst[i] = (fc & mask[i]) | (bc & ~mask[i]);
+  }
+}
+
+void
+cpi_atlas_free (struct cpi_atlas *atlas)
+{
+  free (atlas->mask);
+  free (atlas);
+}
+
 void
 cpi_unmap (cpi_handle_t *handle)
 {
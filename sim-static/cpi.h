@@ -68,6 +68,18 @@ struct glyph
   char bits[16];
 };
 
+/* 
+ * Glyphs of an 8-column font expanded to one 32-bit mask per pixel
+ * (all ones for foreground), so text is drawn a glyph row at a time
+ * with no bit tests.
+ */
+struct cpi_atlas
+{
+  int rows;
+  int chars;
+  unsigned int *mask; /* chars * rows * 8 */
+};
+
 typedef struct cpi_handle
 {
   void *cpi_file;
@@ -77,6 +89,10 @@ typedef struct cpi_handle
   int   font_is_nt;
   
   struct cpi_header *cpi_file_header;
+  
+  /* Last page found by cpi_get_page */
+  short cached_cp;
+  struct cpi_entry *cached_page;
 }
 cpi_handle_t;
 
@@ -96,5 +112,16 @@ void cpi_puts  (struct cpi_disp_font *font,
                 unsigned int,
                 unsigned int,
                 const char *);
+
+struct cpi_atlas *cpi_atlas_new (const struct cpi_disp_font *);
+void cpi_atlas_puts (const struct cpi_atlas *,
+                     int, int,
+                     int, int,
+                     unsigned int *,
+                     int,
+                     unsigned int,
+                     unsigned int,
+                     const char *);
+void cpi_atlas_free (struct cpi_atlas *);
 #endif /* _CPI_H */
 
@@ -73,6 +73,46 @@ try_sdl_traditional (int width, int height)
 #endif
 }
 
+/* Everything but the creation of the screen surface */
+static display_t *
+display_init (display_t *new)
+{
+  if ((new->whole_screen = display_textarea_new (
+    new, 
+    0, 
+    0, 
+    new->width / 8, 
+    new->height / DEFAULT_FONT_SIZE, 
+    NULL, 
+    850, 
+    DEFAULT_FONT_SIZE)
+  ) == NULL)
+  {
+    ERROR ("Unable to set-up whole screen textarea: %s\n", strerror (errno));
+    
+    return NULL;
+  }
+  
+  textarea_set_autorefresh (new->whole_screen, 1);
+  
+  if (!new->headless)
+    SDL_WM_SetCaption ("libsim: simulation window",
+                       "libsim: simulation window");
+  
+  memset (new->screen->pixels, 0, new->width * new->height * sizeof (Uint32));
+  
+  new->kbd_hooks = hook_bucket_new (512);
+  new->grid_step = 16;
+  new->zoom = 1.0;
+  
+  if (display_select_cpi (new, NULL) != -1)
+    (void) display_select_font (new, DEFAULT_CODEPAGE, DEFAULT_FONT_SIZE);
+
+  if (eventLock == NULL)
+    eventLock = SDL_CreateMutex ();    
+  return new;
+}
+
 display_t *
 display_new (int width, int height)
 {
@@ -112,39 +152,70 @@ display_new (int width, int height)
   }
   */
   
-  if ((new->whole_screen = display_textarea_new (
-    new, 
-    0, 
-    0, 
-    width / 8, 
-    height / DEFAULT_FONT_SIZE, 
-    NULL, 
-    850, 
-    DEFAULT_FONT_SIZE)
-  ) == NULL)
+  if (display_init (new) == NULL)
   {
-    ERROR ("Unable to set-up whole screen textarea: %s\n", strerror (errno));
     free (new);
     
     return NULL;
   }
   
-  textarea_set_autorefresh (new->whole_screen, 1);
+  return new;
+}
+
+/* 
+ * Same drawing API on a plain memory framebuffer: no video mode, no
+ * window and no events. Nothing is presented, display_refresh only
+ * resets the dirty region.
+ */
+display_t *
+display_new_headless (int width, int height)
+{
+  display_t *new;
+  
+  new = xmalloc (sizeof (display_t));
   
-  SDL_WM_SetCaption ("libsim: simulation window",
-                     "libsim: simulation window");
+  memset (new, 0, sizeof (display_t));
   
-  memset (new->screen->pixels, 0, width * height * sizeof (Uint32));
+  new->width = width;
+  new->height = height;
+  new->headless = 1;
   
-  new->kbd_hooks = hook_bucket_new (512);
-  new->grid_step = 16;
-  new->zoom = 1.0;
+  if (posix_memalign (&new->framebuffer,
+                      DISPLAY_FRAMEBUFFER_ALIGN,
+                      (size_t) width * height * sizeof (Uint32)) != 0)
+  {
+    ERROR ("Unable to allocate framebuffer: %s\n", strerror (errno));
+    free (new);
+    
+    return NULL;
+  }
+  
+  if ((new->screen = SDL_CreateRGBSurfaceFrom (new->framebuffer,
+                                               width,
+                                               height,
+                                               32,
+                                               width * sizeof (Uint32),
+                                               0x00ff0000,
+                                               0x0000ff00,
+                                               0x000000ff,
+                                               0)) == NULL)
+  {
+    ERROR ("Unable to create framebuffer surface: %s\n", SDL_GetError ());
+    free (new->framebuffer);
+    free (new);
+    
+    return NULL;
+  }
+  
+  if (display_init (new) == NULL)
+  {
+    SDL_FreeSurface (new->screen);
+    free (new->framebuffer);
+    free (new);
+    
+    return NULL;
+  }
   
-  if (display_select_cpi (new, NULL) != -1)
-    (void) display_select_font (new, DEFAULT_CODEPAGE, DEFAULT_FONT_SIZE);
-
-  if (eventLock == NULL)
-    eventLock = SDL_CreateMutex ();    
   return new;
 }
 
@@ -211,14 +282,52 @@ __notify_mouse_event (display_t *disp, SDL_Event *event)
   
   if (disp->areas)
   {
-    event_info.type = EVENT_TYPE_MOUSE;
-    event_info.code = event->button.button;
-    event_info.state = event->type == SDL_MOUSEBUTTONDOWN;
-    event_info.x    = event->button.x;
-    event_info.y    = event->button.y;
+    if (event->type == SDL_MOUSEMOTION)
+    {
+      event_info.type = EVENT_TYPE_MOTION;
+      event_info.code = event->motion.state;
+      event_info.state = 0;
+      event_info.x    = event->motion.x;
+      event_info.y    = event->motion.y;
+      event_info.dx   = event->motion.xrel;
+      event_info.dy   = event->motion.yrel;
+    }
+    else
+    {
+      event_info.type = EVENT_TYPE_MOUSE;
+      event_info.code = event->button.button;
+      event_info.state = event->type == SDL_MOUSEBUTTONDOWN;
+      event_info.x    = event->button.x;
+      event_info.y    = event->button.y;
+      event_info.dx   = 0;
+      event_info.dy   = 0;
+    }
+    
+    /* Drags keep going to the area they started in */
+    if (disp->grab != NULL)
+    {
+      event_info.area = disp->grab;
+      disp->grab->handler (disp, &event_info, disp->grab->data);
+      
+      if (event->type == SDL_MOUSEBUTTONUP)
+        disp->grab = NULL;
+      
+      return;
+    }
     
     for (this = disp->areas; this != NULL; this = this->next)
+    {
+      event_info.area = NULL;
+      
       __try_mouse_event (disp, &event_info, this);
+      
+      /* Wheel "buttons" come with their own button up */
+      if (event->type == SDL_MOUSEBUTTONDOWN 
+          && event_info.area != NULL
+          && event->button.button != SDL_BUTTON_WHEELUP
+          && event->button.button != SDL_BUTTON_WHEELDOWN)
+        disp->grab = event_info.area;
+    }
   }
   
 }
@@ -231,6 +340,25 @@ display_register_key_handler (display_t *disp, int key, kbd_handler_t handler)
     (int (*) (int, void *, void *)) handler, disp);
 }
 
+/* Called instead of exit (0) on escape or when the window is closed */
+void
+display_register_quit_handler (display_t *disp, 
+                               void (*handler) (display_t *, void *), 
+                               void *data)
+{
+  disp->quit_handler = handler;
+  disp->quit_data = data;
+}
+
+static inline void
+__quit (display_t *display)
+{
+  if (display->quit_handler != NULL)
+    (display->quit_handler) (display, display->quit_data);
+  else
+    exit (0);
+}
+
 static inline void
 __parse_event (display_t *display, SDL_Event *event)
 {
@@ -248,16 +376,17 @@ __parse_event (display_t *display, SDL_Event *event)
       trigger_hook (display->kbd_hooks, event->key.keysym.sym, &event_info);
       
       if (event->type == SDL_KEYUP && event->key.keysym.sym == SDLK_ESCAPE)
-        exit (0);
+        __quit (display);
       break;
       
     case SDL_MOUSEBUTTONDOWN:
     case SDL_MOUSEBUTTONUP:
+    case SDL_MOUSEMOTION:
       __notify_mouse_event (display, event);
       break;
     
     case SDL_QUIT:
-      exit (0);
+      __quit (display);
       break;
   }
 }
@@ -266,6 +395,9 @@ void
 display_poll_events (display_t *display)
 {
   SDL_Event event;
+  
+  if (display->headless)
+    return;
 
   while (SDL_PollEvent (&event))
     __parse_event (display, &event); 
@@ -300,12 +432,26 @@ display_break_wait (display_t *display)
 void
 display_refresh (display_t *display)
 {
+  SDL_Rect rects[DISPLAY_MAX_DIRTY];
+  int i;
+  
+  if (display->headless)
+  {
+    display->dirty = 0;
+    return;
+  }
+  
   if (display->dirty)
   {
-    SDL_UpdateRect (display->screen, 
-      display->min_x, display->min_y,
-      display->max_x - display->min_x + 1,
-      display->max_y - display->min_y + 1);
+    for (i = 0; i < display->dirty; i++)
+    {
+      rects[i].x = display->dirty_list[i].x1;
+      rects[i].y = display->dirty_list[i].y1;
+      rects[i].w = display->dirty_list[i].x2 - display->dirty_list[i].x1 + 1;
+      rects[i].h = display->dirty_list[i].y2 - display->dirty_list[i].y1 + 1;
+    }
+    
+    SDL_UpdateRects (display->screen, display->dirty, rects);
       
     display->dirty = 0;
   }
@@ -319,15 +465,17 @@ display_refresh (display_t *display)
 struct draw *
 display_to_draw (display_t *display)
 {
-  int i, j;
+  int j;
   
   struct draw *output;
   
   output = draw_new (display->width, display->height);
   
   for (j = 0; j < display->height; j++)
-    for (i = 0; i < display->width; i++)
-      draw_pset (output, i, j, pget (display, i, j));
+    draw_pack_row (
+      draw_row (output, j),
+      (const DWORD *) display->screen->pixels + j * display->width,
+      display->width);
       
   return output;
 }
@@ -337,7 +485,11 @@ draw_to_display (display_t *display, struct draw *draw, int x, int y, int a)
 {
   int offset_x = 0, offset_y = 0;
   int actual_width, actual_height;
-  int i, j;
+  DWORD *row;
+  int j;
+  
+  if (a <= 0)
+    return;
   
   if (x < 0)
   {
@@ -362,28 +514,208 @@ draw_to_display (display_t *display, struct draw *draw, int x, int y, int a)
     if (actual_height > display->height)
       actual_height = display->height;
       
-    for (j = 0; j < actual_height; j++)
-      for (i = 0; i < actual_width; i++)
-        pset_abs (display, i + x, j + y, 
-          ARGB(a, 0, 0, 0) | 
-          (COLOR_MASK & draw_pget (draw, i + offset_x, j + offset_y)));
+    if (actual_width > display->width - x)
+      actual_width = display->width - x;
+      
+    if (actual_height > display->height - y)
+      actual_height = display->height - y;
+      
+    if (actual_width <= 0 || actual_height <= 0)
+      return;
+      
+    /* Opaque blits are plain row copies (see alphacolor) */
+    if (a == 255)
+    {
+      for (j = 0; j < actual_height; j++)
+        draw_unpack_row (
+          (DWORD *) display->screen->pixels + (j + y) * display->width + x,
+          draw_row (draw, j + offset_y) + 3 * offset_x,
+          actual_width,
+          0);
+      
+      __make_dirty_rect (display, 
+                         x, 
+                         y, 
+                         x + actual_width - 1, 
+                         y + actual_height - 1);
+    }
+    else
+    {
+      row = xmalloc (actual_width * sizeof (DWORD));
+      
+      for (j = 0; j < actual_height; j++)
+      {
+        draw_unpack_row (
+          row,
+          draw_row (draw, j + offset_y) + 3 * offset_x,
+          actual_width,
+          0);
+        
+        blend_row_src (
+          (DWORD *) display->screen->pixels + (j + y) * display->width + x,
+          row,
+          actual_width,
+          a);
+      }
+      
+      free (row);
+      
+      __make_dirty_rect (display, 
+                         x, 
+                         y, 
+                         x + actual_width - 1, 
+                         y + actual_height - 1);
+    }
   }
 }
 
 int
 display_dump (const char *file, display_t *display)
 {
-  int err;
+  return surface_to_bmp (file, 
+                         (const DWORD *) display->screen->pixels, 
+                         display->width, 
+                         display->height, 
+                         display->width * sizeof (DWORD));
+}
+
+struct display_snapshot *
+display_snapshot_new (display_t *display)
+{
+  struct display_snapshot *new;
+  size_t size;
   
-  struct draw *output;
+  new = xmalloc (sizeof (struct display_snapshot));
+  
+  new->width  = display->width;
+  new->height = display->height;
   
-  output = display_to_draw (display);
+  size = (size_t) display->width * display->height * sizeof (DWORD);
   
-  err = draw_to_bmp (file, output);
+  new->pixels = xmalloc (size);
   
-  draw_free (output);
+  memcpy (new->pixels, display->screen->pixels, size);
   
-  return err;
+  return new;
+}
+
+int
+display_snapshot_to_png (const char *file,
+                         const struct display_snapshot *snapshot,
+                         enum png_mode mode)
+{
+  return png_write (file,
+                    snapshot->pixels,
+                    snapshot->width,
+                    snapshot->height,
+                    snapshot->width * sizeof (DWORD),
+                    mode);
+}
+
+void
+display_snapshot_free (struct display_snapshot *snapshot)
+{
+  free (snapshot->pixels);
+  free (snapshot);
+}
+
+/* 
+ * Layered drawing: whatever is on the screen when this is called (grid,
+ * frames, titles...) becomes the static background. Each frame then
+ * starts with display_background_restore and only draws what changes.
+ */
+void
+display_background_capture (display_t *display)
+{
+  size_t size = (size_t) display->width * display->height * sizeof (DWORD);
+  
+  if (display->background == NULL)
+    display->background = xmalloc (size);
+  
+  memcpy (display->background, display->screen->pixels, size);
+}
+
+/* Rows y1 to y2 (both included) of display_background_restore */
+static void
+display_background_restore_rows (display_t *display, int y1, int y2)
+{
+  const DWORD *src;
+  DWORD *dst;
+  size_t pitch = display->width * sizeof (DWORD);
+  int first = -1;
+  int j;
+  
+  src = display->background + (size_t) y1 * display->width;
+  dst = (DWORD *) display->screen->pixels + (size_t) y1 * display->width;
+  
+  for (j = y1; j <= y2; j++, src += display->width, dst += display->width)
+  {
+    if (memcmp (dst, src, pitch) != 0)
+    {
+      memcpy (dst, src, pitch);
+      
+      if (first == -1)
+        first = j;
+    }
+    else if (first != -1)
+    {
+      __make_dirty_rect (display, 0, first, display->width - 1, j - 1);
+      first = -1;
+    }
+  }
+  
+  if (first != -1)
+    __make_dirty_rect (display, 0, first, display->width - 1, j - 1);
+}
+
+static void
+display_background_restore_band (struct display_band *band, void *priv)
+{
+  display_background_restore_rows (&band->view, band->y1, band->y2);
+}
+
+/* 
+ * Copies the background back, row by row, and marks as dirty only the
+ * rows that actually differed (i.e. those the dynamic layers drew on).
+ * Returns -1 if there is no background yet.
+ */
+int
+display_background_restore (display_t *display)
+{
+  if (display->background == NULL)
+    return -1;
+  
+  if (display->band_pool != NULL)
+    display_run_bands (display, 
+                       0, 
+                       display->height - 1, 
+                       display_background_restore_band, 
+                       NULL);
+  else
+    display_background_restore_rows (display, 0, display->height - 1);
+  
+  return 0;
+}
+
+void
+display_background_discard (display_t *display)
+{
+  if (display->background != NULL)
+  {
+    free (display->background);
+    display->background = NULL;
+  }
+}
+
+int
+display_dump_png (const char *file, display_t *display, enum png_mode mode)
+{
+  return png_write (file,
+                    (const DWORD *) display->screen->pixels,
+                    display->width,
+                    display->height,
+                    display->width * sizeof (DWORD),
+                    mode);
 }
 
 int
@@ -406,9 +738,58 @@ display_put_bmp (display_t *display,
   return 0;
 }
 
+/* 
+ * Releases the display right away. Windowed displays close their
+ * window: the video surface belongs to SDL and goes with the subsystem.
+ */
+void
+display_free (display_t *display)
+{
+  struct area_info *area, *next;
+  
+  display_disable_bands (display);
+  display_background_discard (display);
+  
+  for (area = display->areas; area != NULL; area = next)
+  {
+    next = area->next;
+    free (area);
+  }
+  
+  if (display->whole_screen != NULL)
+    display_textarea_free (display->whole_screen);
+  
+  if (display->font_atlas != NULL)
+    cpi_atlas_free (display->font_atlas);
+  
+  if (display->cpi_selected)
+    cpi_unmap (&display->cpi_handle);
+  
+  if (display->kbd_hooks != NULL)
+    hook_bucket_free (display->kbd_hooks);
+  
+  if (display->headless)
+  {
+    SDL_FreeSurface (display->screen);
+    free (display->framebuffer);
+  }
+  else
+    SDL_QuitSubSystem (SDL_INIT_VIDEO);
+  
+  free (display);
+}
+
+/* Windowed displays stay up until the user quits, never returns */
 void
 display_end (display_t *display)
 {
+  if (display->headless)
+  {
+    display_free (display);
+    
+    return;
+  }
+  
   display_refresh (display);
   
   for (;;) 
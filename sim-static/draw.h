@@ -24,23 +24,40 @@
 #include <complex.h>
 
 #include "wbmp.h"
+#include "png.h"
 #include "cpi.h"
+#include "blend.h"
 
 #include "hook.h"
 
 #define EVENT_TYPE_KEYBOARD 0
 #define EVENT_TYPE_MOUSE    1
+#define EVENT_TYPE_MOTION   2 /* code is the button mask */
+
+#define DISPLAY_FRAMEBUFFER_ALIGN 64
+
+#define DISPLAY_PRINTF_BUFSIZ 256 /* Longer text goes to the heap */
+
+#define DISPLAY_MAX_DIRTY   16
+#define DISPLAY_DIRTY_SLACK 4096 /* Clean pixels worth one rectangle less */
+
+#define DISPLAY_BAND_MIN_ROWS 16 /* Thinner bands are not worth a thread */
+
+/* Both corners included */
+struct dirty_rect
+{
+  int x1, y1;
+  int x2, y2;
+};
 
 
 struct display_info
 {
-  int dirty;
+  int dirty; /* Rectangles in dirty_list */
+  struct dirty_rect dirty_list[DISPLAY_MAX_DIRTY];
   
   int width, height;
   
-  int min_x, min_y;
-  int max_x, max_y;
-  
   int cpi_selected;
   
   int     grid_step;
@@ -48,10 +65,23 @@ struct display_info
   double offset_x, offset_y; /* offsets x and y relative to screen coords */
   
   SDL_Surface *screen;
+  
+  int headless;
+  void *framebuffer; /* Headless displays only */
+  
+  DWORD *background; /* Static layer, see display_background_capture */
+  
+  struct display_band_pool *band_pool; /* Tiled render mode, see band.c */
+  
   struct cpi_disp_font *selected_font;
+  struct cpi_atlas *font_atlas;
   struct hook_bucket *kbd_hooks;
   struct text_area *whole_screen;
   struct area_info *areas;
+  struct area_info *grab; /* Gets all mouse events while a button is down */
+  
+  void (*quit_handler) (struct display_info *, void *); /* exit(0) if NULL */
+  void *quit_data;
   
   cpi_handle_t cpi_handle;
 };
@@ -79,15 +109,24 @@ struct event_info
   int code;
   int state;
   int x, y;
+  int dx, dy; /* Motion events only */
   
   struct area_info *area;
 };
 
 
 
+/* Copy of the screen contents, safe to encode from another thread */
+struct display_snapshot
+{
+  int width, height;
+  DWORD *pixels;
+};
+
 struct text_area
 {
   struct cpi_disp_font *selected_font;
+  struct cpi_atlas *font_atlas;
   
   cpi_handle_t cpi_handle;
   
@@ -106,6 +145,16 @@ typedef struct display_info display_t;
 typedef struct text_area    textarea_t;
 typedef struct event_info   event_t;
 
+/* Rows y1 to y2 (both included) of the screen, drawn through view */
+struct display_band
+{
+  display_t view;
+  int index;
+  int y1, y2;
+};
+
+typedef void (*display_band_func_t) (struct display_band *, void *);
+
 static inline int
 pt2px_x (display_t *disp, double x)
 {
@@ -133,10 +182,21 @@ px2pt_y (display_t *disp, int y)
 #include "pixel.h"
 
 display_t *display_new (int, int);
+display_t *display_new_headless (int, int);
 void display_refresh (display_t *);
 struct draw *display_to_draw (display_t *);
 void draw_to_display (display_t *, struct draw *, int, int, int);
 int  display_dump (const char *, display_t *);
+int  display_dump_png (const char *, display_t *, enum png_mode);
+struct display_snapshot *display_snapshot_new (display_t *);
+int  display_snapshot_to_png (const char *, const struct display_snapshot *, enum png_mode);
+void display_snapshot_free (struct display_snapshot *);
+void display_background_capture (display_t *);
+int  display_background_restore (display_t *);
+void display_background_discard (display_t *);
+int  display_enable_bands (display_t *, int);
+void display_disable_bands (display_t *);
+void display_run_bands (display_t *, int, int, display_band_func_t, void *);
 int  display_put_bmp (display_t *, const char *, int, int, int);
 int  display_select_cpi (display_t *, const char *);
 int  display_select_font (display_t *, int, int);
@@ -147,10 +207,14 @@ void display_poll_events (display_t *);
 void display_wait_events (display_t *);
 void display_break_wait (display_t *);
 int  display_area_register (display_t *, int, int, int, int, mouse_handler_t, void *);
+int  display_register_key_handler (display_t *, int, kbd_handler_t);
+void display_register_quit_handler (display_t *, void (*) (display_t *, void *), void *);
+void display_free (display_t *);
 void display_end (display_t *);
 
 textarea_t *display_textarea_new 
   (display_t *, int, int, int, int, const char *, int, int);
+void display_textarea_free (textarea_t *);
 void cputs (textarea_t *, const char *); /* Why C?? */
 void cprintf (textarea_t *, const char *, ...);
 int  textarea_gotoxy (textarea_t *, int, int);
@@ -17,6 +17,9 @@ struct draw *draw_from_bmp (const char *file)
   int color_size;
   int i, j;
   DWORD color;
+  DWORD lut[256];
+  const BYTE *src;
+  BYTE *dst;
   
   BITMAPFILEHEADER *header;
   BITMAPINFOHEADER *info;
@@ -42,7 +45,7 @@ struct draw *draw_from_bmp (const char *file)
   }
   
   if ((fdata = mmap (NULL, size, PROT_READ, MAP_SHARED, fileno (fp), 0)) ==
-    NULL)
+    MAP_FAILED)
   {
     ERROR ("%s: mmap failed: %s\n", file, strerror (errno));
     fclose (fp);
@@ -110,22 +113,37 @@ struct draw *draw_from_bmp (const char *file)
     return NULL;
   }
   
+  if (header->bfOffBits + 
+      BITMAP_SIZE (info->biWidth, info->biHeight, info->biBitCount) > size)
+  {
+    ERROR ("%s: picture data is truncated\n", file);
+    fclose (fp);
+    munmap (fdata, size);
+    
+    return NULL;
+  }
+  
   draw = draw_new (info->biWidth, info->biHeight);
   
-  for (j = 0; j < info->biHeight; j++)
-    for (i = 0; i < info->biWidth; i++)
+  if (color_size && color_size <= 256)
+  {
+    /* Indexed: resolve the palette once, then decode whole rows */
+    for (i = 0; i < 256; i++)
+      lut[i] = i < color_size ? 
+        RGB (colors[i].rgbRed, colors[i].rgbGreen, colors[i].rgbBlue) : 0;
+        
+    for (j = 0; j < info->biHeight; j++)
     {
-      pix = (DWORD *) (fdata + header->bfOffBits + 
-        PIX_OFFSET (i, j, info->biWidth, info->biHeight, info->biBitCount));
+      src = fdata + header->bfOffBits + 
+        PIX_OFFSET (0, j, info->biWidth, info->biHeight, info->biBitCount);
+      dst = draw_row (draw, j);
       
-      /*FIXME: check if pix is out of bounds */
-      
-      color = 0xffffff & *pix;
-      if (color_size)
+      for (i = 0; i < info->biWidth; i++)
       {
-        color = get_color (color, info->biBitCount,
-          PIX_BIT_OFFSET (i, info->biBitCount));
-          
+        color = get_color (src[(i * info->biBitCount) >> 3], 
+                           info->biBitCount,
+                           PIX_BIT_OFFSET (i, info->biBitCount));
+        
         if (color >= color_size)
         {
           ERROR ("%s: unmapped color %x (%d colors)\n", file, color,
@@ -137,14 +155,60 @@ struct draw *draw_from_bmp (const char *file)
           return NULL;  
         }
         
-        color = RGB (colors[color].rgbRed,
-                     colors[color].rgbGreen,
-                     colors[color].rgbBlue);
+        *dst++ = lut[color];
+        *dst++ = lut[color] >> 8;
+        *dst++ = lut[color] >> 16;
       }
+    }
+  }
+  else if (info->biBitCount == 24 || info->biBitCount == 32)
+  {
+    /* Same bottom-up layout: plain row copies */
+    for (j = 0; j < info->biHeight; j++)
+    {
+      src = fdata + header->bfOffBits + 
+        PIX_OFFSET (0, j, info->biWidth, info->biHeight, info->biBitCount);
       
-      draw_pset (draw, i, j, color);
+      if (info->biBitCount == 24)
+        memcpy (draw_row (draw, j), src, 3 * info->biWidth);
+      else
+        draw_pack_row (draw_row (draw, j), (const DWORD *) src, info->biWidth);
     }
-    
+  }
+  else
+  {
+    for (j = 0; j < info->biHeight; j++)
+      for (i = 0; i < info->biWidth; i++)
+      {
+        pix = (DWORD *) (fdata + header->bfOffBits + 
+          PIX_OFFSET (i, j, info->biWidth, info->biHeight, info->biBitCount));
+        
+        color = 0xffffff & *pix;
+        if (color_size)
+        {
+          color = get_color (color, info->biBitCount,
+            PIX_BIT_OFFSET (i, info->biBitCount));
+            
+          if (color >= color_size)
+          {
+            ERROR ("%s: unmapped color %x (%d colors)\n", file, color,
+              color_size);
+            fclose (fp);
+            munmap (fdata, size);
+            draw_free (draw);
+            
+            return NULL;  
+          }
+          
+          color = RGB (colors[color].rgbRed,
+                       colors[color].rgbGreen,
+                       colors[color].rgbBlue);
+        }
+        
+        draw_pset (draw, i, j, color);
+      }
+  }
+  
   fclose (fp);
   munmap (fdata, size);
   
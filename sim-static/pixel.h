@@ -23,6 +23,12 @@
 # error "Don't use pixel.h directly. Include draw.h instead."
 #endif
 
+#include <string.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 #define BLUE(x)  (x)
 #define GREEN(x) ((x) << 8)
 #define RED(x)   ((x) << 16)
@@ -46,48 +52,135 @@
 
 #define LUMINANCE(color) ((257 * (int) G_RED (color) + 504 * (int) G_GREEN (color) + 98 * (int) G_BLUE (color) + 16000) / 1000)
 
+static inline int
+__dirty_area (int x1, int y1, int x2, int y2)
+{
+  return (x2 - x1 + 1) * (y2 - y1 + 1);
+}
+
+/* 
+ * Pixels that the union of rectangle i and (x1, y1, x2, y2) would add
+ * to the area of both of them. Negative if they overlap.
+ */
+static inline int
+__dirty_waste (const struct dirty_rect *r, int x1, int y1, int x2, int y2)
+{
+  return __dirty_area (r->x1 < x1 ? r->x1 : x1,
+                       r->y1 < y1 ? r->y1 : y1,
+                       r->x2 > x2 ? r->x2 : x2,
+                       r->y2 > y2 ? r->y2 : y2)
+       - __dirty_area (r->x1, r->y1, r->x2, r->y2)
+       - __dirty_area (x1, y1, x2, y2);
+}
+
 static inline void
-__make_dirty (display_t *display, int x, int y)
+__dirty_grow (struct dirty_rect *r, int x1, int y1, int x2, int y2)
 {
-  if (!display->dirty)
-  {
-    display->dirty = 1;
-    display->min_x = display->max_x = x;
-    display->min_y = display->max_y = y;
-  }
-  else
+  if (r->x1 > x1)
+    r->x1 = x1;
+  
+  if (r->y1 > y1)
+    r->y1 = y1;
+  
+  if (r->x2 < x2)
+    r->x2 = x2;
+  
+  if (r->y2 < y2)
+    r->y2 = y2;
+}
+
+/* 
+ * Rectangles are merged when that costs at most DISPLAY_DIRTY_SLACK
+ * clean pixels, or with whichever costs less when the list is full.
+ */
+static inline void
+__make_dirty_rect (display_t *display, int x1, int y1, int x2, int y2)
+{
+  struct dirty_rect *r;
+  int best = -1, best_waste = 0, waste;
+  int i;
+  
+  if (x1 < 0)
+    x1 = 0;
+  
+  if (y1 < 0)
+    y1 = 0;
+  
+  if (x2 >= display->width)
+    x2 = display->width - 1;
+  
+  if (y2 >= display->height)
+    y2 = display->height - 1;
+  
+  if (x1 > x2 || y1 > y2)
+    return;
+  
+  for (i = 0; i < display->dirty; i++)
   {
-    if (display->min_x > x)
-    {
-      if (x < 0)
-        x = 0;
-      display->min_x = x;
-    }
+    waste = __dirty_waste (&display->dirty_list[i], x1, y1, x2, y2);
     
-    if (display->max_x < x)
+    if (best == -1 || waste < best_waste)
     {
-      if (x >= display->width)
-        x = display->width - 1;
-        
-      display->max_x = x;
+      best = i;
+      best_waste = waste;
     }
+  }
+  
+  if (best == -1 
+      || (best_waste > DISPLAY_DIRTY_SLACK && display->dirty < DISPLAY_MAX_DIRTY))
+  {
+    r = &display->dirty_list[display->dirty++];
+    r->x1 = x1;
+    r->y1 = y1;
+    r->x2 = x2;
+    r->y2 = y2;
     
-    if (display->min_y > y)
+    return;
+  }
+  
+  r = &display->dirty_list[best];
+  __dirty_grow (r, x1, y1, x2, y2);
+  
+  /* The grown rectangle may now swallow others */
+  for (i = 0; i < display->dirty; i++)
+    if (i != best 
+        && __dirty_waste (&display->dirty_list[i], 
+                          r->x1, r->y1, r->x2, r->y2) <= DISPLAY_DIRTY_SLACK)
     {
-      if (y < 0)
-        y = 0;
-        
-      display->min_y = y;
+      __dirty_grow (r, 
+                    display->dirty_list[i].x1, 
+                    display->dirty_list[i].y1, 
+                    display->dirty_list[i].x2, 
+                    display->dirty_list[i].y2);
+      
+      display->dirty_list[i] = display->dirty_list[--display->dirty];
+      
+      if (best == display->dirty)
+      {
+        best = i;
+        r = &display->dirty_list[best];
+      }
+      
+      i = -1; /* Start over */
     }
+}
+
+static inline void
+__make_dirty (display_t *display, int x, int y)
+{
+  const struct dirty_rect *r;
+  int i;
+  
+  /* Plain pixels mostly fall where the previous ones did */
+  for (i = display->dirty - 1; i >= 0; i--)
+  {
+    r = &display->dirty_list[i];
     
-    if (display->max_y < y)
-    {
-      if (y >= display->height)
-        y = display->height - 1;
-        
-      display->max_y = y;
-    }
+    if (x >= r->x1 && x <= r->x2 && y >= r->y1 && y <= r->y2)
+      return;
   }
+  
+  __make_dirty_rect (display, x, y, x, y);
 }
 
 static inline int 
@@ -161,14 +254,159 @@ pset_abs (display_t *display, Uint32 x, Uint32 y, Uint32 col)
 }
 
 
+/* Opaque span: color must already be stripped of its alpha */
+static inline void
+fill_span (Uint32 *p, int count, Uint32 color)
+{
+  int i = 0;
+  
+#ifdef __SSE2__
+  __m128i v;
+#endif
+  
+  /* Black (night mode background) */
+  if (color == 0)
+  {
+    memset (p, 0, count * sizeof (Uint32));
+    return;
+  }
+  
+#ifdef __SSE2__
+  v = _mm_set1_epi32 (color);
+  
+  for (; i < count && ((uintptr_t) (p + i) & 15); i++)
+    p[i] = color;
+  
+  for (; i + 4 <= count; i += 4)
+    _mm_store_si128 ((__m128i *) (p + i), v);
+#endif
+  
+  for (; i < count; i++)
+    p[i] = color;
+}
+
+#define BLEND_SPAN_MIN 8 /* Shorter spans are not worth the call */
+
+/* Translucent span */
+static inline void
+blend_span (display_t *display, Uint32 *p, int count, Uint32 color)
+{
+  int i;
+  
+  if (count >= BLEND_SPAN_MIN)
+  {
+    blend_row (p, count, color);
+    return;
+  }
+  
+  for (i = 0; i < count; i++)
+    p[i] = alphacolor (display, p[i], color);
+}
+
+/* Either of the above */
+static inline void
+put_span (display_t *display, Uint32 *p, int count, Uint32 color)
+{
+  if (G_ALPHA (color) == 0xff)
+    fill_span (p, count, color & COLOR_MASK);
+  else
+    blend_span (display, p, count, color);
+}
+
+/* From x1 to x2, both included */
+static inline void
+hline (display_t *display, int x1, int x2, int y, Uint32 color)
+{
+  if (!G_ALPHA (color) || y < 0 || y >= display->height)
+    return;
+  
+  if (x1 > x2)
+  {
+    x1 ^= x2;
+    x2 ^= x1;
+    x1 ^= x2;
+  }
+  
+  if (x1 < 0)
+    x1 = 0;
+  
+  if (x2 >= display->width)
+    x2 = display->width - 1;
+  
+  if (x1 > x2)
+    return;
+  
+  put_span (display,
+            (Uint32 *) display->screen->pixels + x1 + y * display->width,
+            x2 - x1 + 1,
+            color);
+  
+  __make_dirty_rect (display, x1, y, x2, y);
+}
+
+/* Vertical span, already clipped and sorted */
+static inline void
+__vspan (display_t *display, int x, int y1, int y2, Uint32 color)
+{
+  Uint32 *p;
+  Uint32 opaque;
+  int j;
+  
+  p = (Uint32 *) display->screen->pixels + x + y1 * display->width;
+  
+  if (G_ALPHA (color) == 0xff)
+  {
+    opaque = color & COLOR_MASK;
+    
+    for (j = y1; j <= y2; j++, p += display->width)
+      *p = opaque;
+  }
+  else
+    for (j = y1; j <= y2; j++, p += display->width)
+      *p = alphacolor (display, *p, color);
+}
+
+/* From y1 to y2, both included */
+static inline void
+vline (display_t *display, int x, int y1, int y2, Uint32 color)
+{
+  if (!G_ALPHA (color) || x < 0 || x >= display->width)
+    return;
+  
+  if (y1 > y2)
+  {
+    y1 ^= y2;
+    y2 ^= y1;
+    y1 ^= y2;
+  }
+  
+  if (y1 < 0)
+    y1 = 0;
+  
+  if (y2 >= display->height)
+    y2 = display->height - 1;
+  
+  if (y1 > y2)
+    return;
+  
+  __vspan (display, x, y1, y2, color);
+  
+  __make_dirty_rect (display, x, y1, x, y2);
+}
+
 static inline void
 clear (display_t *display, Uint32 color)
 {
-  int i, j;
+  if (!G_ALPHA (color))
+    return;
   
-  for (j = 0; j < display->height; j++)
-    for (i = 0; i < display->width; i++)
-      pset_abs (display, i, j, color);
+  /* Rows are contiguous: the whole screen is one span */
+  put_span (display,
+            (Uint32 *) display->screen->pixels,
+            display->width * display->height,
+            color);
+  
+  __make_dirty_rect (display, 0, 0, display->width - 1, display->height - 1);
 }
 
 static inline void 
@@ -197,37 +435,20 @@ line (display_t *display, int x1, int y1, int x2, int y2, Uint32 color)
   dx2 = dx << 1;
   dy2 = dy << 1;
 
+  /* Axis-aligned lines leave out the greater end */
   if (x1 == x2)
   {
     if (y1 < y2)
-    {
-      for (i = y1;i < y2;i++)
-      {
-        pset_abs (display, x1, i, color);
-      }
-    }
-    else{
-      for (i = y2;i < y1;i++)
-      {
-        pset_abs (display, x1, i, color);
-      }
-    }
+      vline (display, x1, y1, y2 - 1, color);
+    else if (y2 < y1)
+      vline (display, x1, y2, y1 - 1, color);
   }
   else if (y1 == y2)
   {
     if (x1 < x2)
-    {
-      for (i = x1;i < x2;i++)
-      {
-        pset_abs (display, i, y1, color);
-      }
-    }
-    else{
-      for (i = x2;i < x1;i++)
-      {
-        pset_abs (display, i, y1, color);
-      }
-    }
+      hline (display, x1, x2 - 1, y1, color);
+    else
+      hline (display, x2, x1 - 1, y1, color);
   }
   else if (dx >= dy)
   {
@@ -300,7 +521,11 @@ swap (int *x, int *y)
 static inline void
 fbox (display_t *display, int x1, int y1, int x2, int y2, Uint32 color)
 {
-  int i, j;
+  Uint32 *p;
+  int j;
+  
+  if (!G_ALPHA (color))
+    return;
   
   if (x1 > x2)
     swap (&x1, &x2);
@@ -308,9 +533,138 @@ fbox (display_t *display, int x1, int y1, int x2, int y2, Uint32 color)
   if (y1 > y2)
     swap (&y1, &y2);
   
-  for (j = y1; j <= y2; j++)
-    for (i = x1; i <= x2; i++)
-      pset_abs (display, i, j, color); 
+  if (x1 < 0)
+    x1 = 0;
+  
+  if (y1 < 0)
+    y1 = 0;
+  
+  if (x2 >= display->width)
+    x2 = display->width - 1;
+  
+  if (y2 >= display->height)
+    y2 = display->height - 1;
+  
+  if (x1 > x2 || y1 > y2)
+    return;
+  
+  p = (Uint32 *) display->screen->pixels + x1 + y1 * display->width;
+  
+  if (G_ALPHA (color) == 0xff)
+    for (j = y1; j <= y2; j++, p += display->width)
+      fill_span (p, x2 - x1 + 1, color & COLOR_MASK);
+  else
+    blend_rect (p, display->width, x2 - x1 + 1, y2 - y1 + 1, color);
+  
+  __make_dirty_rect (display, x1, y1, x2, y2);
+}
+
+/*
+ * Trace of a signal with more samples than columns: column x + i spans
+ * rows top[i] to bottom[i] (top <= bottom), stretched to reach the
+ * span of the previous column so the trace stays connected. The
+ * surface is locked once and each column is a single vertical span.
+ */
+static inline void
+polyline_envelope (display_t *display, 
+                   int x, 
+                   const int *top, 
+                   const int *bottom, 
+                   int count, 
+                   Uint32 color)
+{
+  int min_y = display->height, max_y = -1;
+  int y1, y2;
+  int i;
+  
+  if (!G_ALPHA (color) || count <= 0)
+    return;
+  
+  if (SDL_MUSTLOCK (display->screen))
+    if (SDL_LockSurface (display->screen) < 0)
+      return;
+  
+  for (i = 0; i < count; i++)
+  {
+    y1 = top[i];
+    y2 = bottom[i];
+    
+    if (i > 0)
+    {
+      if (y1 > bottom[i - 1])
+        y1 = bottom[i - 1];
+      
+      if (y2 < top[i - 1])
+        y2 = top[i - 1];
+    }
+    
+    if (x + i < 0 || x + i >= display->width)
+      continue;
+    
+    if (y1 < 0)
+      y1 = 0;
+    
+    if (y2 >= display->height)
+      y2 = display->height - 1;
+    
+    if (y1 > y2)
+      continue;
+    
+    __vspan (display, x + i, y1, y2, color);
+    
+    if (min_y > y1)
+      min_y = y1;
+    
+    if (max_y < y2)
+      max_y = y2;
+  }
+  
+  if (SDL_MUSTLOCK (display->screen))
+    SDL_UnlockSurface (display->screen);
+  
+  if (min_y <= max_y)
+    __make_dirty_rect (display, 
+                       x < 0 ? 0 : x, 
+                       min_y, 
+                       x + count > display->width ? display->width - 1 : x + count - 1, 
+                       max_y);
+}
+
+/* Row of palette indices, opaque. Clipped against the screen. */
+static inline void
+blit_row_lut (display_t *display, 
+              int x, 
+              int y, 
+              const Uint8 *index, 
+              int count, 
+              const Uint32 *lut)
+{
+  Uint32 *p;
+  int i;
+  
+  if (y < 0 || y >= display->height)
+    return;
+  
+  if (x < 0)
+  {
+    index -= x;
+    count += x;
+    x = 0;
+  }
+  
+  if (x + count > display->width)
+    count = display->width - x;
+  
+  if (count <= 0)
+    return;
+  
+  p = (Uint32 *) display->screen->pixels + x + y * display->width;
+  
+  for (i = 0; i < count; i++)
+    p[i] = lut[index[i]] & COLOR_MASK;
+  
+  __make_dirty (display, x, y);
+  __make_dirty (display, x + count - 1, y);
 }
 
 static inline void 
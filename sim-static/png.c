@@ -0,0 +1,589 @@
+/*
+ *    png.c: Minimal PNG encoder for display snapshots
+ *    Copyright (C) 2017  Gonzalo José Carracedo Carballal
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <util.h>
+#include "png.h"
+
+#define PNG_BPP            3
+#define PNG_STORED_MAX     65535
+#define PNG_WINDOW_SIZE    32768
+#define PNG_HASH_BITS      15
+#define PNG_HASH_SIZE      (1 << PNG_HASH_BITS)
+#define PNG_MAX_CHAIN      32
+#define PNG_MIN_MATCH      3
+#define PNG_MAX_MATCH      258
+
+#define PNG_FILTER_NONE    0
+#define PNG_FILTER_SUB     1
+#define PNG_FILTER_UP      2
+#define PNG_FILTER_AVERAGE 3
+#define PNG_FILTER_PAETH   4
+
+static const BYTE png_signature[8] =
+  {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+/* Deflate length codes 257..285: base length and extra bits */
+static const WORD png_len_base[29] =
+{
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const BYTE png_len_extra[29] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+/* Distance codes 0..29 */
+static const WORD png_dist_base[30] =
+{
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+  8193, 12289, 16385, 24577
+};
+
+static const BYTE png_dist_extra[30] =
+{
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static DWORD png_crc_table[256];
+
+static void png_init_crc_table (void) __attribute__ ((constructor));
+
+static void
+png_init_crc_table (void)
+{
+  DWORD c;
+  int n, k;
+
+  for (n = 0; n < 256; ++n)
+  {
+    c = n;
+    for (k = 0; k < 8; ++k)
+      c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    png_crc_table[n] = c;
+  }
+}
+
+static DWORD
+png_crc (DWORD crc, const BYTE *buf, size_t len)
+{
+  crc = ~crc;
+
+  while (len--)
+    crc = png_crc_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+  return ~crc;
+}
+
+static DWORD
+png_adler32 (DWORD adler, const BYTE *buf, size_t len)
+{
+  DWORD a = adler & 0xffff;
+  DWORD b = adler >> 16;
+  size_t chunk;
+
+  while (len > 0)
+  {
+    /* Largest n such that no overflow happens before reducing */
+    chunk = len < 5552 ? len : 5552;
+    len -= chunk;
+
+    while (chunk--)
+    {
+      a += *buf++;
+      b += a;
+    }
+
+    a %= 65521;
+    b %= 65521;
+  }
+
+  return (b << 16) | a;
+}
+
+/************************** Deflate bit writer ******************************/
+struct png_bits
+{
+  BYTE *data;
+  size_t size;
+  QWORD acc;
+  int count;
+};
+
+static inline void
+png_put_bits (struct png_bits *bits, DWORD value, int count)
+{
+  bits->acc |= (QWORD) value << bits->count;
+  bits->count += count;
+
+  while (bits->count >= 8)
+  {
+    bits->data[bits->size++] = bits->acc & 0xff;
+    bits->acc >>= 8;
+    bits->count -= 8;
+  }
+}
+
+static inline void
+png_flush_bits (struct png_bits *bits)
+{
+  if (bits->count > 0)
+    png_put_bits (bits, 0, 8 - bits->count);
+}
+
+/* Huffman codes are stored MSB first */
+static inline void
+png_put_code (struct png_bits *bits, DWORD code, int count)
+{
+  DWORD rev = 0;
+  int i;
+
+  for (i = 0; i < count; ++i)
+    rev |= ((code >> i) & 1) << (count - i - 1);
+
+  png_put_bits (bits, rev, count);
+}
+
+/* Fixed Huffman literal/length alphabet (RFC 1951, 3.2.6) */
+static inline void
+png_put_litlen (struct png_bits *bits, int sym)
+{
+  if (sym < 144)
+    png_put_code (bits, 0x30 + sym, 8);
+  else if (sym < 256)
+    png_put_code (bits, 0x190 + sym - 144, 9);
+  else if (sym < 280)
+    png_put_code (bits, sym - 256, 7);
+  else
+    png_put_code (bits, 0xc0 + sym - 280, 8);
+}
+
+static inline void
+png_put_match (struct png_bits *bits, int len, int dist)
+{
+  int code;
+
+  for (code = 28; png_len_base[code] > len; --code);
+
+  png_put_litlen (bits, 257 + code);
+  if (png_len_extra[code])
+    png_put_bits (bits, len - png_len_base[code], png_len_extra[code]);
+
+  for (code = 29; png_dist_base[code] > dist; --code);
+
+  png_put_code (bits, code, 5);
+  if (png_dist_extra[code])
+    png_put_bits (bits, dist - png_dist_base[code], png_dist_extra[code]);
+}
+
+static void
+png_deflate_stored (struct png_bits *bits, const BYTE *data, size_t len)
+{
+  size_t block;
+
+  do
+  {
+    block = len < PNG_STORED_MAX ? len : PNG_STORED_MAX;
+    len -= block;
+
+    png_put_bits (bits, len == 0, 1); /* BFINAL */
+    png_put_bits (bits, 0, 2);        /* BTYPE = stored */
+    png_flush_bits (bits);
+
+    png_put_bits (bits, block, 16);
+    png_put_bits (bits, ~block & 0xffff, 16);
+
+    memcpy (bits->data + bits->size, data, block);
+    bits->size += block;
+    data += block;
+  }
+  while (len > 0);
+}
+
+static inline unsigned int
+png_hash (const BYTE *p)
+{
+  return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (PNG_HASH_SIZE - 1);
+}
+
+static inline int
+png_match_length (const BYTE *a, const BYTE *b, int max)
+{
+  int len = 0;
+
+  while (len < max && a[len] == b[len])
+    ++len;
+
+  return len;
+}
+
+static void
+png_deflate_fixed (
+  struct png_bits *bits,
+  const BYTE *data,
+  size_t len,
+  int rle_only)
+{
+  int *head = NULL;
+  int *prev = NULL;
+  size_t i = 0;
+  int best_len, best_dist;
+  int cand, chain, max, l;
+  unsigned int h;
+
+  if (!rle_only)
+  {
+    head = xmalloc (PNG_HASH_SIZE * sizeof (int));
+    prev = xmalloc (PNG_WINDOW_SIZE * sizeof (int));
+    memset (head, 0xff, PNG_HASH_SIZE * sizeof (int));
+  }
+
+  png_put_bits (bits, 1, 1); /* BFINAL */
+  png_put_bits (bits, 1, 2); /* BTYPE = fixed Huffman */
+
+  while (i < len)
+  {
+    max = len - i < PNG_MAX_MATCH ? len - i : PNG_MAX_MATCH;
+    best_len = best_dist = 0;
+
+    if (rle_only)
+    {
+      if (i > 0 && max >= PNG_MIN_MATCH)
+      {
+        best_len  = png_match_length (data + i, data + i - 1, max);
+        best_dist = 1;
+      }
+    }
+    else if (max >= PNG_MIN_MATCH)
+    {
+      h = png_hash (data + i);
+      cand = head[h];
+      chain = PNG_MAX_CHAIN;
+
+      while (cand >= 0 && i - cand <= PNG_WINDOW_SIZE && chain-- > 0)
+      {
+        if (data[cand + best_len] == data[i + best_len])
+        {
+          l = png_match_length (data + i, data + cand, max);
+          if (l > best_len)
+          {
+            best_len  = l;
+            best_dist = i - cand;
+            if (l == max)
+              break;
+          }
+        }
+
+        cand = prev[cand & (PNG_WINDOW_SIZE - 1)];
+      }
+    }
+
+    if (best_len < PNG_MIN_MATCH)
+      best_len = 1;
+    else
+      png_put_match (bits, best_len, best_dist);
+
+    if (best_len == 1)
+      png_put_litlen (bits, data[i]);
+
+    if (!rle_only)
+      for (l = 0; l < best_len && i + l + PNG_MIN_MATCH <= len; ++l)
+      {
+        h = png_hash (data + i + l);
+        prev[(i + l) & (PNG_WINDOW_SIZE - 1)] = head[h];
+        head[h] = i + l;
+      }
+
+    i += best_len;
+  }
+
+  png_put_litlen (bits, 256); /* End of block */
+  png_flush_bits (bits);
+
+  if (head != NULL)
+    free (head);
+
+  if (prev != NULL)
+    free (prev);
+}
+
+/***************************** Row filtering ********************************/
+static inline int
+png_paeth (int a, int b, int c)
+{
+  int p  = a + b - c;
+  int pa = abs (p - a);
+  int pb = abs (p - b);
+  int pc = abs (p - c);
+
+  if (pa <= pb && pa <= pc)
+    return a;
+  else if (pb <= pc)
+    return b;
+
+  return c;
+}
+
+static void
+png_filter_row (BYTE *out, const BYTE *row, const BYTE *up, int len, int type)
+{
+  int i, a, b, c;
+
+  for (i = 0; i < len; ++i)
+  {
+    a = i >= PNG_BPP ? row[i - PNG_BPP] : 0;
+    b = up != NULL ? up[i] : 0;
+    c = i >= PNG_BPP && up != NULL ? up[i - PNG_BPP] : 0;
+
+    switch (type)
+    {
+      case PNG_FILTER_SUB:
+        out[i] = row[i] - a;
+        break;
+
+      case PNG_FILTER_UP:
+        out[i] = row[i] - b;
+        break;
+
+      case PNG_FILTER_PAETH:
+        out[i] = row[i] - png_paeth (a, b, c);
+        break;
+
+      default:
+        out[i] = row[i];
+    }
+  }
+}
+
+/* Minimum sum of absolute differences heuristic */
+static unsigned int
+png_filter_cost (const BYTE *buf, int len)
+{
+  unsigned int cost = 0;
+  int i;
+
+  for (i = 0; i < len; ++i)
+    cost += buf[i] < 128 ? buf[i] : 256 - buf[i];
+
+  return cost;
+}
+
+static void
+png_unpack_row (BYTE *out, const DWORD *pixels, int width)
+{
+  int i;
+
+  for (i = 0; i < width; ++i)
+  {
+    *out++ = (pixels[i] >> 16) & 0xff;
+    *out++ = (pixels[i] >> 8) & 0xff;
+    *out++ = pixels[i] & 0xff;
+  }
+}
+
+/*
+ * Builds the filtered scanline stream. Every row is preceded by its
+ * filter type byte.
+ */
+static BYTE *
+png_filter_image (
+  const DWORD *pixels,
+  int width,
+  int height,
+  int pitch,
+  enum png_mode mode,
+  size_t *size)
+{
+  static const int rle_filters[] = {PNG_FILTER_SUB, PNG_FILTER_UP, -1};
+  static const int all_filters[] =
+    {PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_PAETH, -1};
+  const int *filters;
+  int stride = width * PNG_BPP;
+  BYTE *rows[2];
+  BYTE *out, *dest, *trial;
+  unsigned int cost, best_cost;
+  int i, j;
+
+  out      = xmalloc ((size_t) (stride + 1) * height);
+  rows[0]  = xmalloc (stride);
+  rows[1]  = xmalloc (stride);
+  trial    = xmalloc (stride);
+
+  filters = mode == PNG_MODE_RLE ? rle_filters : all_filters;
+
+  for (j = 0; j < height; ++j)
+  {
+    png_unpack_row (
+      rows[j & 1],
+      (const DWORD *) ((const BYTE *) pixels + (size_t) j * pitch),
+      width);
+
+    dest = out + (size_t) j * (stride + 1);
+
+    if (mode == PNG_MODE_STORE)
+    {
+      dest[0] = PNG_FILTER_NONE;
+      memcpy (dest + 1, rows[j & 1], stride);
+      continue;
+    }
+
+    best_cost = ~0u;
+
+    for (i = 0; filters[i] != -1; ++i)
+    {
+      png_filter_row (
+        trial,
+        rows[j & 1],
+        j > 0 ? rows[~j & 1] : NULL,
+        stride,
+        filters[i]);
+
+      if ((cost = png_filter_cost (trial, stride)) < best_cost)
+      {
+        best_cost = cost;
+        dest[0] = filters[i];
+        memcpy (dest + 1, trial, stride);
+      }
+    }
+  }
+
+  free (rows[0]);
+  free (rows[1]);
+  free (trial);
+
+  *size = (size_t) (stride + 1) * height;
+
+  return out;
+}
+
+/****************************** File output *********************************/
+static inline void
+png_put_be32 (BYTE *p, DWORD value)
+{
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+static int
+png_write_chunk (FILE *fp, const char *type, const BYTE *data, size_t len)
+{
+  BYTE hdr[8];
+  BYTE crc[4];
+  DWORD c;
+
+  png_put_be32 (hdr, len);
+  memcpy (hdr + 4, type, 4);
+
+  c = png_crc (0, hdr + 4, 4);
+  c = png_crc (c, data, len);
+  png_put_be32 (crc, c);
+
+  if (fwrite (hdr, sizeof (hdr), 1, fp) < 1
+      || (len > 0 && fwrite (data, len, 1, fp) < 1)
+      || fwrite (crc, sizeof (crc), 1, fp) < 1)
+    return -1;
+
+  return 0;
+}
+
+int
+png_write (
+  const char *file,
+  const DWORD *pixels,
+  int width,
+  int height,
+  int pitch,
+  enum png_mode mode)
+{
+  FILE *fp = NULL;
+  BYTE *raw = NULL;
+  size_t raw_size;
+  struct png_bits bits;
+  BYTE ihdr[13];
+  int err = -1;
+
+  memset (&bits, 0, sizeof (struct png_bits));
+
+  raw = png_filter_image (pixels, width, height, pitch, mode, &raw_size);
+
+  /*
+   * Fixed Huffman codes never take more than 9 bits per input byte,
+   * stored blocks take 5 extra bytes per block.
+   */
+  bits.data = xmalloc (
+    raw_size + raw_size / 8 + 5 * (raw_size / PNG_STORED_MAX + 1) + 16);
+
+  png_put_bits (&bits, 0x78, 8); /* CMF: deflate, 32K window */
+  png_put_bits (&bits, 0x01, 8); /* FLG: fastest, check bits */
+
+  if (mode == PNG_MODE_STORE)
+    png_deflate_stored (&bits, raw, raw_size);
+  else
+    png_deflate_fixed (&bits, raw, raw_size, mode == PNG_MODE_RLE);
+
+  png_put_be32 (bits.data + bits.size, png_adler32 (1, raw, raw_size));
+  bits.size += 4;
+
+  png_put_be32 (ihdr, width);
+  png_put_be32 (ihdr + 4, height);
+  ihdr[8]  = 8; /* Bit depth */
+  ihdr[9]  = 2; /* Truecolor */
+  ihdr[10] = 0; /* Deflate */
+  ihdr[11] = 0; /* Adaptive filtering */
+  ihdr[12] = 0; /* No interlace */
+
+  if ((fp = fopen (file, "wb")) == NULL)
+  {
+    ERROR ("Couldn't open %s for writing: %s\n", file, strerror (errno));
+    goto done;
+  }
+
+  if (fwrite (png_signature, sizeof (png_signature), 1, fp) < 1
+      || png_write_chunk (fp, "IHDR", ihdr, sizeof (ihdr)) == -1
+      || png_write_chunk (fp, "IDAT", bits.data, bits.size) == -1
+      || png_write_chunk (fp, "IEND", NULL, 0) == -1)
+  {
+    ERROR ("Couldn't store data in %s: %s\n", file, strerror (errno));
+    goto done;
+  }
+
+  err = 0;
+
+done:
+  if (fp != NULL && fclose (fp) != 0)
+    err = -1;
+
+  if (raw != NULL)
+    free (raw);
+
+  if (bits.data != NULL)
+    free (bits.data);
+
+  return err;
+}
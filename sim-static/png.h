@@ -0,0 +1,37 @@
+/*
+ *    png.h: Minimal PNG encoder for display snapshots
+ *    Copyright (C) 2017  Gonzalo José Carracedo Carballal
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef _PNG_H
+#define _PNG_H
+
+#include "layout.h"
+
+enum png_mode
+{
+  PNG_MODE_STORE,   /* No filtering, stored deflate blocks */
+  PNG_MODE_RLE,     /* Sub/Up filters, runs only (distance 1) */
+  PNG_MODE_DEFLATE  /* All filters, LZ77 with hash chains */
+};
+
+/*
+ * Encodes a 32 bpp 0xXXRRGGBB image (pitch in bytes) as a 24 bpp RGB
+ * PNG. Thread safe: it does not touch the display.
+ */
+int png_write (const char *, const DWORD *, int, int, int, enum png_mode);
+
+#endif /* _PNG_H */
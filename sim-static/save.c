@@ -5,23 +5,15 @@
 #include <util.h>
 #include "wbmp.h"
 
-int 
-draw_to_bmp (const char *file, struct draw *draw)
+static int
+bmp_write_headers (FILE *fp, const char *file, int width, int height)
 {
-  FILE *fp;
   BITMAPFILEHEADER header;
   BITMAPINFOHEADER info;
   
-  if ((fp = fopen (file, "wb")) == NULL)
-  {
-    ERROR ("Couldn't open %s for writing: %s\n", file, strerror (errno));
-    
-    return -1;
-  }
-  
   header.bfType = BM_MAGIC;
   header.bfSize = sizeof (BITMAPFILEHEADER) + sizeof (BITMAPINFOHEADER) +
-                  BITMAP_SIZE (draw->width, draw->height, 24);
+                  BITMAP_SIZE (width, height, 24);
                   
   header.bfReserved1 = header.bfReserved2 = 0;
   header.bfOffBits   = sizeof (BITMAPFILEHEADER) + sizeof (BITMAPINFOHEADER);
@@ -29,14 +21,13 @@ draw_to_bmp (const char *file, struct draw *draw)
   if (fwrite (&header, sizeof (BITMAPFILEHEADER), 1, fp) < 1)
   {
     ERROR ("Couldn't store header in %s: %s\n", file, strerror (errno));
-    fclose (fp);
     
     return -1;
   }
   
   info.biSize          = sizeof (BITMAPINFOHEADER);
-  info.biWidth         = draw->width;
-  info.biHeight        = draw->height;
+  info.biWidth         = width;
+  info.biHeight        = height;
   info.biPlanes        = 1; /* It's ONE fucking plane, no zero, you dumbass */
   info.biBitCount      = 24;
   info.biCompression   = 0;
@@ -49,6 +40,27 @@ draw_to_bmp (const char *file, struct draw *draw)
   if (fwrite (&info, sizeof (BITMAPINFOHEADER), 1, fp) < 1)
   {
     ERROR ("Couldn't store header in %s: %s\n", file, strerror (errno));
+    
+    return -1;
+  }
+  
+  return 0;
+}
+
+int 
+draw_to_bmp (const char *file, struct draw *draw)
+{
+  FILE *fp;
+  
+  if ((fp = fopen (file, "wb")) == NULL)
+  {
+    ERROR ("Couldn't open %s for writing: %s\n", file, strerror (errno));
+    
+    return -1;
+  }
+  
+  if (bmp_write_headers (fp, file, draw->width, draw->height) == -1)
+  {
     fclose (fp);
     
     return -1;
@@ -67,3 +79,55 @@ draw_to_bmp (const char *file, struct draw *draw)
   return 0;  
 }
 
+/* Straight from a 32 bpp surface, no intermediate struct draw */
+int
+surface_to_bmp (const char *file, 
+                const DWORD *pixels, 
+                int width, 
+                int height, 
+                int pitch)
+{
+  FILE *fp;
+  BYTE *data;
+  int row_bytes;
+  int j;
+  int err = -1;
+  
+  row_bytes = BITMAP_ROW_BYTES (width * 24);
+  
+  /* Zeroed, so row padding is deterministic */
+  data = xmalloc (BITMAP_SIZE (width, height, 24));
+  memset (data, 0, BITMAP_SIZE (width, height, 24));
+  
+  /* BMP rows are stored bottom-up */
+  for (j = 0; j < height; j++)
+    draw_pack_row (
+      data + (height - j - 1) * row_bytes, 
+      (const DWORD *) ((const BYTE *) pixels + j * pitch), 
+      width);
+  
+  if ((fp = fopen (file, "wb")) == NULL)
+  {
+    ERROR ("Couldn't open %s for writing: %s\n", file, strerror (errno));
+    goto done;
+  }
+  
+  if (bmp_write_headers (fp, file, width, height) == -1)
+    goto done;
+  
+  if (fwrite (data, BITMAP_SIZE (width, height, 24), 1, fp) < 1)
+  {
+    ERROR ("Couldn't store data in %s: %s\n", file, strerror (errno));
+    goto done;
+  }
+  
+  err = 0;
+  
+done:
+  if (fp != NULL && fclose (fp) != 0)
+    err = -1;
+    
+  free (data);
+  
+  return err;
+}
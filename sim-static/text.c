@@ -51,18 +51,39 @@ display_puts (display_t *display,
   if (x < 0 || y < 0 || x >= display->width || y >= display->height)
     return;
     
-  cpi_puts (display->selected_font, display->width, display->height, x, y, 
-      display->screen->pixels, 4, !(bgcolor & 0xff000000), color, bgcolor, text);
-  __make_dirty (display, x, y);
-  __make_dirty (display, 
+  if (display->font_atlas != NULL)
+    cpi_atlas_puts (display->font_atlas, display->width, display->height, x, y,
+        display->screen->pixels, !(bgcolor & 0xff000000), color, bgcolor, text);
+  else
+    cpi_puts (display->selected_font, display->width, display->height, x, y, 
+        display->screen->pixels, 4, !(bgcolor & 0xff000000), color, bgcolor, text);
+  __make_dirty_rect (display, x, y,
     x + 8 * strlen (text) - 1, y + display->selected_font->rows - 1);
 }
 
+/* Formats into buf (DISPLAY_PRINTF_BUFSIZ bytes) unless it is too short */
+static char *
+display_vformat (char *buf, const char *fmt, va_list ap)
+{
+  va_list copy;
+  int len;
+  
+  va_copy (copy, ap);
+  len = vsnprintf (buf, DISPLAY_PRINTF_BUFSIZ, fmt, copy);
+  va_end (copy);
+  
+  if (len >= 0 && len < DISPLAY_PRINTF_BUFSIZ)
+    return buf;
+  
+  return vstrbuild (fmt, ap);
+}
+
 void 
 display_printf (display_t *display,
                int x, int y, int color, int bgcolor, const char *fmt, ...)
 {
   va_list ap;
+  char buf[DISPLAY_PRINTF_BUFSIZ];
   char *text;
   
   if (!have_font_selected (display))
@@ -74,10 +95,11 @@ display_printf (display_t *display,
   
   va_start (ap, fmt);
   
-  text = vstrbuild (fmt, ap);
+  text = display_vformat (buf, fmt, ap);
   display_puts (display, x, y, color, bgcolor, text);
   
-  free (text);
+  if (text != buf)
+    free (text);
   
   va_end (ap);
 }
@@ -117,6 +139,11 @@ display_select_font (display_t *display, int cp, int height)
     return -1;
   }
   
+  if (display->font_atlas != NULL)
+    cpi_atlas_free (display->font_atlas);
+  
+  display->font_atlas = cpi_atlas_new (display->selected_font);
+  
   return 0;
 }
 
@@ -150,8 +177,7 @@ scroll_up (textarea_t *area)
       0,
       (area->cpi_width * 8) * sizeof (Uint32));
             
-  __make_dirty (area->display, area->pos_x, area->pos_y);
-  __make_dirty (area->display, 
+  __make_dirty_rect (area->display, area->pos_x, area->pos_y,
     area->pos_x + area->cpi_width  * 8 - 1, 
     area->pos_y + area->cpi_height * area->selected_font->rows - 1);
   
@@ -193,19 +219,25 @@ cputchar (textarea_t *area, char c)
         }
       }
       
-    cpi_puts (area->selected_font, 
-      area->display->width, 
-      area->display->height, 
-      area->pos_x + area->cursor_x * 8, 
-      area->pos_y + area->selected_font->rows * (area->cursor_y), 
-      area->display->screen->pixels, 4, !(area->bgcolor & 0xff000000), area->color, area->bgcolor, cbuf);
+    if (area->font_atlas != NULL)
+      cpi_atlas_puts (area->font_atlas, 
+        area->display->width, 
+        area->display->height, 
+        area->pos_x + area->cursor_x * 8, 
+        area->pos_y + area->selected_font->rows * (area->cursor_y), 
+        area->display->screen->pixels, !(area->bgcolor & 0xff000000), area->color, area->bgcolor, cbuf);
+    else
+      cpi_puts (area->selected_font, 
+        area->display->width, 
+        area->display->height, 
+        area->pos_x + area->cursor_x * 8, 
+        area->pos_y + area->selected_font->rows * (area->cursor_y), 
+        area->display->screen->pixels, 4, !(area->bgcolor & 0xff000000), area->color, area->bgcolor, cbuf);
   
     
-    __make_dirty (area->display, 
+    __make_dirty_rect (area->display, 
       area->pos_x + area->cursor_x * 8, 
-      area->pos_y + area->selected_font->rows * (area->cursor_y));
-    
-    __make_dirty (area->display, 
+      area->pos_y + area->selected_font->rows * (area->cursor_y),
       area->pos_x + area->cursor_x * 8 + 7, 
       area->pos_y + area->selected_font->rows * (area->cursor_y + 1) - 1);
       
@@ -218,7 +250,7 @@ cputs (textarea_t *area, const char *text)
 {
   int i;
   
-  for (i = 0; i < strlen (text); i++)
+  for (i = 0; text[i] != '\0'; i++)
     cputchar (area, text[i]);
     
   if (area->autorefresh)
@@ -230,20 +262,21 @@ void
 cprintf (textarea_t *area, const char *fmt, ...)
 {
   va_list ap;
+  char buf[DISPLAY_PRINTF_BUFSIZ];
   char *text;
   
   va_start (ap, fmt);
   
-  text = vstrbuild (fmt, ap);
+  text = display_vformat (buf, fmt, ap);
   
   cputs (area, text);
   
-  free (text);
+  if (text != buf)
+    free (text);
   
   va_end (ap);
 }
 
-/* FIXME: deallocate this */
 textarea_t *
 display_textarea_new (display_t *disp, int x, int y, int cols, int rows,
   const char *path, int cp, int height)
@@ -282,6 +315,8 @@ display_textarea_new (display_t *disp, int x, int y, int cols, int rows,
     return NULL;
   }
   
+  new->font_atlas = cpi_atlas_new (new->selected_font);
+  
   new->pos_x = x;
   new->pos_y = y;
   
@@ -297,6 +332,17 @@ display_textarea_new (display_t *disp, int x, int y, int cols, int rows,
   return new;
 }
 
+void
+display_textarea_free (textarea_t *area)
+{
+  if (area->font_atlas != NULL)
+    cpi_atlas_free (area->font_atlas);
+  
+  cpi_unmap (&area->cpi_handle);
+  
+  free (area);
+}
+
 void
 textarea_set_fore_color (textarea_t *area, int color)
 {
@@ -25,6 +25,11 @@
 #include "layout.h"
 #include "wbmp.h"
 
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#  define WBMP_HAVE_SSSE3
+#  include <tmmintrin.h>
+#endif
+
 struct draw *
 draw_new (int width, int height)
 {
@@ -37,8 +42,6 @@ draw_new (int width, int height)
   draw->total_size = BITMAP_SIZE (width, height, 24);
   draw->pixels = xmalloc (draw->total_size);
   
-  printf ("Total size: %d\n", draw->total_size);
-  
   memset (draw->pixels, 0, draw->total_size);
   
   return draw;
@@ -85,3 +88,87 @@ draw_pget (struct draw *draw, int x, int y)
 }
 
 
+
+/*
+ * Row conversion between 32 bpp surfaces (0xXXRRGGBB, i.e. B, G, R, X in
+ * memory) and 24 bpp BMP rows (B, G, R). Packing just drops every
+ * fourth byte, so it maps well onto a byte shuffle.
+ */
+static void
+draw_pack_row_generic (BYTE *dest, const DWORD *src, int width)
+{
+  int i;
+  
+  for (i = 0; i < width; ++i)
+  {
+    *dest++ = src[i];
+    *dest++ = src[i] >> 8;
+    *dest++ = src[i] >> 16;
+  }
+}
+
+#ifdef WBMP_HAVE_SSSE3
+__attribute__ ((target ("ssse3"))) static void
+draw_pack_row_ssse3 (BYTE *dest, const DWORD *src, int width)
+{
+  const __m128i shuf = _mm_setr_epi8 (
+    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  __m128i a, b, c, d;
+  int i = 0;
+  
+  /* 16 pixels in, 48 bytes out (three full stores) per iteration */
+  for (; i + 16 <= width; i += 16)
+  {
+    a = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (src + i)), shuf);
+    b = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (src + i + 4)), shuf);
+    c = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (src + i + 8)), shuf);
+    d = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (src + i + 12)), shuf);
+    
+    /* a = 12 bytes of a | 4 bytes of b, etc. */
+    _mm_storeu_si128 (
+      (__m128i *) dest,
+      _mm_or_si128 (a, _mm_slli_si128 (b, 12)));
+    _mm_storeu_si128 (
+      (__m128i *) (dest + 16),
+      _mm_or_si128 (_mm_srli_si128 (b, 4), _mm_slli_si128 (c, 8)));
+    _mm_storeu_si128 (
+      (__m128i *) (dest + 32),
+      _mm_or_si128 (_mm_srli_si128 (c, 8), _mm_slli_si128 (d, 4)));
+    
+    dest += 48;
+  }
+  
+  draw_pack_row_generic (dest, src + i, width - i);
+}
+#endif /* WBMP_HAVE_SSSE3 */
+
+static void (*draw_pack_row_impl) (BYTE *, const DWORD *, int) =
+  draw_pack_row_generic;
+
+static void draw_select_pack_row (void) __attribute__ ((constructor));
+
+static void
+draw_select_pack_row (void)
+{
+#ifdef WBMP_HAVE_SSSE3
+  __builtin_cpu_init ();
+  
+  if (__builtin_cpu_supports ("ssse3"))
+    draw_pack_row_impl = draw_pack_row_ssse3;
+#endif /* WBMP_HAVE_SSSE3 */
+}
+
+void
+draw_pack_row (BYTE *dest, const DWORD *src, int width)
+{
+  (draw_pack_row_impl) (dest, src, width);
+}
+
+void
+draw_unpack_row (DWORD *dest, const BYTE *src, int width, DWORD alpha)
+{
+  int i;
+  
+  for (i = 0; i < width; ++i, src += 3)
+    dest[i] = alpha | RGB (src[2], src[1], src[0]);
+}
@@ -16,6 +16,16 @@ struct draw *draw_new (int, int);
 void draw_free (struct draw *);
 struct draw *draw_from_bmp (const char *);
 int draw_to_bmp (const char *, struct draw *);
+int surface_to_bmp (const char *, const DWORD *, int, int, int);
+
+void  draw_pack_row (BYTE *, const DWORD *, int);
+void  draw_unpack_row (DWORD *, const BYTE *, int, DWORD);
+
+static inline BYTE *
+draw_row (struct draw *draw, int y)
+{
+  return draw->pixels + PIX_OFFSET (0, y, draw->width, draw->height, 24);
+}
 
 void  draw_pset (struct draw *, int, int, DWORD);
 DWORD draw_pget (struct draw *, int, int);
@@ -14,231 +14,449 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <radiotel.h>
+#include "screen.h"
 
 #include <rtsutil/source.h>
+#include <rtsutil/pipeline.h>
 #include <rtsutil/spectrogram.h>
+#include <rtsutil/worker.h>
+#include <rtsutil/waterfall.h>
+#include <rtsutil/checkpoint.h>
+#include <rtsutil/snapshot.h>
+#include <rtsutil/envelope.h>
+#include <rtsutil/control.h>
+#include <rtsutil/perf.h>
+#include <rtsutil/metrics.h>
+#include <rtsutil/trace.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/time.h>
 
-#define RADTEL_NIGHT_MODE
-
 #define RADTEL_AVG_TIME 60.0
 #define RADTEL_BINS     2048
 
+/* Accepted at run time, powers of two */
+#define RADTEL_MIN_BINS 256
+#define RADTEL_MAX_BINS 65536
+
+#define RADTEL_MAX_SETTINGS      8  /* Source settings between integrations */
+#define RADTEL_SETTING_KEY_MAX   16
+#define RADTEL_SETTING_VALUE_MAX 32
+
 #define RADTEL_SNAPSHOT_DIR "snapshots"
-#define RADTEL_SNAPSHOT_TMP_BMP "/tmp/.spectrogram.bmp"
-
-#if RADTEL_FULL_SCREEN
-#  define WINDOW_WIDTH  1920
-#  define WINDOW_HEIGHT 1080
-#else
-#  define WINDOW_WIDTH  1400
-#  define WINDOW_HEIGHT 800
-#endif
-
-#ifdef RADTEL_NIGHT_MODE
-#  define SPECTRUM_TEXT_COLOR 0xbf0000
-#  define SPECTRUM_AXES_COLOR 0x400000
-#  define SPECTRUM_FOREGROUND 0xff0000
-#  define SPECTRUM_BACKGROUND 0x000000
-#else /* !defined(RADTEL_NIGHT_MODE) */
-#  define SPECTRUM_TEXT_COLOR 0xbfbfbf
-#  define SPECTRUM_AXES_COLOR 0x404040
-#  define SPECTRUM_FOREGROUND 0x00ff00
-#  define SPECTRUM_BACKGROUND 0x1f1f1f
-#endif /* RADTEL_NIGHT_MODE */
-
-#define SPECTRUM_X 32
-#define SPECTRUM_Y 64
-
-#define SPECTRUM_TITLE "* * * RADIOTELESCOPE SPECTRUM INTEGRATOR * * *"
-
-#define SPECTRUM_PROGRESS_X 32
-#define SPECTRUM_PROGRESS_Y (WINDOW_HEIGHT - 16)
-#define SPECTRUM_PROGRESS_WIDTH (WINDOW_WIDTH - 2 * SPECTRUM_PROGRESS_X)
-#define SPECTRUM_PROGRESS_HEIGHT 8
-
-#define SPECTRUM_H_DIVS 20
-#define SPECTRUM_V_DIVS 10
-
-#define SPECTRUM_WIDTH  (WINDOW_WIDTH - 2 * SPECTRUM_X)
-#define SPECTRUM_HEIGHT (WINDOW_HEIGHT - 3 * SPECTRUM_Y / 2)
-
-#define RTS_TO_POWER_DB(mag) (10 * log10(mag))
+#define RADTEL_ARCHIVE_NAME "spectra.rta"
+#define RADTEL_ARCHIVE_TYPE RTS_ARCHIVE_FLOAT32
+#define RADTEL_ARCHIVE_COMPRESSION RTS_ARCHIVE_UNCOMPRESSED /* Default */
+#define RADTEL_ARCHIVE_QUANT_STEP  0.05 /* dB, error <= 0.025 dB */
+#define RADTEL_ARCHIVE_KEYFRAMES   60   /* One per hour */
+
+/* Extra integration times, in seconds, each one to its own archive */
+#define RADTEL_CADENCES     {1.0, 10.0, 3600.0}
+#define RADTEL_MAX_CADENCES 8
+#define RADTEL_SNAPSHOT_PNG_MODE PNG_MODE_RLE
+
+#define RADTEL_CHECKPOINT_INTERVAL 10 /* Seconds between checkpoints */
+#define RADTEL_PERF_INTERVAL       10 /* Seconds between stats files */
+#define RADTEL_METRICS_NAMESPACE   "radiotel"
+
+#define RADTEL_RENDER_POLL 20000 /* Microseconds between event polls */
 
 char *snapshot_dir;
-char *matlab_temp;
+char *archive_path;
+char *checkpoint_path;
+char *control_path;
+char *perf_path;
+char *metrics_addr;
+char *trace_path;
+enum rts_archive_compression archive_compression = RADTEL_ARCHIVE_COMPRESSION;
+volatile sig_atomic_t trace_requested;
+volatile sig_atomic_t quit_requested; /* Signals, escape or window closed */
+int trace_busy;
+int headless;
+int render_threads;
+rts_pipeline_t *pipeline;
+struct radtel_control *key_control; /* Target of the key bindings */
+
+/*
+ * Files of the current configuration. Jobs look their archive up when
+ * they run, so that a change of configuration queued in between takes
+ * effect in order. Owned by the writer thread once acquisition starts,
+ * except where noted.
+ */
+struct radtel_archives {
+  rts_worker_t *worker;
+  RTSCOUNT bins;           /* Acquisition thread only */
+  unsigned int generation; /* Changes of configuration so far */
+  rts_archive_t *archive;
+  unsigned int count;
+  rts_archive_t *cadence[RADTEL_MAX_CADENCES];
+  rts_checkpoint_t *ckpt;  /* Taken by the acquisition thread atomically */
+};
+
+struct radtel_cadence_job {
+  struct radtel_archives *archives;
+  unsigned int index;
+  RTSCOUNT bins;
+  struct rts_archive_record record;
+  RTSFLOAT *spectrum;
+};
+
+/* Everything the writer thread needs to save a finished integration */
+struct radtel_archive_job {
+  rts_spectrogram_t *spect;
+  rts_spectrum_acc_t *acc;
+  struct radtel_archives *archives;
+};
+
+/* Everything the writer thread needs to start the files of a new one */
+struct radtel_rotate_job {
+  struct radtel_archives *archives;
+  struct rts_archive_params params;
+  unsigned int count;
+  struct rts_archive_params cadence_params[RADTEL_MAX_CADENCES];
+  rts_checkpoint_t *ckpt; /* Previous one, to be closed */
+  struct rts_checkpoint_config ckpt_config;
+};
+
+#define RADTEL_CONTROL_DUMP     1 /* End the integration now */
+#define RADTEL_CONTROL_RESET    2 /* Discard it and start over */
+#define RADTEL_CONTROL_PLAN     4 /* Spectrogram plan ready */
+#define RADTEL_CONTROL_SETTINGS 8 /* Source settings pending */
+
+struct radtel_setting {
+  char key[RADTEL_SETTING_KEY_MAX];
+  char value[RADTEL_SETTING_VALUE_MAX];
+};
+
+/*
+ * Changes requested at run time, from the keyboard or the control
+ * socket. Plans are prepared by the control worker (FFTW planning
+ * included); the acquisition thread only swaps them in, together with
+ * source settings, between two integrations.
+ */
+struct radtel_control {
+  rts_worker_t *worker;
+  rts_spectrogram_t *spect;
+  struct rts_spectrogram_params params; /* Last requested, worker only */
+  rts_spectrogram_plan_t *plan;         /* Exchanged atomically */
+
+  pthread_mutex_t mutex; /* Protects the settings */
+  RTSBOOL mutex_init;
+  struct radtel_setting setting[RADTEL_MAX_SETTINGS];
+  unsigned int setting_count;
+
+  unsigned int flags; /* RADTEL_CONTROL_*, accessed atomically */
+};
+
+enum radtel_command_type {
+  RADTEL_COMMAND_AVG_TIME,
+  RADTEL_COMMAND_BINS,
+  RADTEL_COMMAND_WINDOW,
+  RADTEL_COMMAND_SOURCE,
+  RADTEL_COMMAND_DUMP,
+  RADTEL_COMMAND_RESET
+};
+
+struct radtel_command {
+  enum radtel_command_type type;
+  struct radtel_control *control;
+  RTSFLOAT value;
+  RTSBOOL relative; /* value is a factor (window: toggle) */
+  struct radtel_setting setting;
+};
+
+struct radtel_png_job {
+  struct display_snapshot *snapshot;
+  char *png_path;
+};
+
+struct radtel_checkpoint_job {
+  rts_checkpoint_t *ckpt;
+  unsigned int slot;
+};
 
 void
-radtel_redraw_spectrum(display_t *disp, const rts_spectrogram_t *spect)
+radtel_archive_job_destroy(struct radtel_archive_job *job)
 {
-  const RTSFLOAT *spectrum = NULL;
-  unsigned int count;
-  RTSFLOAT prev_x = 0;
-  RTSFLOAT prev_y = 0;
-  RTSFLOAT x, y;
-  unsigned int i;
-  unsigned int p;
-  RTSFLOAT min, max;
-  RTSFLOAT f_lo, f_hi;
-  RTSFLOAT range;
-  struct tm tm_buf;
-  time_t now;
-  char now_str[30];
-
-  /* Get spectrogram properties */
-  count    = rts_spectrogram_get_frame_count(spect);
-  spectrum = rts_spectrogram_get_cumulative(spect);
-  rts_spectrogram_get_range(spect, &min, &max, &f_lo, &f_hi);
-
-  /* Adjust range */
-  if (min == 0 && max == 0) {
-    min = -60;
-    max = 0;
-  } else {
-    min = RTS_TO_POWER_DB(min / count);
-    max = RTS_TO_POWER_DB(max / count);
+  if (job->acc != NULL)
+    rts_spectrogram_release(job->spect, job->acc);
+
+  free(job);
+}
+
+/* Runs in the writer thread */
+void
+radtel_archive_job_run(void *ctx)
+{
+  struct radtel_archive_job *job = (struct radtel_archive_job *) ctx;
+  uint64_t start = rts_perf_begin();
+
+  /* Files of a previous configuration are kept if the switch failed */
+  if (job->archives->archive == NULL
+      || job->archives->archive->header.bins != job->acc->bins
+      || !rts_spectrum_acc_dump_archive(job->acc, job->archives->archive)) {
+    fprintf(stderr, "Warning: failed to append spectrum to archive\n");
+    rts_metrics_add(RTS_METRIC_DROPS, 1);
   }
 
-  range = max - min;
+  rts_metrics_set(
+      RTS_METRIC_NOISE_FLOOR,
+      rts_spectrum_acc_get_noise_floor(job->acc));
 
-  /* Clear previous spectrum */
-  clear(disp, OPAQUE(SPECTRUM_BACKGROUND));
+  rts_perf_end(RTS_PERF_DUMP, start);
 
-  /* Draw text */
-  display_printf(
-      disp,
-      WINDOW_WIDTH / 2 - strlen(SPECTRUM_TITLE) * 4,
-      2,
-      OPAQUE(SPECTRUM_TEXT_COLOR),
-      OPAQUE(SPECTRUM_BACKGROUND),
-      "%s",
-      SPECTRUM_TITLE);
-
-  time(&now);
-  asctime_r(gmtime_r(&now, &tm_buf), now_str);
-  now_str[strlen(now_str) - 1] = '\0';
-
-  display_printf(
-      disp,
-      SPECTRUM_X + 2,
-      20,
-      OPAQUE(SPECTRUM_TEXT_COLOR),
-      OPAQUE(SPECTRUM_BACKGROUND),
-      "Time: %s UTC -- ",
-      now_str);
-
-  display_printf(
-      disp,
-      SPECTRUM_X + 38 * 8,
-      20,
-      OPAQUE(SPECTRUM_TEXT_COLOR),
-      OPAQUE(SPECTRUM_BACKGROUND),
-      "dB range: %+5.1lf dB to %+5.1lf dB (%+5.1lf dB) -- ",
-      min,
-      max,
-      range);
-
-  display_printf(
-      disp,
-      SPECTRUM_X + 83 * 8,
-      20,
-      OPAQUE(SPECTRUM_TEXT_COLOR),
-      OPAQUE(SPECTRUM_BACKGROUND),
-      "Frequency range: %lg MHz to %lg MHz (%lg MHz)",
-      (RTSFLOAT) (f_lo * 1e-6),
-      (RTSFLOAT) (f_hi * 1e-6),
-      (RTSFLOAT) ((f_hi - f_lo) * (RTSFLOAT) 1e-6));
-
-  display_printf(
-      disp,
-      SPECTRUM_X + 2,
-      30,
-      OPAQUE(SPECTRUM_TEXT_COLOR),
-      OPAQUE(SPECTRUM_BACKGROUND),
-      "Spectrum snapshot count: %d (integration window: %lg s)",
-      rts_spectrogram_get_reset_count(spect),
-      rts_spectrogram_get_got_samples(spect)
-      / (RTSFLOAT) rts_spectrogram_get_samp_rate(spect));
+  radtel_archive_job_destroy(job);
+}
 
-  for (i = 0; i < SPECTRUM_H_DIVS; ++i) {
-    x = (RTSFLOAT) i / (RTSFLOAT) SPECTRUM_H_DIVS * SPECTRUM_WIDTH + SPECTRUM_X;
-    line(disp, x, SPECTRUM_Y, x, SPECTRUM_Y + SPECTRUM_HEIGHT, OPAQUE(SPECTRUM_AXES_COLOR));
-  }
+/* Takes ownership of acc */
+RTSBOOL
+radtel_queue_archive(
+    struct radtel_archives *archives,
+    rts_spectrogram_t *spect,
+    rts_spectrum_acc_t *acc)
+{
+  struct radtel_archive_job *job = NULL;
+  RTSBOOL ok = RTS_FALSE;
 
-  for (i = 0; i < SPECTRUM_V_DIVS; ++i) {
-    y = (RTSFLOAT) i / (RTSFLOAT) SPECTRUM_V_DIVS * SPECTRUM_HEIGHT + SPECTRUM_Y;
-    line(disp, SPECTRUM_X, y, SPECTRUM_X + SPECTRUM_WIDTH, y, OPAQUE(SPECTRUM_AXES_COLOR));
-  }
+  RTS_TRYCATCH(job = calloc(1, sizeof (struct radtel_archive_job)), goto done);
 
-  for (i = 0; i < RADTEL_BINS; ++i) {
-    p = (i + RADTEL_BINS / 2) % RADTEL_BINS;
+  job->spect    = spect;
+  job->acc      = acc;
+  job->archives = archives;
+  acc = NULL;
 
-    x = (RTSFLOAT) i / (RTSFLOAT) RADTEL_BINS * SPECTRUM_WIDTH + SPECTRUM_X;
-    y = (RTS_TO_POWER_DB(spectrum[p] / count) - min) / range;
+  RTS_TRYCATCH(
+      rts_worker_push(archives->worker, radtel_archive_job_run, job),
+      goto done);
 
-    /* Limit spectrum values if they fall out of range */
-    if (y < 0)
-      y = 0;
-    else if (y > 1)
-      y = 1;
+  job = NULL;
 
-    y = (1 - y) * SPECTRUM_HEIGHT + SPECTRUM_Y;
+  ok = RTS_TRUE;
 
-    if (i > 0)
-      line(disp, prev_x, prev_y, x, y, OPAQUE(SPECTRUM_FOREGROUND));
+done:
+  if (acc != NULL)
+    rts_spectrogram_release(spect, acc);
 
-    prev_x = x;
-    prev_y = y;
-  }
+  if (job != NULL)
+    radtel_archive_job_destroy(job);
 
-  box(
-      disp,
-      SPECTRUM_X,
-      SPECTRUM_Y,
-      SPECTRUM_X + SPECTRUM_WIDTH - 1,
-      SPECTRUM_Y + SPECTRUM_HEIGHT - 1,
-      OPAQUE(SPECTRUM_TEXT_COLOR));
+  return ok;
+}
 
-  fbox(
-      disp,
-      SPECTRUM_PROGRESS_X,
-      SPECTRUM_PROGRESS_Y,
-      SPECTRUM_PROGRESS_X
-      + (SPECTRUM_PROGRESS_WIDTH - 1)
-      * rts_spectrogram_get_progress(spect),
-      SPECTRUM_PROGRESS_Y + SPECTRUM_PROGRESS_HEIGHT - 1,
-      OPAQUE(SPECTRUM_FOREGROUND));
-
-  box(
-      disp,
-      SPECTRUM_PROGRESS_X,
-      SPECTRUM_PROGRESS_Y,
-      SPECTRUM_PROGRESS_X + SPECTRUM_PROGRESS_WIDTH - 1,
-      SPECTRUM_PROGRESS_Y + SPECTRUM_PROGRESS_HEIGHT - 1,
-      OPAQUE(SPECTRUM_TEXT_COLOR));
+void
+radtel_png_job_destroy(struct radtel_png_job *job)
+{
+  if (job->snapshot != NULL)
+    display_snapshot_free(job->snapshot);
+
+  if (job->png_path != NULL)
+    free(job->png_path);
 
-  display_refresh(disp);
+  free(job);
 }
 
+/* Runs in the writer thread */
+void
+radtel_png_job_run(void *ctx)
+{
+  struct radtel_png_job *job = (struct radtel_png_job *) ctx;
+  uint64_t start = rts_perf_begin();
+
+  if (display_snapshot_to_png(
+      job->png_path,
+      job->snapshot,
+      RADTEL_SNAPSHOT_PNG_MODE) != 0)
+    fprintf(stderr, "Warning: failed to dump screenshot\n");
+
+  rts_perf_end(RTS_PERF_PNG, start);
+
+  radtel_png_job_destroy(job);
+}
+
+/*
+ * Runs in the render thread. The screen is copied right away (the
+ * display is not thread safe), encoding is left to the writer thread.
+ */
 RTSBOOL
-radtel_dump_screenshot(display_t *disp)
+radtel_queue_png(rts_worker_t *worker, display_t *disp)
 {
-  char *path = NULL;
-  char *command = NULL;
+  struct radtel_png_job *job = NULL;
   static int times = 0;
   RTSBOOL ok = RTS_FALSE;
 
+  RTS_TRYCATCH(job = calloc(1, sizeof (struct radtel_png_job)), goto done);
+
+  RTS_TRYCATCH(
+      job->png_path = strbuild(
+          "%s/spectrogram-%05d.png",
+          snapshot_dir,
+          times++),
+      goto done);
+
+  RTS_TRYCATCH(job->snapshot = display_snapshot_new(disp), goto done);
+
   RTS_TRYCATCH(
-      path = strbuild("%s/spectrogram-%05d.png", snapshot_dir, times++),
+      rts_worker_push(worker, radtel_png_job_run, job),
       goto done);
 
+  job = NULL;
+
+  ok = RTS_TRUE;
+
+done:
+  if (job != NULL)
+    radtel_png_job_destroy(job);
+
+  return ok;
+}
+
+/* Runs in the writer thread */
+void
+radtel_cadence_job_run(void *ctx)
+{
+  struct radtel_cadence_job *job = (struct radtel_cadence_job *) ctx;
+  struct radtel_archives *archives = job->archives;
+  uint64_t start = rts_perf_begin();
+
+  if (job->index >= archives->count
+      || archives->cadence[job->index] == NULL
+      || archives->cadence[job->index]->header.bins != job->bins
+      || !rts_archive_append(
+      archives->cadence[job->index],
+      &job->record,
+      job->spectrum,
+      1. / job->record.frame_count))
+    fprintf(stderr, "Warning: failed to append spectrum to cadence archive\n");
+
+  rts_perf_end(RTS_PERF_DUMP, start);
+
+  free(job->spectrum);
+  free(job);
+}
+
+/* Runs in the acquisition thread: copy and leave */
+void
+radtel_cadence_ready(
+    void *priv,
+    unsigned int index,
+    const struct rts_cadence *cadence,
+    const RTSFLOAT *spectrum,
+    const struct timespec *end)
+{
+  struct radtel_archives *archives = (struct radtel_archives *) priv;
+  struct radtel_cadence_job *job = NULL;
+
+  if (index >= RADTEL_MAX_CADENCES)
+    return;
+
+  RTS_TRYCATCH(job = calloc(1, sizeof (struct radtel_cadence_job)), goto fail);
+
+  RTS_TRYCATCH(
+      job->spectrum = malloc(archives->bins * sizeof (RTSFLOAT)),
+      goto fail);
+
+  memcpy(job->spectrum, spectrum, archives->bins * sizeof (RTSFLOAT));
+
+  job->archives           = archives;
+  job->index              = index;
+  job->bins               = archives->bins;
+  job->record.tv_sec      = end->tv_sec;
+  job->record.tv_nsec     = end->tv_nsec;
+  job->record.frame_count = cadence->frames;
+  job->record.drop_count  = cadence->xrun_count;
+
   RTS_TRYCATCH(
-      command = strbuild("convert %s %s", RADTEL_SNAPSHOT_TMP_BMP, path),
+      rts_worker_push(archives->worker, radtel_cadence_job_run, job),
+      goto fail);
+
+  return;
+
+fail:
+  if (job != NULL) {
+    if (job->spectrum != NULL)
+      free(job->spectrum);
+    free(job);
+  }
+}
+
+static const RTSFLOAT radtel_cadence_time[] = RADTEL_CADENCES;
+
+/* Storage parameters, the rest come from the spectrogram */
+void
+radtel_init_archive_params(struct rts_archive_params *params)
+{
+  params->sample_type       = RADTEL_ARCHIVE_TYPE;
+  params->compression       = archive_compression;
+  params->quant_step        = RADTEL_ARCHIVE_QUANT_STEP;
+  params->keyframe_interval = RADTEL_ARCHIVE_KEYFRAMES;
+}
+
+/* Files of later configurations get the generation number */
+char *
+radtel_archive_path(unsigned int generation)
+{
+  if (generation == 0)
+    return strdup(archive_path);
+
+  return strbuild("%s/spectra.%u.rta", snapshot_dir, generation);
+}
+
+char *
+radtel_cadence_path(unsigned int index, unsigned int generation)
+{
+  if (generation == 0)
+    return strbuild(
+        "%s/spectra-%gs.rta",
+        snapshot_dir,
+        radtel_cadence_time[index]);
+
+  return strbuild(
+      "%s/spectra-%gs.%u.rta",
+      snapshot_dir,
+      radtel_cadence_time[index],
+      generation);
+}
+
+RTSBOOL
+radtel_init_cadences(
+    rts_spectrogram_t *spect,
+    struct radtel_archives *archives,
+    struct rts_archive_params *params)
+{
+  char *path = NULL;
+  unsigned int i;
+  int index;
+  RTSBOOL ok = RTS_FALSE;
+
+  RTS_TRYCATCH(
+      rts_spectrogram_init_cadences(spect, radtel_cadence_ready, archives),
       goto done);
 
-  RTS_TRYCATCH(display_dump(RADTEL_SNAPSHOT_TMP_BMP, disp) == 0, goto done);
+  for (i = 0;
+       i < sizeof (radtel_cadence_time) / sizeof (radtel_cadence_time[0]);
+       ++i) {
+    RTS_TRYCATCH(i < RADTEL_MAX_CADENCES, goto done);
+    RTS_TRYCATCH(
+        (index = rts_spectrogram_add_cadence(
+            spect,
+            radtel_cadence_time[i])) != -1,
+        goto done);
+
+    RTS_TRYCATCH(path = radtel_cadence_path(index, 0), goto done);
+
+    RTS_TRYCATCH(
+        archives->cadence[index] = rts_spectrogram_create_cadence_archive(
+            spect,
+            index,
+            path,
+            params),
+        goto done);
+
+    archives->count = index + 1;
 
-  RTS_TRYCATCH(system(command) == 0, goto done);
+    free(path);
+    path = NULL;
+  }
 
   ok = RTS_TRUE;
 
@@ -246,65 +464,1119 @@ done:
   if (path != NULL)
     free(path);
 
-  if (command != NULL)
-    free(command);
-
   return ok;
 }
 
+/* Runs in the writer thread */
+void
+radtel_checkpoint_job_run(void *ctx)
+{
+  struct radtel_checkpoint_job *job = (struct radtel_checkpoint_job *) ctx;
+  uint64_t start = rts_perf_begin();
+
+  (void) rts_checkpoint_sync(job->ckpt, job->slot);
+
+  rts_perf_end(RTS_PERF_DUMP, start);
+
+  free(job);
+}
+
+/*
+ * Copies the integrator state to the checkpoint file (a few vectors)
+ * and lets the writer thread flush it. If the previous flush has not
+ * finished yet, this checkpoint is skipped and RTS_FALSE is returned.
+ */
+RTSBOOL
+radtel_queue_checkpoint(
+    rts_worker_t *worker,
+    rts_checkpoint_t *ckpt,
+    const rts_spectrogram_t *spect)
+{
+  struct radtel_checkpoint_job *job = NULL;
+  uint64_t start = rts_perf_begin();
+  int slot;
+
+  slot = rts_checkpoint_save(ckpt, spect);
+
+  rts_perf_end(RTS_PERF_CHECKPOINT, start);
+
+  if (slot == -1)
+    return RTS_FALSE;
+
+  RTS_TRYCATCH(
+      job = calloc(1, sizeof (struct radtel_checkpoint_job)),
+      goto fail);
+
+  job->ckpt = ckpt;
+  job->slot = slot;
+
+  RTS_TRYCATCH(
+      rts_worker_push(worker, radtel_checkpoint_job_run, job),
+      goto fail);
+
+  return RTS_TRUE;
+
+fail:
+  if (job != NULL)
+    free(job);
+
+  /* Flush it here, or the slot would stay busy forever */
+  (void) rts_checkpoint_sync(ckpt, slot);
+
+  return RTS_TRUE;
+}
+
+/* Runs in the writer thread */
+void
+radtel_perf_job_run(void *ctx)
+{
+  if (!rts_perf_dump(perf_path))
+    fprintf(stderr, "Warning: failed to write stats to %s\n", perf_path);
+}
+
+void
+radtel_trace_write(void)
+{
+  if (!rts_trace_dump(trace_path))
+    fprintf(stderr, "Warning: failed to write trace to %s\n", trace_path);
+  else
+    fprintf(stderr, "Trace written to %s\n", trace_path);
+}
+
+void *
+radtel_trace_thread(void *data)
+{
+  radtel_trace_write();
+
+  __atomic_store_n(&trace_busy, 0, __ATOMIC_RELEASE);
+
+  return NULL;
+}
+
+/*
+ * Not a writer job: the writer may well be what stalls, and its queue
+ * would delay the dump until the spans of interest are overwritten.
+ */
+void
+radtel_queue_trace(void)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+
+  /* One at a time */
+  if (__atomic_exchange_n(&trace_busy, 1, __ATOMIC_ACQ_REL))
+    return;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  if (pthread_create(&thread, &attr, radtel_trace_thread, NULL) != 0) {
+    fprintf(stderr, "Warning: cannot start trace writer\n");
+    __atomic_store_n(&trace_busy, 0, __ATOMIC_RELEASE);
+  }
+
+  pthread_attr_destroy(&attr);
+}
+
+void
+radtel_wait_trace(void)
+{
+  while (__atomic_load_n(&trace_busy, __ATOMIC_ACQUIRE))
+    usleep(RADTEL_RENDER_POLL);
+}
+
+/* ALSA's dc_remove parameter, now a dcblock stage ahead of the others */
+RTSBOOL
+radtel_wants_dc_remove(
+    const struct rts_signal_source *source,
+    const rts_params_t *params)
+{
+  const char *str;
+
+  if (strcmp(source->name, "alsa") != 0
+      || (str = rts_params_get(params, "dc_remove")) == NULL)
+    return RTS_FALSE;
+
+  return strcasecmp(str, "yes") == 0
+      || strcasecmp(str, "true") == 0
+      || strcasecmp(str, "1") == 0;
+}
+
+/* Dumps are written by the acquisition loop, never from here */
+void
+radtel_trace_signal(int sig)
+{
+  trace_requested = 1;
+}
+
+/* The acquisition loop stops and everything is flushed as on EOF */
+void
+radtel_quit_signal(int sig)
+{
+  quit_requested = 1;
+}
+
+/* Runs in the render thread */
+void
+radtel_quit_display(display_t *disp, void *data)
+{
+  quit_requested = 1;
+}
+
+/* A second one kills us, should the flush ever hang */
+void
+radtel_catch_quit_signals(void)
+{
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof (struct sigaction));
+  sa.sa_handler = radtel_quit_signal;
+  sa.sa_flags   = SA_RESTART | SA_RESETHAND;
+  sigemptyset(&sa.sa_mask);
+
+  (void) sigaction(SIGINT, &sa, NULL);
+  (void) sigaction(SIGTERM, &sa, NULL);
+}
+
+void
+radtel_close_archives(struct radtel_archives *archives)
+{
+  unsigned int i;
+
+  if (archives->archive != NULL) {
+    rts_archive_close(archives->archive);
+    archives->archive = NULL;
+  }
+
+  for (i = 0; i < archives->count; ++i)
+    if (archives->cadence[i] != NULL) {
+      rts_archive_close(archives->cadence[i]);
+      archives->cadence[i] = NULL;
+    }
+
+  archives->count = 0;
+}
+
+/*
+ * Runs in the writer thread, after every job of the previous
+ * configuration. A file that cannot be created is just left out.
+ */
+void
+radtel_rotate_job_run(void *ctx)
+{
+  struct radtel_rotate_job *job = (struct radtel_rotate_job *) ctx;
+  struct radtel_archives *archives = job->archives;
+  rts_checkpoint_t *ckpt;
+  char *path = NULL;
+  unsigned int i;
+
+  radtel_close_archives(archives);
+
+  ++archives->generation;
+
+  if ((path = radtel_archive_path(archives->generation)) != NULL) {
+    if ((archives->archive = rts_archive_create(path, &job->params)) != NULL)
+      fprintf(stderr, "New configuration, archiving to %s\n", path);
+    free(path);
+  }
+
+  for (i = 0; i < job->count; ++i)
+    if ((path = radtel_cadence_path(i, archives->generation)) != NULL) {
+      archives->cadence[i] = rts_archive_create(
+          path,
+          &job->cadence_params[i]);
+      free(path);
+    }
+
+  archives->count = job->count;
+
+  if (job->ckpt != NULL) {
+    rts_checkpoint_close(job->ckpt);
+
+    if ((ckpt = rts_checkpoint_create(
+        checkpoint_path,
+        &job->ckpt_config)) != NULL)
+      __atomic_store_n(&archives->ckpt, ckpt, __ATOMIC_RELEASE);
+    else
+      fprintf(stderr, "Warning: checkpoints disabled\n");
+  }
+
+  free(job);
+}
+
+/*
+ * Runs in the acquisition thread after a change of configuration.
+ * Checkpoints stop until the writer thread publishes the new file.
+ */
+void
+radtel_queue_rotate(
+    struct radtel_archives *archives,
+    const rts_spectrogram_t *spect)
+{
+  struct radtel_rotate_job *job = NULL;
+  const rts_cadence_bank_t *cadences;
+  rts_checkpoint_t *ckpt;
+  unsigned int i;
+
+  RTS_TRYCATCH(job = calloc(1, sizeof (struct radtel_rotate_job)), goto fail);
+
+  job->archives = archives;
+
+  radtel_init_archive_params(&job->params);
+  rts_spectrogram_get_archive_params(spect, &job->params);
+
+  if ((cadences = rts_spectrogram_get_cadences(spect)) != NULL)
+    job->count = MIN(
+        rts_cadence_bank_get_count(cadences),
+        RADTEL_MAX_CADENCES);
+
+  for (i = 0; i < job->count; ++i) {
+    radtel_init_archive_params(&job->cadence_params[i]);
+    (void) rts_spectrogram_get_cadence_archive_params(
+        spect,
+        i,
+        &job->cadence_params[i]);
+  }
+
+  /* Anything that may fail before the checkpoint is taken */
+  if (checkpoint_path != NULL)
+    RTS_TRYCATCH(
+        rts_checkpoint_get_config(spect, &job->ckpt_config),
+        goto fail);
+
+  job->ckpt = __atomic_exchange_n(&archives->ckpt, NULL, __ATOMIC_ACQ_REL);
+
+  RTS_TRYCATCH(
+      rts_worker_push(archives->worker, radtel_rotate_job_run, job),
+      goto fail);
+
+  return;
+
+fail:
+  fprintf(stderr, "Warning: cannot switch archives, spectra will be lost\n");
+
+  if (job != NULL) {
+    /* Sized for the old configuration: replace it here, once flushed */
+    if (job->ckpt != NULL) {
+      rts_checkpoint_wait(job->ckpt);
+      rts_checkpoint_close(job->ckpt);
+
+      if ((ckpt = rts_checkpoint_create(
+          checkpoint_path,
+          &job->ckpt_config)) != NULL)
+        __atomic_store_n(&archives->ckpt, ckpt, __ATOMIC_RELEASE);
+      else
+        fprintf(stderr, "Warning: checkpoints disabled\n");
+    }
+
+    free(job);
+  }
+}
+
+/* Returns and clears the requested flags among mask */
+unsigned int
+radtel_control_take(struct radtel_control *ctl, unsigned int mask)
+{
+  /* Plain load first: nothing requested is the common case */
+  if ((__atomic_load_n(&ctl->flags, __ATOMIC_RELAXED) & mask) == 0)
+    return 0;
+
+  return __atomic_fetch_and(&ctl->flags, ~mask, __ATOMIC_ACQ_REL) & mask;
+}
+
+/* NULL if acceptable, a reason otherwise */
+const char *
+radtel_check_params(const struct rts_spectrogram_params *params)
+{
+  if (params->bins < RADTEL_MIN_BINS || params->bins > RADTEL_MAX_BINS)
+    return "bins out of range";
+
+  if ((params->bins & (params->bins - 1)) != 0)
+    return "bins must be a power of two";
+
+  if (!(params->avg_time > 0))
+    return "integration time must be positive";
+
+  return NULL;
+}
+
+/* Runs in the control worker */
+void
+radtel_command_run(void *ctx)
+{
+  struct radtel_command *cmd = (struct radtel_command *) ctx;
+  struct radtel_control *ctl = cmd->control;
+  struct rts_spectrogram_params params = ctl->params;
+  rts_spectrogram_plan_t *plan;
+  const char *reason;
+
+  switch (cmd->type) {
+    case RADTEL_COMMAND_AVG_TIME:
+      params.avg_time = cmd->relative
+          ? params.avg_time * cmd->value
+          : cmd->value;
+      break;
+
+    case RADTEL_COMMAND_BINS:
+      params.bins = cmd->relative
+          ? params.bins * cmd->value
+          : cmd->value;
+      break;
+
+    case RADTEL_COMMAND_WINDOW:
+      if (cmd->relative)
+        params.window = params.window == RTS_WINDOW_RECTANGULAR
+            ? RTS_WINDOW_BLACKMANN_HARRIS
+            : RTS_WINDOW_RECTANGULAR;
+      else
+        params.window = (enum rts_window_type) cmd->value;
+      break;
+
+    case RADTEL_COMMAND_SOURCE:
+      pthread_mutex_lock(&ctl->mutex);
+      if (ctl->setting_count < RADTEL_MAX_SETTINGS)
+        ctl->setting[ctl->setting_count++] = cmd->setting;
+      else
+        fprintf(stderr, "control: too many pending settings\n");
+      pthread_mutex_unlock(&ctl->mutex);
+
+      __atomic_or_fetch(&ctl->flags, RADTEL_CONTROL_SETTINGS, __ATOMIC_RELEASE);
+      goto done;
+
+    default:
+      goto done;
+  }
+
+  if ((reason = radtel_check_params(&params)) != NULL) {
+    fprintf(stderr, "control: change ignored, %s\n", reason);
+    goto done;
+  }
+
+  if ((plan = rts_spectrogram_prepare(ctl->spect, &params)) == NULL) {
+    fprintf(stderr, "control: cannot prepare new spectrogram\n");
+    goto done;
+  }
+
+  ctl->params = params;
+
+  fprintf(
+      stderr,
+      "control: next integration: %u bins, %g s, %s window\n",
+      params.bins,
+      params.avg_time,
+      params.window == RTS_WINDOW_RECTANGULAR
+          ? "rectangular"
+          : "Blackmann-Harris");
+
+  /* A plan nobody picked up yet is superseded by this one */
+  if ((plan = __atomic_exchange_n(
+      &ctl->plan,
+      plan,
+      __ATOMIC_ACQ_REL)) != NULL)
+    rts_spectrogram_plan_destroy(plan);
+
+  __atomic_or_fetch(&ctl->flags, RADTEL_CONTROL_PLAN, __ATOMIC_RELEASE);
+
+done:
+  free(cmd);
+}
+
+/* From any thread. Only dump and reset take effect right away. */
+RTSBOOL
+radtel_control_submit(
+    struct radtel_control *ctl,
+    const struct radtel_command *cmd)
+{
+  struct radtel_command *copy;
+
+  switch (cmd->type) {
+    case RADTEL_COMMAND_DUMP:
+      __atomic_or_fetch(&ctl->flags, RADTEL_CONTROL_DUMP, __ATOMIC_RELEASE);
+      return RTS_TRUE;
+
+    case RADTEL_COMMAND_RESET:
+      __atomic_or_fetch(&ctl->flags, RADTEL_CONTROL_RESET, __ATOMIC_RELEASE);
+      return RTS_TRUE;
+
+    default:
+      break;
+  }
+
+  RTS_TRYCATCH(copy = malloc(sizeof (struct radtel_command)), return RTS_FALSE);
+
+  *copy = *cmd;
+  copy->control = ctl;
+
+  RTS_TRYCATCH(
+      rts_worker_push(ctl->worker, radtel_command_run, copy),
+      goto fail);
+
+  return RTS_TRUE;
+
+fail:
+  free(copy);
+
+  return RTS_FALSE;
+}
+
+/* Runs in the control worker, as FFTW planning does */
+void
+radtel_plan_destroy_job_run(void *ctx)
+{
+  rts_spectrogram_plan_destroy((rts_spectrogram_plan_t *) ctx);
+}
+
+/*
+ * Runs in the acquisition thread right after swapping accumulators:
+ * nothing here waits for other threads, except for the brief copy of
+ * pending source settings.
+ */
+void
+radtel_control_apply(
+    struct radtel_control *ctl,
+    struct radtel_archives *archives,
+    rts_spectrogram_t *spect)
+{
+  struct radtel_setting setting[RADTEL_MAX_SETTINGS];
+  rts_spectrogram_plan_t *plan = NULL;
+  int64_t freq = spect->handle->info.freq;
+  unsigned int flags;
+  unsigned int count = 0;
+  unsigned int i;
+
+  flags = radtel_control_take(
+      ctl,
+      RADTEL_CONTROL_PLAN | RADTEL_CONTROL_SETTINGS);
+
+  if (flags & RADTEL_CONTROL_SETTINGS) {
+    pthread_mutex_lock(&ctl->mutex);
+    count = ctl->setting_count;
+    memcpy(setting, ctl->setting, count * sizeof (struct radtel_setting));
+    ctl->setting_count = 0;
+    pthread_mutex_unlock(&ctl->mutex);
+
+    for (i = 0; i < count; ++i)
+      if (!rts_source_set(spect->handle, setting[i].key, setting[i].value))
+        fprintf(
+            stderr,
+            "Warning: source cannot set `%s' to `%s'\n",
+            setting[i].key,
+            setting[i].value);
+  }
+
+  if ((flags & RADTEL_CONTROL_PLAN)
+      && (plan = __atomic_exchange_n(
+          &ctl->plan,
+          NULL,
+          __ATOMIC_ACQ_REL)) != NULL) {
+    rts_spectrogram_apply(spect, plan);
+    archives->bins = spect->params.bins;
+
+    /* Now holds the old buffers and FFT plan */
+    if (!rts_worker_push(ctl->worker, radtel_plan_destroy_job_run, plan))
+      fprintf(stderr, "Warning: cannot release previous spectrogram\n");
+  }
+
+  /* Archive headers describe the configuration */
+  if (plan != NULL || spect->handle->info.freq != freq)
+    radtel_queue_rotate(archives, spect);
+}
+
+/* Runs in the control socket thread */
+void
+radtel_control_line(void *priv, const char *line, char *reply, size_t size)
+{
+  struct radtel_control *ctl = (struct radtel_control *) priv;
+  struct radtel_command cmd;
+  struct rts_spectrogram_params params;
+  char name[16], arg[RADTEL_SETTING_VALUE_MAX], value[RADTEL_SETTING_VALUE_MAX];
+  const char *reason = NULL;
+  char extra;
+  int n;
+
+  memset(&cmd, 0, sizeof (struct radtel_command));
+
+  if ((n = sscanf(line, "%15s %31s %31s %c", name, arg, value, &extra)) < 1) {
+    snprintf(reply, size, "error: empty command");
+    return;
+  }
+
+  /* Either a fourth word or the rest of one that did not fit */
+  if (n > 3) {
+    snprintf(reply, size, "error: too many or too long arguments");
+    return;
+  }
+
+  /* Range checks against the defaults, the rest is checked when run */
+  params.bins     = RADTEL_BINS;
+  params.avg_time = RADTEL_AVG_TIME;
+  params.window   = RTS_WINDOW_BLACKMANN_HARRIS;
+
+  if (strcmp(name, "avg_time") == 0 && n == 2) {
+    cmd.type = RADTEL_COMMAND_AVG_TIME;
+    if (sscanf(arg, "%lf", &params.avg_time) < 1)
+      params.avg_time = 0;
+    cmd.value = params.avg_time;
+    reason = radtel_check_params(&params);
+  } else if (strcmp(name, "bins") == 0 && n == 2) {
+    cmd.type = RADTEL_COMMAND_BINS;
+    if (sscanf(arg, "%u", &params.bins) < 1)
+      params.bins = 0;
+    cmd.value = params.bins;
+    reason = radtel_check_params(&params);
+  } else if (strcmp(name, "window") == 0 && n == 2) {
+    cmd.type = RADTEL_COMMAND_WINDOW;
+    if (strcmp(arg, "blackmann-harris") == 0)
+      cmd.value = RTS_WINDOW_BLACKMANN_HARRIS;
+    else if (strcmp(arg, "rectangular") == 0)
+      cmd.value = RTS_WINDOW_RECTANGULAR;
+    else
+      reason = "unknown window";
+  } else if (strcmp(name, "set") == 0 && n == 3) {
+    cmd.type = RADTEL_COMMAND_SOURCE;
+    if (strlen(arg) >= RADTEL_SETTING_KEY_MAX) {
+      reason = "setting key too long";
+    } else {
+      strcpy(cmd.setting.key, arg);
+      strcpy(cmd.setting.value, value);
+    }
+  } else if (strcmp(name, "dump") == 0 && n == 1) {
+    cmd.type = RADTEL_COMMAND_DUMP;
+  } else if (strcmp(name, "reset") == 0 && n == 1) {
+    cmd.type = RADTEL_COMMAND_RESET;
+  } else {
+    snprintf(
+        reply,
+        size,
+        "error: commands are avg_time SECONDS, bins N, "
+        "window blackmann-harris|rectangular, set KEY VALUE, dump, reset");
+    return;
+  }
+
+  if (reason != NULL)
+    snprintf(reply, size, "error: %s", reason);
+  else if (!radtel_control_submit(ctl, &cmd))
+    snprintf(reply, size, "error: cannot queue command");
+  else
+    snprintf(reply, size, "ok");
+}
+
+/*
+ * Runs in the render thread. Up/down double and halve the integration
+ * time, right/left the number of bins, W switches windows, D ends the
+ * current integration and R discards it.
+ */
+int
+radtel_control_key(int code, display_t *disp, event_t *event)
+{
+  struct radtel_command cmd;
+
+  /* Key releases are delivered too */
+  if (!event->state || key_control == NULL)
+    return HOOK_RESUME_CHAIN;
+
+  memset(&cmd, 0, sizeof (struct radtel_command));
+
+  cmd.relative = RTS_TRUE;
+
+  switch (code) {
+    case SDLK_UP:
+    case SDLK_DOWN:
+      cmd.type  = RADTEL_COMMAND_AVG_TIME;
+      cmd.value = code == SDLK_UP ? 2 : .5;
+      break;
+
+    case SDLK_RIGHT:
+    case SDLK_LEFT:
+      cmd.type  = RADTEL_COMMAND_BINS;
+      cmd.value = code == SDLK_RIGHT ? 2 : .5;
+      break;
+
+    case SDLK_w:
+      cmd.type = RADTEL_COMMAND_WINDOW;
+      break;
+
+    case SDLK_d:
+      cmd.type = RADTEL_COMMAND_DUMP;
+      break;
+
+    case SDLK_r:
+      cmd.type = RADTEL_COMMAND_RESET;
+      break;
+
+    default:
+      return HOOK_RESUME_CHAIN;
+  }
+
+  if (!radtel_control_submit(key_control, &cmd))
+    fprintf(stderr, "Warning: cannot queue command\n");
+
+  return HOOK_RESUME_CHAIN;
+}
+
+RTSBOOL
+radtel_control_init(
+    struct radtel_control *ctl,
+    rts_spectrogram_t *spect)
+{
+  RTS_TRYCATCH(pthread_mutex_init(&ctl->mutex, NULL) == 0, return RTS_FALSE);
+  ctl->mutex_init = RTS_TRUE;
+
+  ctl->spect  = spect;
+  ctl->params = *rts_spectrogram_get_params(spect);
+
+  RTS_TRYCATCH(ctl->worker = rts_worker_new(), return RTS_FALSE);
+
+  return RTS_TRUE;
+}
+
+/* Nobody may submit commands by now */
+void
+radtel_control_finalize(struct radtel_control *ctl)
+{
+  /* Pending commands prepare plans that are never applied */
+  if (ctl->worker != NULL)
+    rts_worker_destroy(ctl->worker);
+
+  if (ctl->plan != NULL)
+    rts_spectrogram_plan_destroy(ctl->plan);
+
+  if (ctl->mutex_init)
+    pthread_mutex_destroy(&ctl->mutex);
+}
+
+/* Runs in the render thread */
+RTSBOOL
+radtel_render_open(struct radtel_render *render)
+{
+  display_t *disp;
+
+  RTS_TRYCATCH(
+      disp = headless
+          ? display_new_headless(WINDOW_WIDTH, WINDOW_HEIGHT)
+          : display_new(WINDOW_WIDTH, WINDOW_HEIGHT),
+      return RTS_FALSE);
+
+  if (render_threads > 0 && display_enable_bands(disp, render_threads) == -1)
+    fprintf(stderr, "Warning: cannot start render threads, drawing alone\n");
+
+  /* Zoom and pan over either panel */
+  (void) display_area_register(
+      disp,
+      SPECTRUM_X,
+      SPECTRUM_Y,
+      SPECTRUM_WIDTH,
+      SPECTRUM_HEIGHT,
+      radtel_view_mouse,
+      &render->view);
+
+  (void) display_area_register(
+      disp,
+      WATERFALL_X,
+      WATERFALL_Y,
+      WATERFALL_WIDTH,
+      WATERFALL_HEIGHT,
+      radtel_view_mouse,
+      &render->view);
+
+  (void) display_register_key_handler(disp, SDLK_UP, radtel_control_key);
+  (void) display_register_key_handler(disp, SDLK_DOWN, radtel_control_key);
+  (void) display_register_key_handler(disp, SDLK_LEFT, radtel_control_key);
+  (void) display_register_key_handler(disp, SDLK_RIGHT, radtel_control_key);
+  (void) display_register_key_handler(disp, SDLK_w, radtel_control_key);
+  (void) display_register_key_handler(disp, SDLK_d, radtel_control_key);
+  (void) display_register_key_handler(disp, SDLK_r, radtel_control_key);
+
+  display_register_quit_handler(disp, radtel_quit_display, NULL);
+
+  render->disp = disp;
+
+  return RTS_TRUE;
+}
+
+void *
+radtel_render_thread(void *data)
+{
+  struct radtel_render *render = (struct radtel_render *) data;
+  const rts_spectrum_snapshot_t *snap;
+  struct timeval row_tv;
+  RTSBOOL ok;
+  int halt;
+
+  rts_trace_set_thread_name("render");
+
+  ok = radtel_render_open(render);
+
+  /* radtel_render_start() waits for this */
+  pthread_mutex_lock(&render->ready_mutex);
+  render->ready = ok ? 1 : -1;
+  pthread_cond_signal(&render->ready_cond);
+  pthread_mutex_unlock(&render->ready_mutex);
+
+  if (!ok)
+    return NULL;
+
+  gettimeofday(&row_tv, NULL);
+
+  do {
+    /* Read before the last update, so nothing published is missed */
+    halt = __atomic_load_n(&render->halt, __ATOMIC_ACQUIRE);
+
+    if ((snap = rts_snapshot_buffer_update(render->snapshots)) != NULL) {
+      radtel_render_snapshot(render, snap, &row_tv);
+
+      if (snap->complete && !radtel_queue_png(render->worker, render->disp))
+        fprintf(stderr, "Warning: failed to queue snapshot\n");
+    }
+
+    display_poll_events(render->disp);
+
+    /* Zoomed or panned: same data, different window */
+    if (render->view.changed && render->last != NULL)
+      radtel_redraw_spectrum(render, render->last);
+
+    if (!halt)
+      usleep(RADTEL_RENDER_POLL);
+  } while (!halt);
+
+  /* Not display_end(): that one waits for the user to close the window */
+  display_free(render->disp);
+  render->disp = NULL;
+
+  return NULL;
+}
+
+/* Returns once the display is up, RTS_FALSE if it could not be */
+RTSBOOL
+radtel_render_start(struct radtel_render *render)
+{
+  pthread_mutex_init(&render->ready_mutex, NULL);
+  pthread_cond_init(&render->ready_cond, NULL);
+  render->ready = 0;
+
+  if (pthread_create(
+      &render->thread,
+      NULL,
+      radtel_render_thread,
+      render) != 0) {
+    pthread_cond_destroy(&render->ready_cond);
+    pthread_mutex_destroy(&render->ready_mutex);
+    return RTS_FALSE;
+  }
+
+  render->thread_running = RTS_TRUE;
+
+  pthread_mutex_lock(&render->ready_mutex);
+  while (render->ready == 0)
+    pthread_cond_wait(&render->ready_cond, &render->ready_mutex);
+  pthread_mutex_unlock(&render->ready_mutex);
+
+  return render->ready == 1;
+}
+
+/* Renders whatever is pending and waits for the thread to finish */
+void
+radtel_render_stop(struct radtel_render *render)
+{
+  if (render->thread_running) {
+    __atomic_store_n(&render->halt, 1, __ATOMIC_RELEASE);
+    pthread_join(render->thread, NULL);
+    render->thread_running = RTS_FALSE;
+
+    pthread_cond_destroy(&render->ready_cond);
+    pthread_mutex_destroy(&render->ready_mutex);
+  }
+}
+
+/* Writer backlog since the last call, for the integration and metrics */
+void
+radtel_note_queue(rts_spectrogram_t *spect, rts_worker_t *worker)
+{
+  RTSCOUNT high_water = rts_worker_take_high_water(worker);
+
+  rts_spectrogram_note_queue(spect, high_water);
+  rts_metrics_set(RTS_METRIC_QUEUE, high_water);
+}
+
+/* Runs in the acquisition thread, never waits for the render thread */
+void
+radtel_publish(
+    rts_snapshot_buffer_t *snapshots,
+    const rts_spectrogram_t *spect,
+    RTSBOOL complete)
+{
+  rts_spectrum_snapshot_t *snap;
+  uint64_t start;
+
+  if ((snap = rts_snapshot_buffer_begin(snapshots, complete)) == NULL)
+    return;
+
+  start = rts_perf_begin();
+
+  rts_spectrum_snapshot_fill(snap, spect, rts_spectrogram_get_acc(spect));
+  rts_snapshot_buffer_commit(snapshots);
+
+  rts_perf_end(RTS_PERF_PUBLISH, start);
+}
+
 RTSBOOL
 radtel_start_rx(rts_srchnd_t *handle)
 {
   rts_spectrogram_t *spect = NULL;
   struct rts_spectrogram_params params;
-  display_t *disp = NULL;
-  struct timeval tv, otv;
+  struct rts_archive_params archive_params;
+  rts_spectrum_acc_t *acc;
+  rts_worker_t *worker = NULL;
+  rts_checkpoint_t *ckpt = NULL;
+  rts_snapshot_buffer_t *snapshots = NULL;
+  rts_control_t *server = NULL;
+  rts_metrics_server_t *metrics = NULL;
+  struct radtel_render render;
+  struct radtel_archives archives;
+  struct radtel_control control;
+  unsigned int flags;
+  struct timeval tv, otv, ckpt_tv, perf_tv;
   struct timeval sub;
+  const rts_margin_t *margin;
+  RTSBOOL margin_warned = RTS_FALSE;
   RTSBOOL ok = RTS_FALSE;
 
+  memset(&archives, 0, sizeof (struct radtel_archives));
+  memset(&render, 0, sizeof (struct radtel_render));
+  memset(&control, 0, sizeof (struct radtel_control));
+
   params.avg_time = RADTEL_AVG_TIME;
   params.bins     = RADTEL_BINS;
+  params.window   = RTS_WINDOW_BLACKMANN_HARRIS;
 
   RTS_TRYCATCH(spect = rts_spectrogram_new(handle, &params), goto done);
 
-  RTS_TRYCATCH(disp = display_new(WINDOW_WIDTH, WINDOW_HEIGHT), goto done);
+  radtel_init_archive_params(&archive_params);
+
+  RTS_TRYCATCH(
+      archives.archive = rts_spectrogram_create_archive(
+          spect,
+          archive_path,
+          &archive_params),
+      goto done);
+
+  RTS_TRYCATCH(worker = rts_worker_new(), goto done);
+
+  archives.worker = worker;
+  archives.bins   = RADTEL_BINS;
+
+  RTS_TRYCATCH(
+      radtel_init_cadences(spect, &archives, &archive_params),
+      goto done);
+
+  if (checkpoint_path != NULL) {
+    RTS_TRYCATCH(
+        ckpt = rts_checkpoint_open(checkpoint_path, spect),
+        goto done);
+
+    if (rts_checkpoint_restore(ckpt, spect))
+      fprintf(
+          stderr,
+          "Resuming integration from %s (%u frames of %u)\n",
+          checkpoint_path,
+          rts_spectrogram_get_frame_count(spect),
+          spect->frames);
+
+    /* From now on, the writer thread may replace it */
+    archives.ckpt = ckpt;
+  }
+
+  /* Cadences first: plans copy them */
+  RTS_TRYCATCH(radtel_control_init(&control, spect), goto done);
+
+  render.view.zoom   = 1;
+  render.view.center = .5;
+  render.headless    = headless;
+
+  RTS_TRYCATCH(radtel_render_resize(&render, RADTEL_BINS), goto done);
+
+  RTS_TRYCATCH(
+      snapshots = rts_snapshot_buffer_new(RADTEL_MAX_BINS),
+      goto done);
+
+  radtel_init_waterfall_palette();
+
+  render.snapshots = snapshots;
+  render.worker    = worker;
+
+  key_control = &control;
+
+  if (control_path != NULL)
+    RTS_TRYCATCH(
+        server = rts_control_new(control_path, radtel_control_line, &control),
+        goto done);
+
+  if (metrics_addr != NULL)
+    RTS_TRYCATCH(
+        metrics = rts_metrics_server_new(
+            metrics_addr,
+            RADTEL_METRICS_NAMESPACE),
+        goto done);
+
+  RTS_TRYCATCH(radtel_render_start(&render), goto done);
+
+  rts_trace_set_thread_name("acquisition");
+
+  gettimeofday(&ckpt_tv, NULL);
+  perf_tv = ckpt_tv;
 
   for (;;) {
     gettimeofday(&otv, NULL);
 
     while (!rts_spectrogram_complete(spect)) {
+      if ((flags = radtel_control_take(
+          &control,
+          RADTEL_CONTROL_DUMP | RADTEL_CONTROL_RESET)) != 0) {
+        if (flags & RADTEL_CONTROL_RESET)
+          rts_spectrogram_reset(spect);
+        else if (rts_spectrogram_get_frame_count(spect) > 0)
+          break; /* Dump what we have as if it were complete */
+      }
+
       if (!rts_spectrogram_acquire(spect)) {
         fprintf(stderr, "RX: finished\n");
         goto done;
       }
 
+      /* While there is still room in the source buffers */
+      margin = rts_spectrogram_get_margin(spect);
+      if (rts_margin_is_critical(margin) && !margin_warned) {
+        fprintf(
+            stderr,
+            "Warning: falling behind, source buffer %.0lf%% full "
+            "(lag %.1lf ms, x%.2lf real time)\n",
+            1e2 * margin->fill,
+            1e3 * margin->lag / rts_spectrogram_get_samp_rate(spect),
+            margin->rtf);
+        margin_warned = RTS_TRUE;
+      }
+
+      if (trace_requested) {
+        trace_requested = 0;
+        radtel_queue_trace();
+      }
+
+      if (quit_requested) {
+        fprintf(stderr, "RX: interrupted\n");
+
+        /* Resumed from here next time */
+        ckpt = __atomic_load_n(&archives.ckpt, __ATOMIC_ACQUIRE);
+        if (ckpt != NULL) {
+          rts_checkpoint_wait(ckpt);
+          (void) radtel_queue_checkpoint(worker, ckpt, spect);
+        }
+
+        ok = RTS_TRUE;
+        goto done;
+      }
+
       gettimeofday(&tv, NULL);
 
+      /* Even if integrations are shorter than that */
+      timersub(&tv, &perf_tv, &sub);
+      if (perf_path != NULL && sub.tv_sec >= RADTEL_PERF_INTERVAL) {
+        if (!rts_worker_push(worker, radtel_perf_job_run, NULL))
+          fprintf(stderr, "Warning: failed to queue stats\n");
+        perf_tv = tv;
+      }
+
       timersub(&tv, &otv, &sub);
 
       if (sub.tv_sec >= 1 && rts_spectrogram_get_frame_count(spect) > 0) {
-        radtel_redraw_spectrum(disp, spect);
+        radtel_note_queue(spect, worker);
+        radtel_publish(snapshots, spect, RTS_FALSE);
+
+        timersub(&tv, &ckpt_tv, &sub);
+        ckpt = __atomic_load_n(&archives.ckpt, __ATOMIC_ACQUIRE);
+        if (ckpt != NULL && sub.tv_sec >= RADTEL_CHECKPOINT_INTERVAL) {
+          (void) radtel_queue_checkpoint(worker, ckpt, spect);
+          ckpt_tv = tv;
+        }
+
         otv = tv;
       }
     }
 
-    /* TODO: Dump spectrogram */
-    radtel_redraw_spectrum(disp, spect);
+    /*
+     * Integration complete: keep acquiring into a fresh accumulator
+     * and let the render and writer threads deal with the finished one.
+     */
+    radtel_note_queue(spect, worker);
+    radtel_publish(snapshots, spect, RTS_TRUE);
+
+    if ((acc = rts_spectrogram_swap(spect)) == NULL) {
+      fprintf(stderr, "Warning: cannot swap accumulators, spectrum lost\n");
+      rts_metrics_add(RTS_METRIC_DROPS, 1);
+      rts_spectrogram_reset(spect);
+      continue;
+    }
 
-    if (!rts_spectrogram_dump_matlab(spect, matlab_temp))
-      fprintf(stderr, "Warning: failed to save spectrum in Matlab format\n");
+    if (!radtel_queue_archive(&archives, spect, acc)) {
+      fprintf(stderr, "Warning: failed to queue spectrum\n");
+      rts_metrics_add(RTS_METRIC_DROPS, 1);
+    }
 
-    if (!radtel_dump_screenshot(disp))
-      fprintf(stderr, "Warning: failed to dump screenshot\n");
+    /* A restart must not resume (and archive again) the finished one */
+    ckpt = __atomic_load_n(&archives.ckpt, __ATOMIC_ACQUIRE);
+    if (ckpt != NULL) {
+      if (!radtel_queue_checkpoint(worker, ckpt, spect))
+        rts_checkpoint_invalidate(ckpt);
+      gettimeofday(&ckpt_tv, NULL);
+    }
+
+    margin_warned = RTS_FALSE; /* Once per integration at most */
 
-    rts_spectrogram_reset(spect);
+    /* Between integrations: the only place the configuration changes */
+    radtel_control_apply(&control, &archives, spect);
+
+    if (pipeline != NULL)
+      rts_pipeline_print_stats(pipeline, stderr);
   }
 
   ok = RTS_TRUE;
 
 done:
-  if (disp != NULL)
-    display_end(disp);
+  /* The render thread queues jobs and uses the display and waterfall */
+  radtel_render_stop(&render);
+
+  /* Nobody else submits commands */
+  if (server != NULL)
+    rts_control_destroy(server);
+
+  if (metrics != NULL)
+    rts_metrics_server_destroy(metrics);
+
+  key_control = NULL;
+  radtel_control_finalize(&control);
+
+  /* Flush pending snapshots before tearing down what they refer to */
+  if (worker != NULL)
+    rts_worker_destroy(worker);
+
+  /* Final figures, everything flushed */
+  if (perf_path != NULL)
+    radtel_perf_job_run(NULL);
+
+  if (trace_path != NULL) {
+    radtel_wait_trace();
+    radtel_trace_write();
+  }
+
+  /* Possibly replaced by the writer thread */
+  if (archives.ckpt != NULL)
+    rts_checkpoint_close(archives.ckpt);
+
+  radtel_close_archives(&archives);
+
+  if (snapshots != NULL)
+    rts_snapshot_buffer_destroy(snapshots);
+
+  radtel_render_finalize(&render);
 
   if (spect != NULL)
     rts_spectrogram_destroy(spect);
@@ -329,7 +1601,9 @@ rtadtel_init_snapshot_dir(void)
         goto done);
 
     if (access(path, F_OK) == -1) {
-      RTS_TRYCATCH(matlab_temp = strbuild("%s/data", path), goto done);
+      RTS_TRYCATCH(
+          archive_path = strbuild("%s/" RADTEL_ARCHIVE_NAME, path),
+          goto done);
       RTS_TRYCATCH(mkdir(path, 0755) != -1, goto done);
 
       snapshot_dir = path;
@@ -350,6 +1624,58 @@ done:
   return ok;
 }
 
+static struct option radtel_options[] = {
+  {"checkpoint",     required_argument, NULL, 'C'},
+  {"headless",       no_argument,       NULL, 'H'},
+  {"render-threads", required_argument, NULL, 'T'},
+  {"control",        required_argument, NULL, 'S'},
+  {"perf-stats",     required_argument, NULL, 'P'},
+  {"metrics",        required_argument, NULL, 'M'},
+  {"trace",          required_argument, NULL, 't'},
+  {"compress",       required_argument, NULL, 'z'},
+  {"help",           no_argument,       NULL, 'h'},
+  {NULL,             0,                 NULL, 0}
+};
+
+void
+radtel_usage(const char *argv0)
+{
+  fprintf(
+      stderr,
+      "Usage: %s [options] source-type parameters [stage[:parameters] ...]\n\n"
+      "Options:\n"
+      "  -C, --checkpoint=FILE  keep the partial integration in FILE and\n"
+      "                         resume from it if the configuration matches\n"
+      "  -H, --headless         render off-screen, only for snapshots\n"
+      "  -T, --render-threads=N split redraws in bands drawn by N extra\n"
+      "                         threads (default: 0, draw alone)\n"
+      "  -S, --control=PATH     accept commands (one per line) on a Unix\n"
+      "                         socket at PATH, see below\n"
+      "  -P, --perf-stats=FILE  write latency histograms of every stage\n"
+      "                         to FILE every %d seconds\n"
+      "  -M, --metrics=ADDR     serve metrics in Prometheus format over\n"
+      "                         HTTP, ADDR being a Unix socket path or a\n"
+      "                         TCP port on the loopback interface\n"
+      "  -t, --trace=FILE       write the last spans of every thread to\n"
+      "                         FILE in Chrome trace format on SIGUSR1\n"
+      "                         and at exit (needs --enable-trace)\n"
+      "  -z, --compress=MODE    compress archives, MODE being lossless or\n"
+      "                         quantized (to %g dB). Compressed archives\n"
+      "                         can only be read sequentially\n"
+      "  -h, --help             show this help\n\n"
+      "Commands, applied when the current integration ends:\n"
+      "  avg_time SECONDS, bins N, window blackmann-harris|rectangular,\n"
+      "  set KEY VALUE (source parameters: fc, gains...)\n"
+      "and right away: dump (end it now), reset (discard it).\n"
+      "Keys: up/down, right/left double/halve the integration time and\n"
+      "the number of bins, W switches windows, D dumps and R resets.\n"
+      "Escape, closing the window, SIGINT or SIGTERM stop acquisition,\n"
+      "with everything pending written out.\n",
+      argv0,
+      RADTEL_PERF_INTERVAL,
+      RADTEL_ARCHIVE_QUANT_STEP);
+}
+
 int
 main(int argc, char *argv[], char *envp[])
 {
@@ -357,9 +1683,82 @@ main(int argc, char *argv[], char *envp[])
   rts_srchnd_t *handle = NULL;
   const struct rts_signal_source *source = NULL;
   rts_params_t *params = NULL;
+  RTSBOOL dc_remove;
+  int c, i;
+
+  while ((c = getopt_long(
+      argc,
+      argv,
+      "C:HT:S:P:M:t:z:h",
+      radtel_options,
+      NULL)) != -1)
+    switch (c) {
+      case 'C':
+        checkpoint_path = optarg;
+        break;
+
+      case 'H':
+        headless = 1;
+        break;
+
+      case 'T':
+        if (sscanf(optarg, "%d", &render_threads) != 1 || render_threads < 0) {
+          fprintf(stderr, "%s: invalid number of render threads\n", argv[0]);
+          goto done;
+        }
+        break;
+
+      case 'S':
+        control_path = optarg;
+        break;
+
+      case 'P':
+        if (!rts_perf_enabled())
+          fprintf(stderr, "%s: built without timing, no stats\n", argv[0]);
+        perf_path = optarg;
+        break;
+
+      case 'M':
+        metrics_addr = optarg;
+        break;
+
+      case 't':
+        if (!rts_trace_enabled()) {
+          fprintf(stderr, "%s: built without tracing, no trace\n", argv[0]);
+          break;
+        }
+        trace_path = optarg;
+        signal(SIGUSR1, radtel_trace_signal);
+        break;
+
+      case 'z':
+        if (strcmp(optarg, "lossless") == 0) {
+          archive_compression = RTS_ARCHIVE_LOSSLESS;
+        } else if (strcmp(optarg, "quantized") == 0) {
+          archive_compression = RTS_ARCHIVE_QUANTIZED;
+        } else {
+          fprintf(stderr, "%s: unknown compression `%s'\n", argv[0], optarg);
+          goto done;
+        }
+        break;
+
+      case 'h':
+        radtel_usage(argv[0]);
+        ret_code = EXIT_SUCCESS;
+        goto done;
+
+      default:
+        radtel_usage(argv[0]);
+        goto done;
+    }
 
-  if (argc != 3) {
-    fprintf(stderr, "Usage: %s source-type parameters\n", argv[0]);
+  /* Positional arguments start at argv[1] from here on */
+  argv[optind - 1] = argv[0];
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc < 3) {
+    radtel_usage(argv[0]);
     goto done;
   }
 
@@ -368,6 +1767,11 @@ main(int argc, char *argv[], char *envp[])
     goto done;
   }
 
+  if (!rts_register_builtin_stages()) {
+    fprintf(stderr, "%s: failed to initialize builtin stages\n", argv[0]);
+    goto done;
+  }
+
   if ((source = rts_signal_source_lookup(argv[1])) == NULL) {
     fprintf(stderr, "%s: unsupported source type `%s'\n", argv[0], argv[1]);
     goto done;
@@ -388,16 +1792,43 @@ main(int argc, char *argv[], char *envp[])
     goto done;
   }
 
+  dc_remove = radtel_wants_dc_remove(source, params);
+
+  if (argc > 3 || dc_remove) {
+    pipeline = rts_pipeline_new(handle, RTS_PIPELINE_DEFAULT_BLOCK_SIZE);
+    if (pipeline == NULL) {
+      fprintf(stderr, "%s: failed to create processing pipeline\n", argv[0]);
+      goto done;
+    }
+
+    if (dc_remove && !rts_pipeline_append_spec(pipeline, "dcblock")) {
+      fprintf(stderr, "%s: failed to add stage `dcblock'\n", argv[0]);
+      goto done;
+    }
+
+    for (i = 3; i < argc; ++i)
+      if (!rts_pipeline_append_spec(pipeline, argv[i])) {
+        fprintf(stderr, "%s: failed to add stage `%s'\n", argv[0], argv[i]);
+        goto done;
+      }
+  }
+
   if (!rtadtel_init_snapshot_dir()) {
     fprintf(stderr, "%s: failed to init capture directory\n", argv[0]);
     goto done;
   }
 
-  (void) radtel_start_rx(handle);
+  radtel_catch_quit_signals();
+
+  (void) radtel_start_rx(
+      pipeline != NULL ? rts_pipeline_get_handle(pipeline) : handle);
 
   ret_code = EXIT_SUCCESS;
 
 done:
+  if (pipeline != NULL)
+    rts_pipeline_destroy(pipeline);
+
   if (handle != NULL)
     rts_source_close(handle);
 
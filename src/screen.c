@@ -0,0 +1,613 @@
+/*
+  screen.c: Layout and drawing of the radiotel screen
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <rtsutil/perf.h>
+
+#include "screen.h"
+
+Uint32 waterfall_lut[256];
+
+void
+radtel_init_waterfall_palette(void)
+{
+  static const Uint32 stops[] = WATERFALL_PALETTE;
+  unsigned int n = sizeof (stops) / sizeof (stops[0]) - 1;
+  unsigned int i, s;
+  RTSFLOAT t;
+
+  for (i = 0; i < 256; ++i) {
+    t = i / 255. * n;
+    if ((s = (unsigned int) t) >= n)
+      s = n - 1;
+    t -= s;
+
+    waterfall_lut[i] = OPAQUE(MAKECOL(
+        (int) ((1 - t) * G_RED(stops[s]) + t * G_RED(stops[s + 1])),
+        (int) ((1 - t) * G_GREEN(stops[s]) + t * G_GREEN(stops[s + 1])),
+        (int) ((1 - t) * G_BLUE(stops[s]) + t * G_BLUE(stops[s + 1]))));
+  }
+}
+
+/* What every band of the waterfall needs, computed once per redraw */
+struct radtel_waterfall_view {
+  const rts_waterfall_t *wf;
+  unsigned int level;
+  RTSCOUNT bins;
+  RTSFLOAT first; /* Visible bins of the level, last excluded */
+  RTSFLOAT last;
+  float min;
+  float scale;
+};
+
+/* Newest row on top, one screen row per waterfall row */
+void
+radtel_redraw_waterfall_band(struct display_band *band, void *priv)
+{
+  const struct radtel_waterfall_view *view =
+      (const struct radtel_waterfall_view *) priv;
+  Uint8 index[WATERFALL_WIDTH];
+  const float *row;
+  RTSCOUNT lo, hi;
+  RTSCOUNT i, x;
+  int y;
+  float v, acc;
+  int c;
+
+  for (y = band->y1; y <= band->y2; ++y) {
+    row = rts_waterfall_get_row(
+        view->wf,
+        y - WATERFALL_Y,
+        view->level,
+        RADTEL_WATERFALL_STAT);
+
+    for (x = 0; x < WATERFALL_WIDTH; ++x) {
+      /* At most a couple of bins per pixel at the selected level */
+      lo = view->first + (view->last - view->first) * x / WATERFALL_WIDTH;
+      hi = view->first
+          + (view->last - view->first) * (x + 1) / WATERFALL_WIDTH;
+      if (lo >= view->bins)
+        lo = view->bins - 1;
+      if (hi > view->bins)
+        hi = view->bins;
+      if (hi <= lo)
+        hi = lo + 1;
+
+      acc = row[lo];
+      for (i = lo + 1; i < hi; ++i) {
+        v = row[i];
+        if (RADTEL_WATERFALL_STAT == RTS_WATERFALL_MAX)
+          acc = v > acc ? v : acc;
+        else if (RADTEL_WATERFALL_STAT == RTS_WATERFALL_MIN)
+          acc = v < acc ? v : acc;
+        else
+          acc += v;
+      }
+
+      if (RADTEL_WATERFALL_STAT == RTS_WATERFALL_MEAN)
+        acc /= hi - lo;
+
+      c = (acc - view->min) * view->scale;
+      index[x] = c < 0 ? 0 : (c > 255 ? 255 : c);
+    }
+
+    blit_row_lut(
+        &band->view,
+        WATERFALL_X,
+        y,
+        index,
+        WATERFALL_WIDTH,
+        waterfall_lut);
+  }
+}
+
+/* Rows are independent, so they are split among the band threads */
+void
+radtel_redraw_waterfall(
+    display_t *disp,
+    const rts_waterfall_t *wf,
+    const struct radtel_view *zoom)
+{
+  struct radtel_waterfall_view view;
+  RTSCOUNT rows;
+  float max;
+
+  rows = rts_waterfall_get_count(wf);
+  if (rows > WATERFALL_HEIGHT)
+    rows = WATERFALL_HEIGHT;
+
+  if (rts_waterfall_get_range(wf, rows, &view.min, &max)) {
+    if (max - view.min < 1)
+      max = view.min + 1;
+
+    view.wf    = wf;
+    view.scale = 255 / (max - view.min);
+    view.level = rts_waterfall_select_level(
+        wf,
+        WATERFALL_WIDTH * zoom->zoom);
+    view.bins  = rts_waterfall_get_level_bins(wf, view.level);
+    view.first = (zoom->center - .5 / zoom->zoom) * view.bins;
+    view.last  = (zoom->center + .5 / zoom->zoom) * view.bins;
+
+    display_run_bands(
+        disp,
+        WATERFALL_Y,
+        WATERFALL_Y + rows - 1,
+        radtel_redraw_waterfall_band,
+        &view);
+  }
+
+  box(
+      disp,
+      WATERFALL_X,
+      WATERFALL_Y,
+      WATERFALL_X + WATERFALL_WIDTH - 1,
+      WATERFALL_Y + WATERFALL_HEIGHT - 1,
+      OPAQUE(SPECTRUM_TEXT_COLOR));
+}
+
+/* Keeps the view within the band */
+void
+radtel_view_clamp(struct radtel_view *view)
+{
+  RTSFLOAT half;
+
+  if (view->zoom > view->bins / RADTEL_MIN_VIEW_BINS)
+    view->zoom = view->bins / RADTEL_MIN_VIEW_BINS;
+  else if (view->zoom < 1)
+    view->zoom = 1;
+
+  half = .5 / view->zoom;
+
+  if (view->center < half)
+    view->center = half;
+  else if (view->center > 1 - half)
+    view->center = 1 - half;
+}
+
+/*
+ * Wheel zooms in and out keeping the frequency under the pointer in
+ * place, dragging with the left button pans and the right button goes
+ * back to the whole band. Runs in the render thread.
+ */
+void
+radtel_view_mouse(display_t *disp, event_t *event, void *data)
+{
+  struct radtel_view *view = (struct radtel_view *) data;
+  RTSFLOAT pos, at;
+
+  pos = (event->x - event->area->x) / (RTSFLOAT) event->area->width;
+
+  if (event->type == EVENT_TYPE_MOTION) {
+    if (!(event->code & SDL_BUTTON_LMASK) || event->dx == 0)
+      return;
+
+    view->center -= event->dx / (RTSFLOAT) event->area->width / view->zoom;
+  } else if (event->state) {
+    at = view->center + (pos - .5) / view->zoom;
+
+    switch (event->code) {
+      case SDL_BUTTON_WHEELUP:
+        view->zoom *= RADTEL_ZOOM_STEP;
+        break;
+
+      case SDL_BUTTON_WHEELDOWN:
+        view->zoom /= RADTEL_ZOOM_STEP;
+        break;
+
+      case SDL_BUTTON_RIGHT:
+        view->zoom = 1;
+        break;
+
+      default:
+        return;
+    }
+
+    /* Zoom limits first, so `at' stays under the pointer */
+    radtel_view_clamp(view);
+
+    view->center = at - (pos - .5) / view->zoom;
+  } else {
+    return;
+  }
+
+  radtel_view_clamp(view);
+
+  view->changed = RTS_TRUE;
+}
+
+/* Limits values that fall out of range */
+int
+radtel_db_to_row(RTSFLOAT db, RTSFLOAT min, RTSFLOAT range)
+{
+  RTSFLOAT y = (db - min) / range;
+
+  if (y < 0)
+    y = 0;
+  else if (y > 1)
+    y = 1;
+
+  return (1 - y) * SPECTRUM_HEIGHT + SPECTRUM_Y;
+}
+
+/* Everything that does not change from one redraw to the next */
+void
+radtel_draw_background(display_t *disp)
+{
+  RTSFLOAT x, y;
+  unsigned int i;
+
+  clear(disp, OPAQUE(SPECTRUM_BACKGROUND));
+
+  display_printf(
+      disp,
+      WINDOW_WIDTH / 2 - strlen(SPECTRUM_TITLE) * 4,
+      2,
+      OPAQUE(SPECTRUM_TEXT_COLOR),
+      OPAQUE(SPECTRUM_BACKGROUND),
+      "%s",
+      SPECTRUM_TITLE);
+
+  for (i = 0; i < SPECTRUM_H_DIVS; ++i) {
+    x = (RTSFLOAT) i / (RTSFLOAT) SPECTRUM_H_DIVS * SPECTRUM_WIDTH + SPECTRUM_X;
+    line(disp, x, SPECTRUM_Y, x, SPECTRUM_Y + SPECTRUM_HEIGHT, OPAQUE(SPECTRUM_AXES_COLOR));
+  }
+
+  for (i = 0; i < SPECTRUM_V_DIVS; ++i) {
+    y = (RTSFLOAT) i / (RTSFLOAT) SPECTRUM_V_DIVS * SPECTRUM_HEIGHT + SPECTRUM_Y;
+    line(disp, SPECTRUM_X, y, SPECTRUM_X + SPECTRUM_WIDTH, y, OPAQUE(SPECTRUM_AXES_COLOR));
+  }
+
+  display_background_capture(disp);
+}
+
+/* Now and worst of the integration, as a fraction of real time */
+void
+radtel_format_margin(
+    const rts_spectrum_snapshot_t *snap,
+    char *buf,
+    size_t size)
+{
+  const rts_margin_t *margin = &snap->margin;
+  const struct rts_margin_stats *worst = &snap->worst;
+  int len = 0;
+
+  if (margin->rtf > 0)
+    len = snprintf(
+        buf,
+        size,
+        "%sReal time: x%.2lf (worst x%.2lf) -- ",
+        rts_margin_is_critical(margin) ? "FALLING BEHIND! " : "",
+        margin->rtf,
+        worst->rtf_min);
+  else
+    len = snprintf(buf, size, "Real time: measuring -- ");
+
+  if (len > 0 && (size_t) len < size)
+    len += snprintf(
+        buf + len,
+        size - len,
+        "lag: %.1lf ms (worst %.1lf ms) -- ",
+        1e3 * margin->lag / snap->samp_rate,
+        1e3 * worst->lag_max / snap->samp_rate);
+
+  if (len > 0 && (size_t) len < size && margin->buffer_size > 0)
+    len += snprintf(
+        buf + len,
+        size - len,
+        "source buffer: %.0lf%% (worst %.0lf%%) -- ",
+        1e2 * margin->fill,
+        1e2 * worst->fill_max);
+
+  if (len > 0 && (size_t) len < size)
+    snprintf(
+        buf + len,
+        size - len,
+        "writer queue: %u jobs at most",
+        worst->queue_max);
+}
+
+void
+radtel_redraw_spectrum(
+    struct radtel_render *render,
+    const rts_spectrum_snapshot_t *snap)
+{
+  display_t *disp = render->disp;
+  struct radtel_view *view = &render->view;
+  unsigned int count;
+  float env_lo[SPECTRUM_WIDTH];
+  float env_hi[SPECTRUM_WIDTH];
+  int top[SPECTRUM_WIDTH];
+  int bottom[SPECTRUM_WIDTH];
+  unsigned int i;
+  RTSFLOAT min, max;
+  RTSFLOAT f_lo, f_hi;
+  RTSFLOAT first, last;
+  RTSFLOAT range;
+  struct tm tm_buf;
+  time_t now;
+  char now_str[30];
+  char perf_str[RTS_PERF_LINE_MAX];
+  char margin_str[RADTEL_MARGIN_LINE_MAX];
+  uint64_t start;
+
+  start = rts_perf_begin();
+
+  /* Get spectrogram properties */
+  count    = snap->frame_count;
+  min      = snap->min;
+  max      = snap->max;
+  f_lo     = snap->f_lo;
+  f_hi     = snap->f_hi;
+
+  /* Adjust range */
+  if (min == 0 && max == 0) {
+    min = -60;
+    max = 0;
+  } else {
+    min = RTS_TO_POWER_DB(min / count);
+    max = RTS_TO_POWER_DB(max / count);
+  }
+
+  range = max - min;
+
+  view->changed = RTS_FALSE;
+
+  /* Back to the static layer: title, grid... */
+  if (display_background_restore(disp) == -1)
+    radtel_draw_background(disp);
+
+  time(&now);
+  asctime_r(gmtime_r(&now, &tm_buf), now_str);
+  now_str[strlen(now_str) - 1] = '\0';
+
+  display_printf(
+      disp,
+      SPECTRUM_X + 2,
+      20,
+      OPAQUE(SPECTRUM_TEXT_COLOR),
+      OPAQUE(SPECTRUM_BACKGROUND),
+      "Time: %s UTC -- ",
+      now_str);
+
+  display_printf(
+      disp,
+      SPECTRUM_X + 38 * 8,
+      20,
+      OPAQUE(SPECTRUM_TEXT_COLOR),
+      OPAQUE(SPECTRUM_BACKGROUND),
+      "dB range: %+5.1lf dB to %+5.1lf dB (%+5.1lf dB) -- ",
+      min,
+      max,
+      range);
+
+  display_printf(
+      disp,
+      SPECTRUM_X + 83 * 8,
+      20,
+      OPAQUE(SPECTRUM_TEXT_COLOR),
+      OPAQUE(SPECTRUM_BACKGROUND),
+      "Frequency range: %lg MHz to %lg MHz (%lg MHz)",
+      (RTSFLOAT) (f_lo * 1e-6),
+      (RTSFLOAT) (f_hi * 1e-6),
+      (RTSFLOAT) ((f_hi - f_lo) * (RTSFLOAT) 1e-6));
+
+  display_printf(
+      disp,
+      SPECTRUM_X + 2,
+      30,
+      OPAQUE(SPECTRUM_TEXT_COLOR),
+      OPAQUE(SPECTRUM_BACKGROUND),
+      "Spectrum snapshot count: %d (integration window: %lg s)",
+      snap->reset_count,
+      snap->got_samples / (RTSFLOAT) snap->samp_rate);
+
+  first = view->center - .5 / view->zoom;
+  last  = view->center + .5 / view->zoom;
+
+  if (view->zoom > 1)
+    display_printf(
+        disp,
+        SPECTRUM_X + 83 * 8,
+        30,
+        OPAQUE(SPECTRUM_TEXT_COLOR),
+        OPAQUE(SPECTRUM_BACKGROUND),
+        "View: %lg MHz to %lg MHz (zoom x%.1lf)",
+        (RTSFLOAT) ((f_lo + first * (f_hi - f_lo)) * 1e-6),
+        (RTSFLOAT) ((f_lo + last * (f_hi - f_lo)) * 1e-6),
+        view->zoom);
+
+  radtel_format_margin(snap, margin_str, sizeof (margin_str));
+
+  display_printf(
+      disp,
+      SPECTRUM_X + 2,
+      50,
+      OPAQUE(SPECTRUM_TEXT_COLOR),
+      OPAQUE(SPECTRUM_BACKGROUND),
+      "%s",
+      margin_str);
+
+  /* Stage latencies so far, to tell who drops samples */
+  if (rts_perf_enabled()) {
+    rts_perf_format_line(perf_str, sizeof (perf_str));
+
+    display_printf(
+        disp,
+        SPECTRUM_X + 2,
+        40,
+        OPAQUE(SPECTRUM_TEXT_COLOR),
+        OPAQUE(SPECTRUM_BACKGROUND),
+        "%s",
+        perf_str);
+  }
+
+  /* One span per column, whatever the number of bins in view */
+  rts_envelope_pyramid_db(
+      render->pyramid,
+      1. / count,
+      first * render->pyramid->bins,
+      last * render->pyramid->bins,
+      env_lo,
+      env_hi,
+      NULL,
+      SPECTRUM_WIDTH);
+
+  for (i = 0; i < SPECTRUM_WIDTH; ++i) {
+    top[i]    = radtel_db_to_row(env_hi[i], min, range);
+    bottom[i] = radtel_db_to_row(env_lo[i], min, range);
+  }
+
+  polyline_envelope(
+      disp,
+      SPECTRUM_X,
+      top,
+      bottom,
+      SPECTRUM_WIDTH,
+      OPAQUE(SPECTRUM_FOREGROUND));
+
+  box(
+      disp,
+      SPECTRUM_X,
+      SPECTRUM_Y,
+      SPECTRUM_X + SPECTRUM_WIDTH - 1,
+      SPECTRUM_Y + SPECTRUM_HEIGHT - 1,
+      OPAQUE(SPECTRUM_TEXT_COLOR));
+
+  fbox(
+      disp,
+      SPECTRUM_PROGRESS_X,
+      SPECTRUM_PROGRESS_Y,
+      SPECTRUM_PROGRESS_X
+      + (SPECTRUM_PROGRESS_WIDTH - 1) * snap->progress,
+      SPECTRUM_PROGRESS_Y + SPECTRUM_PROGRESS_HEIGHT - 1,
+      OPAQUE(SPECTRUM_FOREGROUND));
+
+  box(
+      disp,
+      SPECTRUM_PROGRESS_X,
+      SPECTRUM_PROGRESS_Y,
+      SPECTRUM_PROGRESS_X + SPECTRUM_PROGRESS_WIDTH - 1,
+      SPECTRUM_PROGRESS_Y + SPECTRUM_PROGRESS_HEIGHT - 1,
+      OPAQUE(SPECTRUM_TEXT_COLOR));
+
+  radtel_redraw_waterfall(disp, render->wf, view);
+
+  display_refresh(disp);
+
+  rts_perf_end(RTS_PERF_REDRAW, start);
+}
+
+/*
+ * Runs in the render thread when the number of bins changes (and once
+ * before it starts). Waterfall history is lost: rows of different sizes
+ * cannot be mixed.
+ */
+RTSBOOL
+radtel_render_resize(struct radtel_render *render, RTSCOUNT bins)
+{
+  rts_waterfall_t *wf = NULL;
+  rts_envelope_pyramid_t *pyramid = NULL;
+
+  RTS_TRYCATCH(
+      wf = rts_waterfall_new(bins, RADTEL_WATERFALL_DEPTH, WATERFALL_WIDTH),
+      goto fail);
+  RTS_TRYCATCH(pyramid = rts_envelope_pyramid_new(bins), goto fail);
+
+  radtel_render_finalize(render);
+
+  render->wf      = wf;
+  render->pyramid = pyramid;
+  render->last    = NULL;
+
+  render->view.bins = bins;
+  radtel_view_clamp(&render->view);
+
+  return RTS_TRUE;
+
+fail:
+  if (wf != NULL)
+    rts_waterfall_destroy(wf);
+
+  return RTS_FALSE;
+}
+
+/* Runs in the render thread */
+void
+radtel_render_snapshot(
+    struct radtel_render *render,
+    const rts_spectrum_snapshot_t *snap,
+    struct timeval *row_tv)
+{
+  struct timeval tv, sub;
+
+  if (snap->bins != render->pyramid->bins
+      && !radtel_render_resize(render, snap->bins)) {
+    fprintf(stderr, "Warning: cannot resize waterfall, snapshot lost\n");
+    return;
+  }
+
+  /* Reset (or a new integration not seen complete): sums start over */
+  if (snap->reset_count != render->reset_count
+      || snap->frame_count < render->frame_count)
+    rts_waterfall_restart(render->wf);
+
+  render->reset_count = snap->reset_count;
+  render->frame_count = snap->frame_count;
+
+  if (snap->frame_count > 0)
+    rts_waterfall_feed(render->wf, snap->spectrum, snap->frame_count);
+
+  gettimeofday(&tv, NULL);
+  timersub(&tv, row_tv, &sub);
+  if (sub.tv_sec >= RADTEL_WATERFALL_ROW_TIME) {
+    (void) rts_waterfall_commit(render->wf);
+    *row_tv = tv;
+  }
+
+  /* Nobody is watching: only draw what goes into snapshots */
+  if (!render->headless || snap->complete) {
+    rts_envelope_pyramid_update(render->pyramid, snap->spectrum);
+    render->last = snap;
+
+    radtel_redraw_spectrum(render, snap);
+  }
+
+  if (snap->complete)
+    rts_waterfall_restart(render->wf);
+}
+
+void
+radtel_render_finalize(struct radtel_render *render)
+{
+  if (render->wf != NULL)
+    rts_waterfall_destroy(render->wf);
+
+  if (render->pyramid != NULL)
+    rts_envelope_pyramid_destroy(render->pyramid);
+
+  render->wf      = NULL;
+  render->pyramid = NULL;
+}
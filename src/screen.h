@@ -0,0 +1,164 @@
+/*
+  screen.h: Layout and drawing of the radiotel screen
+
+  Copyright (C) 2017 Gonzalo José Carracedo Carballal <BatchDrake@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef _SCREEN_H
+#define _SCREEN_H
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <config.h>
+#include <draw.h>
+#include <pixel.h>
+
+#include <rtsutil/waterfall.h>
+#include <rtsutil/envelope.h>
+#include <rtsutil/snapshot.h>
+#include <rtsutil/worker.h>
+
+/*
+ * Everything drawn on screen, shared by radiotel and the render
+ * benchmark so that the latter measures the real thing.
+ */
+
+#define RADTEL_NIGHT_MODE
+
+#define RADTEL_MARGIN_LINE_MAX 192
+
+#define RADTEL_WATERFALL_ROW_TIME 10  /* Seconds per waterfall row */
+#define RADTEL_WATERFALL_DEPTH    720 /* Two hours of history */
+#define RADTEL_WATERFALL_STAT     RTS_WATERFALL_MAX /* Keep narrow RFI */
+
+#define RADTEL_ZOOM_STEP     1.25 /* Per mouse wheel click */
+#define RADTEL_MIN_VIEW_BINS 16   /* Deepest zoom */
+
+#if RADTEL_FULL_SCREEN
+#  define WINDOW_WIDTH  1920
+#  define WINDOW_HEIGHT 1080
+#else
+#  define WINDOW_WIDTH  1400
+#  define WINDOW_HEIGHT 800
+#endif
+
+#ifdef RADTEL_NIGHT_MODE
+#  define SPECTRUM_TEXT_COLOR 0xbf0000
+#  define SPECTRUM_AXES_COLOR 0x400000
+#  define SPECTRUM_FOREGROUND 0xff0000
+#  define SPECTRUM_BACKGROUND 0x000000
+#  define WATERFALL_PALETTE   {0x000000, 0x400000, 0x800000, 0xff0000, 0xff8080}
+#else /* !defined(RADTEL_NIGHT_MODE) */
+#  define SPECTRUM_TEXT_COLOR 0xbfbfbf
+#  define SPECTRUM_AXES_COLOR 0x404040
+#  define SPECTRUM_FOREGROUND 0x00ff00
+#  define SPECTRUM_BACKGROUND 0x1f1f1f
+#  define WATERFALL_PALETTE   {0x000000, 0x0000ff, 0x00ffff, 0xffff00, 0xffffff}
+#endif /* RADTEL_NIGHT_MODE */
+
+#define SPECTRUM_X 32
+#define SPECTRUM_Y 64
+
+#define SPECTRUM_TITLE "* * * RADIOTELESCOPE SPECTRUM INTEGRATOR * * *"
+
+#define SPECTRUM_PROGRESS_X 32
+#define SPECTRUM_PROGRESS_Y (WINDOW_HEIGHT - 16)
+#define SPECTRUM_PROGRESS_WIDTH (WINDOW_WIDTH - 2 * SPECTRUM_PROGRESS_X)
+#define SPECTRUM_PROGRESS_HEIGHT 8
+
+#define SPECTRUM_H_DIVS 20
+#define SPECTRUM_V_DIVS 10
+
+#define WATERFALL_HEIGHT 192
+#define WATERFALL_GAP    8
+
+#define SPECTRUM_WIDTH  (WINDOW_WIDTH - 2 * SPECTRUM_X)
+#define SPECTRUM_HEIGHT \
+  (WINDOW_HEIGHT - 3 * SPECTRUM_Y / 2 - WATERFALL_HEIGHT - WATERFALL_GAP)
+
+#define WATERFALL_X     SPECTRUM_X
+#define WATERFALL_Y     (SPECTRUM_Y + SPECTRUM_HEIGHT + WATERFALL_GAP)
+#define WATERFALL_WIDTH SPECTRUM_WIDTH
+
+#define RTS_TO_POWER_DB(mag) (10 * log10(mag))
+
+/* Part of the band shown by the spectrum and the waterfall */
+struct radtel_view {
+  RTSCOUNT bins;   /* Of the spectrum being shown */
+  RTSFLOAT zoom;   /* 1: whole band */
+  RTSFLOAT center; /* Fraction of the band, from 0 (f_lo) to 1 (f_hi) */
+  RTSBOOL changed;
+};
+
+/*
+ * The render thread owns the waterfall and draws (and handles events)
+ * from whatever the acquisition thread last published in `snapshots'.
+ * It also creates and destroys the display: SDL wants the video mode
+ * set, the events pumped and the screen updated by the same thread.
+ */
+struct radtel_render {
+  display_t *disp;
+  rts_waterfall_t *wf;
+  rts_envelope_pyramid_t *pyramid; /* Of the last snapshot */
+  rts_snapshot_buffer_t *snapshots;
+  rts_worker_t *worker;
+
+  const rts_spectrum_snapshot_t *last; /* Redrawn when the view changes */
+  struct radtel_view view;
+  RTSCOUNT reset_count; /* Of the last snapshot fed to the waterfall */
+  RTSCOUNT frame_count;
+  RTSBOOL headless; /* Only complete integrations are drawn */
+
+  pthread_t thread;
+  RTSBOOL thread_running;
+  int halt; /* Accessed atomically */
+
+  pthread_mutex_t ready_mutex;
+  pthread_cond_t ready_cond;
+  int ready; /* 0 while the display is being set up, then 1 or -1 */
+};
+
+/* Palette of the waterfall, once before anything is drawn */
+void radtel_init_waterfall_palette(void);
+
+void radtel_view_clamp(struct radtel_view *view);
+
+/* Mouse handler of both panels, data is the struct radtel_view */
+void radtel_view_mouse(display_t *disp, event_t *event, void *data);
+
+/* (Re)creates the waterfall and envelope for a number of bins */
+RTSBOOL radtel_render_resize(struct radtel_render *render, RTSCOUNT bins);
+
+/*
+ * Feeds a snapshot to the waterfall (a new row every
+ * RADTEL_WATERFALL_ROW_TIME since *row_tv) and redraws the screen.
+ */
+void radtel_render_snapshot(
+    struct radtel_render *render,
+    const rts_spectrum_snapshot_t *snap,
+    struct timeval *row_tv);
+
+/* Whole screen, spectrum of snap and waterfall */
+void radtel_redraw_spectrum(
+    struct radtel_render *render,
+    const rts_spectrum_snapshot_t *snap);
+
+/* Waterfall and envelope only, the display is left alone */
+void radtel_render_finalize(struct radtel_render *render);
+
+#endif /* _SCREEN_H */